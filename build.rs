@@ -1,5 +1,6 @@
 use std::env;
-use std::path::PathBuf;
+use std::fs;
+use std::path::{Path, PathBuf};
 use std::process::Command;
 
 fn main() {
@@ -101,4 +102,96 @@ fn main() {
     // ----------------------------
     println!("cargo:rustc-link-search=native={}", out_dir.display());
     println!("cargo:rustc-link-lib=static=native");
+
+    // ----------------------------
+    // 5. Pack the script initrd
+    // ----------------------------
+    pack_initrd(&out_dir.join("initrd.cpio"));
+}
+
+/// Write the initrd archive: either a prebuilt cpio named by RUSTRIAL_INITRD,
+/// or every script enabled in examples/initrd.list packed as cpio newc,
+/// each followed by its `.rsc` image if `Pipeline --precompile` made one.
+fn pack_initrd(dest: &Path) {
+    println!("cargo:rerun-if-env-changed=RUSTRIAL_INITRD");
+    if let Ok(prebuilt) = env::var("RUSTRIAL_INITRD") {
+        println!("cargo:rerun-if-changed={}", prebuilt);
+        fs::copy(&prebuilt, dest).expect("Failed to copy RUSTRIAL_INITRD");
+        return;
+    }
+
+    let examples = PathBuf::from("src/rustrial_script/examples");
+    let manifest = examples.join("initrd.list");
+    println!("cargo:rerun-if-changed={}", manifest.display());
+
+    let list = fs::read_to_string(&manifest).expect("Failed to read initrd.list");
+    let mut archive = Vec::new();
+    let mut ino = 1;
+    for line in list.lines() {
+        let name = line.trim();
+        if name.is_empty() || name.starts_with('#') {
+            continue;
+        }
+        let path = examples.join(name);
+        println!("cargo:rerun-if-changed={}", path.display());
+        let data = fs::read(&path)
+            .unwrap_or_else(|e| panic!("initrd.list: {}: {}", name, e));
+        cpio_member(&mut archive, ino, 0o100644, name, &data);
+        ino += 1;
+
+        // Ship a precompiled image alongside its script when it is current
+        let image_name = format!("{}.rsc", name.strip_suffix(".rscript").unwrap_or(name));
+        let image_path = examples.join(&image_name);
+        println!("cargo:rerun-if-changed={}", image_path.display());
+        if let Ok(image) = fs::read(&image_path) {
+            if image_matches(&image, &data) {
+                cpio_member(&mut archive, ino, 0o100644, &image_name, &image);
+                ino += 1;
+            } else {
+                println!("cargo:warning={} is stale, not packing it", image_name);
+            }
+        }
+    }
+    cpio_member(&mut archive, 0, 0, "TRAILER!!!", &[]);
+
+    fs::write(dest, archive).expect("Failed to write initrd.cpio");
+}
+
+/// Whether a compiled script image's header (see rustrial_script/image.rs)
+/// names format version 1 and matches the source's length and FNV-1a hash
+fn image_matches(image: &[u8], source: &[u8]) -> bool {
+    let mut hash = 0xcbf2_9ce4_8422_2325u64;
+    for &b in source {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+    }
+    image.len() >= 18
+        && image[0..4] == *b"RSC\0"
+        && image[4..6] == 1u16.to_le_bytes()
+        && image[6..10] == (source.len() as u32).to_le_bytes()
+        && image[10..18] == hash.to_le_bytes()
+}
+
+/// Append one cpio newc member, padding header+name and data to 4 bytes
+fn cpio_member(out: &mut Vec<u8>, ino: u32, mode: u32, name: &str, data: &[u8]) {
+    let fields = [
+        ino, mode, 0, 0, 1, 0,
+        data.len() as u32,
+        0, 0, 0, 0,
+        name.len() as u32 + 1,
+        0,
+    ];
+    out.extend_from_slice(b"070701");
+    for field in fields {
+        out.extend_from_slice(format!("{:08X}", field).as_bytes());
+    }
+    out.extend_from_slice(name.as_bytes());
+    out.push(0);
+    while out.len() % 4 != 0 {
+        out.push(0);
+    }
+    out.extend_from_slice(data);
+    while out.len() % 4 != 0 {
+        out.push(0);
+    }
 }
@@ -5,6 +5,7 @@
 #   -n, --no-kvm    Disable KVM acceleration
 #   -s, --serial    Show serial output in terminal
 #   -g, --graphics  Enable graphics mode (default)
+#   -k, --disk IMG  Attach IMG as the data disk (mounted at /data)
 #   -h, --help      Show this help
 
 set -e
@@ -15,6 +16,7 @@ DEBUG_MODE=""
 SERIAL_MODE="-serial mon:stdio"
 MEMORY="256M"
 CPU="2"
+DATA_DISK=""
 
 # Parse arguments
 while [[ $# -gt 0 ]]; do
@@ -33,6 +35,10 @@ while [[ $# -gt 0 ]]; do
             SERIAL_MODE="-serial stdio"
             shift
             ;;
+        -k|--disk)
+            DATA_DISK="-drive format=raw,file=$2,index=1,media=disk"
+            shift 2
+            ;;
         -h|--help)
             grep '^#' "$0" | grep -v '#!/bin/bash' | sed 's/^# //'
             exit 0
@@ -60,7 +66,8 @@ echo "Memory: $MEMORY, CPUs: $CPU"
 qemu-system-x86_64 \
     $USE_KVM \
     $DEBUG_MODE \
-    -drive format=raw,file=$BOOTIMAGE \
+    -drive format=raw,file=$BOOTIMAGE,index=0 \
+    $DATA_DISK \
     -m $MEMORY \
     -smp $CPU \
     $SERIAL_MODE \
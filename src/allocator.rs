@@ -9,6 +9,7 @@ pub mod fixed_size_block;
 
 use alloc::alloc::{GlobalAlloc, Layout};
 use core::ptr::null_mut;
+use core::sync::atomic::{AtomicUsize, Ordering};
 use x86_64::{
     structures::paging::{
         mapper::MapToError, FrameAllocator, Mapper, Page, PageTableFlags, Size4KiB,
@@ -24,6 +25,14 @@ use fixed_size_block::FixedSizeBlockAllocator;
 static ALLOCATOR: Locked<FixedSizeBlockAllocator> = Locked::new(
     FixedSizeBlockAllocator::new());
 
+/// Bytes currently handed out by the global allocator (size-class rounded)
+static HEAP_USED: AtomicUsize = AtomicUsize::new(0);
+
+/// Current heap usage in bytes, used by caches to detect memory pressure
+pub fn heap_used() -> usize {
+    HEAP_USED.load(Ordering::Relaxed)
+}
+
 pub fn init_heap(
     mapper: &mut impl Mapper<Size4KiB>,
     frame_allocator: &mut impl FrameAllocator<Size4KiB>,
@@ -3,6 +3,8 @@ use core::ptr;
 use super::Locked;
 use alloc::alloc::GlobalAlloc;
 use core::{mem, ptr::NonNull};
+use core::sync::atomic::Ordering;
+use super::HEAP_USED;
 
 struct ListNode {
     next: Option<&'static mut ListNode>,
@@ -14,9 +16,9 @@ unsafe impl GlobalAlloc for Locked<FixedSizeBlockAllocator> {
 
     unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
     let mut allocator = self.lock();
-    match list_index(&layout) {
+    let (ptr, size) = match list_index(&layout) {
         Some(index) => {
-            match allocator.list_heads[index].take() {
+            let ptr = match allocator.list_heads[index].take() {
                 Some(node) => {
                     allocator.list_heads[index] = node.next.take();
                     node as *mut ListNode as *mut u8
@@ -28,16 +30,23 @@ unsafe impl GlobalAlloc for Locked<FixedSizeBlockAllocator> {
                         .unwrap();
                     allocator.fallback_alloc(layout)
                 }
-            }
+            };
+            (ptr, BLOCK_SIZES[index])
         }
-        None => allocator.fallback_alloc(layout),
+        None => (allocator.fallback_alloc(layout), layout.size()),
+    };
+    // A failed allocation must not count towards memory pressure
+    if !ptr.is_null() {
+        HEAP_USED.fetch_add(size, Ordering::Relaxed);
     }
+    ptr
 }
 
     unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
     let mut allocator = self.lock();
     match list_index(&layout) {
         Some(index) => {
+            HEAP_USED.fetch_sub(BLOCK_SIZES[index], Ordering::Relaxed);
             let new_node = ListNode {
                 next: allocator.list_heads[index].take(),
             };
@@ -50,6 +59,7 @@ unsafe impl GlobalAlloc for Locked<FixedSizeBlockAllocator> {
             }
         }
         None => {
+            HEAP_USED.fetch_sub(layout.size(), Ordering::Relaxed);
             let ptr = NonNull::new(ptr).unwrap();
             unsafe {
                 allocator.fallback_allocator.deallocate(ptr, layout);
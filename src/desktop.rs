@@ -6,6 +6,10 @@
 use alloc::{vec::Vec, string::String};
 use crate::vga_buffer::{Color, BUFFER_HEIGHT, BUFFER_WIDTH};
 use crate::window_manager::WindowManager;
+use crate::graphics::compositor::{self, Frame};
+use crate::graphics::hw_cursor;
+use crate::graphics::vsync::FrameScheduler;
+use crate::graphics::region::{Rect, Region};
 use crate::context_menu::{ContextMenu, MenuItem, MenuActionKind};
 use crate::task::keyboard;
 use crate::task::mouse::{MouseStream, get_position, is_left_button_pressed, is_right_button_pressed, update_position, update_buttons};
@@ -13,6 +17,9 @@ use crate::rustrial_menu::menu_system::shutdown::{ShutdownButton, shutdown_syste
 use pc_keyboard::{layouts, DecodedKey, HandleControl, Keyboard, ScancodeSet1, KeyCode};
 use futures_util::stream::StreamExt;
 
+/// Longest gap between the two clicks of a double click
+const DOUBLE_CLICK_MS: u64 = 500;
+
 /// Desktop icon structure
 #[derive(Clone)]
 pub struct DesktopIcon {
@@ -126,7 +133,6 @@ pub struct Desktop {
     last_mouse_y: i16,
     mouse_visible: bool,
     window_manager: WindowManager,
-    cursor_under: u16,
     context_menu: Option<ContextMenu>,
     drag_icon_idx: Option<usize>,
     drag_icon_offset_x: i16,
@@ -165,7 +171,6 @@ impl Desktop {
             last_mouse_y: 12,
             mouse_visible: true,
             window_manager: WindowManager::new(),
-            cursor_under: 0,
             context_menu: None,
             drag_icon_idx: None,
             drag_icon_offset_x: 0,
@@ -182,11 +187,7 @@ impl Desktop {
         let bg = crate::theme::desktop_bg();
 
         // Draw desktop background
-        for y in 0..BUFFER_HEIGHT {
-            for x in 0..BUFFER_WIDTH {
-                write_at(x, y, " ", Color::Black, bg);
-            }
-        }
+        draw_filled_box(0, 0, BUFFER_WIDTH, BUFFER_HEIGHT, Color::Black, bg);
         
         // Draw title bar
         let title_bg = crate::theme::title_bar_bg();
@@ -211,30 +212,35 @@ impl Desktop {
         }
     }
 
-    fn render_cursor(&mut self, x: i16, y: i16) {
-        if x >= 0 && x < BUFFER_WIDTH as i16 && y >= 0 && y < BUFFER_HEIGHT as i16 {
-            use x86_64::instructions::interrupts;
-            self.cursor_under = interrupts::without_interrupts(|| unsafe {
-                core::ptr::read_volatile(
-                    (0xb8000 as *const u16).add(y as usize * BUFFER_WIDTH + x as usize)
-                )
-            });
-            use crate::vga_buffer::{write_char_at, Color};
-            write_char_at(x as usize, y as usize, b'^', Color::Black, Color::White);
+    /// Move the hardware cursor that serves as the mouse pointer; the
+    /// cells under it are never touched
+    fn render_cursor(&self, x: i16, y: i16) {
+        if x >= 0 && y >= 0 {
+            hw_cursor::show(x as usize, y as usize);
+        } else {
+            hw_cursor::hide();
         }
     }
 
-    fn restore_cursor_under(&self, x: i16, y: i16) {
-        if x >= 0 && x < BUFFER_WIDTH as i16 && y >= 0 && y < BUFFER_HEIGHT as i16 {
-            use x86_64::instructions::interrupts;
-            let val = self.cursor_under;
-            interrupts::without_interrupts(|| unsafe {
-                core::ptr::write_volatile(
-                    (0xb8000 as *mut u16).add(y as usize * BUFFER_WIDTH + x as usize),
-                    val,
-                );
-            });
+    /// Repaint only `damage`: the desktop where no window covers it, the
+    /// visible parts of windows, then the context menu if it is in the way
+    fn repaint_damage(&self, damage: &Region) {
+        let mut uncovered = damage.clone();
+        for win in self.window_manager.get_windows() {
+            uncovered.subtract(&win.rect());
         }
+        if !uncovered.is_empty() {
+            compositor::set_clip(Some(&uncovered));
+            self.render_desktop();
+            compositor::set_clip(None);
+        }
+        self.window_manager.render_damage(damage);
+        if let Some(ref menu) = self.context_menu {
+            if damage.overlaps(&Rect::new(menu.x, menu.y, menu.width, menu.height)) {
+                menu.render();
+            }
+        }
+        self.render_cursor(self.last_mouse_x, self.last_mouse_y);
     }
 
     fn render_icons(&self) {
@@ -260,7 +266,6 @@ impl Desktop {
     }
 
     fn update_cursor_position(&mut self, x: i16, y: i16) {
-        self.restore_cursor_under(self.last_mouse_x, self.last_mouse_y);
         self.last_mouse_x = x;
         self.last_mouse_y = y;
         if self.context_menu.is_some() {
@@ -468,9 +473,11 @@ impl Desktop {
         // Mouse hardware is already initialized in main.rs
         
         // Render initial desktop
+        let frame = Frame::begin();
         self.render_desktop();
         self.window_manager.render_all();
         self.render_cursor(self.last_mouse_x, self.last_mouse_y);
+        drop(frame);
         
         // Initialize keyboard - use ScancodeStream to ensure queue is initialized
         let _scancodes = keyboard::ScancodeStream::new();
@@ -483,8 +490,16 @@ impl Desktop {
         let mut mouse_stream = MouseStream::new();
         let mut left_button_was_pressed = true;
         let mut right_button_was_pressed = is_right_button_pressed();
-        let mut double_click_timer = 0u32;
-        let mut last_clicked_icon: Option<usize> = None;
+        // Icon clicked or activated last and when, to spot double clicks
+        let mut last_click: Option<(usize, u64)> = None;
+        let is_double_click = |last_click: Option<(usize, u64)>, icon_idx: usize| {
+            last_click.is_some_and(|(icon, at)| {
+                icon == icon_idx && crate::interrupts::uptime_ms() - at <= DOUBLE_CLICK_MS
+            })
+        };
+        let mut scheduler = FrameScheduler::new();
+        // Drawing waiting for the next vertical retrace
+        let mut pending: Option<Frame> = None;
         
         // Drain any stale mouse packets from before entering desktop
         while mouse_stream.try_next().is_some() {}
@@ -493,8 +508,9 @@ impl Desktop {
         left_button_was_pressed = is_left_button_pressed();
         
         loop {
-            // Capture drag/resize window bounds before processing packets (used for targeted erase)
-            let drag_pre_bounds = self.window_manager.current_drag_bounds();
+            // Everything drawn until the next vertical retrace reaches the
+            // screen as one diffed flush when the frame closes, or on return
+            let frame = pending.take().unwrap_or_else(Frame::begin);
 
             // Process ALL pending mouse packets (non-blocking)
             let mut need_full_redraw = false;
@@ -507,12 +523,16 @@ impl Desktop {
                 let left_pressed = packet.left_button();
 
                 if !left_pressed && left_button_was_pressed {
+                    if self.window_manager.is_dragging_or_resizing() {
+                        compositor::end_interaction();
+                    }
                     self.window_manager.on_mouse_up();
                     if self.drag_icon_idx.take().is_some() {
                         self.pending_drag_icon = None;
                         need_full_redraw = true;
                     } else if let Some(icon_idx) = self.pending_drag_icon.take() {
-                        if double_click_timer > 0 && last_clicked_icon == Some(icon_idx) {
+                        if is_double_click(last_click, icon_idx) {
+                            last_click = None;
                             if let Some(action) = self.handle_icon_click(icon_idx) {
                                 match action {
                                     IconAction::Shutdown => shutdown_system(),
@@ -528,8 +548,7 @@ impl Desktop {
                                 }
                             }
                         } else {
-                            last_clicked_icon = Some(icon_idx);
-                            double_click_timer = 5000;
+                            last_click = Some((icon_idx, crate::interrupts::uptime_ms()));
                         }
                     }
                 }
@@ -556,7 +575,6 @@ impl Desktop {
                             self.erase_desktop_region(ox, oy, iw, ih);
                             self.icons[icon_idx].render(true);
                         }
-                        self.restore_cursor_under(self.last_mouse_x, self.last_mouse_y);
                         self.last_mouse_x = mx;
                         self.last_mouse_y = my;
                         self.render_cursor(mx, my);
@@ -566,14 +584,13 @@ impl Desktop {
                         self.drag_icon_offset_x = mx - self.icons[icon_idx].x;
                         self.drag_icon_offset_y = my - self.icons[icon_idx].y;
                         self.pending_drag_icon = None;
-                        self.restore_cursor_under(self.last_mouse_x, self.last_mouse_y);
                         self.last_mouse_x = mx;
                         self.last_mouse_y = my;
                         self.render_cursor(mx, my);
                     } else if self.window_manager.on_mouse_move(mx, my) {
+                        // The window manager recorded the damage
                         self.last_mouse_x = mx;
                         self.last_mouse_y = my;
-                        need_full_redraw = true;
                     } else {
                         self.update_cursor_position(mx, my);
                     }
@@ -586,23 +603,19 @@ impl Desktop {
                             self.execute_menu_action(action);
                             need_full_redraw = true;
                         } else {
-                            // No action selected: erase menu region only, no full redraw
-                            self.erase_desktop_region(mx2, my2, mw, mh);
-                            self.window_manager.render_all();
-                            // Restore before re-render: avoids saving '^' into cursor_under
-                            self.restore_cursor_under(self.last_mouse_x, self.last_mouse_y);
-                            self.render_cursor(self.last_mouse_x, self.last_mouse_y);
+                            // No action selected: repaint what the menu covered
+                            self.window_manager.damage(Rect::new(mx2, my2, mw, mh));
                         }
                     } else if self.window_manager.on_mouse_down(mx, my) {
-                        need_full_redraw = true;
+                        if self.window_manager.is_dragging_or_resizing() {
+                            compositor::begin_interaction();
+                        }
                     } else if my as usize == BUFFER_HEIGHT - 1 {
                         self.handle_taskbar_click(mx);
-                        need_full_redraw = true;
                     } else if let Some(icon_idx) = self.selected_icon {
                         self.pending_drag_icon = Some(icon_idx);
                     } else {
-                        last_clicked_icon = None;
-                        double_click_timer = 0;
+                        last_click = None;
                     }
                 }
 
@@ -610,8 +623,7 @@ impl Desktop {
                 if right_pressed && !right_button_was_pressed {
                     // Erase any existing menu before showing new one
                     if let Some(old) = self.context_menu.take() {
-                        self.erase_desktop_region(old.x, old.y, old.width, old.height);
-                        self.window_manager.render_all();
+                        self.window_manager.damage(Rect::new(old.x, old.y, old.width, old.height));
                     }
                     let mut items: Vec<MenuItem> = Vec::new();
                     if self.window_manager.is_point_over_window(mx, my) {
@@ -639,36 +651,11 @@ impl Desktop {
             }
 
             if need_full_redraw {
-                let is_drag = self.window_manager.is_dragging_or_resizing();
-                if is_drag && self.context_menu.is_none() {
-                    // Targeted erase: fill union of old+new window bounds with desktop bg,
-                    // then redraw windows. Avoids clearing the whole screen on every move.
-                    let drag_post_bounds = self.window_manager.current_drag_bounds();
-                    if let Some((px, py, pw, ph)) = drag_pre_bounds {
-                        let (ex, ey, ew, eh) = if let Some((nx, ny, nw, nh)) = drag_post_bounds {
-                            let ex = px.min(nx);
-                            let ey = py.min(ny);
-                            let ex2 = (px + pw).max(nx + nw);
-                            let ey2 = (py + ph).max(ny + nh);
-                            (ex, ey, ex2 - ex, ey2 - ey)
-                        } else {
-                            (px, py, pw, ph)
-                        };
-                        self.erase_desktop_region(ex, ey, ew, eh);
-                    }
-                    self.window_manager.render_all();
-                    self.render_cursor(self.last_mouse_x, self.last_mouse_y);
-                } else {
-                    self.render_desktop();
-                    self.window_manager.render_all();
-                    self.render_context_menu();
-                    self.render_cursor(self.last_mouse_x, self.last_mouse_y);
-                }
-            }
-            
-            // Decrement double-click timer (slowly)
-            if double_click_timer > 0 {
-                double_click_timer = double_click_timer.saturating_sub(1);
+                self.window_manager.take_damage();
+                self.render_desktop();
+                self.window_manager.render_all();
+                self.render_context_menu();
+                self.render_cursor(self.last_mouse_x, self.last_mouse_y);
             }
             
             // Process keyboard input (non-blocking polling)
@@ -681,10 +668,7 @@ impl Desktop {
                         }
                         // Route all keys to focused shell window
                         if self.window_manager.focused_window_is_shell() {
-                            if self.window_manager.handle_shell_key(key) {
-                                self.window_manager.render_all();
-                                self.render_cursor(self.last_mouse_x, self.last_mouse_y);
-                            }
+                            self.window_manager.handle_shell_key(key);
                             continue;
                         }
                         match key {
@@ -692,7 +676,8 @@ impl Desktop {
                                 // Enter/Space activates selected icon OR simulates click
                                 if let Some(icon_idx) = self.selected_icon {
                                     // Check for double-press
-                                    if double_click_timer > 0 && last_clicked_icon == Some(icon_idx) {
+                                    if is_double_click(last_click, icon_idx) {
+                                        last_click = None;
                                         if let Some(action) = self.handle_icon_click(icon_idx) {
                                             match action {
                                                 IconAction::Shutdown => shutdown_system(),
@@ -712,8 +697,7 @@ impl Desktop {
                                             }
                                         }
                                     } else {
-                                        last_clicked_icon = Some(icon_idx);
-                                        double_click_timer = 50;
+                                        last_click = Some((icon_idx, crate::interrupts::uptime_ms()));
                                     }
                                 }
                             }
@@ -751,9 +735,7 @@ impl Desktop {
                             }
                             DecodedKey::RawKey(KeyCode::Escape) => {
                                 if let Some(menu) = self.context_menu.take() {
-                                    self.erase_desktop_region(menu.x, menu.y, menu.width, menu.height);
-                                    self.window_manager.render_all();
-                                    self.render_cursor(self.last_mouse_x, self.last_mouse_y);
+                                    self.window_manager.damage(Rect::new(menu.x, menu.y, menu.width, menu.height));
                                 }
                             }
                             _ => {}
@@ -762,6 +744,18 @@ impl Desktop {
                 }
             }
             
+            // Once per retrace, repaint what windows, menus and the taskbar
+            // changed since the last present and flush it all
+            if scheduler.ready() {
+                let damage = self.window_manager.take_damage();
+                if !damage.is_empty() {
+                    self.repaint_damage(&damage);
+                }
+                drop(frame);
+            } else {
+                pending = Some(frame);
+            }
+
             // Yield to allow other async tasks to run
             crate::task::yield_now().await;
         }
@@ -771,5 +765,7 @@ impl Desktop {
 /// Main desktop loop
 pub async fn run_desktop_environment() -> IconAction {
     let mut desktop = Desktop::new();
-    desktop.run().await
+    let action = desktop.run().await;
+    hw_cursor::hide();
+    action
 }
@@ -0,0 +1,254 @@
+//! ATA PIO disk driver
+//!
+//! Polled 28-bit LBA transfers on the legacy IDE ports. Interrupts are
+//! disabled on the device (nIEN) so no IRQ 14/15 handler is needed.
+//!
+//! The primary master holds the boot image, so only the other three
+//! positions are probed for a data disk.
+
+use alloc::boxed::Box;
+use x86_64::instructions::port::Port;
+
+use super::{check_range, BlockDevice, BlockError, SECTOR_SIZE};
+use crate::serial_println;
+
+const PRIMARY_IO: u16 = 0x1F0;
+const PRIMARY_CTRL: u16 = 0x3F6;
+const SECONDARY_IO: u16 = 0x170;
+const SECONDARY_CTRL: u16 = 0x376;
+
+// Register offsets from the I/O base
+const REG_DATA: u16 = 0;
+const REG_SECCOUNT: u16 = 2;
+const REG_LBA_LO: u16 = 3;
+const REG_LBA_MID: u16 = 4;
+const REG_LBA_HI: u16 = 5;
+const REG_DRIVE: u16 = 6;
+const REG_STATUS: u16 = 7;
+const REG_COMMAND: u16 = 7;
+
+const STATUS_ERR: u8 = 1 << 0;
+const STATUS_DRQ: u8 = 1 << 3;
+const STATUS_DF: u8 = 1 << 5;
+const STATUS_BSY: u8 = 1 << 7;
+
+const CTRL_NIEN: u8 = 1 << 1;
+
+const CMD_READ_SECTORS: u8 = 0x20;
+const CMD_WRITE_SECTORS: u8 = 0x30;
+const CMD_CACHE_FLUSH: u8 = 0xE7;
+const CMD_IDENTIFY: u8 = 0xEC;
+
+/// Largest transfer one READ/WRITE SECTORS command can carry
+const MAX_SECTORS_PER_CMD: usize = 256;
+/// Status polls before giving up on the device
+const POLL_LIMIT: u32 = 1_000_000;
+
+/// One ATA disk addressed through PIO
+pub struct AtaPio {
+    io: u16,
+    ctrl: u16,
+    slave: bool,
+    sectors: u64,
+    name: &'static str,
+}
+
+impl AtaPio {
+    /// Probe a drive position; returns None if nothing (or ATAPI) is there
+    pub fn identify(io: u16, ctrl: u16, slave: bool, name: &'static str) -> Option<Self> {
+        let mut dev = AtaPio { io, ctrl, slave, sectors: 0, name };
+
+        unsafe {
+            Port::<u8>::new(ctrl).write(CTRL_NIEN);
+            // Status reflects whichever drive was selected last, so select
+            // this one (and let it settle) before reading it; 0xFF then
+            // means nothing is driving the bus
+            dev.select(0xA0);
+            if dev.status() == 0xFF {
+                return None;
+            }
+
+            dev.reg(REG_SECCOUNT).write(0);
+            dev.reg(REG_LBA_LO).write(0);
+            dev.reg(REG_LBA_MID).write(0);
+            dev.reg(REG_LBA_HI).write(0);
+            dev.reg(REG_COMMAND).write(CMD_IDENTIFY);
+
+            if dev.status() == 0 {
+                return None;
+            }
+            dev.wait_not_busy().ok()?;
+
+            // ATAPI and SATA bridges answer with a signature here
+            if dev.reg(REG_LBA_MID).read() != 0 || dev.reg(REG_LBA_HI).read() != 0 {
+                return None;
+            }
+            dev.wait_drq().ok()?;
+
+            let mut ident = [0u16; 256];
+            let mut data = Port::<u16>::new(io + REG_DATA);
+            for word in ident.iter_mut() {
+                *word = data.read();
+            }
+
+            // Words 60-61: addressable sectors in LBA28 mode
+            dev.sectors = ident[60] as u64 | (ident[61] as u64) << 16;
+        }
+
+        if dev.sectors == 0 {
+            return None;
+        }
+        Some(dev)
+    }
+
+    fn reg(&self, offset: u16) -> Port<u8> {
+        Port::new(self.io + offset)
+    }
+
+    fn status(&self) -> u8 {
+        unsafe { self.reg(REG_STATUS).read() }
+    }
+
+    /// Select this drive with the given high bits and wait ~400ns
+    unsafe fn select(&self, bits: u8) {
+        let drive = bits | if self.slave { 0x10 } else { 0 };
+        unsafe {
+            self.reg(REG_DRIVE).write(drive);
+            // Each alternate status read takes ~100ns
+            let mut alt = Port::<u8>::new(self.ctrl);
+            for _ in 0..4 {
+                alt.read();
+            }
+        }
+    }
+
+    fn wait_not_busy(&self) -> Result<u8, BlockError> {
+        for _ in 0..POLL_LIMIT {
+            let status = self.status();
+            if status & STATUS_BSY == 0 {
+                return Ok(status);
+            }
+        }
+        Err(BlockError::NotReady)
+    }
+
+    fn wait_drq(&self) -> Result<(), BlockError> {
+        for _ in 0..POLL_LIMIT {
+            let status = self.status();
+            if status & (STATUS_ERR | STATUS_DF) != 0 {
+                return Err(BlockError::HardwareError);
+            }
+            if status & STATUS_BSY == 0 && status & STATUS_DRQ != 0 {
+                return Ok(());
+            }
+        }
+        Err(BlockError::NotReady)
+    }
+
+    /// Issue a READ/WRITE SECTORS command for `count` (1..=256) sectors
+    fn command(&mut self, cmd: u8, lba: u64, count: usize) -> Result<(), BlockError> {
+        self.wait_not_busy()?;
+        unsafe {
+            self.select(0xE0 | ((lba >> 24) & 0x0F) as u8);
+            // A count of 0 means 256
+            self.reg(REG_SECCOUNT).write((count % MAX_SECTORS_PER_CMD) as u8);
+            self.reg(REG_LBA_LO).write(lba as u8);
+            self.reg(REG_LBA_MID).write((lba >> 8) as u8);
+            self.reg(REG_LBA_HI).write((lba >> 16) as u8);
+            self.reg(REG_COMMAND).write(cmd);
+        }
+        Ok(())
+    }
+}
+
+impl BlockDevice for AtaPio {
+    fn block_size(&self) -> usize {
+        SECTOR_SIZE
+    }
+
+    fn block_count(&self) -> u64 {
+        self.sectors
+    }
+
+    fn read_blocks(&mut self, start: u64, buf: &mut [u8]) -> Result<(), BlockError> {
+        check_range(self, start, buf.len())?;
+        let mut data = Port::<u16>::new(self.io + REG_DATA);
+        let mut lba = start;
+        for chunk in buf.chunks_mut(MAX_SECTORS_PER_CMD * SECTOR_SIZE) {
+            let count = chunk.len() / SECTOR_SIZE;
+            self.command(CMD_READ_SECTORS, lba, count)?;
+            for sector in chunk.chunks_mut(SECTOR_SIZE) {
+                self.wait_drq()?;
+                for pair in sector.chunks_mut(2) {
+                    let word: u16 = unsafe { data.read() };
+                    pair.copy_from_slice(&word.to_le_bytes());
+                }
+            }
+            lba += count as u64;
+        }
+        Ok(())
+    }
+
+    fn write_blocks(&mut self, start: u64, buf: &[u8]) -> Result<(), BlockError> {
+        check_range(self, start, buf.len())?;
+        let mut data = Port::<u16>::new(self.io + REG_DATA);
+        let mut lba = start;
+        for chunk in buf.chunks(MAX_SECTORS_PER_CMD * SECTOR_SIZE) {
+            let count = chunk.len() / SECTOR_SIZE;
+            self.command(CMD_WRITE_SECTORS, lba, count)?;
+            for sector in chunk.chunks(SECTOR_SIZE) {
+                self.wait_drq()?;
+                for pair in sector.chunks(2) {
+                    unsafe { data.write(u16::from_le_bytes([pair[0], pair[1]])) };
+                }
+            }
+            // The last sector is only committed once BSY drops
+            let status = self.wait_not_busy()?;
+            if status & (STATUS_ERR | STATUS_DF) != 0 {
+                return Err(BlockError::HardwareError);
+            }
+            lba += count as u64;
+        }
+        Ok(())
+    }
+
+    fn flush(&mut self) -> Result<(), BlockError> {
+        self.wait_not_busy()?;
+        unsafe {
+            self.select(0xE0);
+            self.reg(REG_COMMAND).write(CMD_CACHE_FLUSH);
+        }
+        let status = self.wait_not_busy()?;
+        if status & (STATUS_ERR | STATUS_DF) != 0 {
+            return Err(BlockError::HardwareError);
+        }
+        Ok(())
+    }
+
+    fn device_name(&self) -> &str {
+        self.name
+    }
+}
+
+/// Find the first data disk and register it as the primary block device
+pub fn init_disk() -> Result<(), &'static str> {
+    serial_println!("[Disk] Probing ATA drives...");
+
+    let positions = [
+        (PRIMARY_IO, PRIMARY_CTRL, true, "hdb"),
+        (SECONDARY_IO, SECONDARY_CTRL, false, "hdc"),
+        (SECONDARY_IO, SECONDARY_CTRL, true, "hdd"),
+    ];
+
+    for (io, ctrl, slave, name) in positions {
+        if let Some(disk) = AtaPio::identify(io, ctrl, slave, name) {
+            serial_println!("[Disk] {}: {} sectors ({} MB)",
+                name, disk.sectors, disk.sectors * SECTOR_SIZE as u64 / (1024 * 1024));
+            super::register_block_device(Box::new(disk));
+            return Ok(());
+        }
+    }
+
+    serial_println!("[Disk] No data disk found");
+    Err("No ATA data disk found")
+}
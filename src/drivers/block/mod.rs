@@ -0,0 +1,138 @@
+// Block Device Abstraction Layer
+pub mod ata;
+pub mod ramdisk;
+
+use alloc::boxed::Box;
+use spin::Mutex;
+use lazy_static::lazy_static;
+
+/// Size of a device sector in bytes
+pub const SECTOR_SIZE: usize = 512;
+
+/// Errors that can occur during block I/O
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BlockError {
+    /// Block index is past the end of the device
+    OutOfRange,
+    /// Buffer length is not a multiple of the block size
+    BadBufferSize,
+    /// Device is not ready
+    NotReady,
+    /// Hardware error during the transfer
+    HardwareError,
+    /// No block device is registered
+    NotInitialized,
+    /// Every cached page is dirty and waiting for its filesystem
+    CacheFull,
+}
+
+impl core::fmt::Display for BlockError {
+    fn fmt(&self, f: &mut core::fmt::Formatter) -> core::fmt::Result {
+        match self {
+            BlockError::OutOfRange => write!(f, "Block out of range"),
+            BlockError::BadBufferSize => write!(f, "Buffer is not a whole number of blocks"),
+            BlockError::NotReady => write!(f, "Device not ready"),
+            BlockError::HardwareError => write!(f, "Hardware error"),
+            BlockError::NotInitialized => write!(f, "No block device registered"),
+            BlockError::CacheFull => write!(f, "Page cache full of dirty pages"),
+        }
+    }
+}
+
+/// Block device trait that all storage drivers must implement
+///
+/// Blocks are addressed by index in units of `block_size()` bytes. Multi-block
+/// transfers let drivers issue one command for a contiguous run instead of one
+/// per block.
+pub trait BlockDevice: Send + Sync {
+    /// Size of one block in bytes (a multiple of `SECTOR_SIZE`)
+    fn block_size(&self) -> usize;
+
+    /// Total number of blocks on the device
+    fn block_count(&self) -> u64;
+
+    /// Read `buf.len() / block_size()` consecutive blocks starting at `start`
+    fn read_blocks(&mut self, start: u64, buf: &mut [u8]) -> Result<(), BlockError>;
+
+    /// Write `buf.len() / block_size()` consecutive blocks starting at `start`
+    fn write_blocks(&mut self, start: u64, buf: &[u8]) -> Result<(), BlockError>;
+
+    /// Flush any volatile write cache to stable storage
+    fn flush(&mut self) -> Result<(), BlockError>;
+
+    /// Get device name/identifier
+    fn device_name(&self) -> &str;
+}
+
+impl<T: BlockDevice + ?Sized> BlockDevice for Box<T> {
+    fn block_size(&self) -> usize {
+        (**self).block_size()
+    }
+
+    fn block_count(&self) -> u64 {
+        (**self).block_count()
+    }
+
+    fn read_blocks(&mut self, start: u64, buf: &mut [u8]) -> Result<(), BlockError> {
+        (**self).read_blocks(start, buf)
+    }
+
+    fn write_blocks(&mut self, start: u64, buf: &[u8]) -> Result<(), BlockError> {
+        (**self).write_blocks(start, buf)
+    }
+
+    fn flush(&mut self) -> Result<(), BlockError> {
+        (**self).flush()
+    }
+
+    fn device_name(&self) -> &str {
+        (**self).device_name()
+    }
+}
+
+/// Check that a transfer of `len` bytes at `start` fits the device geometry
+pub fn check_range(dev: &dyn BlockDevice, start: u64, len: usize) -> Result<(), BlockError> {
+    let bs = dev.block_size();
+    if len % bs != 0 {
+        return Err(BlockError::BadBufferSize);
+    }
+    let count = (len / bs) as u64;
+    if start.checked_add(count).map_or(true, |end| end > dev.block_count()) {
+        return Err(BlockError::OutOfRange);
+    }
+    Ok(())
+}
+
+
+// Global Block Device Registry
+
+
+lazy_static! {
+    /// Global block device (primary disk)
+    ///
+    /// Protected by a Mutex; the page cache and filesystem backends go through
+    /// this registry rather than holding driver references themselves.
+    pub static ref BLOCK_DEVICE: Mutex<Option<Box<dyn BlockDevice>>> = Mutex::new(None);
+}
+
+/// Register a block device as the primary disk
+pub fn register_block_device(device: Box<dyn BlockDevice>) {
+    *BLOCK_DEVICE.lock() = Some(device);
+}
+
+/// Get a reference to the global block device slot
+pub fn get_block_device() -> &'static Mutex<Option<Box<dyn BlockDevice>>> {
+    &BLOCK_DEVICE
+}
+
+/// Remove the registered device, handing exclusive ownership to the caller
+///
+/// Used by filesystems that manage their own write path (e.g. the LFS).
+pub fn take_block_device() -> Option<Box<dyn BlockDevice>> {
+    BLOCK_DEVICE.lock().take()
+}
+
+/// Check if a block device is registered
+pub fn has_block_device() -> bool {
+    BLOCK_DEVICE.lock().is_some()
+}
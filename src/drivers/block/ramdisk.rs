@@ -0,0 +1,69 @@
+//! RAM-backed block device
+//!
+//! Stores blocks in a heap buffer. Used for testing the page cache and the
+//! block-backed filesystems without real disk hardware.
+
+use alloc::vec;
+use alloc::vec::Vec;
+
+use super::{check_range, BlockDevice, BlockError};
+
+/// RAM disk block device
+pub struct RamDisk {
+    data: Vec<u8>,
+    block_size: usize,
+    /// Number of read_blocks/write_blocks calls (one per device command)
+    pub reads: u64,
+    pub writes: u64,
+}
+
+impl RamDisk {
+    /// Create a zero-filled RAM disk of `block_count` blocks
+    pub fn new(block_size: usize, block_count: usize) -> Self {
+        Self {
+            data: vec![0; block_size * block_count],
+            block_size,
+            reads: 0,
+            writes: 0,
+        }
+    }
+
+    /// Raw view of the disk contents
+    pub fn contents(&self) -> &[u8] {
+        &self.data
+    }
+}
+
+impl BlockDevice for RamDisk {
+    fn block_size(&self) -> usize {
+        self.block_size
+    }
+
+    fn block_count(&self) -> u64 {
+        (self.data.len() / self.block_size) as u64
+    }
+
+    fn read_blocks(&mut self, start: u64, buf: &mut [u8]) -> Result<(), BlockError> {
+        check_range(self, start, buf.len())?;
+        let off = start as usize * self.block_size;
+        buf.copy_from_slice(&self.data[off..off + buf.len()]);
+        self.reads += 1;
+        Ok(())
+    }
+
+    fn write_blocks(&mut self, start: u64, buf: &[u8]) -> Result<(), BlockError> {
+        check_range(self, start, buf.len())?;
+        let off = start as usize * self.block_size;
+        self.data[off..off + buf.len()].copy_from_slice(buf);
+        self.writes += 1;
+        Ok(())
+    }
+
+    fn flush(&mut self) -> Result<(), BlockError> {
+        Ok(())
+    }
+
+    fn device_name(&self) -> &str {
+        "ram0"
+    }
+}
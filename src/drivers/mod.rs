@@ -1,3 +1,4 @@
 // drivers module here
 
 pub mod net;
+pub mod block;
@@ -0,0 +1,278 @@
+// Read-only initrd filesystem backed by a cpio (newc) archive
+//
+// The archive image is never copied: it is indexed once at mount time and
+// every read returns a slice straight into the image.
+
+use super::vfs::{FileSystem, FileType, VfsError};
+use alloc::borrow::Cow;
+use alloc::string::{String, ToString};
+use alloc::vec::Vec;
+
+/// Magic at the start of every newc header
+const NEWC_MAGIC: &[u8] = b"070701";
+/// Fixed header length: magic plus 13 eight-digit hex fields
+const HEADER_LEN: usize = 110;
+/// Name of the entry that terminates the archive
+const TRAILER: &str = "TRAILER!!!";
+
+const S_IFMT: u32 = 0o170000;
+const S_IFDIR: u32 = 0o040000;
+const S_IFREG: u32 = 0o100000;
+
+/// One raw archive member
+pub struct CpioEntry {
+    /// Name as stored in the archive (no leading '/')
+    pub name: &'static str,
+    pub mode: u32,
+    pub data: &'static [u8],
+}
+
+impl CpioEntry {
+    pub fn is_dir(&self) -> bool {
+        self.mode & S_IFMT == S_IFDIR
+    }
+
+    pub fn is_file(&self) -> bool {
+        self.mode & S_IFMT == S_IFREG
+    }
+}
+
+/// Iterator over the members of a newc archive
+///
+/// Stops at the trailer; a malformed header ends iteration with an error.
+pub struct CpioIter {
+    image: &'static [u8],
+    offset: usize,
+    done: bool,
+}
+
+/// Walk the members of `image` in archive order
+pub fn entries(image: &'static [u8]) -> CpioIter {
+    CpioIter { image, offset: 0, done: false }
+}
+
+fn align4(n: usize) -> usize {
+    (n + 3) & !3
+}
+
+fn hex_field(header: &[u8], index: usize) -> Result<u32, VfsError> {
+    let start = 6 + index * 8;
+    let digits = core::str::from_utf8(&header[start..start + 8])
+        .map_err(|_| VfsError::IoError)?;
+    u32::from_str_radix(digits, 16).map_err(|_| VfsError::IoError)
+}
+
+impl CpioIter {
+    fn parse_next(&mut self) -> Result<Option<CpioEntry>, VfsError> {
+        let image = self.image;
+        let header = image.get(self.offset..self.offset + HEADER_LEN)
+            .ok_or(VfsError::IoError)?;
+        if &header[..6] != NEWC_MAGIC {
+            return Err(VfsError::IoError);
+        }
+
+        let mode = hex_field(header, 1)?;
+        let file_size = hex_field(header, 6)? as usize;
+        let name_size = hex_field(header, 11)? as usize;
+
+        let name_start = self.offset + HEADER_LEN;
+        // name_size counts the trailing NUL
+        let name_bytes = image.get(name_start..name_start + name_size.saturating_sub(1))
+            .ok_or(VfsError::IoError)?;
+        let name = core::str::from_utf8(name_bytes).map_err(|_| VfsError::IoError)?;
+
+        let data_start = align4(name_start + name_size);
+        let data = image.get(data_start..data_start + file_size)
+            .ok_or(VfsError::IoError)?;
+        self.offset = align4(data_start + file_size);
+
+        if name == TRAILER {
+            return Ok(None);
+        }
+        Ok(Some(CpioEntry { name, mode, data }))
+    }
+}
+
+impl Iterator for CpioIter {
+    type Item = Result<CpioEntry, VfsError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.done {
+            return None;
+        }
+        match self.parse_next() {
+            Ok(Some(entry)) => Some(Ok(entry)),
+            Ok(None) => {
+                self.done = true;
+                None
+            }
+            Err(e) => {
+                self.done = true;
+                Some(Err(e))
+            }
+        }
+    }
+}
+
+struct Node {
+    /// Absolute path within the archive, e.g. "/fibonacci.rscript"
+    path: String,
+    file_type: FileType,
+    data: &'static [u8],
+}
+
+/// Read-only filesystem serving files in place from an archive image
+pub struct InitrdFs {
+    /// Sorted by path so lookups are a binary search
+    nodes: Vec<Node>,
+}
+
+/// Turn an archive name ("./a/b", "a/b", "/a/b") into "/a/b"
+fn normalize(name: &str) -> String {
+    let trimmed = name.trim_start_matches("./").trim_start_matches('/');
+    let mut path = String::with_capacity(trimmed.len() + 1);
+    path.push('/');
+    path.push_str(trimmed.trim_end_matches('/'));
+    path
+}
+
+impl InitrdFs {
+    /// Index a newc archive; the image must outlive the filesystem
+    pub fn new(image: &'static [u8]) -> Result<Self, VfsError> {
+        let mut nodes: Vec<Node> = Vec::new();
+
+        for entry in entries(image) {
+            let entry = entry?;
+            let path = normalize(entry.name);
+            if path == "/" {
+                continue;
+            }
+
+            let file_type = if entry.is_dir() {
+                FileType::Directory
+            } else if entry.is_file() {
+                FileType::File
+            } else {
+                // Device nodes, symlinks and the like have no meaning here
+                continue;
+            };
+
+            // Archives may omit parent directories; synthesize them
+            let mut end = 0;
+            while let Some(pos) = path[end + 1..].find('/') {
+                end += 1 + pos;
+                nodes.push(Node {
+                    path: path[..end].to_string(),
+                    file_type: FileType::Directory,
+                    data: &[],
+                });
+            }
+
+            nodes.push(Node { path, file_type, data: entry.data });
+        }
+
+        nodes.sort_by(|a, b| a.path.cmp(&b.path));
+        // Later members win, matching how the kernel unpacks an initramfs
+        nodes.dedup_by(|later, earlier| {
+            if later.path == earlier.path {
+                if later.file_type == FileType::File {
+                    core::mem::swap(later, earlier);
+                }
+                true
+            } else {
+                false
+            }
+        });
+
+        Ok(InitrdFs { nodes })
+    }
+
+    /// Number of indexed files and directories
+    pub fn len(&self) -> usize {
+        self.nodes.len()
+    }
+
+    fn find(&self, path: &str) -> Option<&Node> {
+        let path = if path.len() > 1 { path.trim_end_matches('/') } else { path };
+        self.nodes
+            .binary_search_by(|n| n.path.as_str().cmp(path))
+            .ok()
+            .map(|i| &self.nodes[i])
+    }
+
+    /// Contents of a file, borrowed from the archive image
+    pub fn file_data(&self, path: &str) -> Result<&'static [u8], VfsError> {
+        let node = self.find(path).ok_or(VfsError::NotFound)?;
+        if node.file_type != FileType::File {
+            return Err(VfsError::NotAFile);
+        }
+        Ok(node.data)
+    }
+}
+
+impl FileSystem for InitrdFs {
+    fn create_file(&mut self, _path: &str, _content: &[u8]) -> Result<(), VfsError> {
+        Err(VfsError::ReadOnly)
+    }
+
+    fn create_dir(&mut self, _path: &str) -> Result<(), VfsError> {
+        Err(VfsError::ReadOnly)
+    }
+
+    fn read_file(&self, path: &str) -> Result<Vec<u8>, VfsError> {
+        Ok(self.file_data(path)?.to_vec())
+    }
+
+    fn read_file_bytes(&self, path: &str) -> Result<Cow<'_, [u8]>, VfsError> {
+        self.file_data(path).map(Cow::Borrowed)
+    }
+
+    fn read_file_to_string(&self, path: &str) -> Result<String, VfsError> {
+        let data = self.file_data(path)?;
+        core::str::from_utf8(data)
+            .map(|s| s.to_string())
+            .map_err(|_| VfsError::IoError)
+    }
+
+    fn write_file(&mut self, _path: &str, _content: &[u8]) -> Result<(), VfsError> {
+        Err(VfsError::ReadOnly)
+    }
+
+    fn delete(&mut self, _path: &str) -> Result<(), VfsError> {
+        Err(VfsError::ReadOnly)
+    }
+
+    fn exists(&self, path: &str) -> bool {
+        path == "/" || self.find(path).is_some()
+    }
+
+    fn is_file(&self, path: &str) -> bool {
+        self.find(path).map_or(false, |n| n.file_type == FileType::File)
+    }
+
+    fn is_dir(&self, path: &str) -> bool {
+        path == "/" || self.find(path).map_or(false, |n| n.file_type == FileType::Directory)
+    }
+
+    fn list_dir(&self, path: &str) -> Result<Vec<String>, VfsError> {
+        if !self.is_dir(path) {
+            return Err(if self.exists(path) { VfsError::NotADirectory } else { VfsError::NotFound });
+        }
+
+        let mut prefix = String::from(path.trim_end_matches('/'));
+        prefix.push('/');
+        // Children sort contiguously from the first path after "<dir>/"
+        let start = self.nodes.partition_point(|n| n.path < prefix);
+        let mut entries = Vec::new();
+        for node in &self.nodes[start..] {
+            let rest = match node.path.strip_prefix(prefix.as_str()) {
+                Some(rest) => rest,
+                None => break,
+            };
+            if !rest.contains('/') {
+                entries.push(node.path.clone());
+            }
+        }
+        Ok(entries)
+    }
+}
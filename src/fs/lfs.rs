@@ -0,0 +1,1315 @@
+// Log-structured filesystem on a block device
+//
+// Every write is appended to a log of "partial segments": one summary block
+// naming the owner of each block that follows it, then the data, indirect
+// and inode blocks themselves, written with a single device command. Nothing
+// on disk is overwritten in place except the two alternating checkpoint
+// blocks, which record the inode map and where the log continues.
+//
+// `sync` flushes the open partial segment, which is enough for durability:
+// mount rolls the log forward from the newest valid checkpoint, replaying
+// every partial segment whose sequence number and checksum match. Segments
+// whose blocks have all been superseded are reused only after a later
+// checkpoint, so the roll-forward chain never passes through recycled space.
+//
+// File data is read and written through the global page cache. A write only
+// dirties cached pages; they are appended to the log when it is flushed, when
+// the cache's write-back task asks for them (`write_back`), or when the cache
+// has no clean page left to give up, so repeated small writes to one block
+// cost one log block rather than one each.
+//
+// On-disk layout (in 4 KiB filesystem blocks):
+//   0      superblock
+//   1, 2   checkpoint slots (odd/even sequence numbers)
+//   3      reserved
+//   4..    segments of SEGMENT_BLOCKS blocks
+
+use super::page_cache::{CacheVolume, InodeId, PageMap, PAGE_CACHE, PAGE_SIZE};
+use super::vfs::{FileSystem, VfsError};
+use crate::drivers::block::{BlockDevice, BlockError};
+use alloc::borrow::Cow;
+use alloc::collections::{BTreeMap, BTreeSet};
+use alloc::string::{String, ToString};
+use alloc::vec;
+use alloc::vec::Vec;
+use spin::Mutex;
+
+/// Filesystem block size in bytes
+pub const BLOCK_SIZE: usize = 4096;
+/// Blocks per segment, including partial-segment summaries
+pub const SEGMENT_BLOCKS: u64 = 16;
+
+// A file block is cached as exactly one page
+const _: () = assert!(BLOCK_SIZE == PAGE_SIZE);
+
+const SUPERBLOCK: u64 = 0;
+const CHECKPOINT_SLOTS: [u64; 2] = [1, 2];
+const SEGMENT_START: u64 = 4;
+
+const SUPER_MAGIC: u32 = 0x5346_4C52; // "RLFS"
+const CHECKPOINT_MAGIC: u32 = 0x5043_4C52; // "RLCP"
+const SUMMARY_MAGIC: u32 = 0x5350_4C52; // "RLPS"
+const VERSION: u32 = 1;
+
+const ROOT_INO: u64 = 1;
+const KIND_FREE: u32 = 0;
+const KIND_FILE: u32 = 1;
+const KIND_DIR: u32 = 2;
+
+const INODE_HEADER: usize = 32;
+const NDIRECT: usize = 448;
+const NINDIRECT: usize = 56;
+const PTRS_PER_BLOCK: usize = BLOCK_SIZE / 8;
+/// Largest file, in blocks
+pub const MAX_FILE_BLOCKS: usize = NDIRECT + NINDIRECT * PTRS_PER_BLOCK;
+
+const CHECKPOINT_HEADER: usize = 64;
+const MAX_IMAP_BLOCKS: usize = (BLOCK_SIZE - CHECKPOINT_HEADER) / 8;
+const SUMMARY_HEADER: usize = 32;
+const SUMMARY_ENTRY: usize = 16;
+
+// Summary entry slots; anything below SLOT_IMAP is a file block index
+const SLOT_INODE: u64 = u64::MAX;
+const SLOT_INDIRECT: u64 = 1 << 62;
+const SLOT_IMAP: u64 = 1 << 61;
+
+/// No segment allocated
+const NO_SEGMENT: u64 = u64::MAX;
+
+/// Segments written between automatic checkpoints (bounds roll-forward)
+const CHECKPOINT_SEGMENTS: u32 = 8;
+/// Start cleaning when fewer free segments than this remain
+const CLEAN_LOW: usize = 4;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum SegState {
+    Free,
+    /// Holds live blocks
+    Live,
+    /// Being written (log head) or reserved as the next head
+    Active,
+    /// No live blocks, reusable after the next checkpoint
+    Dying,
+}
+
+/// Counters for `lfsstat`
+#[derive(Debug, Clone, Copy, Default)]
+pub struct LfsStats {
+    pub partial_segments: u64,
+    pub blocks_written: u64,
+    pub checkpoints: u64,
+    pub segments_cleaned: u64,
+    pub blocks_relocated: u64,
+    pub rolled_forward: u64,
+    pub free_segments: usize,
+    pub total_segments: usize,
+}
+
+struct Inode {
+    kind: u32,
+    size: u64,
+    /// Block address of every file block (0 = hole)
+    ptrs: Vec<u64>,
+    /// Addresses of the indirect blocks covering ptrs[NDIRECT..]
+    indirect: Vec<u64>,
+    indirect_dirty: BTreeSet<usize>,
+    /// Address of the current on-disk copy (0 = never written)
+    addr: u64,
+    dirty: bool,
+}
+
+impl Inode {
+    fn new(kind: u32) -> Self {
+        Inode {
+            kind,
+            size: 0,
+            ptrs: Vec::new(),
+            indirect: Vec::new(),
+            indirect_dirty: BTreeSet::new(),
+            addr: 0,
+            dirty: true,
+        }
+    }
+
+    fn set_ptr(&mut self, index: usize, addr: u64) -> u64 {
+        if index >= self.ptrs.len() {
+            self.ptrs.resize(index + 1, 0);
+        }
+        if index >= NDIRECT {
+            self.indirect_dirty.insert((index - NDIRECT) / PTRS_PER_BLOCK);
+        }
+        self.dirty = true;
+        core::mem::replace(&mut self.ptrs[index], addr)
+    }
+}
+
+fn get_u32(buf: &[u8], off: usize) -> u32 {
+    u32::from_le_bytes(buf[off..off + 4].try_into().unwrap())
+}
+
+fn get_u64(buf: &[u8], off: usize) -> u64 {
+    u64::from_le_bytes(buf[off..off + 8].try_into().unwrap())
+}
+
+fn put_u32(buf: &mut [u8], off: usize, v: u32) {
+    buf[off..off + 4].copy_from_slice(&v.to_le_bytes());
+}
+
+fn put_u64(buf: &mut [u8], off: usize, v: u64) {
+    buf[off..off + 8].copy_from_slice(&v.to_le_bytes());
+}
+
+/// FNV-1a, enough to catch torn and stale writes
+pub(crate) fn checksum(parts: &[&[u8]]) -> u32 {
+    let mut hash: u32 = 0x811C_9DC5;
+    for part in parts {
+        for &b in part.iter() {
+            hash ^= b as u32;
+            hash = hash.wrapping_mul(0x0100_0193);
+        }
+    }
+    hash
+}
+
+fn io(_: BlockError) -> VfsError {
+    VfsError::IoError
+}
+
+/// Check whether a device holds a formatted LFS
+pub fn probe(dev: &mut dyn BlockDevice) -> bool {
+    let bs = dev.block_size();
+    if bs == 0 || BLOCK_SIZE % bs != 0 || dev.block_count() < (BLOCK_SIZE / bs) as u64 {
+        return false;
+    }
+    let mut buf = vec![0u8; BLOCK_SIZE];
+    dev.read_blocks(SUPERBLOCK, &mut buf).is_ok()
+        && get_u32(&buf, 0) == SUPER_MAGIC
+        && get_u32(&buf, 4) == VERSION
+}
+
+/// Log-structured filesystem over a block device it owns
+pub struct Lfs<D: BlockDevice> {
+    dev: Mutex<D>,
+    /// Device blocks per filesystem block
+    scale: u64,
+    seg_count: u64,
+
+    // Log head: the open partial segment starts at head_seg/head_off
+    head_seg: u64,
+    head_off: u64,
+    next_seg: u64,
+    log_seq: u64,
+    /// Summary block followed by the pending payload blocks
+    ps_buf: Vec<u8>,
+    ps_owners: Vec<(u64, u64)>,
+    /// Log blocks written since the last device cache flush
+    unflushed: bool,
+
+    /// This volume's file pages in the page cache
+    cache: CacheVolume,
+
+    // Metadata, fully resident
+    imap: Vec<u64>,
+    imap_addrs: Vec<u64>,
+    imap_dirty: BTreeSet<usize>,
+    inodes: BTreeMap<u64, Inode>,
+    names: BTreeMap<String, u64>,
+    names_dirty: bool,
+    next_ino: u64,
+    free_inos: Vec<u64>,
+    /// Deleted inodes whose tombstones drop out at the next checkpoint
+    tombstones: Vec<u64>,
+
+    // Segment accounting
+    usage: Vec<u32>,
+    state: Vec<SegState>,
+    free: Vec<u64>,
+    dying: Vec<u64>,
+    cp_seq: u64,
+    segs_since_cp: u32,
+
+    stats: LfsStats,
+}
+
+impl<D: BlockDevice> Lfs<D> {
+    fn empty(dev: D, scale: u64, seg_count: u64) -> Self {
+        let mut ps_buf = Vec::with_capacity(SEGMENT_BLOCKS as usize * BLOCK_SIZE);
+        ps_buf.resize(BLOCK_SIZE, 0);
+        Lfs {
+            dev: Mutex::new(dev),
+            scale,
+            seg_count,
+            head_seg: 0,
+            head_off: 0,
+            next_seg: NO_SEGMENT,
+            log_seq: 1,
+            ps_buf,
+            ps_owners: Vec::new(),
+            unflushed: false,
+            cache: CacheVolume::new(),
+            imap: vec![0; ROOT_INO as usize + 1],
+            imap_addrs: Vec::new(),
+            imap_dirty: BTreeSet::new(),
+            inodes: BTreeMap::new(),
+            names: BTreeMap::new(),
+            names_dirty: false,
+            next_ino: ROOT_INO + 1,
+            free_inos: Vec::new(),
+            tombstones: Vec::new(),
+            usage: vec![0; seg_count as usize],
+            state: vec![SegState::Free; seg_count as usize],
+            free: Vec::new(),
+            dying: Vec::new(),
+            cp_seq: 0,
+            segs_since_cp: 0,
+            stats: LfsStats {
+                total_segments: seg_count as usize,
+                ..LfsStats::default()
+            },
+        }
+    }
+
+    fn geometry(dev: &D) -> Result<(u64, u64), VfsError> {
+        let bs = dev.block_size();
+        if bs == 0 || BLOCK_SIZE % bs != 0 {
+            return Err(VfsError::IoError);
+        }
+        let scale = (BLOCK_SIZE / bs) as u64;
+        let blocks = dev.block_count() / scale;
+        let seg_count = blocks.saturating_sub(SEGMENT_START) / SEGMENT_BLOCKS;
+        Ok((scale, seg_count))
+    }
+
+    /// Write a fresh, empty filesystem to `dev`
+    pub fn format(mut dev: D) -> Result<Self, VfsError> {
+        let (scale, seg_count) = Self::geometry(&dev)?;
+        if seg_count < 2 * CLEAN_LOW as u64 {
+            return Err(VfsError::NoSpace);
+        }
+
+        // Old superblock and checkpoints must not outrank the new
+        // filesystem; the superblock is written last so an interrupted
+        // format leaves the disk unformatted rather than half-built
+        let zeros = vec![0u8; SEGMENT_START as usize * BLOCK_SIZE];
+        dev.write_blocks(SUPERBLOCK * scale, &zeros).map_err(io)?;
+
+        let mut fs = Self::empty(dev, scale, seg_count);
+        fs.state[0] = SegState::Active;
+        fs.free = (1..seg_count).rev().collect();
+        for &seg in &fs.free {
+            fs.state[seg as usize] = SegState::Free;
+        }
+        fs.next_seg = fs.alloc_segment();
+        fs.inodes.insert(ROOT_INO, Inode::new(KIND_DIR));
+        fs.names_dirty = true;
+        fs.checkpoint()?;
+
+        let mut block = vec![0u8; BLOCK_SIZE];
+        put_u32(&mut block, 0, SUPER_MAGIC);
+        put_u32(&mut block, 4, VERSION);
+        put_u64(&mut block, 8, seg_count);
+        put_u64(&mut block, 16, SEGMENT_BLOCKS);
+        {
+            let mut dev = fs.dev.lock();
+            dev.write_blocks(SUPERBLOCK * scale, &block).map_err(io)?;
+            dev.flush().map_err(io)?;
+        }
+        Ok(fs)
+    }
+
+    /// Mount an existing filesystem, recovering anything synced since the
+    /// last checkpoint
+    pub fn mount(mut dev: D) -> Result<Self, VfsError> {
+        let (scale, seg_count) = Self::geometry(&dev)?;
+        let mut block = vec![0u8; BLOCK_SIZE];
+        dev.read_blocks(SUPERBLOCK * scale, &mut block).map_err(io)?;
+        if get_u32(&block, 0) != SUPER_MAGIC || get_u32(&block, 4) != VERSION
+            || get_u64(&block, 8) != seg_count || get_u64(&block, 16) != SEGMENT_BLOCKS
+        {
+            return Err(VfsError::Corrupted);
+        }
+
+        // Newest checkpoint whose checksum holds
+        let mut best: Option<Vec<u8>> = None;
+        for slot in CHECKPOINT_SLOTS {
+            let mut cp = vec![0u8; BLOCK_SIZE];
+            dev.read_blocks(slot * scale, &mut cp).map_err(io)?;
+            let stored = get_u32(&cp, 56);
+            put_u32(&mut cp, 56, 0);
+            if get_u32(&cp, 0) != CHECKPOINT_MAGIC || checksum(&[&cp]) != stored {
+                continue;
+            }
+            if best.as_ref().map_or(true, |b| get_u64(&cp, 8) > get_u64(b, 8)) {
+                best = Some(cp);
+            }
+        }
+        let cp = best.ok_or(VfsError::Corrupted)?;
+
+        let mut fs = Self::empty(dev, scale, seg_count);
+        fs.cp_seq = get_u64(&cp, 8);
+        fs.log_seq = get_u64(&cp, 16);
+        fs.head_seg = get_u64(&cp, 24);
+        fs.head_off = get_u64(&cp, 32);
+        fs.next_ino = get_u64(&cp, 40);
+        let imap_count = get_u64(&cp, 48) as usize;
+        if fs.head_seg >= seg_count || imap_count > MAX_IMAP_BLOCKS {
+            return Err(VfsError::Corrupted);
+        }
+
+        fs.imap = vec![0; (imap_count * PTRS_PER_BLOCK).max(fs.next_ino as usize)];
+        for k in 0..imap_count {
+            let addr = get_u64(&cp, CHECKPOINT_HEADER + k * 8);
+            fs.imap_addrs.push(addr);
+            if addr != 0 {
+                fs.read_block(addr, &mut block)?;
+                for i in 0..PTRS_PER_BLOCK {
+                    fs.imap[k * PTRS_PER_BLOCK + i] = get_u64(&block, i * 8);
+                }
+            }
+        }
+
+        let chain = fs.roll_forward()?;
+        fs.load_inodes()?;
+        fs.load_names()?;
+        fs.reap_orphans();
+        fs.rebuild_usage(&chain);
+
+        // Start a fresh chain so recovered state no longer depends on it
+        fs.imap_dirty = (0..fs.imap_blocks()).collect();
+        fs.checkpoint()?;
+        Ok(fs)
+    }
+
+    /// Give the device back, discarding anything not yet synced
+    pub fn into_device(self) -> D {
+        self.dev.into_inner()
+    }
+
+    /// Access the underlying device (e.g. for I/O counters)
+    pub fn with_device<R>(&self, f: impl FnOnce(&mut D) -> R) -> R {
+        f(&mut self.dev.lock())
+    }
+
+    pub fn stats(&self) -> LfsStats {
+        LfsStats {
+            free_segments: self.free.len() + self.dying.len(),
+            ..self.stats
+        }
+    }
+
+    // Block I/O
+
+    fn seg_base(seg: u64) -> u64 {
+        SEGMENT_START + seg * SEGMENT_BLOCKS
+    }
+
+    fn seg_of(addr: u64) -> usize {
+        ((addr - SEGMENT_START) / SEGMENT_BLOCKS) as usize
+    }
+
+    fn read_block(&self, addr: u64, buf: &mut [u8]) -> Result<(), VfsError> {
+        if let Some(data) = self.pending_block(addr) {
+            buf[..BLOCK_SIZE].copy_from_slice(data);
+            return Ok(());
+        }
+        self.read_run(addr, &mut buf[..BLOCK_SIZE])
+    }
+
+    /// Read consecutive blocks with one device command
+    fn read_run(&self, addr: u64, buf: &mut [u8]) -> Result<(), VfsError> {
+        self.dev.lock().read_blocks(addr * self.scale, buf).map_err(io)
+    }
+
+    /// A block queued in the open partial segment, if `addr` is one
+    fn pending_block(&self, addr: u64) -> Option<&[u8]> {
+        let first = Self::seg_base(self.head_seg) + self.head_off + 1;
+        let n = self.ps_owners.len() as u64;
+        if addr >= first && addr < first + n {
+            let off = BLOCK_SIZE * (1 + (addr - first) as usize);
+            Some(&self.ps_buf[off..off + BLOCK_SIZE])
+        } else {
+            None
+        }
+    }
+
+    // Segment accounting
+
+    fn alloc_segment(&mut self) -> u64 {
+        match self.free.pop() {
+            Some(seg) => {
+                self.state[seg as usize] = SegState::Active;
+                seg
+            }
+            None => NO_SEGMENT,
+        }
+    }
+
+    /// Drop one reference to a block that has been superseded
+    fn release(&mut self, addr: u64) {
+        if addr == 0 {
+            return;
+        }
+        let seg = Self::seg_of(addr);
+        self.usage[seg] -= 1;
+        if self.usage[seg] == 0 && self.state[seg] == SegState::Live {
+            self.state[seg] = SegState::Dying;
+            self.dying.push(seg as u64);
+        }
+    }
+
+    // Log writer
+
+    /// Queue one block owned by (ino, slot); returns its final address
+    fn enqueue(&mut self, ino: u64, slot: u64, data: &[u8]) -> Result<u64, VfsError> {
+        if self.head_off + 1 + self.ps_owners.len() as u64 >= SEGMENT_BLOCKS {
+            self.flush_partial()?;
+            if SEGMENT_BLOCKS - self.head_off < 2 {
+                self.switch_segment()?;
+            }
+        }
+        let addr = Self::seg_base(self.head_seg) + self.head_off + 1 + self.ps_owners.len() as u64;
+        self.ps_buf.extend_from_slice(&data[..BLOCK_SIZE]);
+        self.ps_owners.push((ino, slot));
+        self.usage[self.head_seg as usize] += 1;
+        Ok(addr)
+    }
+
+    /// Write the open partial segment: summary plus payload in one command
+    fn flush_partial(&mut self) -> Result<(), VfsError> {
+        let n = self.ps_owners.len();
+        if n == 0 {
+            return Ok(());
+        }
+
+        let (summary, payload) = self.ps_buf.split_at_mut(BLOCK_SIZE);
+        summary.fill(0);
+        put_u32(summary, 0, SUMMARY_MAGIC);
+        put_u32(summary, 4, n as u32);
+        put_u64(summary, 8, self.log_seq);
+        put_u64(summary, 16, self.next_seg);
+        for (i, &(ino, slot)) in self.ps_owners.iter().enumerate() {
+            let off = SUMMARY_HEADER + i * SUMMARY_ENTRY;
+            put_u64(summary, off, ino);
+            put_u64(summary, off + 8, slot);
+        }
+        let sum = checksum(&[summary, payload]);
+        put_u32(summary, 24, sum);
+
+        let start = Self::seg_base(self.head_seg) + self.head_off;
+        self.dev.lock().write_blocks(start * self.scale, &self.ps_buf).map_err(io)?;
+        self.unflushed = true;
+
+        self.stats.partial_segments += 1;
+        self.stats.blocks_written += 1 + n as u64;
+        self.head_off += 1 + n as u64;
+        self.log_seq += 1;
+        self.ps_buf.truncate(BLOCK_SIZE);
+        self.ps_owners.clear();
+
+        // Same rule as roll_forward: move on once no payload block would fit
+        if SEGMENT_BLOCKS - self.head_off < 2 {
+            self.switch_segment()?;
+        }
+        Ok(())
+    }
+
+    fn switch_segment(&mut self) -> Result<(), VfsError> {
+        if self.next_seg == NO_SEGMENT {
+            return Err(VfsError::NoSpace);
+        }
+        let old = self.head_seg as usize;
+        self.state[old] = if self.usage[old] == 0 {
+            self.dying.push(old as u64);
+            SegState::Dying
+        } else {
+            SegState::Live
+        };
+        self.head_seg = self.next_seg;
+        self.head_off = 0;
+        self.next_seg = self.alloc_segment();
+        self.segs_since_cp += 1;
+        Ok(())
+    }
+
+    /// Write a dirty inode (and its dirty indirect blocks) to the log
+    fn write_inode(&mut self, ino: u64) -> Result<(), VfsError> {
+        let mut block = vec![0u8; BLOCK_SIZE];
+        let mut inode = match self.inodes.remove(&ino) {
+            Some(inode) => inode,
+            None => return Ok(()),
+        };
+
+        // Indirect blocks first so the inode can point at them
+        let needed = inode.ptrs.len().saturating_sub(NDIRECT).div_ceil(PTRS_PER_BLOCK);
+        while inode.indirect.len() > needed {
+            let old = inode.indirect.pop().unwrap();
+            self.release(old);
+        }
+        inode.indirect.resize(needed, 0);
+        let dirty: Vec<usize> = core::mem::take(&mut inode.indirect_dirty).into_iter()
+            .filter(|&k| k < needed)
+            .collect();
+        for k in dirty {
+            block.fill(0);
+            let first = NDIRECT + k * PTRS_PER_BLOCK;
+            for (i, &p) in inode.ptrs[first..].iter().take(PTRS_PER_BLOCK).enumerate() {
+                put_u64(&mut block, i * 8, p);
+            }
+            let result = self.enqueue(ino, SLOT_INDIRECT | k as u64, &block);
+            let addr = match result {
+                Ok(addr) => addr,
+                Err(e) => {
+                    self.inodes.insert(ino, inode);
+                    return Err(e);
+                }
+            };
+            let old = core::mem::replace(&mut inode.indirect[k], addr);
+            self.release(old);
+        }
+
+        block.fill(0);
+        put_u64(&mut block, 0, ino);
+        put_u64(&mut block, 8, inode.size);
+        put_u32(&mut block, 16, inode.kind);
+        for (i, &p) in inode.ptrs.iter().take(NDIRECT).enumerate() {
+            put_u64(&mut block, INODE_HEADER + i * 8, p);
+        }
+        for (k, &p) in inode.indirect.iter().enumerate() {
+            put_u64(&mut block, INODE_HEADER + (NDIRECT + k) * 8, p);
+        }
+        let result = self.enqueue(ino, SLOT_INODE, &block);
+        let addr = match result {
+            Ok(addr) => addr,
+            Err(e) => {
+                self.inodes.insert(ino, inode);
+                return Err(e);
+            }
+        };
+        let old = core::mem::replace(&mut inode.addr, addr);
+        self.release(old);
+        inode.dirty = false;
+        self.imap[ino as usize] = addr;
+        self.imap_dirty.insert(ino as usize / PTRS_PER_BLOCK);
+        self.inodes.insert(ino, inode);
+        Ok(())
+    }
+
+    /// Append up to `max_pages` of the volume's dirty cached pages to the
+    /// log; returns how many
+    ///
+    /// They are then clean pages of blocks in the open partial segment, so
+    /// it must be written out before anything can evict them and read the
+    /// blocks back from the device.
+    fn log_dirty_pages(&mut self, max_pages: usize) -> Result<usize, VfsError> {
+        let mut dirty = PAGE_CACHE.lock().dirty_in(self.cache.inodes());
+        dirty.truncate(max_pages);
+        let count = dirty.len();
+        let mut block = vec![0u8; BLOCK_SIZE];
+        for (key, index) in dirty {
+            match PAGE_CACHE.lock().page(key, index) {
+                Some(data) => block.copy_from_slice(data),
+                None => continue,
+            }
+            let ino = self.cache.local(key);
+            if !self.inodes.contains_key(&ino) {
+                return Err(VfsError::Corrupted);
+            }
+            let addr = self.enqueue(ino, index, &block)?;
+            let old = self.inodes.get_mut(&ino).unwrap().set_ptr(index as usize, addr);
+            self.release(old);
+            PAGE_CACHE.lock().mark_clean(key, index, addr * self.scale);
+        }
+        Ok(count)
+    }
+
+    /// Push names, dirty pages and inodes, and the open partial segment to
+    /// the device
+    fn flush_log(&mut self) -> Result<(), VfsError> {
+        if self.names_dirty {
+            let table = self.encode_names();
+            self.truncate(ROOT_INO)?;
+            self.write_range(ROOT_INO, 0, &table)?;
+            self.names_dirty = false;
+        }
+        self.log_dirty_pages(usize::MAX)?;
+
+        let dirty: Vec<u64> = self.inodes.iter()
+            .filter(|(_, inode)| inode.dirty)
+            .map(|(&ino, _)| ino)
+            .collect();
+        for ino in dirty {
+            self.write_inode(ino)?;
+        }
+
+        self.flush_partial()?;
+        // Idle background syncs should not cost a device cache flush
+        if self.unflushed {
+            self.dev.lock().flush().map_err(io)?;
+            self.unflushed = false;
+        }
+        Ok(())
+    }
+
+    fn imap_blocks(&self) -> usize {
+        (self.next_ino as usize).div_ceil(PTRS_PER_BLOCK)
+    }
+
+    /// Persist the inode map and write a new checkpoint
+    fn checkpoint(&mut self) -> Result<(), VfsError> {
+        self.flush_log()?;
+
+        // Deletes are durable now; their tombstones can go
+        for ino in core::mem::take(&mut self.tombstones) {
+            if let Some(inode) = self.inodes.remove(&ino) {
+                self.release(inode.addr);
+            }
+            self.imap[ino as usize] = 0;
+            self.imap_dirty.insert(ino as usize / PTRS_PER_BLOCK);
+            self.free_inos.push(ino);
+        }
+
+        let count = self.imap_blocks();
+        self.imap_addrs.resize(count, 0);
+        let mut block = vec![0u8; BLOCK_SIZE];
+        for k in core::mem::take(&mut self.imap_dirty) {
+            if k >= count {
+                continue;
+            }
+            block.fill(0);
+            for i in 0..PTRS_PER_BLOCK {
+                let ino = k * PTRS_PER_BLOCK + i;
+                if ino < self.imap.len() {
+                    put_u64(&mut block, i * 8, self.imap[ino]);
+                }
+            }
+            let addr = self.enqueue(0, SLOT_IMAP | k as u64, &block)?;
+            let old = core::mem::replace(&mut self.imap_addrs[k], addr);
+            self.release(old);
+        }
+        self.flush_partial()?;
+        self.dev.lock().flush().map_err(io)?;
+        self.unflushed = false;
+
+        let seq = self.cp_seq + 1;
+        block.fill(0);
+        put_u32(&mut block, 0, CHECKPOINT_MAGIC);
+        put_u32(&mut block, 4, VERSION);
+        put_u64(&mut block, 8, seq);
+        put_u64(&mut block, 16, self.log_seq);
+        put_u64(&mut block, 24, self.head_seg);
+        put_u64(&mut block, 32, self.head_off);
+        put_u64(&mut block, 40, self.next_ino);
+        put_u64(&mut block, 48, count as u64);
+        for (k, &addr) in self.imap_addrs.iter().enumerate() {
+            put_u64(&mut block, CHECKPOINT_HEADER + k * 8, addr);
+        }
+        let sum = checksum(&[&block]);
+        put_u32(&mut block, 56, sum);
+
+        let slot = CHECKPOINT_SLOTS[(seq % 2) as usize];
+        {
+            let mut dev = self.dev.lock();
+            dev.write_blocks(slot * self.scale, &block).map_err(io)?;
+            dev.flush().map_err(io)?;
+        }
+        self.cp_seq = seq;
+        self.segs_since_cp = 0;
+        self.stats.checkpoints += 1;
+
+        // Nothing reachable from the new checkpoint lives in these any more
+        for seg in core::mem::take(&mut self.dying) {
+            self.state[seg as usize] = SegState::Free;
+            self.free.push(seg);
+        }
+        Ok(())
+    }
+
+    // Recovery
+
+    /// Replay partial segments written after the checkpoint; returns the
+    /// segments the chain passed through
+    fn roll_forward(&mut self) -> Result<Vec<u64>, VfsError> {
+        let mut chain = Vec::new();
+        let mut summary = vec![0u8; BLOCK_SIZE];
+        let mut payload = Vec::new();
+
+        loop {
+            let start = Self::seg_base(self.head_seg) + self.head_off;
+            self.read_run(start, &mut summary)?;
+            let n = get_u32(&summary, 4) as u64;
+            if get_u32(&summary, 0) != SUMMARY_MAGIC
+                || get_u64(&summary, 8) != self.log_seq
+                || n == 0
+                || self.head_off + 1 + n > SEGMENT_BLOCKS
+            {
+                break;
+            }
+            payload.resize(n as usize * BLOCK_SIZE, 0);
+            self.read_run(start + 1, &mut payload)?;
+            let stored = get_u32(&summary, 24);
+            put_u32(&mut summary, 24, 0);
+            if checksum(&[&summary, &payload]) != stored {
+                // Torn write: everything from here on was never synced
+                break;
+            }
+
+            for i in 0..n as usize {
+                let off = SUMMARY_HEADER + i * SUMMARY_ENTRY;
+                let (ino, slot) = (get_u64(&summary, off), get_u64(&summary, off + 8));
+                if slot == SLOT_INODE {
+                    if ino as usize >= self.imap.len() {
+                        self.imap.resize(ino as usize + 1, 0);
+                    }
+                    self.imap[ino as usize] = start + 1 + i as u64;
+                    self.next_ino = self.next_ino.max(ino + 1);
+                }
+            }
+            if chain.last() != Some(&self.head_seg) {
+                chain.push(self.head_seg);
+            }
+            self.stats.rolled_forward += 1;
+            self.log_seq += 1;
+            self.head_off += 1 + n;
+
+            if SEGMENT_BLOCKS - self.head_off < 2 {
+                let next = get_u64(&summary, 16);
+                if next >= self.seg_count {
+                    // The writer ran out of segments here; resume after cleaning
+                    break;
+                }
+                self.head_seg = next;
+                self.head_off = 0;
+            }
+        }
+        Ok(chain)
+    }
+
+    fn load_inodes(&mut self) -> Result<(), VfsError> {
+        let mut block = vec![0u8; BLOCK_SIZE];
+        let mut ind = vec![0u8; BLOCK_SIZE];
+        self.imap.resize(self.next_ino as usize, 0);
+
+        for ino in ROOT_INO..self.next_ino {
+            let addr = self.imap[ino as usize];
+            if addr == 0 {
+                self.free_inos.push(ino);
+                continue;
+            }
+            self.read_block(addr, &mut block)?;
+            let kind = get_u32(&block, 16);
+            if get_u64(&block, 0) != ino {
+                return Err(VfsError::Corrupted);
+            }
+            if kind == KIND_FREE {
+                // Tombstone of a deleted file
+                self.imap[ino as usize] = 0;
+                self.free_inos.push(ino);
+                continue;
+            }
+
+            let size = get_u64(&block, 8);
+            let nblocks = (size as usize).div_ceil(BLOCK_SIZE);
+            let mut inode = Inode::new(kind);
+            inode.size = size;
+            inode.addr = addr;
+            inode.dirty = false;
+            inode.ptrs = (0..nblocks.min(NDIRECT))
+                .map(|i| get_u64(&block, INODE_HEADER + i * 8))
+                .collect();
+            let nind = nblocks.saturating_sub(NDIRECT).div_ceil(PTRS_PER_BLOCK);
+            for k in 0..nind {
+                let iaddr = get_u64(&block, INODE_HEADER + (NDIRECT + k) * 8);
+                inode.indirect.push(iaddr);
+                self.read_block(iaddr, &mut ind)?;
+                let count = (nblocks - NDIRECT - k * PTRS_PER_BLOCK).min(PTRS_PER_BLOCK);
+                inode.ptrs.extend((0..count).map(|i| get_u64(&ind, i * 8)));
+            }
+            self.inodes.insert(ino, inode);
+        }
+
+        if !self.inodes.contains_key(&ROOT_INO) {
+            return Err(VfsError::Corrupted);
+        }
+        // Lowest numbers first
+        self.free_inos.reverse();
+        Ok(())
+    }
+
+    /// Free inodes that reached the disk without a name (crash mid-create)
+    fn reap_orphans(&mut self) {
+        let named: BTreeSet<u64> = self.names.values().copied().collect();
+        let orphans: Vec<u64> = self.inodes.keys()
+            .copied()
+            .filter(|&ino| ino != ROOT_INO && !named.contains(&ino))
+            .collect();
+        for ino in orphans {
+            self.inodes.remove(&ino);
+            self.imap[ino as usize] = 0;
+            self.free_inos.push(ino);
+        }
+    }
+
+    fn rebuild_usage(&mut self, chain: &[u64]) {
+        let mut usage = vec![0u32; self.seg_count as usize];
+        let mut count = |addr: u64| {
+            if addr != 0 {
+                usage[Self::seg_of(addr)] += 1;
+            }
+        };
+        for inode in self.inodes.values() {
+            count(inode.addr);
+            inode.indirect.iter().for_each(|&a| count(a));
+            inode.ptrs.iter().for_each(|&a| count(a));
+        }
+        self.imap_addrs.iter().for_each(|&a| count(a));
+        self.usage = usage;
+
+        self.free.clear();
+        self.dying.clear();
+        for seg in (0..self.seg_count).rev() {
+            let i = seg as usize;
+            self.state[i] = if seg == self.head_seg {
+                SegState::Active
+            } else if self.usage[i] > 0 {
+                SegState::Live
+            } else if chain.contains(&seg) {
+                // The old checkpoint still needs these until the next one
+                self.dying.push(seg);
+                SegState::Dying
+            } else {
+                self.free.push(seg);
+                SegState::Free
+            };
+        }
+        self.next_seg = self.alloc_segment();
+    }
+
+    // Cleaner
+
+    fn maybe_clean(&mut self) -> Result<(), VfsError> {
+        if self.free.len() >= CLEAN_LOW {
+            return Ok(());
+        }
+        // Dead segments only need a checkpoint to become reusable
+        if !self.dying.is_empty() {
+            self.checkpoint()?;
+            if self.free.len() >= CLEAN_LOW {
+                return Ok(());
+            }
+        }
+        self.clean()
+    }
+
+    /// Relocate live blocks out of the emptiest segments until enough are free
+    pub fn clean(&mut self) -> Result<(), VfsError> {
+        let mut seg_buf = vec![0u8; SEGMENT_BLOCKS as usize * BLOCK_SIZE];
+        let mut cleaned = 0;
+
+        while self.free.len() + self.dying.len() < 2 * CLEAN_LOW && cleaned < self.seg_count {
+            if self.free.len() < 2 && !self.dying.is_empty() {
+                self.checkpoint()?;
+            }
+            // Fewest live blocks wins; mostly-full segments cost more to move
+            // than they give back
+            let victim = (0..self.seg_count as usize)
+                .filter(|&s| self.state[s] == SegState::Live)
+                .filter(|&s| (self.usage[s] as u64) < SEGMENT_BLOCKS * 3 / 4)
+                .min_by_key(|&s| self.usage[s]);
+            let victim = match victim {
+                Some(v) => v as u64,
+                None => break,
+            };
+            self.relocate(victim, &mut seg_buf)?;
+            self.flush_log()?;
+            cleaned += 1;
+            if self.state[victim as usize] != SegState::Dying {
+                // Something still pins it (e.g. imap blocks); checkpoint frees it
+                break;
+            }
+        }
+
+        if cleaned > 0 || !self.dying.is_empty() {
+            self.checkpoint()?;
+        }
+        Ok(())
+    }
+
+    fn relocate(&mut self, seg: u64, seg_buf: &mut [u8]) -> Result<(), VfsError> {
+        let base = Self::seg_base(seg);
+        self.read_run(base, seg_buf)?;
+
+        let mut off = 0u64;
+        while off + 1 < SEGMENT_BLOCKS {
+            let summary = &seg_buf[off as usize * BLOCK_SIZE..(off as usize + 1) * BLOCK_SIZE];
+            let n = get_u32(summary, 4) as u64;
+            if get_u32(summary, 0) != SUMMARY_MAGIC || n == 0 || off + 1 + n > SEGMENT_BLOCKS {
+                break;
+            }
+            let entries: Vec<(u64, u64)> = (0..n as usize)
+                .map(|i| {
+                    let e = SUMMARY_HEADER + i * SUMMARY_ENTRY;
+                    (get_u64(summary, e), get_u64(summary, e + 8))
+                })
+                .collect();
+
+            for (i, (ino, slot)) in entries.into_iter().enumerate() {
+                let addr = base + off + 1 + i as u64;
+                if slot == SLOT_INODE {
+                    if let Some(inode) = self.inodes.get_mut(&ino) {
+                        if inode.addr == addr {
+                            inode.dirty = true;
+                        }
+                    }
+                } else if slot & SLOT_INDIRECT != 0 {
+                    let k = (slot & !SLOT_INDIRECT) as usize;
+                    if let Some(inode) = self.inodes.get_mut(&ino) {
+                        if inode.indirect.get(k) == Some(&addr) {
+                            inode.indirect_dirty.insert(k);
+                            inode.dirty = true;
+                        }
+                    }
+                } else if slot & SLOT_IMAP != 0 {
+                    let k = (slot & !SLOT_IMAP) as usize;
+                    if self.imap_addrs.get(k) == Some(&addr) {
+                        self.imap_dirty.insert(k);
+                    }
+                } else {
+                    let live = self.inodes.get(&ino)
+                        .map_or(false, |inode| inode.ptrs.get(slot as usize) == Some(&addr));
+                    if live {
+                        let at = (off as usize + 1 + i) * BLOCK_SIZE;
+                        let new = self.enqueue(ino, slot, &seg_buf[at..at + BLOCK_SIZE])?;
+                        let old = self.inodes.get_mut(&ino).unwrap().set_ptr(slot as usize, new);
+                        self.release(old);
+                        self.stats.blocks_relocated += 1;
+                    }
+                }
+            }
+            off += 1 + n;
+        }
+        self.stats.segments_cleaned += 1;
+        Ok(())
+    }
+
+    // File data
+
+    fn write_range(&mut self, ino: u64, offset: u64, data: &[u8]) -> Result<(), VfsError> {
+        let end = offset + data.len() as u64;
+        if end.div_ceil(BLOCK_SIZE as u64) as usize > MAX_FILE_BLOCKS {
+            return Err(VfsError::NoSpace);
+        }
+        let key = self.cache.inode(ino);
+        let mut pos = offset;
+        while pos < end {
+            let index = pos / BLOCK_SIZE as u64;
+            let within = (pos % BLOCK_SIZE as u64) as usize;
+            let len = (BLOCK_SIZE - within).min((end - pos) as usize);
+            let src = &data[(pos - offset) as usize..(pos - offset) as usize + len];
+
+            let written = {
+                let mut dev = self.dev.lock();
+                PAGE_CACHE.lock().write_unplaced(&mut *dev, self, key, index, within, src)
+            };
+            match written {
+                Ok(_) => {}
+                Err(BlockError::CacheFull) => {
+                    // Every cached page is dirty: log ours to make room
+                    if self.log_dirty_pages(usize::MAX)? == 0 {
+                        return Err(VfsError::IoError);
+                    }
+                    self.flush_partial()?;
+                    continue;
+                }
+                Err(e) => return Err(io(e)),
+            }
+            pos += len as u64;
+            let inode = self.inodes.get_mut(&ino).unwrap();
+            if pos > inode.size {
+                inode.size = pos;
+                inode.dirty = true;
+            }
+        }
+        Ok(())
+    }
+
+    fn truncate(&mut self, ino: u64) -> Result<(), VfsError> {
+        let inode = self.inodes.get_mut(&ino).ok_or(VfsError::NotFound)?;
+        let ptrs = core::mem::take(&mut inode.ptrs);
+        inode.size = 0;
+        inode.dirty = true;
+        for addr in ptrs {
+            self.release(addr);
+        }
+        PAGE_CACHE.lock().invalidate_inode(self.cache.inode(ino));
+        Ok(())
+    }
+
+    fn read_range(&self, ino: u64) -> Result<Vec<u8>, VfsError> {
+        let inode = self.inodes.get(&ino).ok_or(VfsError::NotFound)?;
+        let size = inode.size as usize;
+        let key = self.cache.inode(ino);
+        let mut out = Vec::with_capacity(size);
+
+        // Log order keeps file blocks mostly contiguous, so readahead
+        // brings a sequential read in one device command per run
+        let mut dev = self.dev.lock();
+        let mut cache = PAGE_CACHE.lock();
+        for index in 0..size.div_ceil(BLOCK_SIZE) {
+            let page = cache.read(&mut *dev, self, key, index as u64).map_err(io)?;
+            let len = (size - out.len()).min(BLOCK_SIZE);
+            out.extend_from_slice(&page[..len]);
+        }
+        Ok(out)
+    }
+
+    // Names
+
+    fn encode_names(&self) -> Vec<u8> {
+        let mut out = Vec::new();
+        for (path, &ino) in &self.names {
+            out.extend_from_slice(&(path.len() as u16).to_le_bytes());
+            out.extend_from_slice(path.as_bytes());
+            out.extend_from_slice(&ino.to_le_bytes());
+        }
+        out
+    }
+
+    fn load_names(&mut self) -> Result<(), VfsError> {
+        let table = self.read_range(ROOT_INO)?;
+        let mut pos = 0;
+        while pos + 2 <= table.len() {
+            let len = u16::from_le_bytes([table[pos], table[pos + 1]]) as usize;
+            let end = pos + 2 + len + 8;
+            if end > table.len() {
+                return Err(VfsError::Corrupted);
+            }
+            let path = core::str::from_utf8(&table[pos + 2..pos + 2 + len])
+                .map_err(|_| VfsError::Corrupted)?;
+            let ino = get_u64(&table, pos + 2 + len);
+            // Entries whose inode never reached the disk are dropped
+            if self.inodes.contains_key(&ino) {
+                self.names.insert(path.to_string(), ino);
+            } else {
+                self.names_dirty = true;
+            }
+            pos = end;
+        }
+        Ok(())
+    }
+
+    fn lookup(&self, path: &str) -> Option<(u64, &Inode)> {
+        let ino = *self.names.get(path)?;
+        Some((ino, self.inodes.get(&ino)?))
+    }
+
+    fn alloc_ino(&mut self) -> Result<u64, VfsError> {
+        if let Some(ino) = self.free_inos.pop() {
+            return Ok(ino);
+        }
+        if self.next_ino as usize >= MAX_IMAP_BLOCKS * PTRS_PER_BLOCK {
+            return Err(VfsError::NoSpace);
+        }
+        let ino = self.next_ino;
+        self.next_ino += 1;
+        self.imap.push(0);
+        Ok(ino)
+    }
+
+    /// Check that the directory an entry at `path` would live in exists
+    fn check_parent(&self, path: &str) -> Result<(), VfsError> {
+        if !path.starts_with('/') || path.ends_with('/') {
+            return Err(VfsError::InvalidPath);
+        }
+        let parent = &path[..path.rfind('/').unwrap()];
+        if parent.is_empty() {
+            return Ok(());
+        }
+        match self.lookup(parent) {
+            Some((_, inode)) if inode.kind == KIND_DIR => Ok(()),
+            Some(_) => Err(VfsError::NotADirectory),
+            None => Err(VfsError::NotFound),
+        }
+    }
+
+    fn create(&mut self, path: &str, kind: u32) -> Result<u64, VfsError> {
+        self.check_parent(path)?;
+        if self.names.contains_key(path) {
+            return Err(VfsError::AlreadyExists);
+        }
+        let ino = self.alloc_ino()?;
+        self.inodes.insert(ino, Inode::new(kind));
+        self.names.insert(path.to_string(), ino);
+        self.names_dirty = true;
+        Ok(ino)
+    }
+}
+
+impl<D: BlockDevice> PageMap for Lfs<D> {
+    fn page_block(&self, inode: InodeId, index: u64) -> Option<u64> {
+        let ino = self.cache.local(inode);
+        let addr = *self.inodes.get(&ino)?.ptrs.get(index as usize)?;
+        (addr != 0).then(|| addr * self.scale)
+    }
+}
+
+impl<D: BlockDevice> FileSystem for Lfs<D> {
+    fn create_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
+        self.maybe_clean()?;
+        let ino = self.create(path, KIND_FILE)?;
+        self.write_range(ino, 0, content)?;
+        self.maybe_clean()
+    }
+
+    fn create_dir(&mut self, path: &str) -> Result<(), VfsError> {
+        self.create(path, KIND_DIR)?;
+        Ok(())
+    }
+
+    fn read_file(&self, path: &str) -> Result<Vec<u8>, VfsError> {
+        let (ino, inode) = self.lookup(path).ok_or(VfsError::NotFound)?;
+        if inode.kind != KIND_FILE {
+            return Err(VfsError::NotAFile);
+        }
+        self.read_range(ino)
+    }
+
+    fn read_file_bytes(&self, path: &str) -> Result<Cow<'_, [u8]>, VfsError> {
+        self.read_file(path).map(Cow::Owned)
+    }
+
+    fn read_file_to_string(&self, path: &str) -> Result<String, VfsError> {
+        String::from_utf8(self.read_file(path)?).map_err(|_| VfsError::IoError)
+    }
+
+    fn write_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
+        let ino = match self.lookup(path) {
+            Some((_, inode)) if inode.kind != KIND_FILE => return Err(VfsError::NotAFile),
+            Some((ino, _)) => ino,
+            None => return self.create_file(path, content),
+        };
+        self.maybe_clean()?;
+        self.truncate(ino)?;
+        self.write_range(ino, 0, content)?;
+        self.maybe_clean()
+    }
+
+    fn append_file(&mut self, path: &str, data: &[u8]) -> Result<(), VfsError> {
+        let (ino, size) = match self.lookup(path) {
+            Some((_, inode)) if inode.kind != KIND_FILE => return Err(VfsError::NotAFile),
+            Some((ino, inode)) => (ino, inode.size),
+            None => return self.create_file(path, data),
+        };
+        self.maybe_clean()?;
+        self.write_range(ino, size, data)?;
+        self.maybe_clean()
+    }
+
+    fn sync(&mut self) -> Result<(), VfsError> {
+        self.flush_log()?;
+        if self.segs_since_cp >= CHECKPOINT_SEGMENTS {
+            self.checkpoint()?;
+        }
+        self.maybe_clean()
+    }
+
+    /// Log a batch of dirty pages and write the partial segment; the inodes
+    /// pointing at them reach the log at the next `sync`
+    fn write_back(&mut self, max_pages: usize) -> Result<usize, VfsError> {
+        self.maybe_clean()?;
+        let written = self.log_dirty_pages(max_pages)?;
+        self.flush_partial()?;
+        Ok(written)
+    }
+
+    fn counters(&self) -> Vec<(&'static str, u64)> {
+        let stats = self.stats();
+        vec![
+            ("Free segments", stats.free_segments as u64),
+            ("Total segments", stats.total_segments as u64),
+            ("Partial segments", stats.partial_segments),
+            ("Blocks written", stats.blocks_written),
+            ("Checkpoints", stats.checkpoints),
+            ("Segments cleaned", stats.segments_cleaned),
+            ("Blocks relocated", stats.blocks_relocated),
+            ("Rolled forward", stats.rolled_forward),
+        ]
+    }
+
+    fn rename(&mut self, from: &str, to: &str) -> Result<(), VfsError> {
+        if to.starts_with(&alloc::format!("{}/", from)) {
+            return Err(VfsError::InvalidPath);
+        }
+        let ino = *self.names.get(from).ok_or(VfsError::NotFound)?;
+        self.check_parent(to)?;
+        if self.names.contains_key(to) {
+            return Err(VfsError::AlreadyExists);
+        }
+        // Names are full paths, so a directory's descendants move with it
+        let prefix = alloc::format!("{}/", from);
+        let children: Vec<(String, u64)> = self.names.range(prefix.clone()..)
+            .take_while(|(name, _)| name.starts_with(&prefix))
+            .map(|(name, &ino)| (name.clone(), ino))
+            .collect();
+        for (name, child) in children {
+            self.names.remove(&name);
+            self.names.insert(alloc::format!("{}{}", to, &name[from.len()..]), child);
+        }
+        self.names.remove(from);
+        self.names.insert(to.to_string(), ino);
+        // Lands atomically with the next log flush, like any other update
+        self.names_dirty = true;
+        Ok(())
+    }
+
+    fn delete(&mut self, path: &str) -> Result<(), VfsError> {
+        let ino = *self.names.get(path).ok_or(VfsError::NotFound)?;
+        // Names are full paths, so a directory's descendants go with it
+        let prefix = alloc::format!("{}/", path);
+        let mut doomed: Vec<(String, u64)> = self.names.range(prefix.clone()..)
+            .take_while(|(name, _)| name.starts_with(&prefix))
+            .map(|(name, &ino)| (name.clone(), ino))
+            .collect();
+        doomed.push((path.to_string(), ino));
+
+        for (name, ino) in doomed {
+            self.names.remove(&name);
+            self.truncate(ino)?;
+            let inode = self.inodes.get_mut(&ino).unwrap();
+            let indirect = core::mem::take(&mut inode.indirect);
+            inode.indirect_dirty.clear();
+            inode.kind = KIND_FREE;
+            for addr in indirect {
+                self.release(addr);
+            }
+            // The tombstone inode is written like any other dirty inode
+            self.tombstones.push(ino);
+        }
+        self.names_dirty = true;
+        Ok(())
+    }
+
+    fn exists(&self, path: &str) -> bool {
+        path == "/" || self.names.contains_key(path)
+    }
+
+    fn is_file(&self, path: &str) -> bool {
+        self.lookup(path).map_or(false, |(_, inode)| inode.kind == KIND_FILE)
+    }
+
+    fn is_dir(&self, path: &str) -> bool {
+        path == "/" || self.lookup(path).map_or(false, |(_, inode)| inode.kind == KIND_DIR)
+    }
+
+    fn list_dir(&self, path: &str) -> Result<Vec<String>, VfsError> {
+        if !self.is_dir(path) {
+            return Err(if self.exists(path) { VfsError::NotADirectory } else { VfsError::NotFound });
+        }
+        let mut prefix = String::from(path.trim_end_matches('/'));
+        prefix.push('/');
+        Ok(self.names.range(prefix.clone()..)
+            .take_while(|(name, _)| name.starts_with(prefix.as_str()))
+            .filter(|(name, _)| !name[prefix.len()..].contains('/'))
+            .map(|(name, _)| name.clone())
+            .collect())
+    }
+}
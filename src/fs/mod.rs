@@ -1,45 +1,186 @@
 // Filesystem module - Virtual File System abstraction
 
+pub mod initrd;
+pub mod lfs;
+pub mod mount;
+pub mod page_cache;
+pub mod path;
 pub mod ramfs;
 pub mod vfs;
 
 pub use vfs::{FileSystem, File, Directory, FileType, VfsError};
+pub use initrd::InitrdFs;
+pub use lfs::Lfs;
+pub use mount::MountFs;
 pub use ramfs::RamFs;
 
+use crate::drivers::block::{self, BlockDevice};
+use alloc::boxed::Box;
 use alloc::sync::Arc;
 use spin::Mutex;
 
-static ROOT_FS: Mutex<Option<Arc<Mutex<RamFs>>>> = Mutex::new(None);
+static ROOT_FS: Mutex<Option<Arc<Mutex<MountFs>>>> = Mutex::new(None);
 
 /// Initialize the root filesystem
 pub fn init() {
-    let ramfs = RamFs::new();
-    *ROOT_FS.lock() = Some(Arc::new(Mutex::new(ramfs)));
+    let root = MountFs::new(RamFs::new());
+    *ROOT_FS.lock() = Some(Arc::new(Mutex::new(root)));
     crate::println!("[FS] Filesystem initialized");
 }
 
 /// Get a reference to the root filesystem
-pub fn root_fs() -> Option<Arc<Mutex<RamFs>>> {
+pub fn root_fs() -> Option<Arc<Mutex<MountFs>>> {
     ROOT_FS.lock().as_ref().cloned()
 }
 
-/// Mount a directory with files loaded from bootloader
-pub fn mount_scripts(files: &[(&str, &[u8])]) -> Result<(), VfsError> {
-    if let Some(fs) = root_fs() {
-        let mut fs = fs.lock();
-        
-        // Create /scripts directory
-        fs.create_dir("/scripts")?;
-        
-        // Add each script file
-        for (name, content) in files {
-            let path = alloc::format!("/scripts/{}", name);
-            fs.create_file(&path, content)?;
-            crate::println!("[FS] Mounted script: {}", path);
+/// Snapshot the root filesystem in O(1); see `MountFs::snapshot`
+pub fn snapshot() -> Result<RamFs, VfsError> {
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    Ok(fs.lock().snapshot())
+}
+
+/// Roll the root filesystem back to a snapshot
+pub fn rollback(snapshot: &RamFs) -> Result<(), VfsError> {
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    fs.lock().restore(snapshot);
+    Ok(())
+}
+
+/// Mount a cpio (newc) archive read-only at `point`
+///
+/// The archive is indexed in place; file contents are never copied onto the
+/// heap. Returns the number of indexed entries.
+pub fn mount_initrd(point: &str, image: &'static [u8]) -> Result<usize, VfsError> {
+    let initrd = InitrdFs::new(image)?;
+    let count = initrd.len();
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    fs.lock().mount(point, Box::new(initrd))?;
+    crate::println!("[FS] Mounted initrd at {} ({} entries, {} bytes)", point, count, image.len());
+    Ok(count)
+}
+
+/// Mount the registered block device's LFS volume at `point`
+///
+/// The device leaves the block registry: the log must be its only writer,
+/// so the page cache cannot write back behind it. An unformatted device is
+/// handed back untouched.
+pub fn mount_disk(point: &str) -> Result<(), VfsError> {
+    let mut dev = block::take_block_device().ok_or(VfsError::NotFound)?;
+    if !lfs::probe(dev.as_mut()) {
+        crate::println!("[FS] {} has no filesystem (run 'mkfs' to format it)", dev.device_name());
+        block::register_block_device(dev);
+        return Err(VfsError::Corrupted);
+    }
+    let volume = Lfs::mount(dev)?;
+    attach_disk(point, volume)
+}
+
+/// Format the registered block device as LFS and mount it at `point`
+pub fn format_disk(point: &str) -> Result<(), VfsError> {
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    if fs.lock().is_mount_point(point) {
+        return Err(VfsError::AlreadyExists);
+    }
+    let dev = block::take_block_device().ok_or(VfsError::NotFound)?;
+    let volume = Lfs::format(dev)?;
+    attach_disk(point, volume)
+}
+
+fn attach_disk(point: &str, volume: Lfs<Box<dyn BlockDevice>>) -> Result<(), VfsError> {
+    let stats = volume.stats();
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    fs.lock().mount(point, Box::new(volume))?;
+    crate::println!("[FS] Mounted disk at {} ({}/{} segments free)",
+        point, stats.free_segments, stats.total_segments);
+    Ok(())
+}
+
+/// Flush every mounted filesystem to stable storage
+pub fn sync() -> Result<(), VfsError> {
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    fs.lock().sync()
+}
+
+/// Have mounted filesystems write back up to `max_pages` dirty cached
+/// pages; the page cache's write-back task calls this
+pub fn write_back(max_pages: usize) -> Result<usize, VfsError> {
+    let fs = root_fs().ok_or(VfsError::NotInitialized)?;
+    fs.lock().write_back(max_pages)
+}
+
+/// Milliseconds between background syncs; bounds what a crash can lose
+const SYNC_INTERVAL_MS: u64 = 5_000;
+
+/// Background task that syncs mounted filesystems periodically
+///
+/// It sleeps on the timer between syncs, so it keeps no CPU busy.
+pub async fn sync_task() {
+    loop {
+        crate::task::timer::sleep_ms(SYNC_INTERVAL_MS).await;
+        if let Err(e) = sync() {
+            crate::serial_println!("[FS] Background sync failed: {}", e);
+        }
+    }
+}
+
+/// Power-cut test workload, run instead of the desktop
+///
+/// Checks the records a previous boot appended to /data/crash.log, reports
+/// how many survived, then keeps appending and syncing. After each sync it
+/// prints `SYNCED <n>`; `scripts/lfs-crash-test.sh` kills the VM at random
+/// and checks that the next boot recovers at least that many.
+#[cfg(feature = "lfs_crash_test")]
+pub fn crash_test() -> ! {
+    const LOG: &str = "/data/crash.log";
+    const RECORD: usize = 64;
+    const BATCH: u64 = 8;
+
+    fn record(n: u64) -> [u8; RECORD] {
+        let mut r = [0u8; RECORD];
+        r[..8].copy_from_slice(&n.to_le_bytes());
+        for (i, b) in r[16..].iter_mut().enumerate() {
+            *b = (n as u8).wrapping_mul(31).wrapping_add(i as u8);
+        }
+        let sum = lfs::checksum(&[&r[..8], &r[16..]]);
+        r[8..12].copy_from_slice(&sum.to_le_bytes());
+        r
+    }
+
+    if !root_fs().is_some_and(|fs| fs.lock().is_mount_point("/data")) {
+        // Only an unformatted disk is handed back for formatting
+        if let Err(e) = format_disk("/data") {
+            crate::serial_println!("CORRUPT cannot mount /data: {}", e);
+            crate::hlt_loop();
+        }
+    }
+    let fs = root_fs().unwrap();
+
+    let log = fs.lock().read_file(LOG).unwrap_or_default();
+    if log.len() % RECORD != 0 {
+        crate::serial_println!("CORRUPT torn record at byte {}", log.len() / RECORD * RECORD);
+        crate::hlt_loop();
+    }
+    let mut n = 0u64;
+    for r in log.chunks(RECORD) {
+        if r != record(n) {
+            crate::serial_println!("CORRUPT record {}", n);
+            crate::hlt_loop();
+        }
+        n += 1;
+    }
+    crate::serial_println!("RECOVERED {}", n);
+
+    let mut batch = alloc::vec::Vec::with_capacity(BATCH as usize * RECORD);
+    loop {
+        batch.clear();
+        for i in 0..BATCH {
+            batch.extend_from_slice(&record(n + i));
         }
-        
-        Ok(())
-    } else {
-        Err(VfsError::NotInitialized)
+        let mut root = fs.lock();
+        root.append_file(LOG, &batch).expect("append failed");
+        root.sync().expect("sync failed");
+        drop(root);
+        n += BATCH;
+        crate::serial_println!("SYNCED {}", n);
     }
 }
@@ -0,0 +1,235 @@
+// Mount table - routes paths to the filesystem mounted over them
+
+use super::ramfs::RamFs;
+use super::vfs::{FileSystem, VfsError};
+use alloc::borrow::Cow;
+use alloc::boxed::Box;
+use alloc::string::{String, ToString};
+use alloc::vec::Vec;
+
+struct Mount {
+    /// Absolute mount point without a trailing '/', e.g. "/scripts"
+    point: String,
+    fs: Box<dyn FileSystem + Send>,
+}
+
+/// Root RamFs plus any backends mounted over its directories
+///
+/// Paths below a mount point are handed to that backend relative to its own
+/// root, and paths it returns are translated back.
+pub struct MountFs {
+    root: RamFs,
+    mounts: Vec<Mount>,
+}
+
+impl MountFs {
+    pub fn new(root: RamFs) -> Self {
+        MountFs {
+            root,
+            mounts: Vec::new(),
+        }
+    }
+
+    /// Mount `fs` at `point`, creating the mount point directory if needed
+    pub fn mount(&mut self, point: &str, fs: Box<dyn FileSystem + Send>) -> Result<(), VfsError> {
+        let point = point.trim_end_matches('/');
+        if !point.starts_with('/') {
+            return Err(VfsError::InvalidPath);
+        }
+        if self.is_mount_point(point) {
+            return Err(VfsError::AlreadyExists);
+        }
+        // The directory keeps the mount point visible in its parent's listing
+        if !self.root.is_dir(point) {
+            self.root.create_dir(point)?;
+        }
+        self.mounts.push(Mount { point: point.to_string(), fs });
+        Ok(())
+    }
+
+    /// O(1) copy-on-write snapshot of the root RamFs
+    ///
+    /// Mounted backends are not part of it; they keep their own state.
+    pub fn snapshot(&self) -> RamFs {
+        self.root.snapshot()
+    }
+
+    /// Roll the root RamFs back to `snapshot`, keeping every mount point
+    pub fn restore(&mut self, snapshot: &RamFs) {
+        self.root.restore(snapshot);
+        for m in &self.mounts {
+            if !self.root.is_dir(&m.point) {
+                let _ = self.root.create_dir(&m.point);
+            }
+        }
+    }
+
+    /// Whether a backend is already mounted at `point`
+    pub fn is_mount_point(&self, point: &str) -> bool {
+        let point = point.trim_end_matches('/');
+        self.mounts.iter().any(|m| m.point == point)
+    }
+
+    /// Counters of the backend mounted at `point`
+    pub fn counters_at(&self, point: &str) -> Option<Vec<(&'static str, u64)>> {
+        let point = point.trim_end_matches('/');
+        self.mounts.iter().find(|m| m.point == point).map(|m| m.fs.counters())
+    }
+
+    /// Resolve `path` to the backend that owns it and the path inside it
+    fn route<'a>(&self, path: &'a str) -> Option<(usize, &'a str)> {
+        let mut best: Option<(usize, &'a str)> = None;
+        let mut best_len = 0;
+        for (i, m) in self.mounts.iter().enumerate() {
+            let rest = match path.strip_prefix(m.point.as_str()) {
+                Some(rest) if rest.is_empty() => "/",
+                Some(rest) if rest.starts_with('/') => rest,
+                _ => continue,
+            };
+            if m.point.len() >= best_len {
+                best_len = m.point.len();
+                best = Some((i, rest));
+            }
+        }
+        best
+    }
+
+    fn route_mut<'a>(&mut self, path: &'a str) -> Option<(&mut (dyn FileSystem + Send), &'a str)> {
+        let (i, rest) = self.route(path)?;
+        Some((self.mounts[i].fs.as_mut(), rest))
+    }
+}
+
+impl FileSystem for MountFs {
+    fn create_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
+        match self.route_mut(path) {
+            Some((fs, rest)) => fs.create_file(rest, content),
+            None => self.root.create_file(path, content),
+        }
+    }
+
+    fn create_dir(&mut self, path: &str) -> Result<(), VfsError> {
+        match self.route_mut(path) {
+            Some((fs, rest)) => fs.create_dir(rest),
+            None => self.root.create_dir(path),
+        }
+    }
+
+    fn read_file(&self, path: &str) -> Result<Vec<u8>, VfsError> {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.read_file(rest),
+            None => self.root.read_file(path),
+        }
+    }
+
+    fn read_file_bytes(&self, path: &str) -> Result<Cow<'_, [u8]>, VfsError> {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.read_file_bytes(rest),
+            None => self.root.read_file_bytes(path),
+        }
+    }
+
+    fn read_file_to_string(&self, path: &str) -> Result<String, VfsError> {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.read_file_to_string(rest),
+            None => self.root.read_file_to_string(path),
+        }
+    }
+
+    fn write_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
+        match self.route_mut(path) {
+            Some((fs, rest)) => fs.write_file(rest, content),
+            None => self.root.write_file(path, content),
+        }
+    }
+
+    fn append_file(&mut self, path: &str, data: &[u8]) -> Result<(), VfsError> {
+        match self.route_mut(path) {
+            Some((fs, rest)) => fs.append_file(rest, data),
+            None => self.root.append_file(path, data),
+        }
+    }
+
+    fn rename(&mut self, from: &str, to: &str) -> Result<(), VfsError> {
+        match (self.route(from), self.route(to)) {
+            // Mount points themselves cannot move
+            (Some((_, "/")), _) | (_, Some((_, "/"))) => Err(VfsError::InvalidPath),
+            (None, None) => self.root.rename(from, to),
+            (Some((i, a)), Some((j, b))) if i == j => self.mounts[i].fs.rename(a, b),
+            // Across backends only a file copy is possible
+            _ => {
+                if !self.is_file(from) {
+                    return Err(VfsError::NotAFile);
+                }
+                if self.exists(to) {
+                    return Err(VfsError::AlreadyExists);
+                }
+                let content = self.read_file(from)?;
+                self.create_file(to, &content)?;
+                self.delete(from)
+            }
+        }
+    }
+
+    fn sync(&mut self) -> Result<(), VfsError> {
+        for m in self.mounts.iter_mut() {
+            m.fs.sync()?;
+        }
+        self.root.sync()
+    }
+
+    fn write_back(&mut self, max_pages: usize) -> Result<usize, VfsError> {
+        let mut written = 0;
+        for m in self.mounts.iter_mut() {
+            written += m.fs.write_back(max_pages - written)?;
+        }
+        Ok(written)
+    }
+
+    fn delete(&mut self, path: &str) -> Result<(), VfsError> {
+        match self.route_mut(path) {
+            // Mount points themselves cannot be removed
+            Some((_, "/")) => Err(VfsError::InvalidPath),
+            Some((fs, rest)) => fs.delete(rest),
+            None => self.root.delete(path),
+        }
+    }
+
+    fn exists(&self, path: &str) -> bool {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.exists(rest),
+            None => self.root.exists(path),
+        }
+    }
+
+    fn is_file(&self, path: &str) -> bool {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.is_file(rest),
+            None => self.root.is_file(path),
+        }
+    }
+
+    fn is_dir(&self, path: &str) -> bool {
+        match self.route(path) {
+            Some((i, rest)) => self.mounts[i].fs.is_dir(rest),
+            None => self.root.is_dir(path),
+        }
+    }
+
+    fn list_dir(&self, path: &str) -> Result<Vec<String>, VfsError> {
+        match self.route(path) {
+            Some((i, rest)) => {
+                let point = &self.mounts[i].point;
+                let entries = self.mounts[i].fs.list_dir(rest)?;
+                Ok(entries.into_iter()
+                    .map(|e| alloc::format!("{}{}", point, e))
+                    .collect())
+            }
+            None => self.root.list_dir(path),
+        }
+    }
+
+    fn counters(&self) -> Vec<(&'static str, u64)> {
+        self.root.counters()
+    }
+}
@@ -0,0 +1,726 @@
+// Unified page cache between block-backed filesystems and block drivers
+//
+// Pages are indexed by (inode, page index). Filesystems resolve the device
+// block behind a page through the `PageMap` trait; the cache records that
+// block with the page so dirty data can be written back later without asking
+// the filesystem again.
+//
+// A log-structured filesystem never writes a page back where it came from.
+// Its dirty pages have no home block: `writeback` leaves them alone, and the
+// filesystem collects them with `dirty_in` when it flushes its log.
+//
+// Each filesystem instance owns a range of inode numbers (`CacheVolume`),
+// and write-back is done per volume by its owner, which alone holds the
+// device the pages belong to. The background task asks every mounted
+// filesystem to write back through `FileSystem::write_back`. A cache whose
+// every page is dirty takes no new page for writing: the write fails with
+// `BlockError::CacheFull` until the owner flushes, and reads go around it.
+//
+// Lock order: BLOCK_DEVICE (or a filesystem's own device) before PAGE_CACHE.
+
+use alloc::boxed::Box;
+use alloc::collections::BTreeMap;
+use alloc::vec;
+use alloc::vec::Vec;
+use core::future::{poll_fn, Future};
+use core::ops::RangeInclusive;
+use core::pin::pin;
+use core::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use core::task::Poll;
+use futures_util::task::AtomicWaker;
+use spin::Mutex;
+
+use crate::drivers::block::{BlockDevice, BlockError};
+
+/// Size of a cached page in bytes
+pub const PAGE_SIZE: usize = 4096;
+
+/// Default number of resident pages (256 KiB of the 2 MiB heap)
+pub const DEFAULT_CAPACITY: usize = 64;
+
+/// Largest readahead window in pages
+const MAX_READAHEAD: u64 = 16;
+
+/// Dirty pages written per background write-back pass
+pub const WRITEBACK_BATCH: usize = 32;
+
+/// Milliseconds between write-backs of a partial batch
+const WRITEBACK_INTERVAL_MS: u64 = 1_000;
+
+/// Start shedding clean pages once the heap is this full (percent)
+const PRESSURE_PERCENT: usize = 75;
+
+pub type InodeId = u64;
+
+/// Low bits of an `InodeId` that hold a volume's own inode number
+const VOLUME_SHIFT: u32 = 32;
+
+/// Maps file pages to device blocks for a filesystem
+pub trait PageMap {
+    /// First device block backing `index` of `inode`, or None for a hole
+    fn page_block(&self, inode: InodeId, index: u64) -> Option<u64>;
+}
+
+struct CachedPage {
+    inode: InodeId,
+    index: u64,
+    block: Option<u64>,
+    data: Box<[u8]>,
+    dirty: bool,
+    /// CLOCK reference bit
+    referenced: bool,
+    /// Brought in by readahead and not yet touched
+    prefetched: bool,
+}
+
+/// Per-inode sequential access tracking
+#[derive(Clone, Copy)]
+struct Readahead {
+    next_index: u64,
+    window: u64,
+    /// First page not yet covered by readahead
+    ahead_until: u64,
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct PageCacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub readahead_pages: u64,
+    pub readahead_hits: u64,
+    pub writeback_pages: u64,
+    pub writeback_batches: u64,
+    pub evictions: u64,
+    pub resident: usize,
+    pub dirty: usize,
+    pub capacity: usize,
+}
+
+pub struct PageCache {
+    slots: Vec<Option<CachedPage>>,
+    index: BTreeMap<(InodeId, u64), usize>,
+    free_slots: Vec<usize>,
+    readahead: BTreeMap<InodeId, Readahead>,
+    hand: usize,
+    capacity: usize,
+    dirty: usize,
+    /// Page handed out by reads that found no room in the cache
+    bypass: Vec<u8>,
+    stats: PageCacheStats,
+}
+
+impl PageCache {
+    pub const fn new(capacity: usize) -> Self {
+        Self {
+            slots: Vec::new(),
+            index: BTreeMap::new(),
+            free_slots: Vec::new(),
+            readahead: BTreeMap::new(),
+            hand: 0,
+            capacity,
+            dirty: 0,
+            bypass: Vec::new(),
+            stats: PageCacheStats {
+                hits: 0,
+                misses: 0,
+                readahead_pages: 0,
+                readahead_hits: 0,
+                writeback_pages: 0,
+                writeback_batches: 0,
+                evictions: 0,
+                resident: 0,
+                dirty: 0,
+                capacity: 0,
+            },
+        }
+    }
+
+    /// Read a whole page, loading it (and any readahead) on a miss
+    pub fn read(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+    ) -> Result<&[u8], BlockError> {
+        let window = self.note_access(inode, index);
+
+        let cached = self.index.get(&(inode, index)).copied();
+        let mut trigger = cached.is_none();
+        if let Some(slot) = cached {
+            self.stats.hits += 1;
+            let page = self.slots[slot].as_mut().unwrap();
+            page.referenced = true;
+            if page.prefetched {
+                // Consuming readahead pulls the next window in
+                page.prefetched = false;
+                self.stats.readahead_hits += 1;
+                trigger = true;
+            }
+        }
+
+        if trigger && window > 0 {
+            let state = self.readahead.get(&inode).copied().unwrap();
+            let start = state.ahead_until.max(index + 1);
+            let end = index + 1 + window;
+            if start < end {
+                match self.prefetch(dev, map, inode, start, end - start) {
+                    // No room to read ahead into
+                    Ok(()) | Err(BlockError::CacheFull) => {}
+                    Err(e) => return Err(e),
+                }
+            }
+            if let Some(state) = self.readahead.get_mut(&inode) {
+                state.ahead_until = state.ahead_until.max(end);
+            }
+        }
+
+        // Loaded after readahead so the demanded page is the newest resident
+        let slot = match self.index.get(&(inode, index)).copied() {
+            Some(slot) => slot,
+            None => {
+                if cached.is_none() {
+                    self.stats.misses += 1;
+                }
+                match self.load(dev, map, inode, index, false) {
+                    Err(BlockError::CacheFull) => return self.read_uncached(dev, map, inode, index),
+                    slot => slot?,
+                }
+            }
+        };
+        Ok(&self.slots[slot].as_ref().unwrap().data)
+    }
+
+    /// Read a page into the bypass buffer, for when no cache slot is free
+    fn read_uncached(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+    ) -> Result<&[u8], BlockError> {
+        self.bypass.clear();
+        self.bypass.resize(PAGE_SIZE, 0);
+        if let Some(block) = map.page_block(inode, index) {
+            dev.read_blocks(block, &mut self.bypass)?;
+        }
+        Ok(&self.bypass)
+    }
+
+    /// Write `data` into a page at `offset`; the page becomes dirty
+    ///
+    /// Full-page writes skip reading the old contents from the device.
+    pub fn write(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+        offset: usize,
+        data: &[u8],
+    ) -> Result<(), BlockError> {
+        let slot = self.page_for_write(dev, map, inode, index, offset, data.len())?;
+        let page = self.slots[slot].as_mut().unwrap();
+        if page.block.is_none() {
+            // Holes have nowhere to be written back to
+            page.block = map.page_block(inode, index);
+            if page.block.is_none() {
+                return Err(BlockError::OutOfRange);
+            }
+        }
+        self.modify(slot, offset, data);
+        Ok(())
+    }
+
+    /// Write into a page of a filesystem that never writes in place
+    ///
+    /// The page stays dirty until the filesystem takes it from `dirty_in`
+    /// and reports where it went with `mark_clean`. Returns whether the
+    /// page was clean before.
+    pub fn write_unplaced(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+        offset: usize,
+        data: &[u8],
+    ) -> Result<bool, BlockError> {
+        let slot = self.page_for_write(dev, map, inode, index, offset, data.len())?;
+        self.slots[slot].as_mut().unwrap().block = None;
+        Ok(self.modify(slot, offset, data))
+    }
+
+    /// Dirty pages of `inodes` in (inode, index) order
+    pub fn dirty_in(&self, inodes: RangeInclusive<InodeId>) -> Vec<(InodeId, u64)> {
+        self.index
+            .range((*inodes.start(), 0)..=(*inodes.end(), u64::MAX))
+            .filter(|&(_, &slot)| self.slots[slot].as_ref().map_or(false, |p| p.dirty))
+            .map(|(&key, _)| key)
+            .collect()
+    }
+
+    /// Contents of a resident page, without counting an access
+    pub fn page(&self, inode: InodeId, index: u64) -> Option<&[u8]> {
+        let slot = *self.index.get(&(inode, index))?;
+        self.slots[slot].as_ref().map(|p| &p.data[..])
+    }
+
+    /// Record that a dirty page has been written to `block` by its filesystem
+    pub fn mark_clean(&mut self, inode: InodeId, index: u64, block: u64) {
+        let Some(&slot) = self.index.get(&(inode, index)) else { return };
+        let page = self.slots[slot].as_mut().unwrap();
+        page.block = Some(block);
+        if page.dirty {
+            page.dirty = false;
+            self.dirty -= 1;
+            self.stats.writeback_pages += 1;
+        }
+    }
+
+    /// Write back up to `max_pages` dirty pages of `inodes`, the volume on
+    /// `dev`, coalescing contiguous blocks
+    ///
+    /// Returns the number of pages written.
+    pub fn writeback(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        inodes: RangeInclusive<InodeId>,
+        max_pages: usize,
+    ) -> Result<usize, BlockError> {
+        let mut dirty: Vec<(u64, usize)> = self.index
+            .range((*inodes.start(), 0)..=(*inodes.end(), u64::MAX))
+            .filter_map(|(_, &slot)| match &self.slots[slot] {
+                Some(p) if p.dirty => p.block.map(|b| (b, slot)),
+                _ => None,
+            })
+            .collect();
+        if dirty.is_empty() {
+            return Ok(0);
+        }
+        dirty.sort_unstable();
+        dirty.truncate(max_pages);
+
+        let bpp = (PAGE_SIZE / dev.block_size()) as u64;
+        let mut written = 0;
+        let mut run_start = 0;
+        while run_start < dirty.len() {
+            let mut run_end = run_start + 1;
+            while run_end < dirty.len()
+                && dirty[run_end].0 == dirty[run_end - 1].0 + bpp
+            {
+                run_end += 1;
+            }
+
+            let run = &dirty[run_start..run_end];
+            if run.len() == 1 {
+                let page = self.slots[run[0].1].as_ref().unwrap();
+                dev.write_blocks(run[0].0, &page.data)?;
+            } else {
+                let mut buf = Vec::with_capacity(run.len() * PAGE_SIZE);
+                for &(_, slot) in run {
+                    buf.extend_from_slice(&self.slots[slot].as_ref().unwrap().data);
+                }
+                dev.write_blocks(run[0].0, &buf)?;
+            }
+
+            for &(_, slot) in run {
+                self.slots[slot].as_mut().unwrap().dirty = false;
+            }
+            self.dirty -= run.len();
+            written += run.len();
+            self.stats.writeback_batches += 1;
+            run_start = run_end;
+        }
+
+        self.stats.writeback_pages += written as u64;
+        Ok(written)
+    }
+
+    /// Write back every dirty page of `inodes`, the volume on `dev`, and
+    /// flush the device
+    pub fn sync(&mut self, dev: &mut dyn BlockDevice, inodes: RangeInclusive<InodeId>) -> Result<(), BlockError> {
+        // Unplaced pages are left to their filesystem
+        while self.writeback(dev, inodes.clone(), usize::MAX)? > 0 {}
+        dev.flush()
+    }
+
+    /// Drop all pages of an inode without writing them back (truncate/delete)
+    pub fn invalidate_inode(&mut self, inode: InodeId) {
+        let keys: Vec<(InodeId, u64)> = self.index
+            .range((inode, 0)..=(inode, u64::MAX))
+            .map(|(k, _)| *k)
+            .collect();
+        for key in keys {
+            if let Some(slot) = self.index.remove(&key) {
+                self.release(slot);
+            }
+        }
+        self.readahead.remove(&inode);
+    }
+
+    /// Drop all pages of a range of inodes, e.g. a volume going away
+    pub fn invalidate_inodes(&mut self, inodes: RangeInclusive<InodeId>) {
+        let (first, last) = (*inodes.start(), *inodes.end());
+        let keys: Vec<(InodeId, u64)> = self.index
+            .range((first, 0)..=(last, u64::MAX))
+            .map(|(k, _)| *k)
+            .collect();
+        for key in keys {
+            if let Some(slot) = self.index.remove(&key) {
+                self.release(slot);
+            }
+        }
+        self.readahead.retain(|inode, _| !inodes.contains(inode));
+    }
+
+    /// Evict up to `count` clean pages using the CLOCK algorithm
+    ///
+    /// Returns the number of pages evicted. Dirty pages are skipped.
+    pub fn evict(&mut self, count: usize) -> usize {
+        let mut evicted = 0;
+        let mut scanned = 0;
+        let limit = self.slots.len() * 2;
+        while evicted < count && scanned < limit && !self.slots.is_empty() {
+            let slot = self.hand;
+            self.hand = (self.hand + 1) % self.slots.len();
+            scanned += 1;
+
+            let victim = match &mut self.slots[slot] {
+                Some(page) if !page.dirty => {
+                    if page.referenced {
+                        page.referenced = false;
+                        None
+                    } else {
+                        Some((page.inode, page.index))
+                    }
+                }
+                _ => None,
+            };
+
+            if let Some(key) = victim {
+                self.index.remove(&key);
+                self.release(slot);
+                self.stats.evictions += 1;
+                evicted += 1;
+            }
+        }
+        evicted
+    }
+
+    /// Shed a quarter of the cache if the heap is under pressure
+    pub fn reclaim_if_pressured(&mut self) -> usize {
+        let limit = crate::allocator::HEAP_SIZE / 100 * PRESSURE_PERCENT;
+        if crate::allocator::heap_used() > limit {
+            self.evict((self.resident() / 4).max(1))
+        } else {
+            0
+        }
+    }
+
+    pub fn resident(&self) -> usize {
+        self.index.len()
+    }
+
+    pub fn dirty_pages(&self) -> usize {
+        self.dirty
+    }
+
+    pub fn stats(&self) -> PageCacheStats {
+        PageCacheStats {
+            resident: self.resident(),
+            dirty: self.dirty,
+            capacity: self.capacity,
+            ..self.stats
+        }
+    }
+
+    /// Slot of the page a write of `len` bytes at `offset` goes to
+    fn page_for_write(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+        offset: usize,
+        len: usize,
+    ) -> Result<usize, BlockError> {
+        if offset + len > PAGE_SIZE {
+            return Err(BlockError::BadBufferSize);
+        }
+        match self.index.get(&(inode, index)).copied() {
+            Some(slot) => {
+                self.stats.hits += 1;
+                Ok(slot)
+            }
+            None => {
+                self.stats.misses += 1;
+                let whole = offset == 0 && len == PAGE_SIZE;
+                self.load(dev, map, inode, index, whole)
+            }
+        }
+    }
+
+    /// Copy `data` into a page and mark it dirty; true if it was clean
+    ///
+    /// Filling a batch wakes the write-back task.
+    fn modify(&mut self, slot: usize, offset: usize, data: &[u8]) -> bool {
+        let page = self.slots[slot].as_mut().unwrap();
+        page.data[offset..offset + data.len()].copy_from_slice(data);
+        page.referenced = true;
+        page.prefetched = false;
+        if page.dirty {
+            return false;
+        }
+        page.dirty = true;
+        self.dirty += 1;
+        if self.dirty == WRITEBACK_BATCH {
+            wake_writeback();
+        }
+        true
+    }
+
+    /// Track sequential access and return how many pages to read ahead
+    fn note_access(&mut self, inode: InodeId, index: u64) -> u64 {
+        // Never let readahead push out more than a quarter of the cache
+        let max_window = MAX_READAHEAD.min((self.capacity / 4) as u64);
+        let state = self.readahead.entry(inode).or_insert(Readahead {
+            next_index: u64::MAX,
+            window: 0,
+            ahead_until: 0,
+        });
+        if index == state.next_index {
+            state.window = if state.window == 0 { 2 } else { state.window * 2 };
+            state.window = state.window.min(max_window);
+        } else if index + 1 != state.next_index {
+            // Re-reading the same page keeps the window; a jump resets it
+            state.window = 0;
+            state.ahead_until = 0;
+        }
+        state.next_index = index + 1;
+        state.window
+    }
+
+    /// Read ahead `window` pages from `start`, one device command per contiguous run
+    fn prefetch(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        start: u64,
+        window: u64,
+    ) -> Result<(), BlockError> {
+        let bpp = (PAGE_SIZE / dev.block_size()) as u64;
+        let mut run: Vec<(u64, u64)> = Vec::new();
+
+        for index in start..start + window {
+            let block = if self.index.contains_key(&(inode, index)) {
+                None
+            } else {
+                map.page_block(inode, index)
+            };
+            match block {
+                Some(b) if run.last().map_or(true, |&(_, last)| b == last + bpp) => {
+                    run.push((index, b));
+                }
+                Some(b) => {
+                    self.fill_run(dev, inode, &run)?;
+                    run.clear();
+                    run.push((index, b));
+                }
+                None => {
+                    self.fill_run(dev, inode, &run)?;
+                    run.clear();
+                }
+            }
+        }
+        self.fill_run(dev, inode, &run)
+    }
+
+    fn fill_run(&mut self, dev: &mut dyn BlockDevice, inode: InodeId, run: &[(u64, u64)]) -> Result<(), BlockError> {
+        if run.is_empty() {
+            return Ok(());
+        }
+        let mut buf = vec![0u8; run.len() * PAGE_SIZE];
+        dev.read_blocks(run[0].1, &mut buf)?;
+        for (i, &(index, block)) in run.iter().enumerate() {
+            let data: Box<[u8]> = buf[i * PAGE_SIZE..(i + 1) * PAGE_SIZE].into();
+            self.insert(dev, CachedPage {
+                inode,
+                index,
+                block: Some(block),
+                data,
+                dirty: false,
+                referenced: false,
+                prefetched: true,
+            })?;
+        }
+        self.stats.readahead_pages += run.len() as u64;
+        Ok(())
+    }
+
+    fn load(
+        &mut self,
+        dev: &mut dyn BlockDevice,
+        map: &dyn PageMap,
+        inode: InodeId,
+        index: u64,
+        skip_read: bool,
+    ) -> Result<usize, BlockError> {
+        let block = map.page_block(inode, index);
+        let mut data: Box<[u8]> = vec![0u8; PAGE_SIZE].into_boxed_slice();
+        if let (Some(b), false) = (block, skip_read) {
+            dev.read_blocks(b, &mut data)?;
+        }
+        self.insert(dev, CachedPage {
+            inode,
+            index,
+            block,
+            data,
+            dirty: false,
+            referenced: true,
+            prefetched: false,
+        })
+    }
+
+    fn insert(&mut self, dev: &mut dyn BlockDevice, page: CachedPage) -> Result<usize, BlockError> {
+        if self.resident() >= self.capacity && self.evict(1) == 0 {
+            // Everything resident is dirty: clean a batch of the volume on
+            // `dev`, then retry; pages waiting for their filesystem can't be
+            if self.writeback(dev, volume_of(page.inode), WRITEBACK_BATCH)? == 0 || self.evict(1) == 0 {
+                return Err(BlockError::CacheFull);
+            }
+        }
+
+        let key = (page.inode, page.index);
+        let slot = match self.free_slots.pop() {
+            Some(slot) => {
+                self.slots[slot] = Some(page);
+                slot
+            }
+            None => {
+                self.slots.push(Some(page));
+                self.slots.len() - 1
+            }
+        };
+        self.index.insert(key, slot);
+        Ok(slot)
+    }
+
+    fn release(&mut self, slot: usize) {
+        if let Some(page) = self.slots[slot].take() {
+            if page.dirty {
+                self.dirty -= 1;
+            }
+            self.free_slots.push(slot);
+        }
+    }
+}
+
+/// Global page cache shared by all block-backed filesystems
+pub static PAGE_CACHE: Mutex<PageCache> = Mutex::new(PageCache::new(DEFAULT_CAPACITY));
+
+/// Get a snapshot of the global page cache statistics
+pub fn stats() -> PageCacheStats {
+    PAGE_CACHE.lock().stats()
+}
+
+/// One filesystem instance's inode numbers in the global cache
+///
+/// Volumes number their inodes independently, so each gets its own range
+/// of cache inode numbers. Dropping the volume drops its pages, dirty or
+/// not.
+pub struct CacheVolume {
+    base: InodeId,
+}
+
+impl CacheVolume {
+    pub fn new() -> Self {
+        static NEXT: AtomicU64 = AtomicU64::new(1);
+        CacheVolume { base: NEXT.fetch_add(1, Ordering::Relaxed) << VOLUME_SHIFT }
+    }
+
+    /// Cache inode number of the volume's inode `ino`
+    pub fn inode(&self, ino: u64) -> InodeId {
+        self.base | ino
+    }
+
+    /// The volume's inode number behind a cache inode number
+    pub fn local(&self, inode: InodeId) -> u64 {
+        inode - self.base
+    }
+
+    /// Every cache inode number of the volume
+    pub fn inodes(&self) -> RangeInclusive<InodeId> {
+        volume_of(self.base)
+    }
+}
+
+/// Every cache inode number of the volume `inode` belongs to
+fn volume_of(inode: InodeId) -> RangeInclusive<InodeId> {
+    let base = inode >> VOLUME_SHIFT << VOLUME_SHIFT;
+    base..=base | ((1 << VOLUME_SHIFT) - 1)
+}
+
+impl Drop for CacheVolume {
+    fn drop(&mut self) {
+        PAGE_CACHE.lock().invalidate_inodes(self.inodes());
+    }
+}
+
+/// Set when a write fills a batch, until the write-back task sees it
+static BATCH_READY: AtomicBool = AtomicBool::new(false);
+static WRITEBACK_WAKER: AtomicWaker = AtomicWaker::new();
+
+fn wake_writeback() {
+    BATCH_READY.store(true, Ordering::Release);
+    WRITEBACK_WAKER.wake();
+}
+
+/// Wait until a write fills a batch or `WRITEBACK_INTERVAL_MS` passes
+async fn batch_or_interval() {
+    let mut interval = pin!(crate::task::timer::sleep_ms(WRITEBACK_INTERVAL_MS));
+    poll_fn(|cx| {
+        if BATCH_READY.swap(false, Ordering::AcqRel) {
+            return Poll::Ready(());
+        }
+        WRITEBACK_WAKER.register(cx.waker());
+        if BATCH_READY.swap(false, Ordering::AcqRel) {
+            return Poll::Ready(());
+        }
+        interval.as_mut().poll(cx)
+    })
+    .await
+}
+
+/// Background write-back task
+///
+/// Has the mounted filesystems write back their dirty pages when a write
+/// fills a batch, or every `WRITEBACK_INTERVAL_MS` for stragglers, and
+/// sheds clean pages when the heap runs low. It sleeps in between, so an
+/// idle system can halt.
+pub async fn writeback_task() {
+    let mut backlog = false;
+    loop {
+        if backlog {
+            crate::task::yield_now().await;
+        } else {
+            batch_or_interval().await;
+        }
+
+        let mut written = 0;
+        // Not held across the call: filesystems lock their device first
+        let dirty = PAGE_CACHE.lock().dirty_pages();
+        if dirty > 0 {
+            match crate::fs::write_back(WRITEBACK_BATCH) {
+                Ok(n) => written = n,
+                Err(e) => crate::serial_println!("[PageCache] write-back failed: {}", e),
+            }
+        }
+        // More than a batch left is worked off without sleeping, as long
+        // as write-back gets anywhere with it
+        backlog = written > 0 && PAGE_CACHE.lock().dirty_pages() >= WRITEBACK_BATCH;
+
+        PAGE_CACHE.lock().reclaim_if_pressured();
+    }
+}
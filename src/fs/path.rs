@@ -0,0 +1,99 @@
+// Path helpers - normalization and interned path components
+
+use alloc::borrow::Cow;
+use alloc::collections::BTreeSet;
+use alloc::string::String;
+use alloc::sync::Arc;
+use spin::Mutex;
+
+/// Every path component name seen so far, shared by all RamFs trees
+static NAMES: Mutex<BTreeSet<Arc<str>>> = Mutex::new(BTreeSet::new());
+
+/// Intern a path component so equal names share one allocation
+///
+/// A name stays interned until `release` or `sweep` finds that nothing
+/// but the set holds it any more.
+pub fn intern(name: &str) -> Arc<str> {
+    let mut names = NAMES.lock();
+    if let Some(existing) = names.get(name) {
+        return Arc::clone(existing);
+    }
+    let name: Arc<str> = Arc::from(name);
+    names.insert(Arc::clone(&name));
+    name
+}
+
+/// Forget an interned name if nothing but the set still holds it
+pub fn release(name: &str) {
+    let mut names = NAMES.lock();
+    if names.get(name).is_some_and(|n| Arc::strong_count(n) == 1) {
+        names.remove(name);
+    }
+}
+
+/// Forget every interned name nothing else holds, e.g. after a whole
+/// directory tree was dropped
+pub fn sweep() {
+    NAMES.lock().retain(|n| Arc::strong_count(n) > 1);
+}
+
+/// Number of interned names
+pub fn interned() -> usize {
+    NAMES.lock().len()
+}
+
+/// FNV-1a hash of a path component, used to key lookup caches
+pub fn name_hash(name: &str) -> u64 {
+    let mut hash = 0xcbf2_9ce4_8422_2325u64;
+    for &b in name.as_bytes() {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+    }
+    hash
+}
+
+/// Non-empty components of a path
+pub fn components(path: &str) -> impl Iterator<Item = &str> {
+    path.split('/').filter(|s| !s.is_empty())
+}
+
+/// Whether an absolute path has no empty, `.` or `..` components and no
+/// trailing slash
+fn is_normal(path: &str) -> bool {
+    path == "/"
+        || (path.starts_with('/')
+            && path[1..].split('/').all(|c| !c.is_empty() && c != "." && c != ".."))
+}
+
+/// Resolve `path` against the working directory `cwd` (itself absolute)
+///
+/// Paths that are already absolute and normal, and `.`, are returned
+/// without allocating.
+pub fn resolve<'a>(cwd: &'a str, path: &'a str) -> Cow<'a, str> {
+    if is_normal(path) {
+        return Cow::Borrowed(path);
+    }
+    if path.is_empty() || path == "." {
+        return Cow::Borrowed(cwd);
+    }
+
+    let mut out = String::with_capacity(cwd.len() + path.len() + 1);
+    let base = if path.starts_with('/') { "" } else { cwd };
+    for component in components(base).chain(components(path)) {
+        match component {
+            "." => {}
+            ".." => {
+                let parent = out.rfind('/').unwrap_or(0);
+                out.truncate(parent);
+            }
+            name => {
+                out.push('/');
+                out.push_str(name);
+            }
+        }
+    }
+    if out.is_empty() {
+        out.push('/');
+    }
+    Cow::Owned(out)
+}
@@ -1,247 +1,409 @@
 // RAM-based filesystem implementation
-
-use super::vfs::{FileSystem, File, Directory, VfsError};
-use alloc::string::{String, ToString};
-use alloc::vec::Vec;
+//
+// Directories and file extents are reference counted and copied on write:
+// a snapshot shares the whole tree, and a later write copies only the
+// directories on its path and the extents it changes.
+//
+// Metadata queries (exists, is_file, is_dir) resolve through a dentry cache
+// keyed by (parent directory ino, name hash), so repeated walks of the same
+// paths neither allocate nor touch the tree.
+
+use super::path::{self, components, name_hash};
+use super::vfs::{FileSystem, VfsError};
+use alloc::borrow::Cow;
 use alloc::collections::BTreeMap;
+use alloc::string::String;
+use alloc::sync::Arc;
+use alloc::vec::Vec;
+use core::sync::atomic::{AtomicU64, Ordering};
+use spin::Mutex;
 
-pub struct RamFs {
-    root: Directory,
-    // Cache for quick path lookups (reserved for future optimization)
-    #[allow(dead_code)]
-    path_cache: BTreeMap<String, Vec<String>>,
+/// Largest piece of file content shared between snapshots
+const EXTENT_SIZE: usize = 4096;
+
+/// File contents as a list of immutable, shareable extents
+#[derive(Clone, Default)]
+struct FileData {
+    extents: Vec<Arc<[u8]>>,
+    len: usize,
 }
 
-impl RamFs {
-    pub fn new() -> Self {
-        RamFs {
-            root: Directory::new("/".to_string()),
-            path_cache: BTreeMap::new(),
+impl FileData {
+    fn new(content: &[u8]) -> Self {
+        FileData {
+            extents: content.chunks(EXTENT_SIZE).map(Arc::from).collect(),
+            len: content.len(),
         }
     }
 
-    /// Parse a path into components (returns owned Strings to avoid lifetime issues)
-    fn parse_path(&self, path: &str) -> Result<Vec<String>, VfsError> {
-        if !path.starts_with('/') {
-            return Err(VfsError::InvalidPath);
+    /// Append without touching full extents, which stay shared
+    fn append(&mut self, mut data: &[u8]) {
+        self.len += data.len();
+        if let Some(last) = self.extents.last_mut() {
+            let room = EXTENT_SIZE - last.len();
+            if room > 0 && !data.is_empty() {
+                let take = room.min(data.len());
+                let mut merged = Vec::with_capacity(last.len() + take);
+                merged.extend_from_slice(last);
+                merged.extend_from_slice(&data[..take]);
+                *last = Arc::from(merged);
+                data = &data[take..];
+            }
         }
-
-        let components: Vec<String> = path
-            .trim_start_matches('/')
-            .split('/')
-            .filter(|s| !s.is_empty())
-            .map(|s| s.to_string())
-            .collect();
-
-        Ok(components)
+        self.extents.extend(data.chunks(EXTENT_SIZE).map(Arc::from));
     }
 
-    /// Navigate to a directory given a path
-    #[allow(dead_code)]
-    fn navigate_to_dir(&self, path: &str) -> Result<&Directory, VfsError> {
-        if path == "/" {
-            return Ok(&self.root);
+    /// Borrow single-extent files; larger ones are stitched together
+    fn bytes(&self) -> Cow<'_, [u8]> {
+        match self.extents.as_slice() {
+            [] => Cow::Borrowed(&[]),
+            [only] => Cow::Borrowed(only),
+            extents => {
+                let mut content = Vec::with_capacity(self.len);
+                for extent in extents {
+                    content.extend_from_slice(extent);
+                }
+                Cow::Owned(content)
+            }
         }
+    }
+}
 
-        let components = self.parse_path(path)?;
-        let _current_dir = &self.root;
+#[derive(Clone)]
+enum Node {
+    File(FileData),
+    Dir(Arc<Dir>),
+}
 
-        for component in &components {
-            let entry = _current_dir
-                .find(component)
-                .ok_or(VfsError::NotFound)?;
+/// Source of directory inode numbers
+static NEXT_INO: AtomicU64 = AtomicU64::new(1);
 
-            if !entry.is_dir() {
-                return Err(VfsError::NotADirectory);
-            }
+/// A directory; copies made by copy-on-write keep the original's ino
+#[derive(Clone)]
+struct Dir {
+    ino: u64,
+    /// Keyed by interned names
+    entries: BTreeMap<Arc<str>, Node>,
+}
 
-            // For directory entries, we need to get subdirectories
-            // This is a simplified approach; in reality, we'd need a more complex structure
-            return Err(VfsError::NotADirectory);
+impl Dir {
+    fn new() -> Self {
+        Dir {
+            ino: NEXT_INO.fetch_add(1, Ordering::Relaxed),
+            entries: BTreeMap::new(),
         }
+    }
+}
 
-        Ok(_current_dir)
+/// Split an absolute path into its parent and final component
+fn split_path(path: &str) -> Result<(&str, &str), VfsError> {
+    if !path.starts_with('/') {
+        return Err(VfsError::InvalidPath);
     }
+    let path = path.trim_end_matches('/');
+    // The root itself has no parent
+    let pos = path.rfind('/').ok_or(VfsError::InvalidPath)?;
+    Ok((&path[..pos.max(1)], &path[pos + 1..]))
+}
 
-    /// Navigate to a directory (mutable)
-    #[allow(dead_code)]
-    fn navigate_to_dir_mut(&mut self, path: &str) -> Result<&mut Directory, VfsError> {
-        if path == "/" {
-            return Ok(&mut self.root);
-        }
+fn walk<'a>(root: &'a Dir, path: &str) -> Result<&'a Dir, VfsError> {
+    if !path.starts_with('/') {
+        return Err(VfsError::InvalidPath);
+    }
+    let mut dir = root;
+    for name in components(path) {
+        dir = match dir.entries.get(name) {
+            Some(Node::Dir(child)) => child,
+            Some(Node::File(_)) => return Err(VfsError::NotADirectory),
+            None => return Err(VfsError::NotFound),
+        };
+    }
+    Ok(dir)
+}
 
-        let _components = self.parse_path(path)?;
-        
-        // We need to track the directory hierarchy
-        // For now, we'll use a simpler flat structure with full paths
-        Err(VfsError::NotFound)
+/// Walk to a directory for writing, unsharing it and its ancestors
+fn walk_mut<'a>(root: &'a mut Arc<Dir>, path: &str) -> Result<&'a mut Dir, VfsError> {
+    // Check first so a failed write leaves shared directories shared
+    walk(root, path)?;
+    let mut dir = Arc::make_mut(root);
+    for name in components(path) {
+        dir = match dir.entries.get_mut(name) {
+            Some(Node::Dir(child)) => Arc::make_mut(child),
+            _ => unreachable!("path checked above"),
+        };
     }
+    Ok(dir)
+}
 
-    /// Get the parent path and file name
-    #[allow(dead_code)]
-    fn split_path(&self, path: &str) -> Result<(String, String), VfsError> {
-        let components = self.parse_path(path)?;
-        
-        if components.is_empty() {
-            return Err(VfsError::InvalidPath);
-        }
+/// What a name resolved to, as remembered by the dentry cache
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum Lookup {
+    Missing,
+    File,
+    Dir(u64),
+}
 
-        let filename = components.last().unwrap().clone();
-        
-        let parent_path = if components.len() == 1 {
-            "/".to_string()
-        } else {
-            let parent_components = &components[..components.len() - 1];
-            alloc::format!("/{}", parent_components.join("/"))
-        };
+/// Entries kept before the dentry cache is dropped and refilled
+const DCACHE_ENTRIES: usize = 512;
 
-        Ok((parent_path, filename))
-    }
+#[derive(Default)]
+struct DentryCache {
+    /// (parent ino, name hash) -> name and what it resolves to
+    entries: BTreeMap<(u64, u64), (Arc<str>, Lookup)>,
+    hits: u64,
+    misses: u64,
+}
 
-    /// Find a file entry by full path
-    fn find_entry(&self, path: &str) -> Option<&File> {
-        if path == "/" {
-            return None;
+impl DentryCache {
+    fn get(&self, parent: u64, name: &str) -> Option<Lookup> {
+        match self.entries.get(&(parent, name_hash(name))) {
+            // Hashes may collide; the stored name settles it
+            Some((cached, lookup)) if **cached == *name => Some(*lookup),
+            _ => None,
         }
+    }
 
-        let components = self.parse_path(path).ok()?;
-        
-        if components.is_empty() {
-            return None;
+    fn insert(&mut self, parent: u64, name: Arc<str>, lookup: Lookup) {
+        if self.entries.len() >= DCACHE_ENTRIES {
+            self.entries.clear();
+            // Names of removed entries may have been pinned only here
+            path::sweep();
         }
+        self.entries.insert((parent, name_hash(&name)), (name, lookup));
+    }
 
-        // For a simple implementation, store files flat in root
-        // with their full path as the name
-        self.root.find(path)
+    fn invalidate(&mut self, parent: u64, name: &str) {
+        self.entries.remove(&(parent, name_hash(name)));
     }
+}
 
-    /// Find a file entry by full path (mutable)
-    fn find_entry_mut(&mut self, path: &str) -> Option<&mut File> {
-        if path == "/" {
-            return None;
+pub struct RamFs {
+    root: Arc<Dir>,
+    dcache: Mutex<DentryCache>,
+}
+
+impl RamFs {
+    pub fn new() -> Self {
+        RamFs {
+            root: Arc::new(Dir::new()),
+            dcache: Mutex::new(DentryCache::default()),
         }
+    }
 
-        let components = self.parse_path(path).ok()?;
-        
-        if components.is_empty() {
-            return None;
+    /// Capture the current tree in O(1)
+    ///
+    /// The snapshot is a RamFs of its own: it can be read while this one
+    /// keeps changing, or handed back to `restore`.
+    pub fn snapshot(&self) -> RamFs {
+        RamFs {
+            root: Arc::clone(&self.root),
+            dcache: Mutex::new(DentryCache::default()),
         }
+    }
 
-        self.root.find_mut(path)
+    /// Roll the tree back to a snapshot in O(1)
+    pub fn restore(&mut self, snapshot: &RamFs) {
+        self.root = Arc::clone(&snapshot.root);
+        *self.dcache.lock() = DentryCache::default();
+        path::sweep();
     }
-}
 
-impl FileSystem for RamFs {
-    fn create_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
-        if self.exists(path) {
-            return Err(VfsError::AlreadyExists);
+    fn dir(&self, path: &str) -> Result<&Dir, VfsError> {
+        walk(&self.root, path)
+    }
+
+    fn node(&self, path: &str) -> Result<&Node, VfsError> {
+        let (parent, name) = split_path(path)?;
+        self.dir(parent)?.entries.get(name).ok_or(VfsError::NotFound)
+    }
+
+    fn file(&self, path: &str) -> Result<&FileData, VfsError> {
+        match self.node(path)? {
+            Node::File(data) => Ok(data),
+            Node::Dir(_) => Err(VfsError::NotAFile),
         }
+    }
 
-        let file = File::new(
-            path.to_string(),
-            content.to_vec(),
-        );
+    /// Resolve what `path` names, through the dentry cache
+    ///
+    /// The tree is only walked from the first component the cache misses.
+    fn lookup(&self, path: &str) -> Result<Lookup, VfsError> {
+        if !path.starts_with('/') {
+            return Err(VfsError::InvalidPath);
+        }
+        let mut cache = self.dcache.lock();
+        let mut current = Lookup::Dir(self.root.ino);
+        // Position in the tree, known only while walking after a miss
+        let mut dir: Option<&Dir> = Some(&self.root);
+        let mut offset = 0;
+
+        for name in path.split('/') {
+            let start = offset;
+            offset += name.len() + 1;
+            if name.is_empty() {
+                continue;
+            }
+            let parent = match current {
+                Lookup::Dir(ino) => ino,
+                Lookup::File => return Err(VfsError::NotADirectory),
+                Lookup::Missing => return Err(VfsError::NotFound),
+            };
+
+            if let Some(hit) = cache.get(parent, name) {
+                cache.hits += 1;
+                current = hit;
+                dir = None;
+                continue;
+            }
 
-        self.root.add_file(file)?;
-        Ok(())
+            cache.misses += 1;
+            let parent_dir = match dir {
+                Some(d) => d,
+                None => self.dir(&path[..start])?,
+            };
+            let (key, lookup, next) = match parent_dir.entries.get_key_value(name) {
+                Some((key, Node::Dir(child))) => (Arc::clone(key), Lookup::Dir(child.ino), Some(&**child)),
+                Some((key, Node::File(_))) => (Arc::clone(key), Lookup::File, None),
+                None => (Arc::from(name), Lookup::Missing, None),
+            };
+            cache.insert(parent, key, lookup);
+            current = lookup;
+            dir = next;
+        }
+        Ok(current)
     }
 
-    fn create_dir(&mut self, path: &str) -> Result<(), VfsError> {
-        if self.exists(path) {
+    fn insert(&mut self, path: &str, node: Node) -> Result<(), VfsError> {
+        let (parent, name) = split_path(path)?;
+        let dir = walk_mut(&mut self.root, parent)?;
+        if dir.entries.contains_key(name) {
             return Err(VfsError::AlreadyExists);
         }
+        // Drop any negative entry for the new name
+        self.dcache.lock().invalidate(dir.ino, name);
+        dir.entries.insert(path::intern(name), node);
+        Ok(())
+    }
 
-        let dir = File::new_dir(path.to_string());
-        self.root.add_file(dir)?;
+    /// Apply `update` to an existing file, or create it from `content`
+    fn upsert(&mut self, path: &str, content: &[u8], update: impl FnOnce(&mut FileData)) -> Result<(), VfsError> {
+        let (parent, name) = split_path(path)?;
+        match self.dir(parent)?.entries.get(name) {
+            Some(Node::Dir(_)) => return Err(VfsError::NotAFile),
+            None => return self.insert(path, Node::File(FileData::new(content))),
+            Some(Node::File(_)) => {}
+        }
+        if let Some(Node::File(data)) = walk_mut(&mut self.root, parent)?.entries.get_mut(name) {
+            update(data);
+        }
         Ok(())
     }
 
+    /// Remove and return an entry, invalidating its cached lookup
+    fn take(&mut self, path: &str) -> Result<Node, VfsError> {
+        let (parent, name) = split_path(path)?;
+        self.node(path)?;
+        let dir = walk_mut(&mut self.root, parent)?;
+        self.dcache.lock().invalidate(dir.ino, name);
+        Ok(dir.entries.remove(name).unwrap())
+    }
+}
+
+impl FileSystem for RamFs {
+    fn create_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
+        self.insert(path, Node::File(FileData::new(content)))
+    }
+
+    fn create_dir(&mut self, path: &str) -> Result<(), VfsError> {
+        self.insert(path, Node::Dir(Arc::new(Dir::new())))
+    }
+
     fn read_file(&self, path: &str) -> Result<Vec<u8>, VfsError> {
-        let file = self.find_entry(path).ok_or(VfsError::NotFound)?;
-        
-        if !file.is_file() {
-            return Err(VfsError::NotAFile);
-        }
+        Ok(self.file(path)?.bytes().into_owned())
+    }
 
-        Ok(file.content.clone())
+    fn read_file_bytes(&self, path: &str) -> Result<Cow<'_, [u8]>, VfsError> {
+        Ok(self.file(path)?.bytes())
     }
 
     fn read_file_to_string(&self, path: &str) -> Result<String, VfsError> {
-        let file = self.find_entry(path).ok_or(VfsError::NotFound)?;
-        
-        if !file.is_file() {
-            return Err(VfsError::NotAFile);
-        }
-
-        file.read_to_string()
+        String::from_utf8(self.read_file(path)?)
+            .map_err(|_| VfsError::IoError)
     }
 
     fn write_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError> {
-        if let Some(file) = self.find_entry_mut(path) {
-            if !file.is_file() {
-                return Err(VfsError::NotAFile);
-            }
-            file.content = content.to_vec();
-            Ok(())
-        } else {
-            self.create_file(path, content)
+        self.upsert(path, content, |data| *data = FileData::new(content))
+    }
+
+    fn append_file(&mut self, path: &str, data: &[u8]) -> Result<(), VfsError> {
+        self.upsert(path, data, |file| file.append(data))
+    }
+
+    fn rename(&mut self, from: &str, to: &str) -> Result<(), VfsError> {
+        let (from, to) = (from.trim_end_matches('/'), to.trim_end_matches('/'));
+        // A directory cannot move inside itself
+        if to.strip_prefix(from).is_some_and(|rest| rest.is_empty() || rest.starts_with('/')) {
+            return Err(VfsError::InvalidPath);
+        }
+        let (parent, _) = split_path(to)?;
+        self.node(from)?;
+        self.dir(parent)?;
+        if self.node(to).is_ok() {
+            return Err(VfsError::AlreadyExists);
         }
+        let node = self.take(from)?;
+        self.insert(to, node)?;
+        path::release(split_path(from)?.1);
+        Ok(())
     }
 
     fn delete(&mut self, path: &str) -> Result<(), VfsError> {
-        self.root.remove(path)
+        let node = self.take(path)?;
+        let subtree = matches!(node, Node::Dir(_));
+        drop(node);
+        // Let go of names only the removed entries used
+        if subtree {
+            path::sweep();
+        } else {
+            path::release(split_path(path)?.1);
+        }
+        Ok(())
     }
 
     fn exists(&self, path: &str) -> bool {
-        self.find_entry(path).is_some()
+        matches!(self.lookup(path), Ok(Lookup::File | Lookup::Dir(_)))
     }
 
     fn is_file(&self, path: &str) -> bool {
-        self.find_entry(path)
-            .map(|f| f.is_file())
-            .unwrap_or(false)
+        matches!(self.lookup(path), Ok(Lookup::File))
     }
 
     fn is_dir(&self, path: &str) -> bool {
-        if path == "/" {
-            return true;
-        }
-        self.find_entry(path)
-            .map(|f| f.is_dir())
-            .unwrap_or(false)
+        matches!(self.lookup(path), Ok(Lookup::Dir(_)))
     }
 
     fn list_dir(&self, path: &str) -> Result<Vec<String>, VfsError> {
-        if path == "/" {
-            // Return all entries in root
-            return Ok(self.root.entries.iter()
-                .map(|f| f.name.clone())
-                .collect());
-        }
-
-        // For directories, find entries that start with this path
-        let prefix = if path.ends_with('/') {
-            path.to_string()
-        } else {
-            alloc::format!("{}/", path)
-        };
-
-        let mut entries = Vec::new();
-        for file in &self.root.entries {
-            if file.name.starts_with(&prefix) {
-                // Get the relative name (just the next component)
-                let relative = file.name.trim_start_matches(&prefix);
-                if !relative.contains('/') {
-                    entries.push(file.name.clone());
-                }
-            }
-        }
-
-        if entries.is_empty() && !self.is_dir(path) {
-            return Err(VfsError::NotFound);
-        }
+        let dir = self.dir(path)?;
+        let prefix = path.trim_end_matches('/');
+        Ok(dir.entries.keys()
+            .map(|name| {
+                let mut full = String::with_capacity(prefix.len() + 1 + name.len());
+                full.push_str(prefix);
+                full.push('/');
+                full.push_str(name);
+                full
+            })
+            .collect())
+    }
 
-        Ok(entries)
+    fn counters(&self) -> Vec<(&'static str, u64)> {
+        let cache = self.dcache.lock();
+        alloc::vec![
+            ("Dentry cache entries", cache.entries.len() as u64),
+            ("Dentry cache hits", cache.hits),
+            ("Dentry cache misses", cache.misses),
+            ("Interned names", path::interned() as u64),
+        ]
     }
 }
 
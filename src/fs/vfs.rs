@@ -1,5 +1,6 @@
 // Virtual File System abstraction layer
 
+use alloc::borrow::Cow;
 use alloc::string::String;
 use alloc::vec::Vec;
 
@@ -18,6 +19,9 @@ pub enum VfsError {
     InvalidPath,
     NotInitialized,
     IoError,
+    ReadOnly,
+    NoSpace,
+    Corrupted,
 }
 
 impl core::fmt::Display for VfsError {
@@ -30,6 +34,9 @@ impl core::fmt::Display for VfsError {
             VfsError::InvalidPath => write!(f, "Invalid path"),
             VfsError::NotInitialized => write!(f, "Filesystem not initialized"),
             VfsError::IoError => write!(f, "I/O error"),
+            VfsError::ReadOnly => write!(f, "Read-only filesystem"),
+            VfsError::NoSpace => write!(f, "No space left on device"),
+            VfsError::Corrupted => write!(f, "Filesystem is corrupted or not formatted"),
         }
     }
 }
@@ -122,6 +129,8 @@ pub trait FileSystem {
     fn create_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError>;
     fn create_dir(&mut self, path: &str) -> Result<(), VfsError>;
     fn read_file(&self, path: &str) -> Result<Vec<u8>, VfsError>;
+    /// Borrow a file's contents, copying only if the backend must
+    fn read_file_bytes(&self, path: &str) -> Result<Cow<'_, [u8]>, VfsError>;
     fn read_file_to_string(&self, path: &str) -> Result<String, VfsError>;
     fn write_file(&mut self, path: &str, content: &[u8]) -> Result<(), VfsError>;
     fn delete(&mut self, path: &str) -> Result<(), VfsError>;
@@ -129,4 +138,47 @@ pub trait FileSystem {
     fn is_file(&self, path: &str) -> bool;
     fn is_dir(&self, path: &str) -> bool;
     fn list_dir(&self, path: &str) -> Result<Vec<String>, VfsError>;
+
+    /// Append to a file, creating it if needed
+    fn append_file(&mut self, path: &str, data: &[u8]) -> Result<(), VfsError> {
+        if !self.exists(path) {
+            return self.create_file(path, data);
+        }
+        let mut content = self.read_file(path)?;
+        content.extend_from_slice(data);
+        self.write_file(path, &content)
+    }
+
+    /// Move a file or directory to a new path
+    ///
+    /// The default copies a file and deletes the original; backends that
+    /// can relink entries should override it.
+    fn rename(&mut self, from: &str, to: &str) -> Result<(), VfsError> {
+        if !self.is_file(from) {
+            return Err(if self.exists(from) { VfsError::NotAFile } else { VfsError::NotFound });
+        }
+        if self.exists(to) {
+            return Err(VfsError::AlreadyExists);
+        }
+        let content = self.read_file(from)?;
+        self.create_file(to, &content)?;
+        self.delete(from)
+    }
+
+    /// Make completed writes durable (no-op for memory-backed filesystems)
+    fn sync(&mut self) -> Result<(), VfsError> {
+        Ok(())
+    }
+
+    /// Write up to `max_pages` of the filesystem's dirty page-cache pages
+    /// to its device, without the cost of a full `sync`; returns how many
+    /// were written (none for filesystems that don't use the page cache)
+    fn write_back(&mut self, _max_pages: usize) -> Result<usize, VfsError> {
+        Ok(0)
+    }
+
+    /// Backend-specific counters as (label, value) pairs, for diagnostics
+    fn counters(&self) -> Vec<(&'static str, u64)> {
+        Vec::new()
+    }
 }
@@ -5,8 +5,15 @@ use crate::vga_buffer::{Color, WRITER};
 use core::fmt::Write;
 use x86_64::instructions::interrupts;
 
+pub mod compositor;
+pub mod font;
+pub mod framebuffer;
+pub mod hw_cursor;
+pub mod raster;
+pub mod region;
 pub mod text_graphics;
 pub mod vga_graphics;
+pub mod vsync;
 pub mod splash;
 pub mod demo;
 
@@ -35,16 +42,8 @@ pub fn draw_progress_bar(progress: usize, total: usize, width: usize) {
 
 /// Clear a specific region of the screen
 pub fn clear_region(x: usize, y: usize, width: usize, height: usize) {
-    interrupts::without_interrupts(|| {
-        let _writer = WRITER.lock();
-        let buffer = unsafe { &mut *(0xb8000 as *mut [[u16; 80]; 25]) };
-        
-        for row in y..(y + height).min(25) {
-            for col in x..(x + width).min(80) {
-                buffer[row][col] = 0x0720; // Black background, white space
-            }
-        }
-    });
+    // Black background, white space
+    compositor::draw(|c| c.fill(x, y, width, height, compositor::cell(b' ', Color::LightGray, Color::Black)));
 }
 
 /// Set colors for subsequent text output
@@ -0,0 +1,282 @@
+/// Double-buffered compositor for the 80x25 text screen
+///
+/// Text-graphics primitives draw into an off-screen back buffer instead of
+/// VGA memory. A flush walks the cells drawn since the previous flush,
+/// compares each with a shadow of what the screen holds and writes only the
+/// ones that differ, so repainting a desktop whose content barely moved
+/// costs a few MMIO writes instead of thousands of overlapping ones.
+///
+/// Drawing between `begin_frame` and `end_frame` (or while a `Frame` guard
+/// is alive) is flushed once at the end, so intermediate states such as a
+/// background cleared under a window never reach the screen. Outside a
+/// frame every primitive flushes right away, as before.
+///
+/// Only cells drawn since the last flush are ever written, so text the
+/// console writer put on screen in between is not painted over with stale
+/// back-buffer content. Anything that writes VGA memory directly calls
+/// `invalidate` instead, and the next flush writes its cells unconditionally.
+///
+/// A clip region set with `set_clip` limits drawing to its cells, which is
+/// how the window manager repaints only damaged, unoccluded parts.
+
+use core::sync::atomic::{AtomicBool, Ordering};
+use spin::Mutex;
+use x86_64::instructions::interrupts;
+use crate::vga_buffer::{Color, BUFFER_HEIGHT, BUFFER_WIDTH};
+use super::region::Region;
+
+const CELLS: usize = BUFFER_WIDTH * BUFFER_HEIGHT;
+
+/// Row mask with a bit for every column
+const FULL_ROW: u128 = (1 << BUFFER_WIDTH) - 1;
+
+/// Row mask of `width` columns from `x`, clipped to the screen
+fn span(x: usize, width: usize) -> u128 {
+    let end = x.saturating_add(width).min(BUFFER_WIDTH);
+    if x >= end { 0 } else { (u128::MAX >> (128 - (end - x))) << x }
+}
+
+/// A text-mode cell as VGA memory stores it: character, then attribute
+///
+/// The mouse pointer is the hardware cursor, which the VGA paints in the
+/// cell's foreground color. A blank cell shows no foreground, and one whose
+/// foreground matches its background shows none that differs, so both get
+/// a foreground that stands out from the background instead; the pointer
+/// then shows over every fill.
+pub const fn cell(ch: u8, fg: Color, bg: Color) -> u16 {
+    let fg = match ch {
+        b' ' | 0x00 | 0xff => contrast(bg),
+        _ if fg as u8 == bg as u8 => contrast(bg),
+        _ => fg as u8,
+    };
+    ((bg as u16) << 12) | ((fg as u16) << 8) | ch as u16
+}
+
+/// A foreground color that stands out from background `bg`; with blinking
+/// enabled a background shows only its low three bits
+const fn contrast(bg: Color) -> u8 {
+    if bg as u8 & 0x7 == Color::LightGray as u8 { Color::Black as u8 } else { Color::White as u8 }
+}
+
+/// Set when VGA memory was written behind the compositor's back
+static SCREEN_CHANGED: AtomicBool = AtomicBool::new(false);
+
+static COMPOSITOR: Mutex<Compositor> = Mutex::new(Compositor::new());
+
+/// Counters of the work flushes did
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Stats {
+    pub flushes: u64,
+    /// Cells drawn and compared against the shadow
+    pub drawn: u64,
+    /// Cells that differed and were written to VGA memory
+    pub written: u64,
+}
+
+impl Stats {
+    /// Work done since the counters read `start`
+    pub fn since(&self, start: &Stats) -> Stats {
+        Stats {
+            flushes: self.flushes - start.flushes,
+            drawn: self.drawn - start.drawn,
+            written: self.written - start.written,
+        }
+    }
+}
+
+/// Back buffer, screen shadow and the bookkeeping between them
+pub struct Compositor {
+    back: [u16; CELLS],
+    shadow: [u16; CELLS],
+    /// Per row, a bit for each column drawn since the last flush
+    dirty: [u128; BUFFER_HEIGHT],
+    /// Per row, a bit for each column whose shadow matches the screen
+    known: [u128; BUFFER_HEIGHT],
+    /// Per row, a bit for each column drawing may change
+    clip: [u128; BUFFER_HEIGHT],
+    depth: u32,
+    stats: Stats,
+    /// Counters when the current interaction began
+    interaction: Option<Stats>,
+    last_interaction: Option<Stats>,
+}
+
+impl Compositor {
+    pub const fn new() -> Self {
+        Self {
+            back: [0; CELLS],
+            shadow: [0; CELLS],
+            dirty: [0; BUFFER_HEIGHT],
+            known: [0; BUFFER_HEIGHT],
+            clip: [FULL_ROW; BUFFER_HEIGHT],
+            depth: 0,
+            stats: Stats { flushes: 0, drawn: 0, written: 0 },
+            interaction: None,
+            last_interaction: None,
+        }
+    }
+
+    /// Draw one cell; positions off screen or outside the clip are ignored
+    pub fn put(&mut self, x: usize, y: usize, cell: u16) {
+        if x < BUFFER_WIDTH && y < BUFFER_HEIGHT && self.clip[y] & (1 << x) != 0 {
+            self.back[y * BUFFER_WIDTH + x] = cell;
+            self.dirty[y] |= 1 << x;
+        }
+    }
+
+    /// Fill a rectangle, clipped to the screen and the clip region
+    pub fn fill(&mut self, x: usize, y: usize, width: usize, height: usize, cell: u16) {
+        let mask = span(x, width);
+        if mask == 0 {
+            return;
+        }
+        for row in y..y.saturating_add(height).min(BUFFER_HEIGHT) {
+            let base = row * BUFFER_WIDTH;
+            let cols = mask & self.clip[row];
+            if cols == mask {
+                self.back[base + x..base + x + mask.count_ones() as usize].fill(cell);
+            } else {
+                let mut bits = cols;
+                while bits != 0 {
+                    self.back[base + bits.trailing_zeros() as usize] = cell;
+                    bits &= bits - 1;
+                }
+            }
+            self.dirty[row] |= cols;
+        }
+    }
+
+    /// Limit drawing to `region`, or lift the limit with `None`
+    pub fn set_clip(&mut self, region: Option<&Region>) {
+        match region {
+            None => self.clip = [FULL_ROW; BUFFER_HEIGHT],
+            Some(region) => {
+                self.clip = [0; BUFFER_HEIGHT];
+                for rect in region.rects() {
+                    let mask = span(rect.x, rect.w);
+                    for row in rect.y..rect.bottom().min(BUFFER_HEIGHT) {
+                        self.clip[row] |= mask;
+                    }
+                }
+            }
+        }
+    }
+
+    /// Forget what the screen holds, so the next flush writes every cell drawn
+    pub fn forget(&mut self) {
+        self.known = [0; BUFFER_HEIGHT];
+    }
+
+    /// Hand every drawn cell that differs from the screen to `write`, with
+    /// its index in VGA memory
+    pub fn flush(&mut self, mut write: impl FnMut(usize, u16)) {
+        self.stats.flushes += 1;
+        for row in 0..BUFFER_HEIGHT {
+            let mut bits = core::mem::take(&mut self.dirty[row]);
+            while bits != 0 {
+                let col = bits.trailing_zeros() as usize;
+                bits &= bits - 1;
+                let at = row * BUFFER_WIDTH + col;
+                let cell = self.back[at];
+                self.stats.drawn += 1;
+                if self.known[row] & (1 << col) == 0 || self.shadow[at] != cell {
+                    write(at, cell);
+                    self.shadow[at] = cell;
+                    self.known[row] |= 1 << col;
+                    self.stats.written += 1;
+                }
+            }
+        }
+    }
+
+    pub fn stats(&self) -> Stats {
+        self.stats
+    }
+
+    /// Flush to VGA memory
+    fn present(&mut self) {
+        if SCREEN_CHANGED.swap(false, Ordering::Relaxed) {
+            self.forget();
+        }
+        let vga = 0xb8000 as *mut u16;
+        // SAFETY: 0xb8000 is identity-mapped VGA text memory and `at` is
+        // below 80 * 25.
+        self.flush(|at, cell| unsafe { core::ptr::write_volatile(vga.add(at), cell) });
+    }
+}
+
+/// Draw into the back buffer; flushed now unless a frame is open
+pub fn draw<R>(f: impl FnOnce(&mut Compositor) -> R) -> R {
+    interrupts::without_interrupts(|| {
+        let mut compositor = COMPOSITOR.lock();
+        let result = f(&mut compositor);
+        if compositor.depth == 0 {
+            compositor.present();
+        }
+        result
+    })
+}
+
+/// Hold back flushes until the matching `end_frame`; frames nest
+pub fn begin_frame() {
+    interrupts::without_interrupts(|| COMPOSITOR.lock().depth += 1);
+}
+
+/// Close a frame, flushing everything drawn in it when it is the outermost
+pub fn end_frame() {
+    draw(|compositor| compositor.depth = compositor.depth.saturating_sub(1));
+}
+
+/// A frame closed when dropped, so early returns still flush
+pub struct Frame(());
+
+impl Frame {
+    pub fn begin() -> Self {
+        begin_frame();
+        Frame(())
+    }
+}
+
+impl Drop for Frame {
+    fn drop(&mut self) {
+        end_frame();
+    }
+}
+
+/// Limit drawing to `region` until `set_clip(None)`
+pub fn set_clip(region: Option<&Region>) {
+    interrupts::without_interrupts(|| COMPOSITOR.lock().set_clip(region));
+}
+
+/// Start counting the work of one user interaction, such as a window drag
+pub fn begin_interaction() {
+    interrupts::without_interrupts(|| {
+        let mut compositor = COMPOSITOR.lock();
+        compositor.interaction = Some(compositor.stats);
+    });
+}
+
+/// Stop counting and keep the totals for `last_interaction`
+pub fn end_interaction() {
+    interrupts::without_interrupts(|| {
+        let mut compositor = COMPOSITOR.lock();
+        if let Some(start) = compositor.interaction.take() {
+            compositor.last_interaction = Some(compositor.stats.since(&start));
+        }
+    });
+}
+
+/// Work done by the last interaction that ended
+pub fn last_interaction() -> Option<Stats> {
+    interrupts::without_interrupts(|| COMPOSITOR.lock().last_interaction)
+}
+
+/// Record that VGA memory was written without the compositor
+pub fn invalidate() {
+    SCREEN_CHANGED.store(true, Ordering::Relaxed);
+}
+
+/// Flush counters since boot
+pub fn stats() -> Stats {
+    interrupts::without_interrupts(|| COMPOSITOR.lock().stats)
+}
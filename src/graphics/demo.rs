@@ -181,6 +181,126 @@ fn show_escape_hint() {
     write_centered(23, "Press ESC to return to the main menu", Color::LightGray, Color::Black);
 }
 
+/// What `run_framebuffer_demo` measured
+pub struct FramebufferDemoStats {
+    pub frames: u64,
+    pub ms: u64,
+    /// Rasterizer counters of the last frame
+    pub raster: crate::graphics::raster::Stats,
+}
+
+/// Animate bouncing boxes and a triangle fan on the linear framebuffer for
+/// `duration_ms`, or until ESC. Each frame is binned and drawn by the tile
+/// rasterizer into the back buffer, then presented with one copy.
+pub fn run_framebuffer_demo(width: usize, height: usize, duration_ms: u64) -> Result<FramebufferDemoStats, &'static str> {
+    use crate::graphics::framebuffer::{rgb, Framebuffer};
+    use crate::graphics::raster::TileRenderer;
+    use crate::interrupts::uptime_ms;
+
+    const BOXES: usize = 12;
+    const SIZE: i32 = 64;
+    const FAN: i32 = 8;
+    if width <= SIZE as usize || height <= SIZE as usize {
+        return Err("resolution too small for the demo");
+    }
+    let mut fb = Framebuffer::new(width, height)?;
+    let mut raster = TileRenderer::new(width, height);
+    let (w, h) = (width as i32, height as i32);
+    let mut boxes = [(0i32, 0i32, 0i32, 0i32, 0u32); BOXES];
+    for (i, b) in boxes.iter_mut().enumerate() {
+        let i = i as i32;
+        *b = (
+            (i * 97) % (w - SIZE),
+            (i * 61) % (h - SIZE),
+            if i % 2 == 0 { 3 + i % 4 } else { -3 - i % 4 },
+            if i % 3 == 0 { 2 + i % 5 } else { -2 - i % 5 },
+            rgb((i * 40) as u8, (255 - i * 20) as u8, (128 + i * 10) as u8),
+        );
+    }
+
+    let start = uptime_ms();
+    let shown_before = fb.frames();
+    while uptime_ms() - start < duration_ms && !escape_pressed() {
+        let frame = (fb.frames() - shown_before) as i32;
+        raster.begin(rgb(0, 0, 48));
+        for x in (0..w).step_by(64) {
+            raster.fill_rect(x, 0, 1, h, rgb(0, 0, 96));
+        }
+        for y in (0..h).step_by(64) {
+            raster.fill_rect(0, y, w, 1, rgb(0, 0, 96));
+        }
+        // A fan of triangles around the centre whose tips slide along the edges
+        let centre = (w / 2, h / 2);
+        let slide = frame * 8 % w;
+        for i in 0..FAN {
+            let tip = |n: i32| ((slide + n * w / FAN) % w, if n % 2 == 0 { 0 } else { h - 1 });
+            raster.fill_triangle(centre, tip(i), tip(i + 1),
+                rgb((i * 30) as u8, 64, (255 - i * 30) as u8));
+        }
+        raster.draw_line(w / 2, h - 1, slide, 0, rgb(255, 255, 0));
+        for b in boxes.iter_mut() {
+            b.0 += b.2;
+            b.1 += b.3;
+            if b.0 < 0 || b.0 > w - SIZE {
+                b.2 = -b.2;
+                b.0 = b.0.clamp(0, w - SIZE);
+            }
+            if b.1 < 0 || b.1 > h - SIZE {
+                b.3 = -b.3;
+                b.1 = b.1.clamp(0, h - SIZE);
+            }
+            raster.fill_rect(b.0, b.1, SIZE, SIZE, b.4);
+            raster.draw_rect(b.0, b.1, SIZE, SIZE, rgb(255, 255, 255));
+        }
+        raster.render(fb.pixels_mut(), width);
+        fb.present();
+    }
+    Ok(FramebufferDemoStats {
+        frames: fb.frames() - shown_before,
+        ms: uptime_ms() - start,
+        raster: raster.stats(),
+    })
+}
+
+/// Redraw a full screen of text every frame on the linear framebuffer for
+/// `duration_ms`, or until ESC, the way a graphical terminal would;
+/// returns the frames shown, the milliseconds they took and the glyph
+/// cache counters
+pub fn run_text_demo(width: usize, height: usize, font: alloc::sync::Arc<crate::graphics::font::Font>,
+                     duration_ms: u64) -> Result<(u64, u64, crate::graphics::font::Stats), &'static str> {
+    use alloc::string::String;
+    use crate::graphics::font::GlyphCache;
+    use crate::graphics::framebuffer::{rgb, Framebuffer};
+    use crate::interrupts::uptime_ms;
+
+    const COLORS: [(u32, u32); 4] = [
+        (rgb(170, 170, 170), rgb(0, 0, 0)),
+        (rgb(85, 255, 85), rgb(0, 0, 0)),
+        (rgb(255, 255, 85), rgb(0, 0, 170)),
+        (rgb(255, 255, 255), rgb(170, 0, 0)),
+    ];
+    let mut glyphs = GlyphCache::new(font);
+    let (cell_w, cell_h) = (glyphs.font().width(), glyphs.font().height());
+    let (cols, rows) = (width / cell_w, height / cell_h);
+    let mut fb = Framebuffer::new(width, height)?;
+    let mut line = String::with_capacity(cols);
+
+    let start = uptime_ms();
+    let shown_before = fb.frames();
+    while uptime_ms() - start < duration_ms && !escape_pressed() {
+        let frame = (fb.frames() - shown_before) as usize;
+        for row in 0..rows {
+            // Scrolling text so every frame differs
+            line.clear();
+            line.extend((0..cols).map(|col| (b' ' + ((frame + row * 7 + col) % 95) as u8) as char));
+            let (fg, bg) = COLORS[(row + frame / 8) % COLORS.len()];
+            glyphs.draw_text(fb.pixels_mut(), width, 0, row * cell_h, &line, fg, bg);
+        }
+        fb.present();
+    }
+    Ok((fb.frames() - shown_before, uptime_ms() - start, glyphs.stats()))
+}
+
 /// Show the full splash screen with loading animation
 pub fn show_boot_splash() {
     run_boot_sequence();
@@ -0,0 +1,289 @@
+/// Bitmap fonts and cached glyph rendering for 32-bpp graphics modes
+///
+/// A `Font` holds one bit per pixel, a row of bytes per glyph line, in the
+/// layout PSF files use. Fonts come from PSF1/PSF2 files or, at boot, from
+/// the 8x16 font the BIOS loaded into VGA plane 2, which becomes the
+/// system font.
+///
+/// `GlyphCache` draws text with a table per color pair that expands any
+/// glyph byte into its eight finished pixels. A glyph line is then one
+/// table lookup and a 32-byte copy per 8 pixels instead of a test and a
+/// store for every pixel. Text is drawn line by line across a whole run of
+/// characters, so writes to the target are sequential.
+
+use alloc::boxed::Box;
+use alloc::sync::Arc;
+use alloc::vec::Vec;
+use spin::Mutex;
+use crate::fs::FileSystem;
+use x86_64::instructions::interrupts;
+use x86_64::instructions::port::Port;
+use x86_64::VirtAddr;
+
+const PSF1_MAGIC: [u8; 2] = [0x36, 0x04];
+const PSF1_MODE_512: u8 = 0x01;
+const PSF2_MAGIC: [u8; 4] = [0x72, 0xb5, 0x4a, 0x86];
+
+/// Glyph slots VGA font memory has, 32 bytes apart
+const VGA_GLYPHS: usize = 256;
+const VGA_GLYPH_STRIDE: usize = 32;
+const VGA_FONT_HEIGHT: usize = 16;
+
+/// Color pairs a cache keeps expanded at once, 8 KiB each
+const MAX_PAIRS: usize = 8;
+
+static SYSTEM_FONT: Mutex<Option<Arc<Font>>> = Mutex::new(None);
+
+#[derive(Debug, Clone)]
+pub struct Font {
+    width: usize,
+    height: usize,
+    bytes_per_row: usize,
+    count: usize,
+    glyphs: Vec<u8>,
+}
+
+fn read_u32(data: &[u8], at: usize) -> Option<usize> {
+    data.get(at..at + 4).map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]) as usize)
+}
+
+impl Font {
+    /// Parse a PSF1 or PSF2 font
+    pub fn parse_psf(data: &[u8]) -> Result<Font, &'static str> {
+        let (width, height, count, glyph_size, offset) = if data.starts_with(&PSF1_MAGIC) {
+            let mode = *data.get(2).ok_or("truncated PSF1 header")?;
+            let height = *data.get(3).ok_or("truncated PSF1 header")? as usize;
+            let count = if mode & PSF1_MODE_512 != 0 { 512 } else { 256 };
+            (8, height, count, height, 4)
+        } else if data.starts_with(&PSF2_MAGIC) {
+            let header = read_u32(data, 8).ok_or("truncated PSF2 header")?;
+            let count = read_u32(data, 16).ok_or("truncated PSF2 header")?;
+            let glyph_size = read_u32(data, 20).ok_or("truncated PSF2 header")?;
+            let height = read_u32(data, 24).ok_or("truncated PSF2 header")?;
+            let width = read_u32(data, 28).ok_or("truncated PSF2 header")?;
+            (width, height, count, glyph_size, header)
+        } else {
+            return Err("not a PSF font");
+        };
+        if width == 0 || height == 0 || width > 32 || height > 64 || count == 0 {
+            return Err("unsupported glyph size");
+        }
+        let bytes_per_row = width.div_ceil(8);
+        if glyph_size != bytes_per_row * height {
+            return Err("glyph size does not match its dimensions");
+        }
+        let glyphs = data.get(offset..offset + count * glyph_size).ok_or("truncated glyph data")?;
+        Ok(Font { width, height, bytes_per_row, count, glyphs: glyphs.to_vec() })
+    }
+
+    /// Load a PSF font from the filesystem
+    pub fn load(path: &str) -> Result<Font, &'static str> {
+        let fs = crate::fs::root_fs().ok_or("no filesystem mounted")?;
+        let data = fs.lock().read_file(path).map_err(|_| "cannot read font file")?;
+        Font::parse_psf(&data)
+    }
+
+    /// Copy the font the BIOS loaded for text mode out of VGA plane 2
+    ///
+    /// Must run in text mode. The sequencer and graphics controller are
+    /// switched to plain plane-2 access for the copy and put back after.
+    ///
+    /// # Safety
+    /// Physical memory must be mapped at `physical_memory_offset`.
+    pub unsafe fn from_vga(physical_memory_offset: VirtAddr) -> Font {
+        let window = (physical_memory_offset.as_u64() + 0xA0000) as *const u8;
+        let mut glyphs = Vec::with_capacity(VGA_GLYPHS * VGA_FONT_HEIGHT);
+        interrupts::without_interrupts(|| unsafe {
+            let mut seq_index = Port::<u8>::new(0x3C4);
+            let mut seq_data = Port::<u8>::new(0x3C5);
+            let mut gc_index = Port::<u8>::new(0x3CE);
+            let mut gc_data = Port::<u8>::new(0x3CF);
+            let read = |index: &mut Port<u8>, data: &mut Port<u8>, reg: u8| {
+                index.write(reg);
+                data.read()
+            };
+            // Map mask, memory mode; read map select, mode, misc
+            let saved_seq = [read(&mut seq_index, &mut seq_data, 2), read(&mut seq_index, &mut seq_data, 4)];
+            let saved_gc = [
+                read(&mut gc_index, &mut gc_data, 4),
+                read(&mut gc_index, &mut gc_data, 5),
+                read(&mut gc_index, &mut gc_data, 6),
+            ];
+            let write = |index: &mut Port<u8>, data: &mut Port<u8>, reg: u8, value: u8| {
+                index.write(reg);
+                data.write(value);
+            };
+            // Plane 2 only, sequential addressing, mapped at 0xA0000
+            write(&mut seq_index, &mut seq_data, 2, 0x04);
+            write(&mut seq_index, &mut seq_data, 4, 0x07);
+            write(&mut gc_index, &mut gc_data, 4, 0x02);
+            write(&mut gc_index, &mut gc_data, 5, 0x00);
+            write(&mut gc_index, &mut gc_data, 6, 0x04);
+
+            for glyph in 0..VGA_GLYPHS {
+                for row in 0..VGA_FONT_HEIGHT {
+                    glyphs.push(core::ptr::read_volatile(window.add(glyph * VGA_GLYPH_STRIDE + row)));
+                }
+            }
+
+            write(&mut seq_index, &mut seq_data, 2, saved_seq[0]);
+            write(&mut seq_index, &mut seq_data, 4, saved_seq[1]);
+            write(&mut gc_index, &mut gc_data, 4, saved_gc[0]);
+            write(&mut gc_index, &mut gc_data, 5, saved_gc[1]);
+            write(&mut gc_index, &mut gc_data, 6, saved_gc[2]);
+        });
+        Font { width: 8, height: VGA_FONT_HEIGHT, bytes_per_row: 1, count: VGA_GLYPHS, glyphs }
+    }
+
+    pub fn width(&self) -> usize {
+        self.width
+    }
+
+    pub fn height(&self) -> usize {
+        self.height
+    }
+
+    pub fn glyph_count(&self) -> usize {
+        self.count
+    }
+
+    /// Bitmap of glyph `index`, a row of bytes per line, most significant
+    /// bit leftmost; out-of-range indices give glyph 0
+    pub fn glyph(&self, index: usize) -> &[u8] {
+        let size = self.bytes_per_row * self.height;
+        let index = if index < self.count { index } else { 0 };
+        &self.glyphs[index * size..(index + 1) * size]
+    }
+}
+
+/// Capture the VGA font as the system font; call once at boot, in text mode
+///
+/// # Safety
+/// Physical memory must be mapped at `physical_memory_offset`.
+pub unsafe fn init(physical_memory_offset: VirtAddr) -> Arc<Font> {
+    let font = Arc::new(unsafe { Font::from_vga(physical_memory_offset) });
+    *SYSTEM_FONT.lock() = Some(font.clone());
+    font
+}
+
+/// The font graphics-mode text uses unless given another
+pub fn system_font() -> Option<Arc<Font>> {
+    SYSTEM_FONT.lock().clone()
+}
+
+/// Replace the system font, e.g. with one loaded from a PSF file
+pub fn set_system_font(font: Font) {
+    *SYSTEM_FONT.lock() = Some(Arc::new(font));
+}
+
+/// Eight finished pixels for each value of a glyph byte
+type Expansion = [[u32; 8]; 256];
+
+struct ColorPair {
+    fg: u32,
+    bg: u32,
+    table: Box<Expansion>,
+    last_used: u64,
+}
+
+/// Counters of a glyph cache
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Stats {
+    pub glyphs: u64,
+    /// Color pairs found already expanded
+    pub hits: u64,
+    /// Color pairs expanded, possibly evicting the least recently used
+    pub misses: u64,
+}
+
+/// Draws text in one font, keeping recently used color pairs expanded
+pub struct GlyphCache {
+    font: Arc<Font>,
+    pairs: Vec<ColorPair>,
+    clock: u64,
+    stats: Stats,
+}
+
+impl GlyphCache {
+    pub fn new(font: Arc<Font>) -> Self {
+        GlyphCache { font, pairs: Vec::new(), clock: 0, stats: Stats::default() }
+    }
+
+    pub fn font(&self) -> &Font {
+        &self.font
+    }
+
+    pub fn stats(&self) -> Stats {
+        self.stats
+    }
+
+    /// Index of the expansion table for `fg` on `bg`, building it if needed
+    fn pair(&mut self, fg: u32, bg: u32) -> usize {
+        self.clock += 1;
+        if let Some(i) = self.pairs.iter().position(|p| p.fg == fg && p.bg == bg) {
+            self.stats.hits += 1;
+            self.pairs[i].last_used = self.clock;
+            return i;
+        }
+        self.stats.misses += 1;
+        let slot = if self.pairs.len() < MAX_PAIRS {
+            self.pairs.push(ColorPair { fg, bg, table: Box::new([[0; 8]; 256]), last_used: 0 });
+            self.pairs.len() - 1
+        } else {
+            (0..self.pairs.len()).min_by_key(|&i| self.pairs[i].last_used).unwrap()
+        };
+        let pair = &mut self.pairs[slot];
+        for (bits, pixels) in pair.table.iter_mut().enumerate() {
+            for (bit, pixel) in pixels.iter_mut().enumerate() {
+                *pixel = if bits & (0x80 >> bit) != 0 { fg } else { bg };
+            }
+        }
+        pair.fg = fg;
+        pair.bg = bg;
+        pair.last_used = self.clock;
+        slot
+    }
+
+    /// Draw `text` with its top-left corner at pixel (`x`, `y`) of
+    /// `target`, an image `stride` pixels wide, clipped to it; returns the
+    /// pixel column after the last character
+    ///
+    /// Bytes outside printable ASCII show as a block, as on the text
+    /// console.
+    pub fn draw_text(&mut self, target: &mut [u32], stride: usize, x: usize, y: usize,
+                     text: &str, fg: u32, bg: u32) -> usize {
+        let width = self.font.width;
+        let end = x.saturating_add(text.len().saturating_mul(width));
+        if stride == 0 {
+            return end;
+        }
+        let rows = self.font.height.min((target.len() / stride).saturating_sub(y));
+        // Characters that fit, and the pixels shown of a clipped last one
+        let visible = stride.saturating_sub(x);
+        let chars = text.len().min(visible.div_ceil(width));
+        if chars == 0 || rows == 0 {
+            return end;
+        }
+        let pair = self.pair(fg, bg);
+        let table = &*self.pairs[pair].table;
+        let font = &*self.font;
+        let bytes = text.as_bytes();
+        let shown = visible.min(chars * width);
+        for row in 0..rows {
+            let line = &mut target[(y + row) * stride + x..][..shown];
+            for (i, &byte) in bytes[..chars].iter().enumerate() {
+                let ch = match byte {
+                    0x20..=0x7e => byte,
+                    _ => 0xfe,
+                };
+                let glyph = &font.glyph(ch as usize)[row * font.bytes_per_row..][..font.bytes_per_row];
+                let cell = &mut line[i * width..((i + 1) * width).min(shown)];
+                for (chunk, &bits) in cell.chunks_mut(8).zip(glyph) {
+                    chunk.copy_from_slice(&table[bits as usize][..chunk.len()]);
+                }
+            }
+        }
+        self.stats.glyphs += chars as u64;
+        end
+    }
+}
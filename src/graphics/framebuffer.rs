@@ -0,0 +1,359 @@
+/// Linear framebuffer graphics through the Bochs VBE interface
+///
+/// QEMU's `-vga std` (and Bochs) expose a "dispi" register pair at I/O ports
+/// 0x1CE/0x1CF that sets any resolution at 32 bpp, and put the video memory
+/// behind BAR 0 of PCI device 1234:1111. `init` runs once at boot: it finds
+/// the device, maps its memory write-combining and maps RAM for an off-screen
+/// back buffer large enough for the biggest supported mode.
+///
+/// `Framebuffer::new` switches modes. Drawing goes to the back buffer, which
+/// is cheap to read and write; `present` copies it with sequential stores
+/// into the video page that is not on screen, then points the display at
+/// that page, so a frame is never shown half drawn. The first 256 KiB of
+/// video memory are left alone because VGA text mode keeps its characters
+/// and font there: dropping the `Framebuffer` returns to text mode with the
+/// screen intact.
+
+use core::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use x86_64::instructions::port::Port;
+use x86_64::registers::model_specific::Msr;
+use x86_64::structures::paging::{FrameAllocator, Mapper, Page, PageTableFlags, PhysFrame, Size4KiB};
+use x86_64::{PhysAddr, VirtAddr};
+use crate::native_ffi::{enumerate_pci_devices, pci_enable_mmio, pci_get_bar};
+
+const VENDOR_ID: u16 = 0x1234;
+const DEVICE_ID: u16 = 0x1111;
+
+const DISPI_INDEX_PORT: u16 = 0x01CE;
+const DISPI_DATA_PORT: u16 = 0x01CF;
+
+const DISPI_ID: u16 = 0;
+const DISPI_XRES: u16 = 1;
+const DISPI_YRES: u16 = 2;
+const DISPI_BPP: u16 = 3;
+const DISPI_ENABLE: u16 = 4;
+const DISPI_VIRT_WIDTH: u16 = 6;
+const DISPI_VIRT_HEIGHT: u16 = 7;
+const DISPI_X_OFFSET: u16 = 8;
+const DISPI_Y_OFFSET: u16 = 9;
+
+/// Oldest interface version with 32 bpp and a linear framebuffer
+const DISPI_ID2: u16 = 0xB0C2;
+
+const DISPI_ENABLED: u16 = 0x01;
+const DISPI_LFB_ENABLED: u16 = 0x40;
+const DISPI_NO_CLEAR_MEM: u16 = 0x80;
+
+/// Where video memory is mapped
+const VRAM_START: u64 = 0x6666_0000_0000;
+
+/// Where the back buffer is mapped
+const BACK_BUFFER_START: u64 = 0x6666_8000_0000;
+
+pub const MAX_WIDTH: usize = 1024;
+pub const MAX_HEIGHT: usize = 768;
+
+/// Video memory VGA text mode uses, kept out of the flipped pages
+const TEXT_RESERVED: usize = 256 * 1024;
+
+const PAGE_SIZE: usize = 4096;
+
+/// Video memory needed for two pages at the largest mode
+const VRAM_NEEDED: usize = TEXT_RESERVED + 2 * MAX_WIDTH * MAX_HEIGHT * 4;
+
+const BACK_BUFFER_SIZE: usize = MAX_WIDTH * MAX_HEIGHT * 4;
+
+/// IA32_PAT; entry 1, selected by PWT alone, is reprogrammed to write-combining
+const PAT_MSR: u32 = 0x277;
+const PAT_WRITE_COMBINING: u64 = 0x01;
+
+/// Bytes of video memory mapped by `init`; zero without a device
+static VRAM_MAPPED: AtomicUsize = AtomicUsize::new(0);
+
+/// Set while a `Framebuffer` owns the display
+static IN_USE: AtomicBool = AtomicBool::new(false);
+
+/// A 32-bpp pixel from 8-bit channels
+pub const fn rgb(r: u8, g: u8, b: u8) -> u32 {
+    (r as u32) << 16 | (g as u32) << 8 | b as u32
+}
+
+fn dispi_write(index: u16, value: u16) {
+    unsafe {
+        Port::<u16>::new(DISPI_INDEX_PORT).write(index);
+        Port::<u16>::new(DISPI_DATA_PORT).write(value);
+    }
+}
+
+fn dispi_read(index: u16) -> u16 {
+    unsafe {
+        Port::<u16>::new(DISPI_INDEX_PORT).write(index);
+        Port::<u16>::new(DISPI_DATA_PORT).read()
+    }
+}
+
+/// Make PWT-only mappings write-combining. Nothing else in the kernel maps
+/// memory write-through, so the entry is free to repurpose.
+fn enable_write_combining() {
+    unsafe {
+        let mut pat = Msr::new(PAT_MSR);
+        let value = pat.read();
+        let value = (value & !(0xff << 8)) | (PAT_WRITE_COMBINING << 8);
+        // Caches must not hold lines of the old type when it changes
+        core::arch::asm!("wbinvd", options(nostack, preserves_flags));
+        pat.write(value);
+    }
+    x86_64::instructions::tlb::flush_all();
+}
+
+/// Find the Bochs VBE display, map its memory and the back buffer
+///
+/// Returns the bytes of video memory mapped. Must run once, at boot,
+/// while the mapper and frame allocator are at hand.
+pub fn init(
+    mapper: &mut impl Mapper<Size4KiB>,
+    frame_allocator: &mut impl FrameAllocator<Size4KiB>,
+) -> Result<usize, &'static str> {
+    let devices = enumerate_pci_devices();
+    let device = devices.iter()
+        .find(|dev| dev.vendor_id == VENDOR_ID && dev.device_id == DEVICE_ID)
+        .ok_or("no Bochs VBE display (run QEMU with -vga std)")?;
+    if dispi_read(DISPI_ID) < DISPI_ID2 {
+        return Err("VBE interface too old for 32 bpp");
+    }
+    let bar = pci_get_bar(device, 0).filter(|bar| bar.is_mmio).ok_or("no framebuffer BAR")?;
+    let size = bar.size.min(VRAM_NEEDED);
+    if size < TEXT_RESERVED + 2 * 640 * 480 * 4 {
+        return Err("not enough video memory");
+    }
+    pci_enable_mmio(device);
+    enable_write_combining();
+
+    // PWT selects the PAT entry reprogrammed above
+    let flags = PageTableFlags::PRESENT | PageTableFlags::WRITABLE | PageTableFlags::WRITE_THROUGH;
+    for offset in (0..size).step_by(PAGE_SIZE) {
+        let page = Page::<Size4KiB>::containing_address(VirtAddr::new(VRAM_START + offset as u64));
+        let frame = PhysFrame::containing_address(PhysAddr::new(bar.base_addr.as_u64() + offset as u64));
+        unsafe {
+            mapper.map_to(page, frame, flags, frame_allocator)
+                .map_err(|_| "cannot map video memory")?
+                .flush();
+        }
+    }
+
+    let flags = PageTableFlags::PRESENT | PageTableFlags::WRITABLE;
+    for offset in (0..BACK_BUFFER_SIZE).step_by(PAGE_SIZE) {
+        let page = Page::<Size4KiB>::containing_address(VirtAddr::new(BACK_BUFFER_START + offset as u64));
+        let frame = frame_allocator.allocate_frame().ok_or("out of memory for the back buffer")?;
+        unsafe {
+            mapper.map_to(page, frame, flags, frame_allocator)
+                .map_err(|_| "cannot map the back buffer")?
+                .flush();
+        }
+    }
+
+    VRAM_MAPPED.store(size, Ordering::Release);
+    Ok(size)
+}
+
+/// Whether `init` found and mapped a display
+pub fn is_available() -> bool {
+    VRAM_MAPPED.load(Ordering::Acquire) != 0
+}
+
+/// A 32-bpp graphics mode with an off-screen back buffer; text mode returns
+/// when it is dropped
+pub struct Framebuffer {
+    width: usize,
+    height: usize,
+    back: &'static mut [u32],
+    vram: *mut u32,
+    /// First line of each video page
+    pages: [usize; 2],
+    /// Index of the page on screen
+    shown: usize,
+    frames: u64,
+}
+
+impl Framebuffer {
+    /// Switch to `width` x `height` at 32 bpp
+    pub fn new(width: usize, height: usize) -> Result<Self, &'static str> {
+        if width == 0 || height == 0 || width > MAX_WIDTH || height > MAX_HEIGHT || width % 8 != 0 {
+            return Err("unsupported resolution");
+        }
+        let mapped = VRAM_MAPPED.load(Ordering::Acquire);
+        if mapped == 0 {
+            return Err("no linear framebuffer");
+        }
+        let pitch = width * 4;
+        let reserved_lines = TEXT_RESERVED.div_ceil(pitch);
+        let virt_height = reserved_lines + 2 * height;
+        if virt_height * pitch > mapped {
+            return Err("not enough video memory");
+        }
+        if IN_USE.swap(true, Ordering::Acquire) {
+            return Err("framebuffer already in use");
+        }
+
+        dispi_write(DISPI_ENABLE, 0);
+        dispi_write(DISPI_XRES, width as u16);
+        dispi_write(DISPI_YRES, height as u16);
+        dispi_write(DISPI_BPP, 32);
+        dispi_write(DISPI_ENABLE, DISPI_ENABLED | DISPI_LFB_ENABLED | DISPI_NO_CLEAR_MEM);
+        dispi_write(DISPI_VIRT_WIDTH, width as u16);
+        dispi_write(DISPI_VIRT_HEIGHT, virt_height as u16);
+        dispi_write(DISPI_X_OFFSET, 0);
+        dispi_write(DISPI_Y_OFFSET, reserved_lines as u16);
+        if dispi_read(DISPI_XRES) != width as u16 || dispi_read(DISPI_BPP) != 32
+            || dispi_read(DISPI_VIRT_HEIGHT) < virt_height as u16
+        {
+            dispi_write(DISPI_ENABLE, 0);
+            IN_USE.store(false, Ordering::Release);
+            return Err("mode rejected by the display");
+        }
+
+        // SAFETY: `init` mapped BACK_BUFFER_SIZE bytes of RAM there, and
+        // IN_USE makes this the only reference to them.
+        let back = unsafe {
+            core::slice::from_raw_parts_mut(BACK_BUFFER_START as *mut u32, width * height)
+        };
+        back.fill(0);
+        let mut framebuffer = Framebuffer {
+            width,
+            height,
+            back,
+            vram: VRAM_START as *mut u32,
+            pages: [reserved_lines, reserved_lines + height],
+            shown: 0,
+            frames: 0,
+        };
+        // Start from a black screen rather than old video memory
+        framebuffer.present();
+        Ok(framebuffer)
+    }
+
+    pub fn width(&self) -> usize {
+        self.width
+    }
+
+    pub fn height(&self) -> usize {
+        self.height
+    }
+
+    /// Frames presented so far
+    pub fn frames(&self) -> u64 {
+        self.frames
+    }
+
+    /// The back buffer, row after row
+    pub fn pixels_mut(&mut self) -> &mut [u32] {
+        self.back
+    }
+
+    pub fn clear(&mut self, color: u32) {
+        self.back.fill(color);
+    }
+
+    pub fn set_pixel(&mut self, x: usize, y: usize, color: u32) {
+        if x < self.width && y < self.height {
+            self.back[y * self.width + x] = color;
+        }
+    }
+
+    pub fn get_pixel(&self, x: usize, y: usize) -> u32 {
+        if x < self.width && y < self.height { self.back[y * self.width + x] } else { 0 }
+    }
+
+    /// Fill a rectangle, clipped to the screen
+    pub fn fill_rect(&mut self, x: usize, y: usize, width: usize, height: usize, color: u32) {
+        let x_end = x.saturating_add(width).min(self.width);
+        let y_end = y.saturating_add(height).min(self.height);
+        if x >= x_end {
+            return;
+        }
+        for row in y..y_end {
+            self.back[row * self.width + x..row * self.width + x_end].fill(color);
+        }
+    }
+
+    pub fn draw_hline(&mut self, x: usize, y: usize, length: usize, color: u32) {
+        self.fill_rect(x, y, length, 1, color);
+    }
+
+    pub fn draw_vline(&mut self, x: usize, y: usize, length: usize, color: u32) {
+        self.fill_rect(x, y, 1, length, color);
+    }
+
+    /// Rectangle outline
+    pub fn draw_rect(&mut self, x: usize, y: usize, width: usize, height: usize, color: u32) {
+        if width == 0 || height == 0 {
+            return;
+        }
+        self.draw_hline(x, y, width, color);
+        self.draw_hline(x, y + height - 1, width, color);
+        self.draw_vline(x, y, height, color);
+        self.draw_vline(x + width - 1, y, height, color);
+    }
+
+    /// Bresenham line; points off screen are skipped
+    pub fn draw_line(&mut self, x0: usize, y0: usize, x1: usize, y1: usize, color: u32) {
+        let (mut x, mut y) = (x0 as isize, y0 as isize);
+        let dx = (x1 as isize - x).abs();
+        let dy = -(y1 as isize - y).abs();
+        let sx = if x < x1 as isize { 1 } else { -1 };
+        let sy = if y < y1 as isize { 1 } else { -1 };
+        let mut err = dx + dy;
+        loop {
+            self.set_pixel(x as usize, y as usize, color);
+            if x == x1 as isize && y == y1 as isize {
+                break;
+            }
+            let e2 = 2 * err;
+            if e2 >= dy {
+                err += dy;
+                x += sx;
+            }
+            if e2 <= dx {
+                err += dx;
+                y += sy;
+            }
+        }
+    }
+
+    /// Copy a `width` x `height` image of row-major pixels, clipped
+    pub fn blit(&mut self, x: usize, y: usize, width: usize, height: usize, src: &[u32]) {
+        let x_end = x.saturating_add(width).min(self.width);
+        let y_end = y.saturating_add(height).min(self.height);
+        if x >= x_end || src.len() < width * height {
+            return;
+        }
+        let visible = x_end - x;
+        for row in y..y_end {
+            let from = (row - y) * width;
+            self.back[row * self.width + x..row * self.width + x_end]
+                .copy_from_slice(&src[from..from + visible]);
+        }
+    }
+
+    /// Copy the back buffer into the hidden video page and show it
+    pub fn present(&mut self) {
+        let target = 1 - self.shown;
+        // SAFETY: `new` checked both pages lie in the video memory `init`
+        // mapped. Rows are contiguous since the virtual width is the width.
+        unsafe {
+            let page = self.vram.add(self.pages[target] * self.width);
+            core::ptr::copy_nonoverlapping(self.back.as_ptr(), page, self.width * self.height);
+        }
+        dispi_write(DISPI_Y_OFFSET, self.pages[target] as u16);
+        self.shown = target;
+        self.frames += 1;
+    }
+}
+
+impl Drop for Framebuffer {
+    fn drop(&mut self) {
+        dispi_write(DISPI_ENABLE, 0);
+        crate::graphics::compositor::invalidate();
+        IN_USE.store(false, Ordering::Release);
+    }
+}
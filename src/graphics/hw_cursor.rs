@@ -0,0 +1,73 @@
+/// The VGA hardware text cursor, used as the mouse pointer
+///
+/// The CRTC draws the cursor over the character cell itself, so moving it
+/// is four port writes and no text memory changes: nothing has to be
+/// restored under the old position and the compositor never sees it.
+
+use core::sync::atomic::{AtomicU32, Ordering};
+use x86_64::instructions::interrupts;
+use x86_64::instructions::port::Port;
+use crate::vga_buffer::{BUFFER_HEIGHT, BUFFER_WIDTH};
+
+const CRTC_INDEX: u16 = 0x3D4;
+const CRTC_DATA: u16 = 0x3D5;
+
+const MAX_SCAN_LINE: u8 = 0x09;
+const CURSOR_START: u8 = 0x0A;
+const CURSOR_END: u8 = 0x0B;
+const LOCATION_HIGH: u8 = 0x0E;
+const LOCATION_LOW: u8 = 0x0F;
+
+/// Cursor start bit that turns the cursor off
+const CURSOR_DISABLE: u8 = 0x20;
+
+const HIDDEN: u32 = u32::MAX;
+
+/// Cell index the cursor is shown at, or HIDDEN
+static POSITION: AtomicU32 = AtomicU32::new(HIDDEN);
+
+fn crtc_read(index: u8) -> u8 {
+    unsafe {
+        Port::<u8>::new(CRTC_INDEX).write(index);
+        Port::<u8>::new(CRTC_DATA).read()
+    }
+}
+
+fn crtc_write(index: u8, value: u8) {
+    unsafe {
+        Port::<u8>::new(CRTC_INDEX).write(index);
+        Port::<u8>::new(CRTC_DATA).write(value);
+    }
+}
+
+/// Show the cursor as a full-cell block at (`x`, `y`); a position off
+/// screen hides it
+pub fn show(x: usize, y: usize) {
+    if x >= BUFFER_WIDTH || y >= BUFFER_HEIGHT {
+        hide();
+        return;
+    }
+    let at = (y * BUFFER_WIDTH + x) as u32;
+    interrupts::without_interrupts(|| {
+        let was = POSITION.swap(at, Ordering::Relaxed);
+        if was == at {
+            return;
+        }
+        if was == HIDDEN {
+            // Cover every scan line of the character cell
+            let last_line = crtc_read(MAX_SCAN_LINE) & 0x1f;
+            crtc_write(CURSOR_START, crtc_read(CURSOR_START) & 0xc0);
+            crtc_write(CURSOR_END, (crtc_read(CURSOR_END) & 0xe0) | last_line);
+        }
+        crtc_write(LOCATION_HIGH, (at >> 8) as u8);
+        crtc_write(LOCATION_LOW, at as u8);
+    });
+}
+
+pub fn hide() {
+    interrupts::without_interrupts(|| {
+        if POSITION.swap(HIDDEN, Ordering::Relaxed) != HIDDEN {
+            crtc_write(CURSOR_START, crtc_read(CURSOR_START) | CURSOR_DISABLE);
+        }
+    });
+}
@@ -0,0 +1,383 @@
+/// Tile-binning software rasterizer for 32-bpp images
+///
+/// Drawing calls don't touch pixels. They append a shape to a display list
+/// and file its index in the bin of every 64x64 tile its bounding box
+/// touches. `render` then draws the image one tile at a time: only the
+/// shapes binned there, in the order they were added, clipped to the tile.
+/// A tile's pixels stay in cache while all its shapes are drawn, tiles with
+/// no shapes are just cleared, and shapes under an opaque rectangle that
+/// covers the whole tile are skipped.
+///
+/// Rendering a tile reads only the display list and writes only the tile,
+/// so once other cores run kernel code they can take tiles from a shared
+/// counter; `render_tile` is the unit of work for that.
+
+use alloc::vec::Vec;
+
+/// Tile edge in pixels
+pub const TILE: usize = 64;
+
+#[derive(Debug, Clone, Copy)]
+enum Shape {
+    Rect { x0: i32, y0: i32, x1: i32, y1: i32, color: u32 },
+    Line { x0: i32, y0: i32, x1: i32, y1: i32, color: u32 },
+    Triangle { v: [(i32, i32); 3], color: u32 },
+}
+
+/// Counters of the last `render`
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Stats {
+    pub shapes: usize,
+    /// Shape entries over all bins
+    pub binned: usize,
+    /// Tiles with no shapes, only cleared
+    pub empty_tiles: usize,
+    /// Bin entries skipped because a later rectangle covered the tile
+    pub occluded: usize,
+}
+
+/// Pixels of a half-open box `x0..x1` x `y0..y1`
+#[derive(Debug, Clone, Copy)]
+struct Bounds {
+    x0: i32,
+    y0: i32,
+    x1: i32,
+    y1: i32,
+}
+
+impl Bounds {
+    fn intersect(&self, other: &Bounds) -> Option<Bounds> {
+        let b = Bounds {
+            x0: self.x0.max(other.x0),
+            y0: self.y0.max(other.y0),
+            x1: self.x1.min(other.x1),
+            y1: self.y1.min(other.y1),
+        };
+        if b.x0 < b.x1 && b.y0 < b.y1 { Some(b) } else { None }
+    }
+
+    fn contains(&self, other: &Bounds) -> bool {
+        self.x0 <= other.x0 && self.y0 <= other.y0 && self.x1 >= other.x1 && self.y1 >= other.y1
+    }
+
+    /// Cohen-Sutherland outcode of a point: one bit per edge it lies beyond
+    fn outcode(&self, x: i32, y: i32) -> u8 {
+        (x < self.x0) as u8
+            | ((x >= self.x1) as u8) << 1
+            | ((y < self.y0) as u8) << 2
+            | ((y >= self.y1) as u8) << 3
+    }
+}
+
+impl Shape {
+    fn bounds(&self) -> Bounds {
+        match *self {
+            Shape::Rect { x0, y0, x1, y1, .. } => Bounds { x0, y0, x1, y1 },
+            Shape::Line { x0, y0, x1, y1, .. } => Bounds {
+                x0: x0.min(x1),
+                y0: y0.min(y1),
+                x1: x0.max(x1) + 1,
+                y1: y0.max(y1) + 1,
+            },
+            Shape::Triangle { v, .. } => Bounds {
+                x0: v[0].0.min(v[1].0).min(v[2].0),
+                y0: v[0].1.min(v[1].1).min(v[2].1),
+                x1: v[0].0.max(v[1].0).max(v[2].0) + 1,
+                y1: v[0].1.max(v[1].1).max(v[2].1) + 1,
+            },
+        }
+    }
+}
+
+/// A display list binned into tiles, drawn with `render`
+pub struct TileRenderer {
+    width: usize,
+    height: usize,
+    tiles_x: usize,
+    tiles_y: usize,
+    clear: u32,
+    shapes: Vec<Shape>,
+    /// Per tile, indices into `shapes` in drawing order
+    bins: Vec<Vec<u32>>,
+    stats: Stats,
+}
+
+impl TileRenderer {
+    pub fn new(width: usize, height: usize) -> Self {
+        let tiles_x = width.div_ceil(TILE);
+        let tiles_y = height.div_ceil(TILE);
+        TileRenderer {
+            width,
+            height,
+            tiles_x,
+            tiles_y,
+            clear: 0,
+            shapes: Vec::new(),
+            bins: (0..tiles_x * tiles_y).map(|_| Vec::new()).collect(),
+            stats: Stats::default(),
+        }
+    }
+
+    pub fn tile_count(&self) -> usize {
+        self.tiles_x * self.tiles_y
+    }
+
+    /// Start a frame cleared to `color`; bins keep their allocations
+    pub fn begin(&mut self, color: u32) {
+        self.clear = color;
+        self.shapes.clear();
+        for bin in &mut self.bins {
+            bin.clear();
+        }
+    }
+
+    pub fn fill_rect(&mut self, x: i32, y: i32, width: i32, height: i32, color: u32) {
+        if width > 0 && height > 0 {
+            self.push(Shape::Rect { x0: x, y0: y, x1: x + width, y1: y + height, color });
+        }
+    }
+
+    /// Rectangle outline, as four filled sides
+    pub fn draw_rect(&mut self, x: i32, y: i32, width: i32, height: i32, color: u32) {
+        if width <= 0 || height <= 0 {
+            return;
+        }
+        self.fill_rect(x, y, width, 1, color);
+        if height > 1 {
+            self.fill_rect(x, y + height - 1, width, 1, color);
+        }
+        if height > 2 {
+            self.fill_rect(x, y + 1, 1, height - 2, color);
+            if width > 1 {
+                self.fill_rect(x + width - 1, y + 1, 1, height - 2, color);
+            }
+        }
+    }
+
+    pub fn draw_line(&mut self, x0: i32, y0: i32, x1: i32, y1: i32, color: u32) {
+        self.push(Shape::Line { x0, y0, x1, y1, color });
+    }
+
+    /// Filled triangle; pixels on an edge shared with another triangle are
+    /// drawn by exactly one of them
+    pub fn fill_triangle(&mut self, a: (i32, i32), b: (i32, i32), c: (i32, i32), color: u32) {
+        // Wind every triangle the same way so one inside test serves all
+        let v = if orient(a, b, c) < 0 { [a, c, b] } else { [a, b, c] };
+        if orient(v[0], v[1], v[2]) != 0 {
+            self.push(Shape::Triangle { v, color });
+        }
+    }
+
+    fn push(&mut self, shape: Shape) {
+        let screen = Bounds { x0: 0, y0: 0, x1: self.width as i32, y1: self.height as i32 };
+        let Some(b) = shape.bounds().intersect(&screen) else { return };
+        let index = self.shapes.len() as u32;
+        self.shapes.push(shape);
+        let tile = TILE as i32;
+        for ty in (b.y0 / tile)..=((b.y1 - 1) / tile) {
+            for tx in (b.x0 / tile)..=((b.x1 - 1) / tile) {
+                self.bins[ty as usize * self.tiles_x + tx as usize].push(index);
+            }
+        }
+    }
+
+    /// Pixels of tile `index`
+    fn tile_bounds(&self, index: usize) -> Bounds {
+        let x0 = (index % self.tiles_x * TILE) as i32;
+        let y0 = (index / self.tiles_x * TILE) as i32;
+        Bounds {
+            x0,
+            y0,
+            x1: (x0 + TILE as i32).min(self.width as i32),
+            y1: (y0 + TILE as i32).min(self.height as i32),
+        }
+    }
+
+    /// Draw tile `index` into `target`, an image `stride` pixels wide at
+    /// least as large as the renderer; returns the bin entries skipped
+    /// as occluded
+    pub fn render_tile(&self, index: usize, target: &mut [u32], stride: usize) -> usize {
+        let tile = self.tile_bounds(index);
+        let bin = &self.bins[index];
+        // Nothing before the last rectangle covering the tile shows
+        let first = bin.iter().rposition(|&s| matches!(
+            self.shapes[s as usize], Shape::Rect { .. } if self.shapes[s as usize].bounds().contains(&tile)
+        ));
+        let mut tile_target = TileTarget { target, stride, clip: tile };
+        if first.is_none() {
+            tile_target.fill(&tile, self.clear);
+        }
+        for &s in &bin[first.unwrap_or(0)..] {
+            match self.shapes[s as usize] {
+                Shape::Rect { x0, y0, x1, y1, color } => {
+                    if let Some(b) = tile.intersect(&Bounds { x0, y0, x1, y1 }) {
+                        tile_target.fill(&b, color);
+                    }
+                }
+                Shape::Line { x0, y0, x1, y1, color } => tile_target.line(x0, y0, x1, y1, color),
+                Shape::Triangle { v, color } => tile_target.triangle(v, color),
+            }
+        }
+        first.unwrap_or(0)
+    }
+
+    /// Draw every tile into `target`, an image `stride` pixels wide
+    pub fn render(&mut self, target: &mut [u32], stride: usize) {
+        assert!(stride >= self.width && target.len() >= stride * (self.height - 1) + self.width);
+        let mut stats = Stats { shapes: self.shapes.len(), ..Stats::default() };
+        for index in 0..self.tile_count() {
+            stats.binned += self.bins[index].len();
+            if self.bins[index].is_empty() {
+                stats.empty_tiles += 1;
+            }
+            stats.occluded += self.render_tile(index, target, stride);
+        }
+        self.stats = stats;
+    }
+
+    pub fn stats(&self) -> Stats {
+        self.stats
+    }
+}
+
+/// Twice the signed area of `a`, `b`, `p`; its sign says which side of
+/// `a`->`b` the point `p` lies on
+fn orient(a: (i32, i32), b: (i32, i32), p: (i32, i32)) -> i64 {
+    (b.0 - a.0) as i64 * (p.1 - a.1) as i64 - (b.1 - a.1) as i64 * (p.0 - a.0) as i64
+}
+
+/// Whether pixels exactly on edge `a`->`b` belong to the triangle; of an
+/// edge and its reverse exactly one does
+fn owns_edge(a: (i32, i32), b: (i32, i32)) -> bool {
+    b.1 < a.1 || (b.1 == a.1 && b.0 > a.0)
+}
+
+/// How far along an axis, in its stepping direction `step`, a line from
+/// `from` can go and stay in `lo..hi`
+fn axis_range(from: i32, step: i64, lo: i32, hi: i32) -> (i64, i64) {
+    let (from, lo, hi) = (from as i64, lo as i64, hi as i64 - 1);
+    if step > 0 { (lo - from, hi - from) } else { (from - hi, from - lo) }
+}
+
+/// How far a Bresenham line `major` steps long has moved along an axis it
+/// covers `extent` pixels of, after `k` steps
+fn step_offset(k: i64, extent: i64, major: i64) -> i64 {
+    if major == 0 {
+        return 0;
+    }
+    ((2 * extent as i128 * k as i128 + major as i128) / (2 * major as i128)) as i64
+}
+
+/// The steps `first..=last` of a line `major` steps long whose offset
+/// along an axis it covers `extent` pixels of lies in `range`; empty when
+/// `first > last`
+fn steps_within(range: (i64, i64), extent: i64, major: i64) -> (i64, i64) {
+    let (lo, hi) = (range.0.max(0), range.1.min(extent));
+    if lo > hi {
+        return (1, 0);
+    }
+    if extent == 0 {
+        return (0, major);
+    }
+    // Invert `step_offset`: it grows by at most one per step
+    let (extent, major) = (extent as i128, major as i128);
+    let first = ((2 * major * lo as i128 - major).max(0) + 2 * extent - 1) / (2 * extent);
+    let last = if hi as i128 == extent {
+        major
+    } else {
+        (2 * major * (hi as i128 + 1) - major - 1) / (2 * extent)
+    };
+    (first as i64, last as i64)
+}
+
+/// The part of an image one tile may write
+struct TileTarget<'a> {
+    target: &'a mut [u32],
+    stride: usize,
+    clip: Bounds,
+}
+
+impl TileTarget<'_> {
+    /// Fill `b`, which must lie inside the clip
+    fn fill(&mut self, b: &Bounds, color: u32) {
+        for y in b.y0..b.y1 {
+            let row = y as usize * self.stride;
+            self.target[row + b.x0 as usize..row + b.x1 as usize].fill(color);
+        }
+    }
+
+    /// Bresenham line, the same pixels `Framebuffer::draw_line` sets, kept
+    /// to the clip
+    ///
+    /// Cohen-Sutherland outcodes settle lines wholly inside or beside the
+    /// tile. Otherwise the line is clipped in Bresenham's own steps rather
+    /// than at a rounded crossing point, so the tile sets exactly the
+    /// pixels the whole line would; the loop then only runs over the
+    /// steps inside the tile, however far away the endpoints are.
+    fn line(&mut self, x0: i32, y0: i32, x1: i32, y1: i32, color: u32) {
+        let clip = self.clip;
+        let (code0, code1) = (clip.outcode(x0, y0), clip.outcode(x1, y1));
+        if code0 & code1 != 0 {
+            return;
+        }
+        let dx = (x1 as i64 - x0 as i64).abs();
+        let dy = (y1 as i64 - y0 as i64).abs();
+        let sx = if x0 < x1 { 1 } else { -1 };
+        let sy = if y0 < y1 { 1 } else { -1 };
+        // One axis moves on every step
+        let major = dx.max(dy);
+        let (first, last) = if code0 | code1 == 0 {
+            (0, major)
+        } else {
+            let (fx, lx) = steps_within(axis_range(x0, sx, clip.x0, clip.x1), dx, major);
+            let (fy, ly) = steps_within(axis_range(y0, sy, clip.y0, clip.y1), dy, major);
+            (fx.max(fy), lx.min(ly))
+        };
+        if first > last {
+            return;
+        }
+
+        // Pick up the error term where the full line would have it
+        let (ox, oy) = (step_offset(first, dx, major), step_offset(first, dy, major));
+        let mut x = (x0 as i64 + sx * ox) as i32;
+        let mut y = (y0 as i64 + sy * oy) as i32;
+        let mut err = (dx as i128 - dy as i128 - ox as i128 * dy as i128 + oy as i128 * dx as i128) as i64;
+        for _ in first..=last {
+            self.target[y as usize * self.stride + x as usize] = color;
+            let e2 = 2 * err;
+            if e2 >= -dy {
+                err -= dy;
+                x += sx as i32;
+            }
+            if e2 <= dx {
+                err += dx;
+                y += sy as i32;
+            }
+        }
+    }
+
+    /// Fill the pixels of triangle `v` inside the clip, stepping the three
+    /// edge functions across each row
+    fn triangle(&mut self, v: [(i32, i32); 3], color: u32) {
+        let Some(b) = self.clip.intersect(&Shape::Triangle { v, color }.bounds()) else { return };
+        let edges = [(v[1], v[2]), (v[2], v[0]), (v[0], v[1])];
+        // An edge that doesn't own its pixels needs a strictly positive value
+        let bias = edges.map(|(a, c)| if owns_edge(a, c) { 0 } else { -1 });
+        let step = edges.map(|(a, c)| -(c.1 - a.1) as i64);
+        for y in b.y0..b.y1 {
+            let mut w = [0; 3];
+            for i in 0..3 {
+                w[i] = orient(edges[i].0, edges[i].1, (b.x0, y)) + bias[i];
+            }
+            let row = y as usize * self.stride;
+            for x in b.x0..b.x1 {
+                if w[0] >= 0 && w[1] >= 0 && w[2] >= 0 {
+                    self.target[row + x as usize] = color;
+                }
+                for i in 0..3 {
+                    w[i] += step[i];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,187 @@
+/// Rectangles and regions of text-mode cells, used to track damage
+///
+/// A `Region` is a set of cells kept as disjoint rectangles, so its area
+/// is the sum of theirs and repainting it never touches a cell twice.
+
+use alloc::vec::Vec;
+use crate::vga_buffer::{BUFFER_HEIGHT, BUFFER_WIDTH};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct Rect {
+    pub x: usize,
+    pub y: usize,
+    pub w: usize,
+    pub h: usize,
+}
+
+impl Rect {
+    pub const fn new(x: usize, y: usize, w: usize, h: usize) -> Self {
+        Rect { x, y, w, h }
+    }
+
+    /// The whole screen
+    pub const fn screen() -> Self {
+        Rect::new(0, 0, BUFFER_WIDTH, BUFFER_HEIGHT)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.w == 0 || self.h == 0
+    }
+
+    pub fn right(&self) -> usize {
+        self.x + self.w
+    }
+
+    pub fn bottom(&self) -> usize {
+        self.y + self.h
+    }
+
+    pub fn area(&self) -> usize {
+        self.w * self.h
+    }
+
+    pub fn contains(&self, x: usize, y: usize) -> bool {
+        x >= self.x && x < self.right() && y >= self.y && y < self.bottom()
+    }
+
+    /// Cells in both rectangles; empty when they don't overlap
+    pub fn intersect(&self, other: &Rect) -> Rect {
+        let x = self.x.max(other.x);
+        let y = self.y.max(other.y);
+        let right = self.right().min(other.right());
+        let bottom = self.bottom().min(other.bottom());
+        if right <= x || bottom <= y {
+            Rect::default()
+        } else {
+            Rect::new(x, y, right - x, bottom - y)
+        }
+    }
+
+    pub fn overlaps(&self, other: &Rect) -> bool {
+        !self.intersect(other).is_empty()
+    }
+
+    /// Push the parts of `self` outside `other` to `out`: full-width bands
+    /// above and below the overlap, then the pieces left and right of it
+    fn subtract_into(&self, other: &Rect, out: &mut Vec<Rect>) {
+        let overlap = self.intersect(other);
+        if overlap.is_empty() {
+            out.push(*self);
+            return;
+        }
+        if overlap.y > self.y {
+            out.push(Rect::new(self.x, self.y, self.w, overlap.y - self.y));
+        }
+        if overlap.bottom() < self.bottom() {
+            out.push(Rect::new(self.x, overlap.bottom(), self.w, self.bottom() - overlap.bottom()));
+        }
+        if overlap.x > self.x {
+            out.push(Rect::new(self.x, overlap.y, overlap.x - self.x, overlap.h));
+        }
+        if overlap.right() < self.right() {
+            out.push(Rect::new(overlap.right(), overlap.y, self.right() - overlap.right(), overlap.h));
+        }
+    }
+}
+
+/// A set of cells as disjoint rectangles
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct Region {
+    rects: Vec<Rect>,
+}
+
+impl Region {
+    pub const fn new() -> Self {
+        Region { rects: Vec::new() }
+    }
+
+    pub fn from_rect(rect: Rect) -> Self {
+        let mut region = Region::new();
+        region.add(rect);
+        region
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.rects.is_empty()
+    }
+
+    pub fn rects(&self) -> &[Rect] {
+        &self.rects
+    }
+
+    /// Number of cells in the region
+    pub fn area(&self) -> usize {
+        self.rects.iter().map(Rect::area).sum()
+    }
+
+    pub fn clear(&mut self) {
+        self.rects.clear();
+    }
+
+    pub fn contains(&self, x: usize, y: usize) -> bool {
+        self.rects.iter().any(|r| r.contains(x, y))
+    }
+
+    pub fn overlaps(&self, rect: &Rect) -> bool {
+        self.rects.iter().any(|r| r.overlaps(rect))
+    }
+
+    /// Smallest rectangle holding the whole region
+    pub fn bounds(&self) -> Rect {
+        let mut rects = self.rects.iter();
+        let Some(first) = rects.next() else { return Rect::default() };
+        let (mut x, mut y, mut right, mut bottom) = (first.x, first.y, first.right(), first.bottom());
+        for r in rects {
+            x = x.min(r.x);
+            y = y.min(r.y);
+            right = right.max(r.right());
+            bottom = bottom.max(r.bottom());
+        }
+        Rect::new(x, y, right - x, bottom - y)
+    }
+
+    /// Union with `rect`; only the cells not already in the region are added
+    pub fn add(&mut self, rect: Rect) {
+        if rect.is_empty() {
+            return;
+        }
+        let mut pieces = alloc::vec![rect];
+        for existing in &self.rects {
+            let mut rest = Vec::with_capacity(pieces.len());
+            for piece in &pieces {
+                piece.subtract_into(existing, &mut rest);
+            }
+            pieces = rest;
+            if pieces.is_empty() {
+                return;
+            }
+        }
+        self.rects.extend(pieces);
+    }
+
+    /// Union with another region
+    pub fn union(&mut self, other: &Region) {
+        for rect in &other.rects {
+            self.add(*rect);
+        }
+    }
+
+    /// Remove the cells of `rect`
+    pub fn subtract(&mut self, rect: &Rect) {
+        if !self.overlaps(rect) {
+            return;
+        }
+        let mut rest = Vec::with_capacity(self.rects.len() + 3);
+        for r in &self.rects {
+            r.subtract_into(rect, &mut rest);
+        }
+        self.rects = rest;
+    }
+
+    /// The cells of the region inside `rect`
+    pub fn intersect(&self, rect: &Rect) -> Region {
+        Region {
+            rects: self.rects.iter().map(|r| r.intersect(rect)).filter(|r| !r.is_empty()).collect(),
+        }
+    }
+}
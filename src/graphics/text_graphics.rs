@@ -1,8 +1,7 @@
 /// Text-mode graphics enhancements using ASCII art and box-drawing characters
 
-use crate::vga_buffer::{Color, ColorCode};
-use x86_64::instructions::interrupts;
-use volatile::Volatile;
+use crate::vga_buffer::Color;
+use super::compositor::{self, cell};
 
 /// Box drawing characters
 pub const BOX_HORIZONTAL: u8 = 0xC4; // ─
@@ -31,68 +30,15 @@ pub const BLOCK_DARK: u8 = 0xB2;  // ▒
 pub const BLOCK_MEDIUM: u8 = 0xB1; // ░
 pub const BLOCK_LIGHT: u8 = 0xB0; // ░
 
-/// Represents a positioned character with color
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
-#[repr(C)]
-struct ScreenChar {
-    ascii_character: u8,
-    color_code: ColorCode,
-}
-
 /// Draw a box with single lines
 pub fn draw_box(x: usize, y: usize, width: usize, height: usize, fg: Color, bg: Color) {
     if width < 2 || height < 2 || x + width > 80 || y + height > 25 {
         return; // Invalid dimensions
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color = ColorCode::new(fg, bg);
-
-    interrupts::without_interrupts(|| {
-        // Top border
-        buffer[y][x].write(ScreenChar {
-            ascii_character: BOX_TOP_LEFT,
-            color_code: color,
-        });
-        for i in 1..width - 1 {
-            buffer[y][x + i].write(ScreenChar {
-                ascii_character: BOX_HORIZONTAL,
-                color_code: color,
-            });
-        }
-        buffer[y][x + width - 1].write(ScreenChar {
-            ascii_character: BOX_TOP_RIGHT,
-            color_code: color,
-        });
-
-        // Sides
-        for row in 1..height - 1 {
-            buffer[y + row][x].write(ScreenChar {
-                ascii_character: BOX_VERTICAL,
-                color_code: color,
-            });
-            buffer[y + row][x + width - 1].write(ScreenChar {
-                ascii_character: BOX_VERTICAL,
-                color_code: color,
-            });
-        }
-
-        // Bottom border
-        buffer[y + height - 1][x].write(ScreenChar {
-            ascii_character: BOX_BOTTOM_LEFT,
-            color_code: color,
-        });
-        for i in 1..width - 1 {
-            buffer[y + height - 1][x + i].write(ScreenChar {
-                ascii_character: BOX_HORIZONTAL,
-                color_code: color,
-            });
-        }
-        buffer[y + height - 1][x + width - 1].write(ScreenChar {
-            ascii_character: BOX_BOTTOM_RIGHT,
-            color_code: color,
-        });
-    });
+    draw_frame(x, y, width, height, fg, bg, [
+        BOX_TOP_LEFT, BOX_TOP_RIGHT, BOX_BOTTOM_LEFT, BOX_BOTTOM_RIGHT, BOX_HORIZONTAL, BOX_VERTICAL,
+    ]);
 }
 
 /// Draw a filled box
@@ -101,19 +47,7 @@ pub fn draw_filled_box(x: usize, y: usize, width: usize, height: usize, fg: Colo
         return;
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color = ColorCode::new(fg, bg);
-
-    interrupts::without_interrupts(|| {
-        for row in 0..height {
-            for col in 0..width {
-                buffer[y + row][x + col].write(ScreenChar {
-                    ascii_character: b' ',
-                    color_code: color,
-                });
-            }
-        }
-    });
+    compositor::draw(|c| c.fill(x, y, width, height, cell(b' ', fg, bg)));
 }
 
 /// Draw a double-line box
@@ -122,53 +56,29 @@ pub fn draw_double_box(x: usize, y: usize, width: usize, height: usize, fg: Colo
         return;
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color = ColorCode::new(fg, bg);
+    draw_frame(x, y, width, height, fg, bg, [
+        BOX_DBL_TOP_LEFT, BOX_DBL_TOP_RIGHT, BOX_DBL_BOTTOM_LEFT, BOX_DBL_BOTTOM_RIGHT,
+        BOX_DBL_HORIZONTAL, BOX_DBL_VERTICAL,
+    ]);
+}
+
+/// Box outline from corners top-left, top-right, bottom-left, bottom-right,
+/// then the horizontal and vertical edge characters
+fn draw_frame(x: usize, y: usize, width: usize, height: usize, fg: Color, bg: Color, chars: [u8; 6]) {
+    let [top_left, top_right, bottom_left, bottom_right, horizontal, vertical] = chars;
+    let (right, bottom) = (x + width - 1, y + height - 1);
 
-    interrupts::without_interrupts(|| {
-        // Top border
-        buffer[y][x].write(ScreenChar {
-            ascii_character: BOX_DBL_TOP_LEFT,
-            color_code: color,
-        });
-        for i in 1..width - 1 {
-            buffer[y][x + i].write(ScreenChar {
-                ascii_character: BOX_DBL_HORIZONTAL,
-                color_code: color,
-            });
-        }
-        buffer[y][x + width - 1].write(ScreenChar {
-            ascii_character: BOX_DBL_TOP_RIGHT,
-            color_code: color,
-        });
+    compositor::draw(|c| {
+        c.put(x, y, cell(top_left, fg, bg));
+        c.fill(x + 1, y, width - 2, 1, cell(horizontal, fg, bg));
+        c.put(right, y, cell(top_right, fg, bg));
 
-        // Sides
-        for row in 1..height - 1 {
-            buffer[y + row][x].write(ScreenChar {
-                ascii_character: BOX_DBL_VERTICAL,
-                color_code: color,
-            });
-            buffer[y + row][x + width - 1].write(ScreenChar {
-                ascii_character: BOX_DBL_VERTICAL,
-                color_code: color,
-            });
-        }
+        c.fill(x, y + 1, 1, height - 2, cell(vertical, fg, bg));
+        c.fill(right, y + 1, 1, height - 2, cell(vertical, fg, bg));
 
-        // Bottom border
-        buffer[y + height - 1][x].write(ScreenChar {
-            ascii_character: BOX_DBL_BOTTOM_LEFT,
-            color_code: color,
-        });
-        for i in 1..width - 1 {
-            buffer[y + height - 1][x + i].write(ScreenChar {
-                ascii_character: BOX_DBL_HORIZONTAL,
-                color_code: color,
-            });
-        }
-        buffer[y + height - 1][x + width - 1].write(ScreenChar {
-            ascii_character: BOX_DBL_BOTTOM_RIGHT,
-            color_code: color,
-        });
+        c.put(x, bottom, cell(bottom_left, fg, bg));
+        c.fill(x + 1, bottom, width - 2, 1, cell(horizontal, fg, bg));
+        c.put(right, bottom, cell(bottom_right, fg, bg));
     });
 }
 
@@ -178,43 +88,32 @@ pub fn write_at(x: usize, y: usize, text: &str, fg: Color, bg: Color) {
         return;
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color = ColorCode::new(fg, bg);
-
-    interrupts::without_interrupts(|| {
+    compositor::draw(|c| {
         let mut col = x;
         for byte in text.bytes() {
             if col >= 80 {
                 break;
             }
             if byte >= 0x20 && byte <= 0x7e {
-                buffer[y][col].write(ScreenChar {
-                    ascii_character: byte,
-                    color_code: color,
-                });
+                c.put(col, y, cell(byte, fg, bg));
                 col += 1;
             }
         }
     });
 }
 
+/// Write one character cell, any code page 437 glyph included
+pub fn put_char(x: usize, y: usize, ch: u8, fg: Color, bg: Color) {
+    compositor::draw(|c| c.put(x, y, cell(ch, fg, bg)));
+}
+
 /// Draw a horizontal line
 pub fn draw_hline(x: usize, y: usize, length: usize, fg: Color, bg: Color) {
     if y >= 25 || x + length > 80 {
         return;
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color = ColorCode::new(fg, bg);
-
-    interrupts::without_interrupts(|| {
-        for i in 0..length {
-            buffer[y][x + i].write(ScreenChar {
-                ascii_character: BOX_HORIZONTAL,
-                color_code: color,
-            });
-        }
-    });
+    compositor::draw(|c| c.fill(x, y, length, 1, cell(BOX_HORIZONTAL, fg, bg)));
 }
 
 /// Draw a progress bar with percentage
@@ -223,26 +122,11 @@ pub fn draw_progress_bar(x: usize, y: usize, width: usize, progress: usize, tota
         return;
     }
 
-    let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-    let color_filled = ColorCode::new(fg, bg);
-    let color_empty = ColorCode::new(Color::DarkGray, bg);
+    let filled_width = ((progress * width) / total).min(width);
 
-    let filled_width = (progress * width) / total;
-
-    interrupts::without_interrupts(|| {
-        for i in 0..width {
-            let char_to_write = if i < filled_width {
-                BLOCK_FULL
-            } else {
-                BLOCK_LIGHT
-            };
-            let color = if i < filled_width { color_filled } else { color_empty };
-            
-            buffer[y][x + i].write(ScreenChar {
-                ascii_character: char_to_write,
-                color_code: color,
-            });
-        }
+    compositor::draw(|c| {
+        c.fill(x, y, filled_width, 1, cell(BLOCK_FULL, fg, bg));
+        c.fill(x + filled_width, y, width - filled_width, 1, cell(BLOCK_LIGHT, Color::DarkGray, bg));
     });
 
     // Draw percentage
@@ -269,34 +153,19 @@ pub fn write_centered(y: usize, text: &str, fg: Color, bg: Color) {
 
 /// Draw a shadow effect box
 pub fn draw_shadow_box(x: usize, y: usize, width: usize, height: usize, fg: Color, bg: Color) {
-    // Draw the main box
+    // Draw the main box and its shadow as one flush
+    compositor::begin_frame();
     draw_double_box(x, y, width, height, fg, bg);
     
     // Draw shadow (if space available)
     if x + width + 1 < 80 && y + height < 25 {
-        let shadow_color = ColorCode::new(Color::DarkGray, Color::Black);
-        let buffer = unsafe { &mut *(0xb8000 as *mut [[Volatile<ScreenChar>; 80]; 25]) };
-        
-        interrupts::without_interrupts(|| {
+        let shadow = cell(BLOCK_DARK, Color::DarkGray, Color::Black);
+        compositor::draw(|c| {
             // Right shadow
-            for row in 1..=height {
-                if y + row < 25 {
-                    buffer[y + row][x + width].write(ScreenChar {
-                        ascii_character: BLOCK_DARK,
-                        color_code: shadow_color,
-                    });
-                }
-            }
-            
+            c.fill(x + width, y + 1, 1, height, shadow);
             // Bottom shadow
-            for col in 1..=width {
-                if x + col < 80 {
-                    buffer[y + height][x + col].write(ScreenChar {
-                        ascii_character: BLOCK_DARK,
-                        color_code: shadow_color,
-                    });
-                }
-            }
+            c.fill(x + 1, y + height, width, 1, shadow);
         });
     }
+    compositor::end_frame();
 }
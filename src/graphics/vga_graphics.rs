@@ -25,6 +25,20 @@ impl VgaGraphics {
         }
     }
 
+    /// Draw into `framebuffer` instead of VGA memory, for off-screen
+    /// images and measurements
+    ///
+    /// # Safety
+    /// `framebuffer` must point to 320 * 200 writable bytes that outlive
+    /// the returned value.
+    pub const unsafe fn with_buffer(framebuffer: *mut u8) -> Self {
+        Self {
+            framebuffer,
+            width: VGA_WIDTH,
+            height: VGA_HEIGHT,
+        }
+    }
+
     /// Switch to VGA mode 13h (320x200x256)
     pub unsafe fn enter_mode_13h(&mut self) {
         // Set VGA mode 13h using BIOS interrupt (requires real mode or v86 mode)
@@ -200,31 +214,43 @@ impl VgaGraphics {
         }
     }
 
+    /// The part of a rectangle on screen as (x, y, x_end, y_end), or None
+    /// when none of it is
+    fn clip(&self, x: usize, y: usize, width: usize, height: usize) -> Option<(usize, usize, usize, usize)> {
+        let x_end = x.saturating_add(width).min(self.width);
+        let y_end = y.saturating_add(height).min(self.height);
+        if x < x_end && y < y_end { Some((x, y, x_end, y_end)) } else { None }
+    }
+
     /// Clear screen with a color
     pub fn clear(&mut self, color: u8) {
-        for i in 0..(self.width * self.height) {
-            unsafe {
-                ptr::write_volatile(self.framebuffer.add(i), color);
-            }
-        }
+        // SAFETY: the framebuffer holds width * height bytes
+        unsafe { fill_span(self.framebuffer, self.width * self.height, color) };
     }
 
     /// Draw a horizontal line
     pub fn draw_hline(&mut self, x: usize, y: usize, length: usize, color: u8) {
-        for i in 0..length {
-            self.set_pixel(x + i, y, color);
+        if let Some((x, y, x_end, _)) = self.clip(x, y, length, 1) {
+            // SAFETY: the span was clipped to the row
+            unsafe { fill_span(self.framebuffer.add(y * self.width + x), x_end - x, color) };
         }
     }
 
     /// Draw a vertical line
     pub fn draw_vline(&mut self, x: usize, y: usize, length: usize, color: u8) {
-        for i in 0..length {
-            self.set_pixel(x, y + i, color);
+        if let Some((x, y, _, y_end)) = self.clip(x, y, 1, length) {
+            for row in y..y_end {
+                // SAFETY: the column was clipped to the screen
+                unsafe { ptr::write_volatile(self.framebuffer.add(row * self.width + x), color) };
+            }
         }
     }
 
     /// Draw a rectangle outline
     pub fn draw_rect(&mut self, x: usize, y: usize, width: usize, height: usize, color: u8) {
+        if width == 0 || height == 0 {
+            return;
+        }
         self.draw_hline(x, y, width, color);
         self.draw_hline(x, y + height - 1, width, color);
         self.draw_vline(x, y, height, color);
@@ -233,8 +259,54 @@ impl VgaGraphics {
 
     /// Draw a filled rectangle
     pub fn fill_rect(&mut self, x: usize, y: usize, width: usize, height: usize, color: u8) {
-        for dy in 0..height {
-            self.draw_hline(x, y + dy, width, color);
+        let Some((x, y, x_end, y_end)) = self.clip(x, y, width, height) else { return };
+        // SAFETY: every span lies in a clipped row
+        unsafe {
+            if x == 0 && x_end == self.width {
+                // Full-width rows are contiguous
+                fill_span(self.framebuffer.add(y * self.width), (y_end - y) * self.width, color);
+            } else {
+                for row in y..y_end {
+                    fill_span(self.framebuffer.add(row * self.width + x), x_end - x, color);
+                }
+            }
+        }
+    }
+
+    /// Copy a `width` x `height` image of row-major palette indices, clipped
+    pub fn blit(&mut self, x: usize, y: usize, width: usize, height: usize, src: &[u8]) {
+        self.blit_rows(x, y, width, height, src, None);
+    }
+
+    /// Like `blit`, but pixels equal to `key` are transparent
+    pub fn blit_keyed(&mut self, x: usize, y: usize, width: usize, height: usize, src: &[u8], key: u8) {
+        self.blit_rows(x, y, width, height, src, Some(key));
+    }
+
+    fn blit_rows(&mut self, x: usize, y: usize, width: usize, height: usize, src: &[u8], key: Option<u8>) {
+        if src.len() < width * height {
+            return;
+        }
+        let Some((x, y, x_end, y_end)) = self.clip(x, y, width, height) else { return };
+        for row in y..y_end {
+            let line = &src[(row - y) * width..][..x_end - x];
+            let dst = unsafe { self.framebuffer.add(row * self.width + x) };
+            match key {
+                // SAFETY: the row was clipped to the screen
+                None => unsafe { copy_span(line, dst) },
+                Some(key) => {
+                    // Copy each run of opaque pixels in one go
+                    let mut at = 0;
+                    while at < line.len() {
+                        let Some(start) = line[at..].iter().position(|&p| p != key) else { break };
+                        let start = at + start;
+                        let end = line[start..].iter().position(|&p| p == key).map_or(line.len(), |n| start + n);
+                        // SAFETY: the run is part of the clipped row
+                        unsafe { copy_span(&line[start..end], dst.add(start)) };
+                        at = end;
+                    }
+                }
+            }
         }
     }
 
@@ -271,7 +343,8 @@ impl VgaGraphics {
         }
     }
 
-    /// Draw a line (Bresenham's algorithm)
+    /// Draw a line (Bresenham's algorithm), filling each horizontal run of
+    /// pixels as one span
     pub fn draw_line(&mut self, x0: usize, y0: usize, x1: usize, y1: usize, color: u8) {
         let dx = if x1 > x0 { x1 - x0 } else { x0 - x1 };
         let dy = if y1 > y0 { y1 - y0 } else { y0 - y1 };
@@ -280,22 +353,38 @@ impl VgaGraphics {
         let mut err = (if dx > dy { dx as isize } else { -(dy as isize) }) / 2;
         let mut x = x0 as isize;
         let mut y = y0 as isize;
+        // First pixel of the run on row `y`
+        let mut run_x = x;
 
         loop {
-            self.set_pixel(x as usize, y as usize, color);
             if x == x1 as isize && y == y1 as isize {
                 break;
             }
             let e2 = err;
+            let mut next_x = x;
             if e2 > -(dx as isize) {
                 err -= dy as isize;
-                x += sx;
+                next_x += sx;
             }
             if e2 < dy as isize {
                 err += dx as isize;
+                self.draw_run(run_x, x, y, color);
                 y += sy;
+                run_x = next_x;
             }
+            x = next_x;
+        }
+        self.draw_run(run_x, x, y, color);
+    }
+
+    /// Fill row `y` between columns `a` and `b`, in either order
+    fn draw_run(&mut self, a: isize, b: isize, y: isize, color: u8) {
+        let (left, right) = if a <= b { (a, b) } else { (b, a) };
+        if y < 0 || right < 0 {
+            return;
         }
+        let left = left.max(0) as usize;
+        self.draw_hline(left, y as usize, right as usize - left + 1, color);
     }
 
     /// Return to text mode
@@ -308,9 +397,98 @@ impl VgaGraphics {
             // Additional register setup would go here
             // This is a simplified version
         }
+        // Mode switches leave text memory undefined
+        crate::graphics::compositor::invalidate();
+    }
+}
+
+/// Fill `len` bytes from `dst` with `color`, eight bytes per store once
+/// `dst` is aligned
+///
+/// # Safety
+/// `dst..dst + len` must be writable.
+unsafe fn fill_span(dst: *mut u8, len: usize, color: u8) {
+    let head = dst.align_offset(8).min(len);
+    let words = (len - head) / 8;
+    unsafe {
+        for i in 0..head {
+            ptr::write_volatile(dst.add(i), color);
+        }
+        if words > 0 {
+            let pattern = u64::from_ne_bytes([color; 8]);
+            core::arch::asm!(
+                "rep stosq",
+                inout("rcx") words => _,
+                inout("rdi") dst.add(head) => _,
+                in("rax") pattern,
+                options(nostack, preserves_flags),
+            );
+        }
+        for i in head + words * 8..len {
+            ptr::write_volatile(dst.add(i), color);
+        }
     }
 }
 
+/// Copy `src` to `dst`
+///
+/// # Safety
+/// `dst..dst + src.len()` must be writable and not overlap `src`.
+unsafe fn copy_span(src: &[u8], dst: *mut u8) {
+    unsafe { ptr::copy_nonoverlapping(src.as_ptr(), dst, src.len()) };
+}
+
+/// Pixels per second filled by the old per-pixel loop and by span fills
+#[derive(Debug, Clone, Copy)]
+pub struct FillRate {
+    pub per_pixel: u64,
+    pub spans: u64,
+}
+
+/// Measure fill rate for about `duration_ms`, split between the two paths
+///
+/// Fills go to an off-screen buffer: leaving mode 13h again is not
+/// supported, and in text mode VGA memory at 0xA0000 is not mapped to
+/// anything, so this measures the drawing code rather than the bus.
+pub fn measure_fill_rate(duration_ms: u64) -> FillRate {
+    use alloc::vec;
+    use crate::interrupts::uptime_ms;
+
+    // Rectangles of a few sizes, so row setup and clipping are included
+    const RECTS: [(usize, usize, usize, usize); 4] =
+        [(0, 0, 320, 200), (13, 7, 150, 90), (101, 50, 33, 140), (200, 180, 200, 40)];
+
+    let mut buffer = vec![0u8; VGA_WIDTH * VGA_HEIGHT];
+    // SAFETY: the buffer holds a full screen and outlives `vga`
+    let mut vga = unsafe { VgaGraphics::with_buffer(buffer.as_mut_ptr()) };
+    let pixels: u64 = RECTS.iter()
+        .map(|&(x, y, w, h)| (w.min(VGA_WIDTH - x) * h.min(VGA_HEIGHT - y)) as u64)
+        .sum();
+
+    let mut rate = |fill: &mut dyn FnMut(&mut VgaGraphics, usize, usize, usize, usize, u8)| {
+        let start = uptime_ms();
+        let mut filled = 0u64;
+        let mut color = 0u8;
+        while uptime_ms() - start < duration_ms / 2 {
+            for &(x, y, w, h) in &RECTS {
+                fill(&mut vga, x, y, w, h, color);
+            }
+            color = color.wrapping_add(1);
+            filled += pixels;
+        }
+        filled * 1000 / (uptime_ms() - start).max(1)
+    };
+    let per_pixel = rate(&mut |vga, x, y, w, h, color| {
+        for row in y..y + h {
+            for col in x..x + w {
+                vga.set_pixel(col, row, color);
+            }
+        }
+    });
+    let spans = rate(&mut |vga, x, y, w, h, color| vga.fill_rect(x, y, w, h, color));
+    FillRate { per_pixel, spans }
+}
+
 /// Default VGA color palette indices
 #[repr(u8)]
 #[derive(Debug, Clone, Copy)]
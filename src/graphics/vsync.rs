@@ -0,0 +1,129 @@
+/// Pacing presents to the display's vertical retrace
+///
+/// A loop that redraws whenever input arrives flushes far more often than
+/// the screen refreshes. `FrameScheduler::ready` says when to present:
+/// once per vertical retrace, seen by polling bit 3 of input status
+/// register 1 (port 0x3DA). Everything drawn in between is coalesced into
+/// that one flush.
+///
+/// Some emulated adapters toggle the retrace bit on every read instead of
+/// following the beam, so presents are also kept at least most of a
+/// refresh period apart. When the caller polls too rarely to catch a
+/// retrace, it presents late rather than not at all. Both need finer time
+/// than the ~55 ms timer tick, so the TSC is measured against the tick.
+
+use core::sync::atomic::{AtomicU64, Ordering};
+use x86_64::instructions::port::Port;
+use crate::interrupts::{ticks, TICK_US};
+
+const INPUT_STATUS_1: u16 = 0x3DA;
+const VERTICAL_RETRACE: u8 = 0x08;
+
+/// Refresh period of the 70 Hz VGA text modes
+const REFRESH_US: u64 = 14_286;
+
+/// Presents closer together than this wait for a later retrace
+const MIN_INTERVAL_US: u64 = REFRESH_US * 3 / 4;
+
+/// Present even without a retrace once this long has passed
+const LATE_US: u64 = REFRESH_US * 2;
+
+/// Timer ticks the TSC rate is measured over
+const CALIBRATION_TICKS: u64 = 4;
+
+static ON_RETRACE: AtomicU64 = AtomicU64::new(0);
+static LATE: AtomicU64 = AtomicU64::new(0);
+
+/// Counters of all schedulers since boot
+#[derive(Debug, Clone, Copy)]
+pub struct Stats {
+    /// Presents made during a vertical retrace
+    pub on_retrace: u64,
+    /// Presents made late, without seeing a retrace
+    pub late: u64,
+}
+
+pub fn stats() -> Stats {
+    Stats {
+        on_retrace: ON_RETRACE.load(Ordering::Relaxed),
+        late: LATE.load(Ordering::Relaxed),
+    }
+}
+
+fn tsc() -> u64 {
+    unsafe { core::arch::x86_64::_rdtsc() }
+}
+
+pub struct FrameScheduler {
+    /// Tick and TSC at the first tick edge seen, to measure the TSC from
+    calibration: Option<(u64, u64)>,
+    /// Tick seen by the previous poll, until calibration starts
+    seen_tick: u64,
+    /// TSC cycles per microsecond, zero until measured
+    tsc_per_us: u64,
+    last_present: u64,
+    last_present_tick: u64,
+    /// Whether the retrace in progress has had its present
+    presented_this_retrace: bool,
+}
+
+impl FrameScheduler {
+    pub fn new() -> Self {
+        FrameScheduler {
+            calibration: None,
+            seen_tick: ticks(),
+            tsc_per_us: 0,
+            last_present: tsc(),
+            last_present_tick: ticks(),
+            presented_this_retrace: false,
+        }
+    }
+
+    /// Measure the TSC rate from the first tick edge seen over the
+    /// following CALIBRATION_TICKS ticks
+    fn calibrate(&mut self, now: u64) {
+        if self.tsc_per_us != 0 {
+            return;
+        }
+        let tick = ticks();
+        match self.calibration {
+            None if tick != self.seen_tick => self.calibration = Some((tick, now)),
+            None => {}
+            Some((start_tick, start_tsc)) if tick >= start_tick + CALIBRATION_TICKS => {
+                self.tsc_per_us = ((now - start_tsc) / ((tick - start_tick) * TICK_US)).max(1);
+            }
+            Some(_) => {}
+        }
+        self.seen_tick = tick;
+    }
+
+    /// Whether to present now; call once per pass of the drawing loop
+    pub fn ready(&mut self) -> bool {
+        let now = tsc();
+        self.calibrate(now);
+        let retrace = unsafe { Port::<u8>::new(INPUT_STATUS_1).read() } & VERTICAL_RETRACE != 0;
+        if !retrace {
+            self.presented_this_retrace = false;
+        }
+        let since_us = (self.tsc_per_us != 0).then(|| (now - self.last_present) / self.tsc_per_us);
+
+        let on_retrace = retrace && !self.presented_this_retrace
+            && since_us.is_none_or(|us| us >= MIN_INTERVAL_US);
+        let late = !on_retrace && match since_us {
+            Some(us) => us >= LATE_US,
+            None => ticks() != self.last_present_tick,
+        };
+        if !on_retrace && !late {
+            return false;
+        }
+        if on_retrace {
+            ON_RETRACE.fetch_add(1, Ordering::Relaxed);
+        } else {
+            LATE.fetch_add(1, Ordering::Relaxed);
+        }
+        self.presented_this_retrace = retrace;
+        self.last_present = now;
+        self.last_present_tick = ticks();
+        true
+    }
+}
@@ -28,6 +28,8 @@ lazy_static! {
             .set_handler_fn(keyboard_interrupt_handler);
         idt[InterruptIndex::Mouse.as_usize()]
             .set_handler_fn(mouse_interrupt_handler);
+        idt[InterruptIndex::Serial1.as_usize()]
+            .set_handler_fn(serial_interrupt_handler);
         idt[InterruptIndex::Network10.as_usize()]
             .set_handler_fn(network_interrupt_handler);
         idt[InterruptIndex::Network11.as_usize()]
@@ -41,10 +43,28 @@ pub fn init_idt() {
     IDT.load();
 }
 
+/// Timer interrupts since boot
+static TICKS: AtomicU64 = AtomicU64::new(0);
+
+/// PIT period at the BIOS default divisor (65536), in microseconds
+pub const TICK_US: u64 = 54_925;
+
+/// Number of timer ticks since interrupts were enabled
+pub fn ticks() -> u64 {
+    TICKS.load(Ordering::Relaxed)
+}
+
+/// Milliseconds since boot, at timer-tick resolution (~55 ms)
+pub fn uptime_ms() -> u64 {
+    ticks() * TICK_US / 1000
+}
+
 extern "x86-interrupt" fn timer_interrupt_handler(
     _stack_frame: InterruptStackFrame) 
 {
     //print!(".");
+    let now = TICKS.fetch_add(1, Ordering::Relaxed) + 1;
+    crate::task::timer::wake_expired(now);
     // call registered irq handlers (irq 0)
     handle_registered_irq(0);
     unsafe {
@@ -124,6 +144,16 @@ extern "x86-interrupt" fn mouse_interrupt_handler(
     }
 }
 
+extern "x86-interrupt" fn serial_interrupt_handler(
+    _stack_frame: InterruptStackFrame)
+{
+    crate::serial::handle_interrupt();
+    unsafe {
+        PICS.lock()
+            .notify_end_of_interrupt(InterruptIndex::Serial1.as_u8());
+    }
+}
+
 extern "x86-interrupt" fn network_interrupt_handler(
     _stack_frame: InterruptStackFrame)
 {
@@ -148,6 +178,7 @@ fn handle_network_interrupt() {
 
 // irq handler registry for dynamic registration (supports 16 pic irqs)
 use core::option::Option;
+use core::sync::atomic::{AtomicU64, Ordering};
 use spin::Mutex as SpinMutex;
 
 static IRQ_HANDLERS: SpinMutex<[Option<fn()>; 16]> = SpinMutex::new([None; 16]);
@@ -195,6 +226,7 @@ pub static PICS: spin::Mutex<ChainedPics> = spin::Mutex::new(
 pub enum InterruptIndex {
     Timer = PIC_1_OFFSET,
     Keyboard,
+    Serial1 = PIC_1_OFFSET + 4, // IRQ 4 (COM1)
     Mouse = PIC_2_OFFSET + 4, // IRQ 12 (secondary PIC)
     // Stage 1.2: Network card IRQs (typically IRQ 10 or 11)
     Network10 = PIC_2_OFFSET + 2, // IRQ 10 (secondary PIC)
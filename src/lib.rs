@@ -13,6 +13,7 @@ pub mod interrupts;
 pub mod memory;
 pub mod allocator;
 pub mod serial;
+pub mod line_buffer;
 pub mod vga_buffer;
 pub mod task;
 
@@ -46,6 +47,7 @@ pub fn init() {
     // The secondary PIC's IMR is at port 0xA1
     // IRQ 12 is bit 4 on the secondary PIC (IRQ 12 = 8 + 4)
     // We also need to unmask IRQ 2 on primary PIC (cascade to secondary)
+    // and IRQ 4 (COM1), which drains serial output
     unsafe {
         use x86_64::instructions::port::Port;
         
@@ -53,16 +55,17 @@ pub fn init() {
         let mut pic1_data: Port<u8> = Port::new(0x21); // Primary PIC data/IMR
         let mut pic2_data: Port<u8> = Port::new(0xA1); // Secondary PIC data/IMR
         
-        // Unmask IRQ 2 on primary (cascade) - bit 2
+        // Unmask IRQ 2 on primary (cascade) - bit 2, IRQ 4 (COM1) - bit 4
         let mask1: u8 = pic1_data.read();
-        pic1_data.write(mask1 & !0x04);
+        pic1_data.write(mask1 & !0x14);
         
         // Unmask IRQ 12 on secondary (mouse) - bit 4
         let mask2: u8 = pic2_data.read();
         pic2_data.write(mask2 & !0x10);
         
-        serial_println!("[PIC] Unmasked IRQ2 (cascade) and IRQ12 (mouse)");
+        serial_println!("[PIC] Unmasked IRQ2 (cascade), IRQ4 (COM1) and IRQ12 (mouse)");
     }
+    serial::enable_interrupts();
     
     x86_64::instructions::interrupts::enable();
 }
@@ -106,6 +109,8 @@ pub enum QemuExitCode {
 pub fn exit_qemu(exit_code: QemuExitCode) {
     use x86_64::instructions::port::Port;
 
+    // Output still queued for COM1 would be lost
+    serial::flush();
     unsafe {
         let mut port = Port::new(0xf4);
         port.write(exit_code as u32);
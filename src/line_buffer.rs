@@ -0,0 +1,65 @@
+/// Formatting output before taking a device lock
+///
+/// `print!` and `serial_print!` used to hold their device's lock, with
+/// interrupts off, for the whole of formatting, and took it again for every
+/// fragment. Here the text is formatted into a buffer on the caller's stack,
+/// which no other core or interrupt handler can touch, and handed over in a
+/// few large pieces, each ending at a line break where possible. The lock is
+/// taken once per piece, for a copy.
+
+use core::fmt;
+
+/// Bytes formatted before a piece is committed
+const CAPACITY: usize = 256;
+
+struct LineBuffer<F: FnMut(&[u8])> {
+    bytes: [u8; CAPACITY],
+    len: usize,
+    commit: F,
+}
+
+impl<F: FnMut(&[u8])> LineBuffer<F> {
+    /// Commit the complete lines held, or everything if there are none,
+    /// and keep the rest
+    fn commit_lines(&mut self) {
+        let end = match self.bytes[..self.len].iter().rposition(|&b| b == b'\n') {
+            Some(newline) => newline + 1,
+            None => self.len,
+        };
+        (self.commit)(&self.bytes[..end]);
+        self.bytes.copy_within(end..self.len, 0);
+        self.len -= end;
+    }
+}
+
+impl<F: FnMut(&[u8])> fmt::Write for LineBuffer<F> {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        let mut s = s.as_bytes();
+        while !s.is_empty() {
+            if self.len == CAPACITY {
+                self.commit_lines();
+            }
+            let n = s.len().min(CAPACITY - self.len);
+            self.bytes[self.len..self.len + n].copy_from_slice(&s[..n]);
+            self.len += n;
+            s = &s[n..];
+        }
+        Ok(())
+    }
+}
+
+/// Format `args` without holding any lock and pass the text to `commit`
+pub fn format_buffered(args: fmt::Arguments, mut commit: impl FnMut(&[u8])) {
+    // Plain strings need no formatting, however long
+    if let Some(s) = args.as_str() {
+        if !s.is_empty() {
+            commit(s.as_bytes());
+        }
+        return;
+    }
+    let mut buffer = LineBuffer { bytes: [0; CAPACITY], len: 0, commit };
+    let _ = fmt::write(&mut buffer, args);
+    if buffer.len > 0 {
+        (buffer.commit)(&buffer.bytes[..buffer.len]);
+    }
+}
@@ -22,6 +22,16 @@ use rustrial_os::native_ffi;
 use rustrial_os::desktop::{run_desktop_environment, IconAction};
 //use x86_64::structures::paging::PageTable;
 
+/// Probe for an ATA data disk and mount its filesystem at /data
+fn mount_data_disk() {
+    if rustrial_os::drivers::block::ata::init_disk().is_err() {
+        return;
+    }
+    if let Err(e) = rustrial_os::fs::mount_disk("/data") {
+        println!("[FS] Data disk not mounted: {}", e);
+    }
+}
+
 fn print_hardware_summary() {
     let cpu_info = native_ffi::CpuInfo::get();
     let dt = native_ffi::DateTime::read();
@@ -174,6 +184,16 @@ fn kernel_main(boot_info: &'static BootInfo) -> ! {
     rustrial_os::memory::dma::init_dma(&mut mapper, &mut frame_allocator, phys_mem_offset)
         .expect("DMA initialization failed");
 
+    // keep the BIOS text font for drawing text in graphics modes
+    let font = unsafe { rustrial_os::graphics::font::init(phys_mem_offset) };
+    println!("[Graphics] System font captured ({} glyphs, {}x{})", font.glyph_count(), font.width(), font.height());
+
+    // map the linear framebuffer, if the display has one
+    match rustrial_os::graphics::framebuffer::init(&mut mapper, &mut frame_allocator) {
+        Ok(size) => println!("[Graphics] Linear framebuffer mapped ({} KiB video memory)", size / 1024),
+        Err(e) => println!("[Graphics] Linear framebuffer unavailable: {}", e),
+    }
+
     // Initialize loopback device (127.0.0.1)
     println!("[Network] Initializing loopback interface...");
     let loopback = rustrial_os::net::loopback::LoopbackDevice::default();
@@ -191,6 +211,10 @@ fn kernel_main(boot_info: &'static BootInfo) -> ! {
     rustrial_os::fs::init();
     rustrial_os::script_loader::load_scripts()
         .expect("failed to load scripts");
+    mount_data_disk();
+
+    #[cfg(feature = "lfs_crash_test")]
+    rustrial_os::fs::crash_test();
 
     // let page = Page::containing_address(VirtAddr::new(0xdeadbeaf000));
     // memory::create_example_mapping(page, &mut mapper, &mut frame_allocator);
@@ -230,6 +254,10 @@ fn kernel_main(boot_info: &'static BootInfo) -> ! {
     println!("[Network] Initializing network stack...");
     rustrial_os::net::stack::init(&mut executor);
     println!("[Network] Network stack initialized");
+
+    // Page cache write-back and filesystem sync run alongside the desktop
+    executor.spawn(Task::new(rustrial_os::fs::page_cache::writeback_task()));
+    executor.spawn(Task::new(rustrial_os::fs::sync_task()));
     
     executor.spawn(Task::new(desktop_loop()));
     executor.run();
@@ -255,6 +283,7 @@ fn kernel_main_custom() -> ! {
     rustrial_os::fs::init();
     rustrial_os::script_loader::load_scripts()
         .expect("failed to load scripts");
+    mount_data_disk();
 
     #[cfg(test)]
     test_main();
@@ -272,6 +301,8 @@ fn kernel_main_custom() -> ! {
     // Initialize network stack (spawn RX/TX processing tasks)
     // Note: Custom bootloader path has no DMA/heap, network may not work
     rustrial_os::net::stack::init(&mut executor);
+    executor.spawn(Task::new(rustrial_os::fs::page_cache::writeback_task()));
+    executor.spawn(Task::new(rustrial_os::fs::sync_task()));
     
     executor.spawn(Task::new(desktop_loop()));
     executor.run();
@@ -1,6 +1,5 @@
 use crate::{print, println};
 use crate::task::keyboard;
-use crate::fs::FileSystem;
 use crate::graphics::text_graphics::{
     draw_filled_box,
     draw_hline,
@@ -416,10 +415,7 @@ pub async fn show_scripts_from_desktop() {
                                                     }
                                                 }
                                                 DecodedKey::RawKey(KeyCode::ArrowDown) | DecodedKey::Unicode('s') | DecodedKey::Unicode('S') => {
-                                                    let max_index = crate::fs::root_fs()
-                                                        .and_then(|fs| fs.lock().list_dir("/scripts").ok())
-                                                        .map(|scripts: Vec<alloc::string::String>| scripts.len())
-                                                        .unwrap_or(0);
+                                                    let max_index = crate::script_loader::script_paths().len();
                                                     if max_index > 0 && selected_index < max_index.saturating_sub(1) {
                                                         selected_index += 1;
                                                         if selected_index >= (page + 1) * 10 {
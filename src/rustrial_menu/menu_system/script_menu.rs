@@ -8,7 +8,6 @@ use crate::graphics::text_graphics::{
 };
 use crate::graphics::splash::show_status_bar;
 use crate::vga_buffer::Color;
-use crate::fs::FileSystem;
 use pc_keyboard::{DecodedKey, KeyCode};
 use alloc::{format, vec::Vec, string::String};
 use core::cmp::min;
@@ -68,9 +67,7 @@ pub fn show_script_browser(selected_index: usize, page: usize) {
 
     draw_hline(FRAME_X + 2, FRAME_Y + 4, FRAME_WIDTH - 4, Color::Cyan, Color::Black);
 
-    let scripts: Vec<String> = crate::fs::root_fs()
-        .and_then(|fs| fs.lock().list_dir("/scripts").ok())
-        .unwrap_or_else(Vec::new);
+    let scripts: Vec<String> = crate::script_loader::script_paths();
 
     if scripts.is_empty() {
         write_centered(FRAME_Y + FRAME_HEIGHT / 2, "No scripts found in /scripts", Color::LightRed, Color::Black);
@@ -149,13 +146,7 @@ pub fn handle_script_browser_input(
             }
         }
         DecodedKey::RawKey(KeyCode::ArrowDown) | DecodedKey::Unicode('s') | DecodedKey::Unicode('S') => {
-            let max_index = crate::fs::root_fs()
-                .and_then(|fs| {
-                    let fs_guard = fs.lock();
-                    fs_guard.list_dir("/scripts").ok()
-                })
-                .map(|scripts| scripts.len())
-                .unwrap_or(0);
+            let max_index = crate::script_loader::script_paths().len();
 
             if max_index > 0 && *selected_index < max_index.saturating_sub(1) {
                 *selected_index += 1;
@@ -176,13 +167,7 @@ pub fn handle_script_browser_input(
             }
         }
         DecodedKey::RawKey(KeyCode::ArrowRight) => {
-            let max_index = crate::fs::root_fs()
-                .and_then(|fs| {
-                    let fs_guard = fs.lock();
-                    fs_guard.list_dir("/scripts").ok()
-                })
-                .map(|scripts| scripts.len())
-                .unwrap_or(0);
+            let max_index = crate::script_loader::script_paths().len();
             let max_page = if max_index == 0 { 0 } else { (max_index - 1) / 10 };
             if *page < max_page {
                 *page += 1;
@@ -209,36 +194,23 @@ pub fn run_selected_script(index: usize) {
     println!("           Running Script");
     println!("+========================================+\n");
     
-    if let Some(fs) = crate::fs::root_fs() {
-        let fs = fs.lock();
-        match fs.list_dir("/scripts") {
-            Ok(scripts) => {
-                if index < scripts.len() {
-                    let script_path = &scripts[index];
-                    let filename = script_path.trim_start_matches("/scripts/");
-                    println!("Running: {}\n", filename);
-                    
-                    match fs.read_file_to_string(script_path) {
-                        Ok(content) => {
-                            match crate::rustrial_script::run(&content) {
-                                Ok(_) => println!("\n[OK] Script completed successfully!"),
-                                Err(e) => println!("\n[ERROR] Script error: {}", e),
-                            }
-                        }
-                        Err(e) => {
-                            println!("Error reading script: {}", e);
-                        }
-                    }
-                } else {
-                    println!("Invalid script index");
-                }
-            }
-            Err(e) => {
-                println!("Error listing scripts: {}", e);
-            }
-        }
-    } else {
+    let Some(fs) = crate::fs::root_fs() else {
         println!("Error: Filesystem not initialized");
+        return;
+    };
+    let scripts = crate::script_loader::script_paths();
+    let Some(script_path) = scripts.get(index) else {
+        println!("Invalid script index");
+        return;
+    };
+    let filename = script_path.trim_start_matches("/scripts/");
+    println!("Running: {}\n", filename);
+
+    // Compile, or load the cached image, then run with the filesystem unlocked
+    let loaded = crate::rustrial_script::image::load(&mut *fs.lock(), script_path);
+    match loaded.and_then(|chunk| crate::rustrial_script::run_chunk(&chunk)) {
+        Ok(_) => println!("\n[OK] Script completed successfully!"),
+        Err(e) => println!("\n[ERROR] Script error: {}", e),
     }
 }
 
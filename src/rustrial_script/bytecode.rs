@@ -0,0 +1,539 @@
+//! Compact byte encoding of RustrialScript programs
+//!
+//! Each instruction is one opcode byte followed by its operands as
+//! little-endian `u16`s: a constant pool index, a variable slot, or a jump
+//! target (byte offset into the code). `INCREMENT_SLOT` takes a slot and
+//! then a constant. Every chunk ends in `HALT`.
+//!
+//! A `Chunk` can only be built through the verifier, which checks operands
+//! and proves that no path over- or underflows the VM stack. The VM relies
+//! on this to run without per-instruction bounds checks.
+//!
+//! After verification, `specialize` rewrites arithmetic and comparisons
+//! whose operands are provably integers to `_INT` forms that skip the type
+//! check. These never appear in encoded code from outside: the verifier
+//! rejects them and images store the generic opcodes.
+
+use alloc::string::String;
+use alloc::vec;
+use alloc::vec::Vec;
+use crate::rustrial_script::parser::{Comparison, OpCode, Program};
+use crate::rustrial_script::value::Value;
+
+/// Operand stack depth the VM provides
+pub const STACK_SIZE: usize = 256;
+
+/// Opcode bytes
+pub mod op {
+    pub const CONSTANT: u8 = 0;
+    pub const LOAD_SLOT: u8 = 1;
+    pub const STORE_SLOT: u8 = 2;
+    pub const ADD: u8 = 3;
+    pub const SUBTRACT: u8 = 4;
+    pub const MULTIPLY: u8 = 5;
+    pub const DIVIDE: u8 = 6;
+    pub const MODULO: u8 = 7;
+    pub const NEGATE: u8 = 8;
+    pub const EQUAL: u8 = 9;
+    pub const NOT_EQUAL: u8 = 10;
+    pub const LESS: u8 = 11;
+    pub const GREATER: u8 = 12;
+    pub const LESS_EQUAL: u8 = 13;
+    pub const GREATER_EQUAL: u8 = 14;
+    pub const JUMP: u8 = 15;
+    pub const JUMP_IF_FALSE: u8 = 16;
+    pub const PRINT: u8 = 17;
+    pub const CLEAR: u8 = 18;
+    pub const POP: u8 = 19;
+    pub const HALT: u8 = 20;
+    pub const INCREMENT_SLOT: u8 = 21;
+    pub const JUMP_UNLESS_EQUAL: u8 = 22;
+    pub const JUMP_UNLESS_NOT_EQUAL: u8 = 23;
+    pub const JUMP_UNLESS_LESS: u8 = 24;
+    pub const JUMP_UNLESS_GREATER: u8 = 25;
+    pub const JUMP_UNLESS_LESS_EQUAL: u8 = 26;
+    pub const JUMP_UNLESS_GREATER_EQUAL: u8 = 27;
+
+    // Specialized forms, set by `specialize` only
+    pub const ADD_INT: u8 = 28;
+    pub const SUBTRACT_INT: u8 = 29;
+    pub const MULTIPLY_INT: u8 = 30;
+    pub const DIVIDE_INT: u8 = 31;
+    pub const MODULO_INT: u8 = 32;
+    pub const LESS_INT: u8 = 33;
+    pub const GREATER_INT: u8 = 34;
+    pub const LESS_EQUAL_INT: u8 = 35;
+    pub const GREATER_EQUAL_INT: u8 = 36;
+    pub const JUMP_UNLESS_LESS_INT: u8 = 37;
+    pub const JUMP_UNLESS_GREATER_INT: u8 = 38;
+    pub const JUMP_UNLESS_LESS_EQUAL_INT: u8 = 39;
+    pub const JUMP_UNLESS_GREATER_EQUAL_INT: u8 = 40;
+}
+
+/// The `_INT` form of an opcode that has one
+fn int_form(opcode: u8) -> Option<u8> {
+    use op::*;
+    Some(match opcode {
+        ADD => ADD_INT,
+        SUBTRACT => SUBTRACT_INT,
+        MULTIPLY => MULTIPLY_INT,
+        DIVIDE => DIVIDE_INT,
+        MODULO => MODULO_INT,
+        LESS => LESS_INT,
+        GREATER => GREATER_INT,
+        LESS_EQUAL => LESS_EQUAL_INT,
+        GREATER_EQUAL => GREATER_EQUAL_INT,
+        JUMP_UNLESS_LESS => JUMP_UNLESS_LESS_INT,
+        JUMP_UNLESS_GREATER => JUMP_UNLESS_GREATER_INT,
+        JUMP_UNLESS_LESS_EQUAL => JUMP_UNLESS_LESS_EQUAL_INT,
+        JUMP_UNLESS_GREATER_EQUAL => JUMP_UNLESS_GREATER_EQUAL_INT,
+        _ => return None,
+    })
+}
+
+/// The generic opcode behind a specialized one, or `opcode` itself
+pub fn generic(opcode: u8) -> u8 {
+    use op::*;
+    match opcode {
+        ADD_INT => ADD,
+        SUBTRACT_INT => SUBTRACT,
+        MULTIPLY_INT => MULTIPLY,
+        DIVIDE_INT => DIVIDE,
+        MODULO_INT => MODULO,
+        LESS_INT => LESS,
+        GREATER_INT => GREATER,
+        LESS_EQUAL_INT => LESS_EQUAL,
+        GREATER_EQUAL_INT => GREATER_EQUAL,
+        JUMP_UNLESS_LESS_INT => JUMP_UNLESS_LESS,
+        JUMP_UNLESS_GREATER_INT => JUMP_UNLESS_GREATER,
+        JUMP_UNLESS_LESS_EQUAL_INT => JUMP_UNLESS_LESS_EQUAL,
+        JUMP_UNLESS_GREATER_EQUAL_INT => JUMP_UNLESS_GREATER_EQUAL,
+        _ => opcode,
+    }
+}
+
+/// Mnemonic of an opcode, for profiles and listings
+pub fn name(opcode: u8) -> &'static str {
+    use op::*;
+    match opcode {
+        CONSTANT => "CONSTANT",
+        LOAD_SLOT => "LOAD_SLOT",
+        STORE_SLOT => "STORE_SLOT",
+        ADD => "ADD",
+        SUBTRACT => "SUBTRACT",
+        MULTIPLY => "MULTIPLY",
+        DIVIDE => "DIVIDE",
+        MODULO => "MODULO",
+        NEGATE => "NEGATE",
+        EQUAL => "EQUAL",
+        NOT_EQUAL => "NOT_EQUAL",
+        LESS => "LESS",
+        GREATER => "GREATER",
+        LESS_EQUAL => "LESS_EQUAL",
+        GREATER_EQUAL => "GREATER_EQUAL",
+        JUMP => "JUMP",
+        JUMP_IF_FALSE => "JUMP_IF_FALSE",
+        PRINT => "PRINT",
+        CLEAR => "CLEAR",
+        POP => "POP",
+        HALT => "HALT",
+        INCREMENT_SLOT => "INCREMENT_SLOT",
+        JUMP_UNLESS_EQUAL => "JUMP_UNLESS_EQUAL",
+        JUMP_UNLESS_NOT_EQUAL => "JUMP_UNLESS_NOT_EQUAL",
+        JUMP_UNLESS_LESS => "JUMP_UNLESS_LESS",
+        JUMP_UNLESS_GREATER => "JUMP_UNLESS_GREATER",
+        JUMP_UNLESS_LESS_EQUAL => "JUMP_UNLESS_LESS_EQUAL",
+        JUMP_UNLESS_GREATER_EQUAL => "JUMP_UNLESS_GREATER_EQUAL",
+        ADD_INT => "ADD_INT",
+        SUBTRACT_INT => "SUBTRACT_INT",
+        MULTIPLY_INT => "MULTIPLY_INT",
+        DIVIDE_INT => "DIVIDE_INT",
+        MODULO_INT => "MODULO_INT",
+        LESS_INT => "LESS_INT",
+        GREATER_INT => "GREATER_INT",
+        LESS_EQUAL_INT => "LESS_EQUAL_INT",
+        GREATER_EQUAL_INT => "GREATER_EQUAL_INT",
+        JUMP_UNLESS_LESS_INT => "JUMP_UNLESS_LESS_INT",
+        JUMP_UNLESS_GREATER_INT => "JUMP_UNLESS_GREATER_INT",
+        JUMP_UNLESS_LESS_EQUAL_INT => "JUMP_UNLESS_LESS_EQUAL_INT",
+        JUMP_UNLESS_GREATER_EQUAL_INT => "JUMP_UNLESS_GREATER_EQUAL_INT",
+        _ => "?",
+    }
+}
+
+/// Opcode of the `JumpUnless` form of a comparison
+fn jump_unless(comparison: Comparison) -> u8 {
+    match comparison {
+        Comparison::Equal => op::JUMP_UNLESS_EQUAL,
+        Comparison::NotEqual => op::JUMP_UNLESS_NOT_EQUAL,
+        Comparison::Less => op::JUMP_UNLESS_LESS,
+        Comparison::Greater => op::JUMP_UNLESS_GREATER,
+        Comparison::LessEqual => op::JUMP_UNLESS_LESS_EQUAL,
+        Comparison::GreaterEqual => op::JUMP_UNLESS_GREATER_EQUAL,
+    }
+}
+
+/// Operand kinds, for the verifier
+#[derive(Clone, Copy, PartialEq)]
+enum Operand {
+    None,
+    Constant,
+    Slot,
+    Target,
+    SlotConstant,
+}
+
+/// (operand, values popped, values pushed) for an opcode
+fn shape(opcode: u8) -> Option<(Operand, usize, usize)> {
+    use op::*;
+    Some(match opcode {
+        CONSTANT => (Operand::Constant, 0, 1),
+        LOAD_SLOT => (Operand::Slot, 0, 1),
+        STORE_SLOT => (Operand::Slot, 1, 0),
+        ADD | SUBTRACT | MULTIPLY | DIVIDE | MODULO
+        | EQUAL | NOT_EQUAL | LESS | GREATER | LESS_EQUAL | GREATER_EQUAL => (Operand::None, 2, 1),
+        NEGATE => (Operand::None, 1, 1),
+        JUMP => (Operand::Target, 0, 0),
+        JUMP_IF_FALSE => (Operand::Target, 1, 0),
+        JUMP_UNLESS_EQUAL..=JUMP_UNLESS_GREATER_EQUAL => (Operand::Target, 2, 0),
+        INCREMENT_SLOT => (Operand::SlotConstant, 0, 0),
+        PRINT | POP => (Operand::None, 1, 0),
+        CLEAR | HALT => (Operand::None, 0, 0),
+        _ => return None,
+    })
+}
+
+/// Encoded length of an instruction
+fn instruction_len(operand: Operand) -> usize {
+    match operand {
+        Operand::None => 1,
+        Operand::SlotConstant => 5,
+        _ => 3,
+    }
+}
+
+/// Encoded length of the instruction at `at` in verified code
+pub fn len_at(code: &[u8], at: usize) -> usize {
+    shape(generic(code[at])).map_or(1, |(operand, _, _)| instruction_len(operand))
+}
+
+/// Encoded length of a parsed instruction
+fn encoded_len(op: &OpCode) -> usize {
+    match op {
+        OpCode::Constant(_) | OpCode::LoadSlot(_) | OpCode::StoreSlot(_)
+        | OpCode::Jump(_) | OpCode::JumpIfFalse(_) | OpCode::JumpUnless(..) => 3,
+        OpCode::IncrementSlot(..) => 5,
+        _ => 1,
+    }
+}
+
+/// Read the `n`th `u16` operand of the instruction at `at`
+#[inline(always)]
+pub fn operand(code: &[u8], at: usize, n: usize) -> u16 {
+    let at = at + 1 + 2 * n;
+    u16::from_le_bytes([code[at], code[at + 1]])
+}
+
+/// A verified, encoded program
+#[derive(Debug, Clone)]
+pub struct Chunk {
+    code: Vec<u8>,
+    constants: Vec<Value>,
+    slots: Vec<String>,
+    max_stack: usize,
+    /// (byte offset, source line) where each run of same-line code starts;
+    /// empty for chunks not assembled from source
+    lines: Vec<(u16, u32)>,
+}
+
+impl Chunk {
+    /// Verify encoded code and wrap it in a chunk
+    pub fn new(code: Vec<u8>, constants: Vec<Value>, slots: Vec<String>) -> Result<Self, &'static str> {
+        let max_stack = verify(&code, constants.len(), slots.len())?;
+        let mut code = code;
+        specialize(&mut code, &constants, slots.len());
+        Ok(Self { code, constants, slots, max_stack, lines: Vec::new() })
+    }
+
+    /// Encode a parsed program
+    pub fn assemble(program: &Program) -> Result<Self, &'static str> {
+        // Byte offset of every instruction, plus one past the end for HALT
+        let mut offsets = Vec::with_capacity(program.code.len() + 1);
+        let mut len = 0;
+        for op in &program.code {
+            offsets.push(len);
+            len += encoded_len(op);
+        }
+        offsets.push(len);
+        if len >= u16::MAX as usize {
+            return Err("Program too large");
+        }
+
+        let mut code = Vec::with_capacity(len + 1);
+        let mut constants: Vec<Value> = Vec::new();
+        let emit = |code: &mut Vec<u8>, opcode: u8, arg: usize| {
+            code.push(opcode);
+            code.extend_from_slice(&(arg as u16).to_le_bytes());
+        };
+        let mut constant = |n: i32| {
+            let value = Value::Int(n);
+            let index = match constants.iter().position(|c| *c == value) {
+                Some(index) => index,
+                None => {
+                    constants.push(value);
+                    constants.len() - 1
+                }
+            };
+            u16::try_from(index).map_err(|_| "Too many constants")
+        };
+        for op in &program.code {
+            match op {
+                OpCode::Constant(n) => emit(&mut code, op::CONSTANT, constant(*n)? as usize),
+                OpCode::IncrementSlot(slot, n) => {
+                    let index = constant(*n)?;
+                    emit(&mut code, op::INCREMENT_SLOT, *slot as usize);
+                    code.extend_from_slice(&index.to_le_bytes());
+                }
+                OpCode::LoadSlot(slot) => emit(&mut code, op::LOAD_SLOT, *slot as usize),
+                OpCode::StoreSlot(slot) => emit(&mut code, op::STORE_SLOT, *slot as usize),
+                OpCode::Jump(target) => {
+                    let target = *offsets.get(*target).ok_or("Jump out of range")?;
+                    emit(&mut code, op::JUMP, target);
+                }
+                OpCode::JumpIfFalse(target) => {
+                    let target = *offsets.get(*target).ok_or("Jump out of range")?;
+                    emit(&mut code, op::JUMP_IF_FALSE, target);
+                }
+                OpCode::JumpUnless(comparison, target) => {
+                    let target = *offsets.get(*target).ok_or("Jump out of range")?;
+                    emit(&mut code, jump_unless(*comparison), target);
+                }
+                OpCode::Add => code.push(op::ADD),
+                OpCode::Subtract => code.push(op::SUBTRACT),
+                OpCode::Multiply => code.push(op::MULTIPLY),
+                OpCode::Divide => code.push(op::DIVIDE),
+                OpCode::Modulo => code.push(op::MODULO),
+                OpCode::Negate => code.push(op::NEGATE),
+                OpCode::Equal => code.push(op::EQUAL),
+                OpCode::NotEqual => code.push(op::NOT_EQUAL),
+                OpCode::Less => code.push(op::LESS),
+                OpCode::Greater => code.push(op::GREATER),
+                OpCode::LessEqual => code.push(op::LESS_EQUAL),
+                OpCode::GreaterEqual => code.push(op::GREATER_EQUAL),
+                OpCode::Print => code.push(op::PRINT),
+                OpCode::Clear => code.push(op::CLEAR),
+                OpCode::Pop => code.push(op::POP),
+            }
+        }
+        code.push(op::HALT);
+
+        let mut lines: Vec<(u16, u32)> = Vec::new();
+        for (&offset, &line) in offsets.iter().zip(&program.lines) {
+            if lines.last().map_or(true, |&(_, last)| last != line) {
+                lines.push((offset as u16, line));
+            }
+        }
+
+        let mut chunk = Self::new(code, constants, program.slots.clone())?;
+        chunk.lines = lines;
+        Ok(chunk)
+    }
+
+    /// Source line of the instruction at byte offset `at`, if known
+    pub fn line_at(&self, at: usize) -> Option<u32> {
+        let run = self.lines.partition_point(|&(offset, _)| offset as usize <= at);
+        run.checked_sub(1).map(|run| self.lines[run].1)
+    }
+
+    /// The code as run, with specialized opcodes
+    pub fn code(&self) -> &[u8] {
+        &self.code
+    }
+
+    /// The code with only generic opcodes, as `Chunk::new` accepts it
+    pub fn generic_code(&self) -> Vec<u8> {
+        let mut code = self.code.clone();
+        let mut at = 0;
+        while at < code.len() {
+            let len = len_at(&code, at);
+            code[at] = generic(code[at]);
+            at += len;
+        }
+        code
+    }
+
+    pub fn constants(&self) -> &[Value] {
+        &self.constants
+    }
+
+    /// Variable name of each slot
+    pub fn slots(&self) -> &[String] {
+        &self.slots
+    }
+
+    /// Deepest operand stack any path through the code reaches
+    pub fn max_stack(&self) -> usize {
+        self.max_stack
+    }
+}
+
+/// Check that code is well formed and return its maximum stack depth
+///
+/// Every opcode must be known, every operand in range, every jump must land
+/// on an instruction, the code must end in `HALT` or `JUMP` so execution
+/// never runs off the end, and each instruction must be reached with the
+/// same stack depth on every path, enough for its pops and within
+/// `STACK_SIZE`.
+pub fn verify(code: &[u8], constants: usize, slots: usize) -> Result<usize, &'static str> {
+    // Decode linearly to find instruction boundaries
+    let mut starts = vec![false; code.len()];
+    let mut at = 0;
+    let mut last = op::HALT;
+    while at < code.len() {
+        let (operand, _, _) = shape(code[at]).ok_or("Invalid opcode")?;
+        let len = instruction_len(operand);
+        if at + len > code.len() {
+            return Err("Truncated instruction");
+        }
+        starts[at] = true;
+        last = code[at];
+        at += len;
+    }
+    if code.is_empty() || !(last == op::HALT || last == op::JUMP) {
+        return Err("Code does not end in HALT");
+    }
+
+    // Propagate stack depths along every path
+    const UNSEEN: u16 = u16::MAX;
+    let mut depth = vec![UNSEEN; code.len()];
+    let mut pending = vec![(0usize, 0usize)];
+    let mut max_stack = 0;
+    while let Some((at, entry)) = pending.pop() {
+        if depth[at] != UNSEEN {
+            if depth[at] as usize != entry {
+                return Err("Inconsistent stack depth");
+            }
+            continue;
+        }
+        depth[at] = entry as u16;
+
+        let opcode = code[at];
+        let (operand, pops, pushes) = shape(opcode).ok_or("Invalid opcode")?;
+        if entry < pops {
+            return Err("Stack underflow");
+        }
+        let exit = entry - pops + pushes;
+        if exit > STACK_SIZE {
+            return Err("Stack overflow");
+        }
+        max_stack = max_stack.max(exit);
+
+        let next = at + instruction_len(operand);
+        match operand {
+            Operand::Constant if operand_value(code, at, 0) >= constants => {
+                return Err("Constant index out of range");
+            }
+            Operand::Slot if operand_value(code, at, 0) >= slots => {
+                return Err("Slot out of range");
+            }
+            Operand::SlotConstant if operand_value(code, at, 0) >= slots
+                || operand_value(code, at, 1) >= constants => {
+                return Err("Operand out of range");
+            }
+            Operand::Target => {
+                let target = operand_value(code, at, 0);
+                if !starts.get(target).copied().unwrap_or(false) {
+                    return Err("Jump target is not an instruction");
+                }
+                pending.push((target, exit));
+            }
+            _ => {}
+        }
+        if opcode != op::HALT && opcode != op::JUMP {
+            pending.push((next, exit));
+        }
+    }
+    Ok(max_stack)
+}
+
+fn operand_value(code: &[u8], at: usize, n: usize) -> usize {
+    operand(code, at, n) as usize
+}
+
+// Types `specialize` tracks, as bit sets: a value that may be either is
+// `INT | BOOL`, and a slot nothing is stored to has no type
+const INT: u8 = 1;
+const BOOL: u8 = 2;
+const ANY: u8 = INT | BOOL;
+
+/// Switch instructions whose operands are always integers to their `_INT`
+/// forms
+///
+/// Each slot's type is the union of everything stored to it, found by
+/// rescanning until no slot changes. Operand types come from the producing
+/// instructions within a basic block; values already on the stack when a
+/// block starts count as any type. Loading a slot that is never stored to
+/// always fails, so it can count as an integer.
+fn specialize(code: &mut [u8], constants: &[Value], slots: usize) {
+    let mut leader = vec![false; code.len()];
+    let mut at = 0;
+    while at < code.len() {
+        let next = at + len_at(code, at);
+        if matches!(shape(code[at]), Some((Operand::Target, _, _))) {
+            leader[operand_value(code, at, 0)] = true;
+            if next < code.len() {
+                leader[next] = true;
+            }
+        }
+        at = next;
+    }
+
+    let mut slot_types = vec![0u8; slots];
+    loop {
+        let before = slot_types.clone();
+        scan(code, constants, &leader, &mut slot_types, false);
+        if slot_types == before {
+            break;
+        }
+    }
+    scan(code, constants, &leader, &mut slot_types, true);
+}
+
+/// One pass of `specialize`: widen slot types by what is stored to them,
+/// and with `rewrite`, switch instructions to their `_INT` forms
+fn scan(code: &mut [u8], constants: &[Value], leader: &[bool], slot_types: &mut [u8], rewrite: bool) {
+    let mut stack: Vec<u8> = Vec::new();
+    let mut at = 0;
+    while at < code.len() {
+        if leader[at] {
+            stack.clear();
+        }
+        let opcode = code[at];
+        let pops = shape(opcode).map_or(0, |(_, pops, _)| pops);
+        let mut operands = 0;
+        for _ in 0..pops {
+            operands |= stack.pop().unwrap_or(ANY);
+        }
+        if rewrite && pops == 2 && operands == INT {
+            if let Some(int_form) = int_form(opcode) {
+                code[at] = int_form;
+            }
+        }
+        match opcode {
+            op::CONSTANT => stack.push(match constants[operand_value(code, at, 0)] {
+                Value::Int(_) => INT,
+                Value::Bool(_) => BOOL,
+                Value::Nil => ANY,
+            }),
+            op::LOAD_SLOT => stack.push(match slot_types[operand_value(code, at, 0)] {
+                0 => INT,
+                ty => ty,
+            }),
+            op::STORE_SLOT => slot_types[operand_value(code, at, 0)] |= operands,
+            op::ADD..=op::NEGATE => stack.push(INT),
+            op::EQUAL..=op::GREATER_EQUAL => stack.push(BOOL),
+            _ => {}
+        }
+        at += len_at(code, at);
+    }
+}
@@ -0,0 +1,189 @@
+//! Compiled script images (`.rsc`)
+//!
+//! An image is a serialized `Chunk` stored next to its source, so launching
+//! a script again skips lexing, parsing and optimizing. Layout, all
+//! integers little-endian:
+//!
+//! ```text
+//! magic "RSC\0" | version u16 | source length u32 | source hash u64
+//! code length u32 | code
+//! constant count u16 | (tag u8, value i32) per constant
+//! slot count u16 | (name length u16, UTF-8 name) per slot
+//! ```
+//!
+//! The header ties an image to the exact source it was compiled from: a
+//! different version, length or FNV-1a hash makes it stale. Decoding runs
+//! the bytecode verifier again, so a corrupt image is rejected, never run.
+
+use alloc::string::String;
+use alloc::vec::Vec;
+use crate::fs::FileSystem;
+use crate::rustrial_script::bytecode::Chunk;
+use crate::rustrial_script::value::Value;
+
+pub const MAGIC: &[u8; 4] = b"RSC\0";
+
+/// Bumped whenever the layout or the opcode numbering changes
+pub const FORMAT_VERSION: u16 = 1;
+
+/// File extension of scripts and of their images
+pub const SOURCE_EXTENSION: &str = ".rscript";
+pub const IMAGE_EXTENSION: &str = ".rsc";
+
+const HEADER_LEN: usize = 4 + 2 + 4 + 8;
+
+const TAG_INT: u8 = 0;
+const TAG_BOOL: u8 = 1;
+
+/// FNV-1a hash of a script's source
+pub fn source_hash(source: &[u8]) -> u64 {
+    let mut hash = 0xcbf2_9ce4_8422_2325u64;
+    for &b in source {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+    }
+    hash
+}
+
+/// Path of the image cached for the script at `path`
+pub fn image_path(path: &str) -> String {
+    let stem = path.strip_suffix(SOURCE_EXTENSION).unwrap_or(path);
+    let mut image = String::from(stem);
+    image.push_str(IMAGE_EXTENSION);
+    image
+}
+
+/// Whether `path` names an image rather than a script
+pub fn is_image(path: &str) -> bool {
+    path.ends_with(IMAGE_EXTENSION)
+}
+
+/// Serialize a chunk compiled from `source`
+pub fn encode(chunk: &Chunk, source: &[u8]) -> Vec<u8> {
+    let code = chunk.generic_code();
+    let mut out = Vec::with_capacity(HEADER_LEN + 4 + code.len() + 64);
+    out.extend_from_slice(MAGIC);
+    out.extend_from_slice(&FORMAT_VERSION.to_le_bytes());
+    out.extend_from_slice(&(source.len() as u32).to_le_bytes());
+    out.extend_from_slice(&source_hash(source).to_le_bytes());
+
+    out.extend_from_slice(&(code.len() as u32).to_le_bytes());
+    out.extend_from_slice(&code);
+
+    out.extend_from_slice(&(chunk.constants().len() as u16).to_le_bytes());
+    for constant in chunk.constants() {
+        let (tag, value) = match *constant {
+            Value::Int(n) => (TAG_INT, n),
+            Value::Bool(b) => (TAG_BOOL, b as i32),
+            // The assembler only pools integers
+            Value::Nil => unreachable!("nil constant"),
+        };
+        out.push(tag);
+        out.extend_from_slice(&value.to_le_bytes());
+    }
+
+    out.extend_from_slice(&(chunk.slots().len() as u16).to_le_bytes());
+    for name in chunk.slots() {
+        out.extend_from_slice(&(name.len() as u16).to_le_bytes());
+        out.extend_from_slice(name.as_bytes());
+    }
+    out
+}
+
+/// Cursor over an image's bytes
+struct Reader<'a> {
+    data: &'a [u8],
+    at: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, len: usize) -> Result<&'a [u8], &'static str> {
+        let end = self.at.checked_add(len).filter(|&end| end <= self.data.len())
+            .ok_or("Truncated image")?;
+        let bytes = &self.data[self.at..end];
+        self.at = end;
+        Ok(bytes)
+    }
+
+    fn u8(&mut self) -> Result<u8, &'static str> {
+        Ok(self.bytes(1)?[0])
+    }
+
+    fn u16(&mut self) -> Result<u16, &'static str> {
+        let b = self.bytes(2)?;
+        Ok(u16::from_le_bytes([b[0], b[1]]))
+    }
+
+    fn u32(&mut self) -> Result<u32, &'static str> {
+        let b = self.bytes(4)?;
+        Ok(u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+    }
+}
+
+/// Whether an image's header matches this format and `source`
+pub fn is_current(image: &[u8], source: &[u8]) -> bool {
+    image.len() >= HEADER_LEN
+        && image[0..4] == *MAGIC
+        && image[4..6] == FORMAT_VERSION.to_le_bytes()
+        && image[6..10] == (source.len() as u32).to_le_bytes()
+        && image[10..18] == source_hash(source).to_le_bytes()
+}
+
+/// Deserialize and verify an image compiled from `source`
+pub fn decode(image: &[u8], source: &[u8]) -> Result<Chunk, &'static str> {
+    if !is_current(image, source) {
+        return Err("Stale image");
+    }
+    let mut r = Reader { data: image, at: HEADER_LEN };
+
+    let len = r.u32()? as usize;
+    let code = r.bytes(len)?.to_vec();
+
+    let count = r.u16()? as usize;
+    let mut constants = Vec::with_capacity(count);
+    for _ in 0..count {
+        let tag = r.u8()?;
+        let value = r.u32()? as i32;
+        constants.push(match tag {
+            TAG_INT => Value::Int(value),
+            TAG_BOOL => Value::Bool(value != 0),
+            _ => return Err("Invalid constant"),
+        });
+    }
+
+    let count = r.u16()? as usize;
+    let mut slots = Vec::with_capacity(count);
+    for _ in 0..count {
+        let len = r.u16()? as usize;
+        let name = core::str::from_utf8(r.bytes(len)?).map_err(|_| "Invalid slot name")?;
+        slots.push(String::from(name));
+    }
+
+    if r.at != image.len() {
+        return Err("Trailing data in image");
+    }
+    Chunk::new(code, constants, slots)
+}
+
+/// Compile the script at `path`, reusing its cached image when current
+///
+/// A missing, stale or invalid image is replaced after compiling. Writing
+/// it is best effort: scripts on read-only mounts such as the initrd can
+/// only use images packed in at build time.
+pub fn load<F: FileSystem + ?Sized>(fs: &mut F, path: &str) -> Result<Chunk, &'static str> {
+    let image_path = image_path(path);
+    let (chunk, image) = {
+        let source = fs.read_file_bytes(path).map_err(|_| "Cannot read script")?;
+        if let Ok(image) = fs.read_file_bytes(&image_path) {
+            if let Ok(chunk) = decode(&image, &source) {
+                return Ok(chunk);
+            }
+        }
+        let text = core::str::from_utf8(&source).map_err(|_| "Script is not valid UTF-8")?;
+        let chunk = crate::rustrial_script::compile(text)?;
+        let image = encode(&chunk, &source);
+        (chunk, image)
+    };
+    let _ = fs.write_file(&image_path, &image);
+    Ok(chunk)
+}
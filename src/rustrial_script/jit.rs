@@ -0,0 +1,755 @@
+//! Baseline template JIT for RustrialScript
+//!
+//! Translates a whole verified chunk into x86-64 machine code, one fixed
+//! template per bytecode instruction. Before emitting anything it infers a
+//! type (Int or Bool) for every stack position and variable, so the native
+//! code needs no type tags; scripts it can't type statically, or that would
+//! fail a type check at run time, are left to the interpreter.
+//!
+//! Register use (System V ABI, so helpers can be called directly):
+//! - `r12`-`r15` hold the bottom four operand stack positions; deeper
+//!   positions spill to the native stack frame
+//! - `rbx` points at the variable array, one `u64` per slot: the value
+//!   zero-extended, or `UNDEFINED` before the first store
+//! - `rbp` points at the `Context` passed to helpers
+//! - `rax`, `rcx`, `rdx`, `rsi`, `rdi` are scratch
+//!
+//! Like the interpreter, native code runs on an instruction budget. Each
+//! basic block subtracts its length from `Context::fuel`, and loop heads,
+//! which are always reached with an empty operand stack, exit with
+//! `EXIT_YIELD` once it is used up. Entering again jumps straight to the
+//! loop head recorded in `Context::resume`; the variables stay in the VM.
+//!
+//! Code buffers come from the kernel heap, which is mapped without
+//! NO_EXECUTE. That makes the whole heap writable and executable, not just
+//! these buffers: a stray write anywhere in the heap can become code. A
+//! W^X scheme would need its own region, remapped read-only and executable
+//! once the code is emitted.
+//!
+//! `tests/script_test.rs` checks the native code against the interpreter.
+
+use alloc::vec;
+use alloc::vec::Vec;
+use core::mem::offset_of;
+use core::sync::atomic::{AtomicBool, Ordering};
+use core::task::Poll;
+use crate::rustrial_script::bytecode::{len_at, op, operand, Chunk};
+use crate::rustrial_script::value::Value;
+use crate::rustrial_script::vm::VirtualMachine;
+use crate::println;
+
+/// Whether `run` compiles scripts before executing them
+static ENABLED: AtomicBool = AtomicBool::new(true);
+
+pub fn enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+pub fn set_enabled(enabled: bool) {
+    ENABLED.store(enabled, Ordering::Relaxed);
+}
+
+/// Variable value before its first store; any non-zero upper half works
+const UNDEFINED: u64 = 0xFFFF_FFFF_0000_0000;
+
+/// Stack positions kept in registers
+const STACK_REGS: [u8; 4] = [R12, R13, R14, R15];
+
+// Register numbers
+const RAX: u8 = 0;
+const RCX: u8 = 1;
+const RDX: u8 = 2;
+const RBX: u8 = 3;
+const RSP: u8 = 4;
+const RBP: u8 = 5;
+const RSI: u8 = 6;
+const RDI: u8 = 7;
+const R12: u8 = 12;
+const R13: u8 = 13;
+const R14: u8 = 14;
+const R15: u8 = 15;
+
+// Condition codes
+const CC_E: u8 = 0x4;
+const CC_NE: u8 = 0x5;
+const CC_L: u8 = 0xC;
+const CC_GE: u8 = 0xD;
+const CC_LE: u8 = 0xE;
+const CC_G: u8 = 0xF;
+
+/// Exit status of native code
+const EXIT_OK: u32 = 0;
+const EXIT_UNDEFINED: u32 = 1;
+const EXIT_DIVIDE_BY_ZERO: u32 = 2;
+const EXIT_MODULO_BY_ZERO: u32 = 3;
+const EXIT_YIELD: u32 = 4;
+
+/// Statically inferred type of a value
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Ty {
+    Int,
+    Bool,
+}
+
+/// Per-instruction facts from type inference
+#[derive(Clone, PartialEq)]
+struct State {
+    stack: Vec<Ty>,
+    /// Slots assigned on every path to this instruction
+    defined: Vec<bool>,
+}
+
+/// Infer stack and slot types of `code`, the chunk's generic code, or
+/// `None` if it can't be typed or contains an operation that fails a type
+/// check
+fn analyze(chunk: &Chunk, code: &[u8]) -> Option<(Vec<Option<State>>, Vec<Option<Ty>>)> {
+    let mut slots: Vec<Option<Ty>> = vec![None; chunk.slots().len()];
+
+    // Slot types only move from unknown to known, so this settles after at
+    // most one extra pass per slot
+    loop {
+        let before = slots.clone();
+        let mut states: Vec<Option<State>> = vec![None; code.len()];
+        let mut pending = vec![(0, State {
+            stack: Vec::new(),
+            defined: vec![false; slots.len()],
+        })];
+
+        while let Some((at, incoming)) = pending.pop() {
+            let state = match &mut states[at] {
+                Some(existing) => {
+                    if existing.stack != incoming.stack {
+                        return None;
+                    }
+                    let mut changed = false;
+                    for (d, i) in existing.defined.iter_mut().zip(&incoming.defined) {
+                        if *d && !*i {
+                            *d = false;
+                            changed = true;
+                        }
+                    }
+                    if !changed {
+                        continue;
+                    }
+                    existing.clone()
+                }
+                empty => {
+                    *empty = Some(incoming.clone());
+                    incoming
+                }
+            };
+
+            let mut next = state;
+            let arg = |n: usize| u16::from_le_bytes([code[at + 1 + 2 * n], code[at + 2 + 2 * n]]) as usize;
+            let mut target = None;
+            let mut falls_through = true;
+            match code[at] {
+                op::CONSTANT => next.stack.push(match chunk.constants()[arg(0)] {
+                    Value::Int(_) => Ty::Int,
+                    Value::Bool(_) => Ty::Bool,
+                    Value::Nil => return None,
+                }),
+                // A slot never stored to always fails the load, so any type
+                // will do
+                op::LOAD_SLOT => next.stack.push(slots[arg(0)].unwrap_or(Ty::Int)),
+                op::STORE_SLOT => {
+                    let ty = next.stack.pop()?;
+                    if *slots[arg(0)].get_or_insert(ty) != ty {
+                        return None;
+                    }
+                    next.defined[arg(0)] = true;
+                }
+                op::INCREMENT_SLOT => {
+                    if *slots[arg(0)].get_or_insert(Ty::Int) != Ty::Int
+                        || !matches!(chunk.constants()[arg(1)], Value::Int(_)) {
+                        return None;
+                    }
+                }
+                op::ADD | op::SUBTRACT | op::MULTIPLY | op::DIVIDE | op::MODULO => {
+                    if next.stack.pop()? != Ty::Int || next.stack.pop()? != Ty::Int {
+                        return None;
+                    }
+                    next.stack.push(Ty::Int);
+                }
+                op::NEGATE => {
+                    if *next.stack.last()? != Ty::Int {
+                        return None;
+                    }
+                }
+                op::EQUAL | op::NOT_EQUAL => {
+                    next.stack.pop()?;
+                    next.stack.pop()?;
+                    next.stack.push(Ty::Bool);
+                }
+                op::LESS | op::GREATER | op::LESS_EQUAL | op::GREATER_EQUAL => {
+                    if next.stack.pop()? != Ty::Int || next.stack.pop()? != Ty::Int {
+                        return None;
+                    }
+                    next.stack.push(Ty::Bool);
+                }
+                op::JUMP => {
+                    target = Some(arg(0));
+                    falls_through = false;
+                }
+                op::JUMP_IF_FALSE => {
+                    next.stack.pop()?;
+                    target = Some(arg(0));
+                }
+                op::JUMP_UNLESS_EQUAL | op::JUMP_UNLESS_NOT_EQUAL => {
+                    next.stack.pop()?;
+                    next.stack.pop()?;
+                    target = Some(arg(0));
+                }
+                op::JUMP_UNLESS_LESS..=op::JUMP_UNLESS_GREATER_EQUAL => {
+                    if next.stack.pop()? != Ty::Int || next.stack.pop()? != Ty::Int {
+                        return None;
+                    }
+                    target = Some(arg(0));
+                }
+                op::PRINT | op::POP => {
+                    next.stack.pop()?;
+                }
+                op::CLEAR => {}
+                op::HALT => falls_through = false,
+                _ => return None,
+            }
+
+            if let Some(target) = target {
+                pending.push((target, next.clone()));
+            }
+            if falls_through {
+                pending.push((at + len_at(code, at), next));
+            }
+        }
+
+        if slots == before {
+            return Some((states, slots));
+        }
+    }
+}
+
+/// Operand stack position: a register or a frame slot
+#[derive(Clone, Copy, PartialEq)]
+enum Loc {
+    Reg(u8),
+    Mem(u8, i32),
+}
+
+fn stack_loc(position: usize) -> Loc {
+    match STACK_REGS.get(position) {
+        Some(&reg) => Loc::Reg(reg),
+        None => Loc::Mem(RSP, 8 * (position - STACK_REGS.len()) as i32),
+    }
+}
+
+fn slot_loc(slot: usize) -> Loc {
+    Loc::Mem(RBX, 8 * slot as i32)
+}
+
+/// Minimal x86-64 encoder for the instructions the templates use
+struct Asm {
+    code: Vec<u8>,
+}
+
+impl Asm {
+    fn byte(&mut self, b: u8) {
+        self.code.push(b);
+    }
+
+    fn imm32(&mut self, v: i32) {
+        self.code.extend_from_slice(&v.to_le_bytes());
+    }
+
+    /// Emit `opcode` with a ModRM operand: register `reg` and `rm`
+    fn modrm(&mut self, wide: bool, opcode: &[u8], reg: u8, rm: Loc) {
+        let base = match rm {
+            Loc::Reg(r) | Loc::Mem(r, _) => r,
+        };
+        let rex = 0x40 | (wide as u8) << 3 | (reg >> 3) << 2 | base >> 3;
+        if rex != 0x40 {
+            self.byte(rex);
+        }
+        self.code.extend_from_slice(opcode);
+        match rm {
+            Loc::Reg(r) => self.byte(0xC0 | (reg & 7) << 3 | (r & 7)),
+            Loc::Mem(b, disp) => {
+                self.byte(0x80 | (reg & 7) << 3 | (b & 7));
+                if b & 7 == RSP {
+                    self.byte(0x24);
+                }
+                self.imm32(disp);
+            }
+        }
+    }
+
+    /// `mov reg32, rm32`
+    fn load(&mut self, reg: u8, rm: Loc) {
+        if rm != Loc::Reg(reg) {
+            self.modrm(false, &[0x8B], reg, rm);
+        }
+    }
+
+    /// `mov rm32, reg32`
+    fn store(&mut self, rm: Loc, reg: u8) {
+        if rm != Loc::Reg(reg) {
+            self.modrm(false, &[0x89], reg, rm);
+        }
+    }
+
+    /// A register holding `rm`, loading it into `scratch` if needed
+    fn in_reg(&mut self, rm: Loc, scratch: u8) -> u8 {
+        match rm {
+            Loc::Reg(r) => r,
+            mem => {
+                self.load(scratch, mem);
+                scratch
+            }
+        }
+    }
+
+    /// `mov rm32, imm32`
+    fn mov_imm(&mut self, rm: Loc, v: i32) {
+        match rm {
+            Loc::Reg(r) => {
+                if r >= 8 {
+                    self.byte(0x41);
+                }
+                self.byte(0xB8 + (r & 7));
+                self.imm32(v);
+            }
+            mem => {
+                self.modrm(false, &[0xC7], 0, mem);
+                self.imm32(v);
+            }
+        }
+    }
+
+    /// `mov rm64, reg64`
+    fn store64(&mut self, rm: Loc, reg: u8) {
+        self.modrm(true, &[0x89], reg, rm);
+    }
+
+    /// Group-1 ALU op (`/digit`) on `rm32` with an immediate
+    fn alu_imm(&mut self, digit: u8, rm: Loc, v: i32) {
+        self.modrm(false, &[0x81], digit, rm);
+        self.imm32(v);
+    }
+
+    fn push(&mut self, reg: u8) {
+        if reg >= 8 {
+            self.byte(0x41);
+        }
+        self.byte(0x50 + (reg & 7));
+    }
+
+    fn pop(&mut self, reg: u8) {
+        if reg >= 8 {
+            self.byte(0x41);
+        }
+        self.byte(0x58 + (reg & 7));
+    }
+
+    /// `setcc al; movzx eax, al`
+    fn setcc_eax(&mut self, cc: u8) {
+        self.code.extend_from_slice(&[0x0F, 0x90 + cc, 0xC0, 0x0F, 0xB6, 0xC0]);
+    }
+
+    /// `mov rax, imm64; call rax`
+    fn call(&mut self, target: usize) {
+        self.code.extend_from_slice(&[0x48, 0xB8]);
+        self.code.extend_from_slice(&(target as u64).to_le_bytes());
+        self.code.extend_from_slice(&[0xFF, 0xD0]);
+    }
+
+    /// `jcc rel32` (or `jmp` when `cc` is `None`); returns the offset of
+    /// the displacement to patch
+    fn jump(&mut self, cc: Option<u8>) -> usize {
+        match cc {
+            Some(cc) => self.code.extend_from_slice(&[0x0F, 0x80 + cc]),
+            None => self.byte(0xE9),
+        }
+        self.imm32(0);
+        self.code.len() - 4
+    }
+
+    /// Point the displacement at `at` to `target`
+    fn patch(&mut self, at: usize, target: usize) {
+        let rel = target as i32 - (at as i32 + 4);
+        self.code[at..at + 4].copy_from_slice(&rel.to_le_bytes());
+    }
+}
+
+/// State shared with helper functions called from native code
+#[repr(C)]
+struct Context {
+    quiet: bool,
+    /// Bytecode offset of the loop head to enter at, or 0 for the start;
+    /// set when the code yields
+    resume: u32,
+    /// Instructions left in the budget; goes negative when a loop-free
+    /// stretch overruns it
+    fuel: i64,
+}
+
+const RESUME: Loc = Loc::Mem(RBP, offset_of!(Context, resume) as i32);
+const FUEL: Loc = Loc::Mem(RBP, offset_of!(Context, fuel) as i32);
+
+extern "sysv64" fn print_helper(context: &Context, value: u32, is_bool: u32) {
+    if context.quiet {
+        return;
+    }
+    if is_bool != 0 {
+        println!("{}", Value::Bool(value != 0));
+    } else {
+        println!("{}", Value::Int(value as i32));
+    }
+}
+
+extern "sysv64" fn clear_helper(context: &Context) {
+    if !context.quiet {
+        crate::vga_buffer::WRITER.lock().clear_screen();
+    }
+}
+
+type Entry = extern "sysv64" fn(*mut u64, *mut Context) -> u32;
+
+/// Native code for one chunk
+pub struct JitCode {
+    code: Vec<u8>,
+    slots: Vec<Option<Ty>>,
+}
+
+impl JitCode {
+    /// Size of the generated machine code in bytes
+    pub fn len(&self) -> usize {
+        self.code.len()
+    }
+
+    /// Run the native code to completion, leaving the variables in `vm`
+    /// as the interpreter would
+    pub fn run(&self, vm: &mut VirtualMachine) -> Result<(), &'static str> {
+        self.start(vm);
+        loop {
+            if let Poll::Ready(result) = self.resume(vm, u64::MAX) {
+                return result;
+            }
+        }
+    }
+
+    /// Reset `vm` to run this code from the beginning
+    pub fn start(&self, vm: &mut VirtualMachine) {
+        vm.native_locals.clear();
+        vm.native_locals.resize(self.slots.len(), UNDEFINED);
+        vm.ip = 0;
+        vm.executed = 0;
+    }
+
+    /// Continue the run begun by `start` for about `budget` instructions
+    ///
+    /// The budget is only checked at loop heads, so a slice may overrun it
+    /// by one loop-free stretch of the script.
+    pub fn resume(&self, vm: &mut VirtualMachine, budget: u64) -> Poll<Result<(), &'static str>> {
+        let native = &mut vm.native_locals;
+        if native.len() != self.slots.len() {
+            return Poll::Ready(Err("VM is not running this chunk"));
+        }
+        let fuel = budget.min(i64::MAX as u64) as i64;
+        let mut context = Context { quiet: vm.quiet, resume: vm.ip as u32, fuel };
+
+        // SAFETY: the code was generated by `compile` for a verified chunk
+        // and is sized for `self.slots` variables. A resume offset that is
+        // not one of its loop heads enters at the start.
+        let entry: Entry = unsafe { core::mem::transmute(self.code.as_ptr()) };
+        let status = entry(native.as_mut_ptr(), &mut context);
+        vm.executed += fuel.wrapping_sub(context.fuel) as u64;
+
+        if status == EXIT_YIELD {
+            vm.ip = context.resume as usize;
+            return Poll::Pending;
+        }
+        vm.ip = 0;
+        vm.locals.clear();
+        vm.locals.extend(native.iter().zip(&self.slots).map(|(&raw, ty)| {
+            match (raw >> 32, ty) {
+                (0, Some(Ty::Int)) => Value::Int(raw as u32 as i32),
+                (0, Some(Ty::Bool)) => Value::Bool(raw as u32 != 0),
+                _ => Value::Nil,
+            }
+        }));
+
+        Poll::Ready(match status {
+            EXIT_OK => Ok(()),
+            EXIT_UNDEFINED => Err("Undefined variable"),
+            EXIT_DIVIDE_BY_ZERO => Err("Division by zero"),
+            EXIT_MODULO_BY_ZERO => Err("Modulo by zero"),
+            _ => Err("JIT error"),
+        })
+    }
+}
+
+/// Compile a chunk to native code, or `None` if it needs the interpreter
+pub fn compile(chunk: &Chunk) -> Option<JitCode> {
+    // Type inference here subsumes the interpreter's `_INT` forms
+    let code = &chunk.generic_code();
+    let (states, slots) = analyze(chunk, code)?;
+
+    // Basic blocks start at jump targets and after jumps; loop heads are
+    // the targets of reachable backward jumps
+    let is_jump = |opcode| matches!(opcode,
+        op::JUMP | op::JUMP_IF_FALSE | op::JUMP_UNLESS_EQUAL..=op::JUMP_UNLESS_GREATER_EQUAL);
+    let mut leader = vec![false; code.len()];
+    let mut loop_head = vec![false; code.len()];
+    leader[0] = true;
+    let mut at = 0;
+    while at < code.len() {
+        let next = at + len_at(code, at);
+        if states[at].is_some() && is_jump(code[at]) {
+            let target = operand(code, at, 0) as usize;
+            leader[target] = true;
+            if target <= at {
+                // Yielding saves no operand stack
+                if !states[target].as_ref()?.stack.is_empty() {
+                    return None;
+                }
+                loop_head[target] = true;
+            }
+        }
+        if (is_jump(code[at]) || code[at] == op::HALT) && next < code.len() {
+            leader[next] = true;
+        }
+        at = next;
+    }
+    // Instructions from the leader at `at` to the end of its block
+    let block_len = |mut at: usize| {
+        let mut len = 0;
+        loop {
+            len += 1;
+            let opcode = code[at];
+            at += len_at(code, at);
+            if is_jump(opcode) || opcode == op::HALT || at >= code.len() || leader[at] {
+                return len;
+            }
+        }
+    };
+
+    // Prologue: six pushes plus the return address leave rsp 8 bytes off
+    // 16-byte alignment, which the spill area makes up
+    let spill = chunk.max_stack().saturating_sub(STACK_REGS.len()) * 8;
+    let frame = (if spill % 16 == 0 { spill + 8 } else { spill }) as i32;
+    let mut asm = Asm { code: Vec::with_capacity(code.len() * 8) };
+    for reg in [RBX, RBP, R12, R13, R14, R15] {
+        asm.push(reg);
+    }
+    asm.modrm(true, &[0x81], 5, Loc::Reg(RSP)); // sub rsp, frame
+    asm.imm32(frame);
+    asm.modrm(true, &[0x89], RDI, Loc::Reg(RBX)); // mov rbx, rdi
+    asm.modrm(true, &[0x89], RSI, Loc::Reg(RBP)); // mov rbp, rsi
+
+    let mut native_at = vec![0usize; code.len()];
+    let mut jumps: Vec<(usize, usize)> = Vec::new(); // (displacement, bytecode target)
+    let mut exits: Vec<(usize, u32)> = Vec::new(); // (displacement, status)
+    let mut yields: Vec<(usize, usize)> = Vec::new(); // (displacement, loop head)
+
+    // Resume at the loop head the last run yielded at
+    for head in (0..code.len()).filter(|&at| loop_head[at]) {
+        asm.alu_imm(7, RESUME, head as i32); // cmp dword [resume], head
+        jumps.push((asm.jump(Some(CC_E)), head));
+    }
+
+    let mut at = 0;
+    while at < code.len() {
+        let len = len_at(code, at);
+        let Some(state) = &states[at] else {
+            at += len; // unreachable
+            continue;
+        };
+        native_at[at] = asm.code.len();
+        if loop_head[at] {
+            asm.modrm(true, &[0x81], 7, FUEL); // cmp qword [fuel], 0
+            asm.imm32(0);
+            yields.push((asm.jump(Some(CC_LE)), at));
+        }
+        if leader[at] {
+            asm.modrm(true, &[0x81], 5, FUEL); // sub qword [fuel], len
+            asm.imm32(block_len(at) as i32);
+        }
+        let arg = |n: usize| u16::from_le_bytes([code[at + 1 + 2 * n], code[at + 2 + 2 * n]]) as usize;
+        let depth = state.stack.len();
+        let top = || stack_loc(depth - 1);
+        let second = || stack_loc(depth - 2);
+
+        let check_defined = |asm: &mut Asm, exits: &mut Vec<(usize, u32)>, slot: usize| {
+            if !state.defined[slot] {
+                // cmp dword [rbx + 8 * slot + 4], 0; jne undefined
+                asm.alu_imm(7, Loc::Mem(RBX, 8 * slot as i32 + 4), 0);
+                exits.push((asm.jump(Some(CC_NE)), EXIT_UNDEFINED));
+            }
+        };
+        // Compare the top two values, returning the condition for "true";
+        // `None` for an equality test between different types
+        let compare = |asm: &mut Asm, cc: u8| -> Option<u8> {
+            let (a, b) = (state.stack[depth - 2], state.stack[depth - 1]);
+            if a != b {
+                return None;
+            }
+            let left = asm.in_reg(second(), RAX);
+            asm.modrm(false, &[0x3B], left, top()); // cmp left, rm
+            Some(cc)
+        };
+
+        match code[at] {
+            op::CONSTANT => {
+                let v = match chunk.constants()[arg(0)] {
+                    Value::Int(n) => n,
+                    Value::Bool(b) => b as i32,
+                    Value::Nil => unreachable!(),
+                };
+                asm.mov_imm(stack_loc(depth), v);
+            }
+            op::LOAD_SLOT => {
+                check_defined(&mut asm, &mut exits, arg(0));
+                let dest = stack_loc(depth);
+                let reg = if let Loc::Reg(r) = dest { r } else { RAX };
+                asm.load(reg, slot_loc(arg(0)));
+                asm.store(dest, reg);
+            }
+            op::STORE_SLOT => {
+                // 32-bit loads and ALU ops zero the upper half, which marks
+                // the slot defined
+                let reg = asm.in_reg(top(), RAX);
+                asm.store64(slot_loc(arg(0)), reg);
+            }
+            op::INCREMENT_SLOT => {
+                check_defined(&mut asm, &mut exits, arg(0));
+                let Value::Int(n) = chunk.constants()[arg(1)] else { unreachable!() };
+                asm.alu_imm(0, slot_loc(arg(0)), n); // add dword [slot], n
+            }
+            opcode @ (op::ADD | op::SUBTRACT | op::MULTIPLY) => {
+                let left = asm.in_reg(second(), RAX);
+                let opcode: &[u8] = match opcode {
+                    op::ADD => &[0x03],
+                    op::SUBTRACT => &[0x2B],
+                    _ => &[0x0F, 0xAF],
+                };
+                asm.modrm(false, opcode, left, top());
+                asm.store(second(), left);
+            }
+            opcode @ (op::DIVIDE | op::MODULO) => {
+                let modulo = opcode == op::MODULO;
+                asm.load(RAX, second());
+                asm.load(RCX, top());
+                asm.modrm(false, &[0x85], RCX, Loc::Reg(RCX)); // test ecx, ecx
+                let status = if modulo { EXIT_MODULO_BY_ZERO } else { EXIT_DIVIDE_BY_ZERO };
+                exits.push((asm.jump(Some(CC_E)), status));
+                // idiv faults on i32::MIN / -1, so -1 is done by hand
+                asm.alu_imm(7, Loc::Reg(RCX), -1); // cmp ecx, -1
+                let not_minus_one = asm.jump(Some(CC_NE));
+                if modulo {
+                    asm.mov_imm(Loc::Reg(RAX), 0);
+                } else {
+                    asm.modrm(false, &[0xF7], 3, Loc::Reg(RAX)); // neg eax
+                }
+                let done = asm.jump(None);
+                asm.patch(not_minus_one, asm.code.len());
+                asm.byte(0x99); // cdq
+                asm.modrm(false, &[0xF7], 7, Loc::Reg(RCX)); // idiv ecx
+                if modulo {
+                    asm.load(RAX, Loc::Reg(RDX));
+                }
+                asm.patch(done, asm.code.len());
+                asm.store(second(), RAX);
+            }
+            op::NEGATE => asm.modrm(false, &[0xF7], 3, top()), // neg rm
+            opcode @ (op::EQUAL | op::NOT_EQUAL | op::LESS | op::GREATER
+                | op::LESS_EQUAL | op::GREATER_EQUAL) => {
+                let cc = match opcode {
+                    op::EQUAL => CC_E,
+                    op::NOT_EQUAL => CC_NE,
+                    op::LESS => CC_L,
+                    op::GREATER => CC_G,
+                    op::LESS_EQUAL => CC_LE,
+                    _ => CC_GE,
+                };
+                match compare(&mut asm, cc) {
+                    Some(cc) => {
+                        asm.setcc_eax(cc);
+                        asm.store(second(), RAX);
+                    }
+                    None => asm.mov_imm(second(), (opcode == op::NOT_EQUAL) as i32),
+                }
+            }
+            op::JUMP => jumps.push((asm.jump(None), arg(0))),
+            op::JUMP_IF_FALSE => {
+                match top() {
+                    Loc::Reg(r) => asm.modrm(false, &[0x85], r, Loc::Reg(r)), // test r, r
+                    mem => asm.alu_imm(7, mem, 0), // cmp [mem], 0
+                }
+                jumps.push((asm.jump(Some(CC_E)), arg(0)));
+            }
+            opcode @ op::JUMP_UNLESS_EQUAL..=op::JUMP_UNLESS_GREATER_EQUAL => {
+                // Jump on the negated condition
+                let cc = match opcode {
+                    op::JUMP_UNLESS_EQUAL => CC_NE,
+                    op::JUMP_UNLESS_NOT_EQUAL => CC_E,
+                    op::JUMP_UNLESS_LESS => CC_GE,
+                    op::JUMP_UNLESS_GREATER => CC_LE,
+                    op::JUMP_UNLESS_LESS_EQUAL => CC_G,
+                    _ => CC_L,
+                };
+                match compare(&mut asm, cc) {
+                    Some(cc) => jumps.push((asm.jump(Some(cc)), arg(0))),
+                    // Values of different types are never equal
+                    None if opcode == op::JUMP_UNLESS_EQUAL => jumps.push((asm.jump(None), arg(0))),
+                    None => {}
+                }
+            }
+            op::PRINT => {
+                asm.load(RSI, top());
+                asm.mov_imm(Loc::Reg(RDX), (state.stack[depth - 1] == Ty::Bool) as i32);
+                asm.modrm(true, &[0x89], RBP, Loc::Reg(RDI)); // mov rdi, rbp
+                asm.call(print_helper as usize);
+            }
+            op::CLEAR => {
+                asm.modrm(true, &[0x89], RBP, Loc::Reg(RDI)); // mov rdi, rbp
+                asm.call(clear_helper as usize);
+            }
+            op::POP => {}
+            op::HALT => exits.push((asm.jump(None), EXIT_OK)),
+            _ => return None,
+        }
+        at += len;
+    }
+
+    // Exit stubs set the status, then fall into the epilogue
+    let mut stubs = [None; 4];
+    for (displacement, status) in exits {
+        let stub = *stubs[status as usize].get_or_insert_with(|| {
+            let stub = asm.code.len();
+            asm.mov_imm(Loc::Reg(RAX), status as i32);
+            let to_epilogue = asm.jump(None);
+            jumps.push((to_epilogue, usize::MAX));
+            stub
+        });
+        asm.patch(displacement, stub);
+    }
+    for (displacement, head) in yields {
+        asm.patch(displacement, asm.code.len());
+        asm.mov_imm(RESUME, head as i32);
+        asm.mov_imm(Loc::Reg(RAX), EXIT_YIELD as i32);
+        jumps.push((asm.jump(None), usize::MAX));
+    }
+    let epilogue = asm.code.len();
+    asm.modrm(true, &[0x81], 0, Loc::Reg(RSP)); // add rsp, frame
+    asm.imm32(frame);
+    for reg in [R15, R14, R13, R12, RBP, RBX] {
+        asm.pop(reg);
+    }
+    asm.byte(0xC3); // ret
+
+    for (displacement, target) in jumps {
+        let native = if target == usize::MAX { epilogue } else { native_at[target] };
+        asm.patch(displacement, native);
+    }
+
+    Some(JitCode { code: asm.code, slots })
+}
@@ -1,14 +1,17 @@
 //! Lexer for RustrialScript
+//!
+//! Tokens are produced on demand by scanning the source bytes; nothing is
+//! buffered and identifiers borrow their name from the source, so lexing
+//! allocates nothing however long the script is.
 
-use alloc::vec::Vec;
-use alloc::string::String;
+use core::ops::Range;
 
-#[derive(Debug, Clone, PartialEq)]
-pub enum Token {
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Token<'src> {
     // Literals
     Number(i32),
-    Identifier(String),
-    
+    Identifier(&'src str),
+
     // Keywords
     Let,
     If,
@@ -16,7 +19,7 @@ pub enum Token {
     While,
     Print,
     Clear,
-    
+
     // Operators
     Plus,
     Minus,
@@ -30,152 +33,146 @@ pub enum Token {
     Greater,
     LessEqual,
     GreaterEqual,
-    
+
     // Delimiters
     LeftParen,
     RightParen,
     LeftBrace,
     RightBrace,
     Semicolon,
-    
+
     Eof,
 }
 
-pub fn tokenize(source: &str) -> Result<Vec<Token>, &'static str> {
-    let mut tokens = Vec::new();
-    let mut chars = source.chars().peekable();
-    
-    while let Some(&ch) = chars.peek() {
-        match ch {
-            ' ' | '\t' | '\r' | '\n' => {
-                chars.next();
-            }
-            '0'..='9' => {
-                let mut num = 0i32;
-                while let Some(&ch) = chars.peek() {
-                    if ch.is_ascii_digit() {
-                        num = num.wrapping_mul(10).wrapping_add((ch as i32) - ('0' as i32));
-                        chars.next();
-                    } else {
-                        break;
+/// Keywords indexed by `(first byte + length) % 8`, a perfect hash for this
+/// set: one table probe and one comparison tell a keyword from a name
+const KEYWORDS: [Option<(&[u8], Token<'static>)>; 8] = [
+    Some((b"clear", Token::Clear)),
+    Some((b"else", Token::Else)),
+    None,
+    Some((b"if", Token::If)),
+    Some((b"while", Token::While)),
+    Some((b"print", Token::Print)),
+    None,
+    Some((b"let", Token::Let)),
+];
+
+fn keyword(word: &[u8]) -> Option<Token<'static>> {
+    let (name, token) = KEYWORDS[(word[0] as usize + word.len()) % KEYWORDS.len()]?;
+    (name == word).then_some(token)
+}
+
+/// On-demand tokenizer over a script's source
+pub struct Lexer<'src> {
+    source: &'src str,
+    pos: usize,
+    start: usize,
+    line: u32,
+}
+
+impl<'src> Lexer<'src> {
+    pub fn new(source: &'src str) -> Self {
+        Self { source, pos: 0, start: 0, line: 1 }
+    }
+
+    /// Byte range in the source of the token last returned
+    pub fn span(&self) -> Range<usize> {
+        self.start..self.pos
+    }
+
+    /// Line, counting from 1, of the token last returned
+    pub fn line(&self) -> u32 {
+        self.line
+    }
+
+    fn peek(&self) -> Option<u8> {
+        self.source.as_bytes().get(self.pos).copied()
+    }
+
+    /// Consume the next byte if it is `expected`
+    fn eat(&mut self, expected: u8) -> bool {
+        let matched = self.peek() == Some(expected);
+        if matched {
+            self.pos += 1;
+        }
+        matched
+    }
+
+    /// Scan the next token; returns `Eof` at, and after, the end
+    pub fn next_token(&mut self) -> Result<Token<'src>, &'static str> {
+        let bytes = self.source.as_bytes();
+        loop {
+            self.start = self.pos;
+            let Some(&byte) = bytes.get(self.pos) else {
+                return Ok(Token::Eof);
+            };
+            self.pos += 1;
+
+            let token = match byte {
+                b'\n' => {
+                    self.line += 1;
+                    continue;
+                }
+                b' ' | b'\t' | b'\r' => continue,
+                b'0'..=b'9' => {
+                    let mut num = (byte - b'0') as i32;
+                    while let Some(digit @ b'0'..=b'9') = self.peek() {
+                        num = num.wrapping_mul(10).wrapping_add((digit - b'0') as i32);
+                        self.pos += 1;
                     }
+                    Token::Number(num)
                 }
-                tokens.push(Token::Number(num));
-            }
-            'a'..='z' | 'A'..='Z' | '_' => {
-                let mut ident = String::new();
-                while let Some(&ch) = chars.peek() {
-                    if ch.is_alphanumeric() || ch == '_' {
-                        ident.push(ch);
-                        chars.next();
-                    } else {
-                        break;
+                b'a'..=b'z' | b'A'..=b'Z' | b'_' => {
+                    while let Some(b'a'..=b'z' | b'A'..=b'Z' | b'0'..=b'9' | b'_') = self.peek() {
+                        self.pos += 1;
                     }
+                    let word = &self.source[self.start..self.pos];
+                    keyword(word.as_bytes()).unwrap_or(Token::Identifier(word))
                 }
-                
-                let token = match ident.as_str() {
-                    "let" => Token::Let,
-                    "if" => Token::If,
-                    "else" => Token::Else,
-                    "while" => Token::While,
-                    "print" => Token::Print,
-                    "clear" => Token::Clear,
-                    _ => Token::Identifier(ident),
-                };
-                tokens.push(token);
-            }
-            '+' => {
-                chars.next();
-                tokens.push(Token::Plus);
-            }
-            '-' => {
-                chars.next();
-                tokens.push(Token::Minus);
-            }
-            '*' => {
-                chars.next();
-                tokens.push(Token::Star);
-            }
-            '/' => {
-                chars.next();
-                if chars.peek() == Some(&'/') {
+                b'+' => Token::Plus,
+                b'-' => Token::Minus,
+                b'*' => Token::Star,
+                b'/' if self.eat(b'/') => {
                     // Comment - skip to end of line
-                    while let Some(&ch) = chars.peek() {
-                        chars.next();
-                        if ch == '\n' {
+                    while let Some(byte) = self.peek() {
+                        self.pos += 1;
+                        if byte == b'\n' {
+                            self.line += 1;
                             break;
                         }
                     }
-                } else {
-                    tokens.push(Token::Slash);
-                }
-            }
-            '%' => {
-                chars.next();
-                tokens.push(Token::Percent);
-            }
-            '=' => {
-                chars.next();
-                if chars.peek() == Some(&'=') {
-                    chars.next();
-                    tokens.push(Token::EqualEqual);
-                } else {
-                    tokens.push(Token::Equal);
-                }
-            }
-            '!' => {
-                chars.next();
-                if chars.peek() == Some(&'=') {
-                    chars.next();
-                    tokens.push(Token::BangEqual);
-                } else {
-                    return Err("Unexpected character '!'");
+                    continue;
                 }
-            }
-            '<' => {
-                chars.next();
-                if chars.peek() == Some(&'=') {
-                    chars.next();
-                    tokens.push(Token::LessEqual);
-                } else {
-                    tokens.push(Token::Less);
-                }
-            }
-            '>' => {
-                chars.next();
-                if chars.peek() == Some(&'=') {
-                    chars.next();
-                    tokens.push(Token::GreaterEqual);
-                } else {
-                    tokens.push(Token::Greater);
-                }
-            }
-            '(' => {
-                chars.next();
-                tokens.push(Token::LeftParen);
-            }
-            ')' => {
-                chars.next();
-                tokens.push(Token::RightParen);
-            }
-            '{' => {
-                chars.next();
-                tokens.push(Token::LeftBrace);
-            }
-            '}' => {
-                chars.next();
-                tokens.push(Token::RightBrace);
-            }
-            ';' => {
-                chars.next();
-                tokens.push(Token::Semicolon);
-            }
-            _ => {
-                return Err("Unexpected character");
-            }
+                b'/' => Token::Slash,
+                b'%' => Token::Percent,
+                b'=' if self.eat(b'=') => Token::EqualEqual,
+                b'=' => Token::Equal,
+                b'!' if self.eat(b'=') => Token::BangEqual,
+                b'!' => return Err("Unexpected character '!'"),
+                b'<' if self.eat(b'=') => Token::LessEqual,
+                b'<' => Token::Less,
+                b'>' if self.eat(b'=') => Token::GreaterEqual,
+                b'>' => Token::Greater,
+                b'(' => Token::LeftParen,
+                b')' => Token::RightParen,
+                b'{' => Token::LeftBrace,
+                b'}' => Token::RightBrace,
+                b';' => Token::Semicolon,
+                _ => return Err("Unexpected character"),
+            };
+            return Ok(token);
+        }
+    }
+}
+
+/// Tokens up to, but not including, `Eof`
+impl<'src> Iterator for Lexer<'src> {
+    type Item = Result<Token<'src>, &'static str>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        match self.next_token() {
+            Ok(Token::Eof) => None,
+            result => Some(result),
         }
     }
-    
-    tokens.push(Token::Eof);
-    Ok(tokens)
 }
@@ -8,20 +8,41 @@
 //! - Built-in functions (print, clear, color)
 //! - No heap allocation for execution (only for storage)
 
+pub mod bytecode;
+pub mod image;
+pub mod jit;
 pub mod lexer;
+pub mod optimizer;
 pub mod parser;
+pub mod profile;
+pub mod task;
 pub mod vm;
 pub mod value;
 
 
 pub use vm::VirtualMachine;
 pub use value::Value;
+pub use parser::Program;
+pub use bytecode::Chunk;
+
+/// Compile a RustrialScript program to verified bytecode
+pub fn compile(source: &str) -> Result<Chunk, &'static str> {
+    let mut program = parser::parse(source)?;
+    optimizer::optimize(&mut program);
+    Chunk::assemble(&program)
+}
 
 /// Run a RustrialScript program
 pub fn run(source: &str) -> Result<(), &'static str> {
-    let tokens = lexer::tokenize(source)?;
-    let bytecode = parser::parse(&tokens)?;
+    run_chunk(&compile(source)?)
+}
+
+/// Run compiled bytecode, such as a chunk loaded from an image
+pub fn run_chunk(chunk: &Chunk) -> Result<(), &'static str> {
     let mut vm = VirtualMachine::new();
-    vm.execute(&bytecode)?;
-    Ok(())
+    // Scripts the JIT can't handle fall back to the interpreter
+    match jit::enabled().then(|| jit::compile(chunk)).flatten() {
+        Some(native) => native.run(&mut vm),
+        None => vm.execute(chunk),
+    }
 }
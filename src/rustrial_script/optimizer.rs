@@ -0,0 +1,138 @@
+//! Peephole optimizer for RustrialScript bytecode
+//!
+//! Runs on the parser's `OpCode`s before they are encoded. Each pass
+//! rewrites short windows of instructions, never across a jump target, and
+//! passes repeat until nothing changes:
+//!
+//! - constant folding of arithmetic, and of constant branch conditions
+//! - `LoadSlot s; Constant n; Add|Subtract; StoreSlot s` to `IncrementSlot`
+//! - a comparison followed by `JumpIfFalse` to `JumpUnless`
+//! - unreachable code after a `Jump`, and jumps to the next instruction
+//! - constants pushed only to be popped
+//!
+//! Each instruction keeps the source line it came from: a rewrite's
+//! instructions take the line of the first one they replace.
+//!
+//! Runtime errors are preserved: division by zero is never folded, and
+//! loads of variables are never removed since they may be undefined.
+
+use alloc::vec;
+use alloc::vec::Vec;
+use crate::rustrial_script::parser::{Comparison, OpCode, Program};
+
+/// Longest instruction sequence any rewrite matches
+const WINDOW: usize = 4;
+
+/// Optimize a program in place
+pub fn optimize(program: &mut Program) {
+    while pass(&mut program.code, &mut program.lines) {}
+}
+
+/// Fold a binary arithmetic opcode over two constants
+fn fold(op: &OpCode, a: i32, b: i32) -> Option<i32> {
+    Some(match op {
+        OpCode::Add => a.wrapping_add(b),
+        OpCode::Subtract => a.wrapping_sub(b),
+        OpCode::Multiply => a.wrapping_mul(b),
+        OpCode::Divide if b != 0 => a.wrapping_div(b),
+        OpCode::Modulo if b != 0 => a.wrapping_rem(b),
+        _ => return None,
+    })
+}
+
+/// Rewrite of the instructions starting at some index
+enum Rewrite {
+    /// Replace this many instructions with these
+    Replace(usize, Vec<OpCode>),
+    Keep,
+}
+
+/// Match the window starting at `code[0]`; `free` is how many of its
+/// instructions may be rewritten (no jump lands inside the window)
+fn rewrite(code: &[OpCode], free: usize, next: usize) -> Rewrite {
+    use OpCode::*;
+    let window = &code[..free.min(code.len())];
+    match window {
+        [Constant(a), Constant(b), op, ..] if fold(op, *a, *b).is_some() => {
+            Rewrite::Replace(3, vec![Constant(fold(op, *a, *b).unwrap())])
+        }
+        [Constant(a), Negate, ..] => Rewrite::Replace(2, vec![Constant(a.wrapping_neg())]),
+        [Constant(a), Constant(b), cmp, JumpIfFalse(target), ..] if Comparison::of(cmp).is_some() => {
+            let taken = !Comparison::of(cmp).unwrap().ints(*a, *b);
+            Rewrite::Replace(4, if taken { vec![Jump(*target)] } else { vec![] })
+        }
+        [Constant(n), JumpIfFalse(target), ..] => {
+            Rewrite::Replace(2, if *n == 0 { vec![Jump(*target)] } else { vec![] })
+        }
+        [Constant(_), Pop, ..] => Rewrite::Replace(2, vec![]),
+        [LoadSlot(s), Constant(n), Add, StoreSlot(d), ..]
+        | [Constant(n), LoadSlot(s), Add, StoreSlot(d), ..] if s == d => {
+            Rewrite::Replace(4, vec![IncrementSlot(*s, *n)])
+        }
+        [LoadSlot(s), Constant(n), Subtract, StoreSlot(d), ..] if s == d => {
+            Rewrite::Replace(4, vec![IncrementSlot(*s, n.wrapping_neg())])
+        }
+        [cmp, JumpIfFalse(target), ..] if Comparison::of(cmp).is_some() => {
+            Rewrite::Replace(2, vec![JumpUnless(Comparison::of(cmp).unwrap(), *target)])
+        }
+        [Jump(target), ..] if *target == next => Rewrite::Replace(1, vec![]),
+        _ => Rewrite::Keep,
+    }
+}
+
+/// Run one pass over the code, returning whether anything changed
+fn pass(code: &mut Vec<OpCode>, lines: &mut Vec<u32>) -> bool {
+    let len = code.len();
+    let mut is_target = vec![false; len + 1];
+    for op in code.iter() {
+        if let OpCode::Jump(t) | OpCode::JumpIfFalse(t) | OpCode::JumpUnless(_, t) = op {
+            is_target[*t] = true;
+        }
+    }
+
+    // New index of each old instruction; removed ones map to whatever
+    // follows them, which only matters for jumps to the end
+    let mut map = vec![0; len + 1];
+    let mut out = Vec::with_capacity(len);
+    let mut out_lines = Vec::with_capacity(len);
+    let mut changed = false;
+    let mut i = 0;
+    while i < len {
+        let free = 1 + (i + 1..len.min(i + WINDOW)).take_while(|&j| !is_target[j]).count();
+        match rewrite(&code[i..], free, i + 1) {
+            Rewrite::Replace(n, ops) => {
+                for j in i..i + n {
+                    map[j] = out.len();
+                }
+                out_lines.extend(core::iter::repeat(lines[i]).take(ops.len()));
+                out.extend(ops);
+                i += n;
+                changed = true;
+            }
+            Rewrite::Keep => {
+                map[i] = out.len();
+                out.push(code[i].clone());
+                out_lines.push(lines[i]);
+                i += 1;
+                // Code after an unconditional jump is dead until the next target
+                if matches!(code[i - 1], OpCode::Jump(_)) {
+                    while i < len && !is_target[i] {
+                        map[i] = out.len();
+                        i += 1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    map[len] = out.len();
+
+    for op in out.iter_mut() {
+        if let OpCode::Jump(t) | OpCode::JumpIfFalse(t) | OpCode::JumpUnless(_, t) = op {
+            *t = map[*t];
+        }
+    }
+    *code = out;
+    *lines = out_lines;
+    changed
+}
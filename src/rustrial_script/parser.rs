@@ -1,15 +1,16 @@
 //! Parser and bytecode compiler for RustrialScript
 
+use alloc::collections::BTreeMap;
 use alloc::vec::Vec;
 use alloc::string::String;
-use crate::rustrial_script::lexer::Token;
+use crate::rustrial_script::lexer::{Lexer, Token};
 
 #[derive(Debug, Clone)]
 pub enum OpCode {
     // Stack operations
     Constant(i32),
-    LoadVar(String),
-    StoreVar(String),
+    LoadSlot(u16),         // Push the variable in a slot
+    StoreSlot(u16),        // Pop into the variable in a slot
     
     // Arithmetic
     Add,
@@ -37,48 +38,136 @@ pub enum OpCode {
     
     // Stack management
     Pop,
+
+    // Superinstructions, emitted only by the optimizer
+    IncrementSlot(u16, i32),         // Add a constant to a slot in place
+    JumpUnless(Comparison, usize),   // Compare the top two values, jump if false
+}
+
+/// Comparison fused into `JumpUnless`
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Comparison {
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+}
+
+impl Comparison {
+    /// The comparison an opcode performs, if it is one
+    pub fn of(op: &OpCode) -> Option<Self> {
+        Some(match op {
+            OpCode::Equal => Comparison::Equal,
+            OpCode::NotEqual => Comparison::NotEqual,
+            OpCode::Less => Comparison::Less,
+            OpCode::Greater => Comparison::Greater,
+            OpCode::LessEqual => Comparison::LessEqual,
+            OpCode::GreaterEqual => Comparison::GreaterEqual,
+            _ => return None,
+        })
+    }
+
+    pub fn ints(self, a: i32, b: i32) -> bool {
+        match self {
+            Comparison::Equal => a == b,
+            Comparison::NotEqual => a != b,
+            Comparison::Less => a < b,
+            Comparison::Greater => a > b,
+            Comparison::LessEqual => a <= b,
+            Comparison::GreaterEqual => a >= b,
+        }
+    }
 }
 
-pub struct Parser {
-    tokens: Vec<Token>,
-    current: usize,
+/// Compiled script: bytecode plus the variable name of each slot
+#[derive(Debug, Clone)]
+pub struct Program {
+    pub code: Vec<OpCode>,
+    /// Source line of each instruction
+    pub lines: Vec<u32>,
+    pub slots: Vec<String>,
+}
+
+/// Recursive descent parser pulling tokens from the lexer as it goes, with
+/// two tokens of lookahead
+pub struct Parser<'src> {
+    lexer: Lexer<'src>,
+    current: Token<'src>,
+    next: Token<'src>,
+    current_line: u32,
+    next_line: u32,
+    /// Line of the token last consumed, which new instructions belong to
+    line: u32,
     bytecode: Vec<OpCode>,
+    lines: Vec<u32>,
+    slots: BTreeMap<&'src str, u16>,
+    names: Vec<&'src str>,
 }
 
-impl Parser {
-    fn new(tokens: Vec<Token>) -> Self {
-        Self {
-            tokens,
-            current: 0,
+impl<'src> Parser<'src> {
+    fn new(source: &'src str) -> Result<Self, &'static str> {
+        let mut lexer = Lexer::new(source);
+        let current = lexer.next_token()?;
+        let current_line = lexer.line();
+        let next = lexer.next_token()?;
+        let next_line = lexer.line();
+        Ok(Self {
+            lexer,
+            current,
+            next,
+            current_line,
+            next_line,
+            line: current_line,
             bytecode: Vec::new(),
+            lines: Vec::new(),
+            slots: BTreeMap::new(),
+            names: Vec::new(),
+        })
+    }
+
+    /// Slot for a variable, allocating one on first mention
+    ///
+    /// All variables are global, so a name maps to the same slot everywhere.
+    fn slot(&mut self, name: &'src str) -> Result<u16, &'static str> {
+        if let Some(&slot) = self.slots.get(name) {
+            return Ok(slot);
         }
+        let slot = u16::try_from(self.names.len()).map_err(|_| "Too many variables")?;
+        self.slots.insert(name, slot);
+        self.names.push(name);
+        Ok(slot)
     }
     
     fn is_at_end(&self) -> bool {
         matches!(self.peek(), Token::Eof)
     }
     
-    fn peek(&self) -> &Token {
-        &self.tokens[self.current]
+    fn peek(&self) -> Token<'src> {
+        self.current
     }
     
-    fn advance(&mut self) -> &Token {
-        if !self.is_at_end() {
-            self.current += 1;
-        }
-        &self.tokens[self.current - 1]
+    fn advance(&mut self) -> Result<Token<'src>, &'static str> {
+        let token = self.current;
+        self.line = self.current_line;
+        self.current = self.next;
+        self.current_line = self.next_line;
+        self.next = self.lexer.next_token()?;
+        self.next_line = self.lexer.line();
+        Ok(token)
     }
     
     fn check(&self, token: &Token) -> bool {
         if self.is_at_end() {
             return false;
         }
-        core::mem::discriminant(self.peek()) == core::mem::discriminant(token)
+        core::mem::discriminant(&self.peek()) == core::mem::discriminant(token)
     }
     
     fn consume(&mut self, expected: Token, msg: &'static str) -> Result<(), &'static str> {
         if self.check(&expected) {
-            self.advance();
+            self.advance()?;
             Ok(())
         } else {
             Err(msg)
@@ -87,6 +176,7 @@ impl Parser {
     
     fn emit(&mut self, op: OpCode) {
         self.bytecode.push(op);
+        self.lines.push(self.line);
     }
     
     fn parse_program(&mut self) -> Result<(), &'static str> {
@@ -104,7 +194,7 @@ impl Parser {
             Token::Print => self.parse_print(),
             Token::Clear => self.parse_clear(),
             Token::LeftBrace => self.parse_block(),
-            Token::Identifier(_) => self.parse_assignment_or_expr(),
+            Token::Identifier(name) if self.next == Token::Equal => self.parse_assignment(name),
             _ => {
                 self.parse_expression()?;
                 self.consume(Token::Semicolon, "Expected ';'")?;
@@ -115,10 +205,10 @@ impl Parser {
     }
     
     fn parse_let(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume 'let'
+        self.advance()?; // consume 'let'
         
-        let name = match self.advance() {
-            Token::Identifier(n) => n.clone(),
+        let name = match self.advance()? {
+            Token::Identifier(n) => n,
             _ => return Err("Expected identifier after 'let'"),
         };
         
@@ -126,35 +216,23 @@ impl Parser {
         self.parse_expression()?;
         self.consume(Token::Semicolon, "Expected ';'")?;
         
-        self.emit(OpCode::StoreVar(name));
+        let slot = self.slot(name)?;
+        self.emit(OpCode::StoreSlot(slot));
         Ok(())
     }
     
-    fn parse_assignment_or_expr(&mut self) -> Result<(), &'static str> {
-        let name = match self.peek() {
-            Token::Identifier(n) => n.clone(),
-            _ => return Err("Expected identifier"),
-        };
-        self.advance();
-        
-        if self.check(&Token::Equal) {
-            self.advance(); // consume '='
-            self.parse_expression()?;
-            self.consume(Token::Semicolon, "Expected ';'")?;
-            self.emit(OpCode::StoreVar(name));
-            Ok(())
-        } else {
-            // It's an expression starting with identifier
-            self.current -= 1; // backtrack
-            self.parse_expression()?;
-            self.consume(Token::Semicolon, "Expected ';'")?;
-            self.emit(OpCode::Pop);
-            Ok(())
-        }
+    fn parse_assignment(&mut self, name: &'src str) -> Result<(), &'static str> {
+        self.advance()?; // consume the name
+        self.advance()?; // consume '='
+        self.parse_expression()?;
+        self.consume(Token::Semicolon, "Expected ';'")?;
+        let slot = self.slot(name)?;
+        self.emit(OpCode::StoreSlot(slot));
+        Ok(())
     }
     
     fn parse_if(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume 'if'
+        self.advance()?; // consume 'if'
         
         self.consume(Token::LeftParen, "Expected '(' after 'if'")?;
         self.parse_expression()?;
@@ -167,7 +245,7 @@ impl Parser {
         self.parse_statement()?;
         
         if self.check(&Token::Else) {
-            self.advance(); // consume 'else'
+            self.advance()?; // consume 'else'
             
             // Jump over else branch
             let jump_idx = self.bytecode.len();
@@ -192,7 +270,7 @@ impl Parser {
     }
     
     fn parse_while(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume 'while'
+        self.advance()?; // consume 'while'
         
         let loop_start = self.bytecode.len();
         
@@ -214,7 +292,7 @@ impl Parser {
     }
     
     fn parse_print(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume 'print'
+        self.advance()?; // consume 'print'
         
         self.consume(Token::LeftParen, "Expected '(' after 'print'")?;
         self.parse_expression()?;
@@ -226,7 +304,7 @@ impl Parser {
     }
     
     fn parse_clear(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume 'clear'
+        self.advance()?; // consume 'clear'
         
         self.consume(Token::LeftParen, "Expected '(' after 'clear'")?;
         self.consume(Token::RightParen, "Expected ')'")?;
@@ -237,7 +315,7 @@ impl Parser {
     }
     
     fn parse_block(&mut self) -> Result<(), &'static str> {
-        self.advance(); // consume '{'
+        self.advance()?; // consume '{'
         
         while !self.check(&Token::RightBrace) && !self.is_at_end() {
             self.parse_statement()?;
@@ -259,7 +337,7 @@ impl Parser {
             Token::Less | Token::Greater | 
             Token::LessEqual | Token::GreaterEqual) {
             
-            let op = self.advance().clone();
+            let op = self.advance()?;
             self.parse_term()?;
             
             match op {
@@ -280,7 +358,7 @@ impl Parser {
         self.parse_factor()?;
         
         while matches!(self.peek(), Token::Plus | Token::Minus) {
-            let op = self.advance().clone();
+            let op = self.advance()?;
             self.parse_factor()?;
             
             match op {
@@ -297,7 +375,7 @@ impl Parser {
         self.parse_unary()?;
         
         while matches!(self.peek(), Token::Star | Token::Slash | Token::Percent) {
-            let op = self.advance().clone();
+            let op = self.advance()?;
             self.parse_unary()?;
             
             match op {
@@ -313,7 +391,7 @@ impl Parser {
     
     fn parse_unary(&mut self) -> Result<(), &'static str> {
         if self.check(&Token::Minus) {
-            self.advance();
+            self.advance()?;
             self.parse_unary()?;
             self.emit(OpCode::Negate);
             Ok(())
@@ -323,13 +401,14 @@ impl Parser {
     }
     
     fn parse_primary(&mut self) -> Result<(), &'static str> {
-        match self.advance().clone() {
+        match self.advance()? {
             Token::Number(n) => {
                 self.emit(OpCode::Constant(n));
                 Ok(())
             }
             Token::Identifier(name) => {
-                self.emit(OpCode::LoadVar(name));
+                let slot = self.slot(name)?;
+                self.emit(OpCode::LoadSlot(slot));
                 Ok(())
             }
             Token::LeftParen => {
@@ -342,8 +421,13 @@ impl Parser {
     }
 }
 
-pub fn parse(tokens: &[Token]) -> Result<Vec<OpCode>, &'static str> {
-    let mut parser = Parser::new(tokens.to_vec());
+/// Compile source to bytecode in one pass, lexing as the parser goes
+pub fn parse(source: &str) -> Result<Program, &'static str> {
+    let mut parser = Parser::new(source)?;
     parser.parse_program()?;
-    Ok(parser.bytecode)
+    Ok(Program {
+        code: parser.bytecode,
+        lines: parser.lines,
+        slots: parser.names.into_iter().map(String::from).collect(),
+    })
 }
@@ -0,0 +1,152 @@
+//! Execution profiles of RustrialScript runs
+//!
+//! A profiling VM counts every instruction it executes and charges it the
+//! TSC cycles until the next one starts, both indexed by byte offset. A
+//! `Report` folds these into per-line and per-opcode totals through the
+//! chunk's line table, and `Report::export` writes them out in a text
+//! format the Haxe Inspector loads:
+//!
+//! ```text
+//! rustrial-profile 1
+//! script <path>
+//! instructions <count>
+//! cycles <count>
+//! line <line> <count> <cycles>      one per line that ran
+//! op <NAME> <count> <cycles>        one per opcode that ran
+//! source                            the rest of the file is the script
+//! ```
+//!
+//! Cycles include the profiler's own overhead, so they rank lines against
+//! each other rather than measure an unprofiled run.
+
+use alloc::string::String;
+use alloc::vec;
+use alloc::vec::Vec;
+use core::fmt::Write;
+use crate::rustrial_script::bytecode::{self, Chunk};
+
+/// Header line of an exported profile
+pub const MAGIC: &str = "rustrial-profile 1";
+
+/// File extension of exported profiles
+pub const PROFILE_EXTENSION: &str = ".prof";
+
+/// Path of the profile exported for the script at `path`
+pub fn profile_path(path: &str) -> String {
+    let stem = path.strip_suffix(crate::rustrial_script::image::SOURCE_EXTENSION).unwrap_or(path);
+    let mut profile = String::from(stem);
+    profile.push_str(PROFILE_EXTENSION);
+    profile
+}
+
+/// Raw counters of one run, by instruction byte offset
+pub struct Profile {
+    pub(super) counts: Vec<u64>,
+    pub(super) cycles: Vec<u64>,
+}
+
+impl Profile {
+    pub(super) fn new(code_len: usize) -> Self {
+        Self { counts: vec![0; code_len], cycles: vec![0; code_len] }
+    }
+
+    /// Times the instruction at byte offset `at` was executed
+    pub fn count(&self, at: usize) -> u64 {
+        self.counts.get(at).copied().unwrap_or(0)
+    }
+
+    /// Cycles spent in the instruction at byte offset `at`
+    pub fn cycles(&self, at: usize) -> u64 {
+        self.cycles.get(at).copied().unwrap_or(0)
+    }
+
+    /// Totals per source line and per opcode for the chunk profiled
+    pub fn report(&self, chunk: &Chunk) -> Report {
+        let code = chunk.code();
+        let mut report = Report::default();
+        let mut lines: Vec<LineStats> = Vec::new();
+        let mut opcodes: Vec<OpStats> = Vec::new();
+        let mut at = 0;
+        while at < code.len() && at < self.counts.len() {
+            let (count, cycles) = (self.counts[at], self.cycles[at]);
+            if count > 0 {
+                report.instructions += count;
+                report.cycles += cycles;
+                if let Some(line) = chunk.line_at(at) {
+                    match lines.iter_mut().find(|s| s.line == line) {
+                        Some(stats) => {
+                            stats.count += count;
+                            stats.cycles += cycles;
+                        }
+                        None => lines.push(LineStats { line, count, cycles }),
+                    }
+                }
+                match opcodes.iter_mut().find(|s| s.opcode == code[at]) {
+                    Some(stats) => {
+                        stats.count += count;
+                        stats.cycles += cycles;
+                    }
+                    None => opcodes.push(OpStats { opcode: code[at], count, cycles }),
+                }
+            }
+            at += bytecode::len_at(code, at);
+        }
+        lines.sort_unstable_by(|a, b| b.cycles.cmp(&a.cycles).then(a.line.cmp(&b.line)));
+        opcodes.sort_unstable_by(|a, b| b.count.cmp(&a.count).then(a.opcode.cmp(&b.opcode)));
+        report.lines = lines;
+        report.opcodes = opcodes;
+        report
+    }
+}
+
+/// Time spent on one source line
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct LineStats {
+    pub line: u32,
+    /// Instructions of the line executed
+    pub count: u64,
+    pub cycles: u64,
+}
+
+/// Executions of one opcode
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct OpStats {
+    pub opcode: u8,
+    pub count: u64,
+    pub cycles: u64,
+}
+
+/// A profile summarized for display; lines are sorted hottest first by
+/// cycles, opcodes by count
+#[derive(Debug, Clone, Default)]
+pub struct Report {
+    pub instructions: u64,
+    pub cycles: u64,
+    pub lines: Vec<LineStats>,
+    pub opcodes: Vec<OpStats>,
+}
+
+impl Report {
+    /// Percentage of all cycles spent in `cycles`, in tenths
+    pub fn permille(&self, cycles: u64) -> u64 {
+        if self.cycles == 0 { 0 } else { cycles * 1000 / self.cycles }
+    }
+
+    /// The profile in the Inspector's text format, with the script's source
+    pub fn export(&self, script: &str, source: &str) -> String {
+        let mut out = String::with_capacity(128 + 32 * (self.lines.len() + self.opcodes.len()) + source.len());
+        let _ = writeln!(out, "{}", MAGIC);
+        let _ = writeln!(out, "script {}", script);
+        let _ = writeln!(out, "instructions {}", self.instructions);
+        let _ = writeln!(out, "cycles {}", self.cycles);
+        for stats in &self.lines {
+            let _ = writeln!(out, "line {} {} {}", stats.line, stats.count, stats.cycles);
+        }
+        for stats in &self.opcodes {
+            let _ = writeln!(out, "op {} {} {}", bytecode::name(stats.opcode), stats.count, stats.cycles);
+        }
+        out.push_str("source\n");
+        out.push_str(source);
+        out
+    }
+}
@@ -0,0 +1,153 @@
+//! Scripts as executor tasks
+//!
+//! A script task runs its chunk `SLICE` instructions at a time and yields
+//! to the executor in between, so any number of scripts share the CPU with
+//! the shell, the desktop and each other. Each task is listed in a registry
+//! with its instruction count until a few newer scripts have finished.
+//!
+//! A profiled run always uses the interpreter, which keeps the counters.
+
+use alloc::string::String;
+use alloc::sync::Arc;
+use alloc::vec::Vec;
+use core::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+use core::task::Poll;
+use spin::Mutex;
+use crate::rustrial_script::bytecode::Chunk;
+use crate::rustrial_script::jit::{self, JitCode};
+use crate::rustrial_script::profile::Report;
+use crate::rustrial_script::vm::VirtualMachine;
+
+/// Instructions a script runs before yielding to other tasks
+pub const SLICE: u64 = 10_000;
+
+/// Finished scripts kept in the registry
+const KEEP_FINISHED: usize = 8;
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Status {
+    Running,
+    Done,
+    Failed(&'static str),
+}
+
+/// Registry entry of one script task
+pub struct ScriptInfo {
+    pub id: u32,
+    pub name: String,
+    /// Whether the script runs as JIT-compiled code
+    pub native: bool,
+    executed: AtomicU64,
+    slices: AtomicU64,
+    status: Mutex<Status>,
+}
+
+impl ScriptInfo {
+    /// Instructions executed so far
+    pub fn executed(&self) -> u64 {
+        self.executed.load(Ordering::Relaxed)
+    }
+
+    /// Times the script has been scheduled
+    pub fn slices(&self) -> u64 {
+        self.slices.load(Ordering::Relaxed)
+    }
+
+    pub fn status(&self) -> Status {
+        *self.status.lock()
+    }
+}
+
+static SCRIPTS: Mutex<Vec<Arc<ScriptInfo>>> = Mutex::new(Vec::new());
+
+/// Running and recently finished scripts, oldest first
+pub fn scripts() -> Vec<Arc<ScriptInfo>> {
+    SCRIPTS.lock().clone()
+}
+
+/// A compiled script with its registry entry, ready to run
+struct ScriptTask {
+    info: Arc<ScriptInfo>,
+    chunk: Chunk,
+    native: Option<JitCode>,
+}
+
+impl ScriptTask {
+    fn new(name: String, chunk: Chunk, use_jit: bool) -> Self {
+        static NEXT_ID: AtomicU32 = AtomicU32::new(1);
+
+        // Scripts the JIT can't handle fall back to the interpreter
+        let native = (use_jit && jit::enabled()).then(|| jit::compile(&chunk)).flatten();
+        let info = Arc::new(ScriptInfo {
+            id: NEXT_ID.fetch_add(1, Ordering::Relaxed),
+            name,
+            native: native.is_some(),
+            executed: AtomicU64::new(0),
+            slices: AtomicU64::new(0),
+            status: Mutex::new(Status::Running),
+        });
+
+        let mut scripts = SCRIPTS.lock();
+        let finished = scripts.iter().filter(|s| s.status() != Status::Running).count();
+        if finished >= KEEP_FINISHED {
+            if let Some(oldest) = scripts.iter().position(|s| s.status() != Status::Running) {
+                scripts.remove(oldest);
+            }
+        }
+        scripts.push(info.clone());
+        drop(scripts);
+
+        Self { info, chunk, native }
+    }
+
+    async fn run(&self, vm: &mut VirtualMachine) -> Result<(), &'static str> {
+        match &self.native {
+            Some(native) => native.start(vm),
+            None => vm.start(&self.chunk),
+        }
+        let result = loop {
+            let poll = match &self.native {
+                Some(native) => native.resume(vm, SLICE),
+                None => vm.resume(&self.chunk, SLICE),
+            };
+            self.info.executed.store(vm.executed(), Ordering::Relaxed);
+            self.info.slices.fetch_add(1, Ordering::Relaxed);
+            match poll {
+                Poll::Ready(result) => break result,
+                Poll::Pending => crate::task::yield_now().await,
+            }
+        };
+        *self.info.status.lock() = match result {
+            Ok(()) => Status::Done,
+            Err(e) => Status::Failed(e),
+        };
+        result
+    }
+}
+
+/// Run a script to completion, letting other tasks run between slices
+pub async fn run(name: String, chunk: Chunk) -> Result<(), &'static str> {
+    ScriptTask::new(name, chunk, true).run(&mut VirtualMachine::new()).await
+}
+
+/// Run a script to completion in the interpreter, profiling it
+pub async fn run_profiled(name: String, chunk: Chunk) -> (Result<(), &'static str>, Report) {
+    let task = ScriptTask::new(name, chunk, false);
+    let mut vm = VirtualMachine::new();
+    vm.set_profiling(true);
+    let result = task.run(&mut vm).await;
+    let report = vm.profile().map(|profile| profile.report(&task.chunk)).unwrap_or_default();
+    (result, report)
+}
+
+/// Start a script in a task of its own; returns its registry id
+pub fn spawn(name: String, chunk: Chunk) -> u32 {
+    let task = ScriptTask::new(name, chunk, true);
+    let id = task.info.id;
+    crate::task::spawn_task(async move {
+        if let Err(e) = task.run(&mut VirtualMachine::new()).await {
+            crate::println!("Script #{} error: {}", id, e);
+        }
+    });
+    id
+}
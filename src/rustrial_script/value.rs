@@ -30,6 +30,75 @@ impl Value {
     }
 }
 
+/// A value as the VM stores it: the payload in the low 32 bits and a type
+/// tag in the high 32, with integers tagged zero
+///
+/// An integer is its own zero-extended bits, so arithmetic needs no
+/// unpacking, and a single test of the OR of two values checks that both
+/// are integers.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Tagged(u64);
+
+const TAG_BOOL: u64 = 1 << 32;
+const TAG_NIL: u64 = 2 << 32;
+
+impl Tagged {
+    pub const NIL: Tagged = Tagged(TAG_NIL);
+
+    #[inline(always)]
+    pub const fn int(n: i32) -> Self {
+        Tagged(n as u32 as u64)
+    }
+
+    #[inline(always)]
+    pub const fn bool(b: bool) -> Self {
+        Tagged(TAG_BOOL | b as u64)
+    }
+
+    /// Whether `a` and `b` are both integers
+    #[inline(always)]
+    pub fn both_int(a: Tagged, b: Tagged) -> bool {
+        (a.0 | b.0) >> 32 == 0
+    }
+
+    #[inline(always)]
+    pub fn is_int(self) -> bool {
+        self.0 >> 32 == 0
+    }
+
+    /// The payload as an integer; only meaningful for integers
+    #[inline(always)]
+    pub fn payload(self) -> i32 {
+        self.0 as u32 as i32
+    }
+
+    /// Same rules as `Value::is_truthy`: a zero payload is false
+    #[inline(always)]
+    pub fn is_truthy(self) -> bool {
+        self.0 as u32 != 0
+    }
+}
+
+impl From<Value> for Tagged {
+    fn from(value: Value) -> Self {
+        match value {
+            Value::Int(n) => Tagged::int(n),
+            Value::Bool(b) => Tagged::bool(b),
+            Value::Nil => Tagged::NIL,
+        }
+    }
+}
+
+impl From<Tagged> for Value {
+    fn from(value: Tagged) -> Self {
+        match value.0 & !0xFFFF_FFFF {
+            0 => Value::Int(value.payload()),
+            TAG_BOOL => Value::Bool(value.payload() != 0),
+            _ => Value::Nil,
+        }
+    }
+}
+
 impl fmt::Display for Value {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         match self {
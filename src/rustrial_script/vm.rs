@@ -1,165 +1,393 @@
 //! Virtual Machine for executing RustrialScript bytecode
+//!
+//! Execution is resumable: `start` loads a chunk and `resume` runs it for
+//! a budget of instructions, returning `Poll::Pending` with the machine
+//! state saved when the budget runs out. Script tasks use this to share
+//! the CPU with the rest of the system.
+//!
+//! The stack and variables hold `Tagged` values. Generic arithmetic checks
+//! both operands with one test; the `_INT` forms `specialize` emits for
+//! operands known to be integers skip even that.
+//!
+//! With profiling on, the VM also counts each instruction it executes and
+//! the TSC cycles spent in it. The profiling loop is a separate
+//! instantiation of the interpreter, so ordinary runs pay nothing for it.
 
-use alloc::collections::BTreeMap;
-use alloc::string::String;
-use crate::rustrial_script::parser::OpCode;
-use crate::rustrial_script::value::Value;
+use alloc::vec::Vec;
+use core::task::Poll;
+use crate::rustrial_script::bytecode::{op, Chunk, STACK_SIZE};
+use crate::rustrial_script::profile::Profile;
+use crate::rustrial_script::value::{Tagged, Value};
 use crate::println;
 
-const STACK_SIZE: usize = 256;
-
 pub struct VirtualMachine {
-    stack: [Value; STACK_SIZE],
-    stack_top: usize,
-    variables: BTreeMap<String, Value>,
-    ip: usize, // instruction pointer
+    stack: [Tagged; STACK_SIZE],
+    /// Variables by slot while running; `NIL` marks one not yet assigned
+    variables: Vec<Tagged>,
+    /// The chunk's constant pool, tagged
+    constants: Vec<Tagged>,
+    /// Variables as left by the last completed run
+    pub(super) locals: Vec<Value>,
+    /// Variable storage for JIT-compiled code
+    pub(super) native_locals: Vec<u64>,
+    pub(super) quiet: bool,
+    /// Where a suspended run continues: the next instruction's byte
+    /// offset, the stack depth and the cached top of stack
+    pub(super) ip: usize,
+    sp: usize,
+    top: Tagged,
+    /// Address and length of the code being run, to catch resuming with
+    /// another chunk
+    running: (usize, usize),
+    /// Instructions executed since `start`
+    pub(super) executed: u64,
+    profiling: bool,
+    /// Counters of the run since `start`, when profiling
+    profile: Option<Profile>,
 }
 
 impl VirtualMachine {
     pub fn new() -> Self {
         Self {
-            stack: [Value::Nil; STACK_SIZE],
-            stack_top: 0,
-            variables: BTreeMap::new(),
+            stack: [Tagged::NIL; STACK_SIZE],
+            variables: Vec::new(),
+            constants: Vec::new(),
+            locals: Vec::new(),
+            native_locals: Vec::new(),
+            quiet: false,
             ip: 0,
+            sp: 0,
+            top: Tagged::NIL,
+            running: (0, 0),
+            executed: 0,
+            profiling: false,
+            profile: None,
         }
     }
-    
-    fn push(&mut self, value: Value) -> Result<(), &'static str> {
-        if self.stack_top >= STACK_SIZE {
-            return Err("Stack overflow");
+
+    /// A VM that discards `print` and `clear`, for benchmarking
+    pub fn quiet() -> Self {
+        Self {
+            quiet: true,
+            ..Self::new()
         }
-        self.stack[self.stack_top] = value;
-        self.stack_top += 1;
-        Ok(())
     }
-    
-    fn pop(&mut self) -> Result<Value, &'static str> {
-        if self.stack_top == 0 {
-            return Err("Stack underflow");
-        }
-        self.stack_top -= 1;
-        Ok(self.stack[self.stack_top].clone())
+
+    /// Variable values by slot, as left by the last completed run
+    pub fn locals(&self) -> &[Value] {
+        &self.locals
+    }
+
+    /// Instructions executed since the last `start`
+    pub fn executed(&self) -> u64 {
+        self.executed
+    }
+
+    /// Profile runs from the next `start` on
+    pub fn set_profiling(&mut self, on: bool) {
+        self.profiling = on;
+    }
+
+    /// Counters of the run since the last `start`, if it was profiled
+    pub fn profile(&self) -> Option<&Profile> {
+        self.profile.as_ref()
     }
-    
-    fn peek(&self) -> Result<&Value, &'static str> {
-        if self.stack_top == 0 {
-            return Err("Stack is empty");
+
+    /// Run a chunk to completion
+    pub fn execute(&mut self, chunk: &Chunk) -> Result<(), &'static str> {
+        self.start(chunk);
+        loop {
+            if let Poll::Ready(result) = self.resume(chunk, u64::MAX) {
+                return result;
+            }
         }
-        Ok(&self.stack[self.stack_top - 1])
     }
-    
-    pub fn execute(&mut self, bytecode: &[OpCode]) -> Result<(), &'static str> {
+
+    /// Reset the machine to run `chunk` from the beginning
+    pub fn start(&mut self, chunk: &Chunk) {
+        self.variables.clear();
+        self.variables.resize(chunk.slots().len(), Tagged::NIL);
+        self.constants.clear();
+        self.constants.extend(chunk.constants().iter().map(|&c| Tagged::from(c)));
         self.ip = 0;
-        
-        while self.ip < bytecode.len() {
-            let op = &bytecode[self.ip];
-            self.ip += 1;
-            
-            match op {
-                OpCode::Constant(n) => {
-                    self.push(Value::Int(*n))?;
-                }
-                OpCode::LoadVar(name) => {
-                    let value = self.variables.get(name)
-                        .ok_or("Undefined variable")?
-                        .clone();
-                    self.push(value)?;
-                }
-                OpCode::StoreVar(name) => {
-                    let value = self.pop()?;
-                    self.variables.insert(name.clone(), value);
-                }
-                OpCode::Add => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(a.wrapping_add(b)))?;
-                }
-                OpCode::Subtract => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(a.wrapping_sub(b)))?;
+        self.sp = 0;
+        self.top = Tagged::NIL;
+        self.running = Self::identity(chunk);
+        self.executed = 0;
+        self.profile = self.profiling.then(|| Profile::new(chunk.code().len()));
+    }
+
+    fn identity(chunk: &Chunk) -> (usize, usize) {
+        (chunk.code().as_ptr() as usize, chunk.code().len())
+    }
+
+    /// Continue the chunk passed to `start` for at most `budget`
+    /// instructions
+    pub fn resume(&mut self, chunk: &Chunk, budget: u64) -> Poll<Result<(), &'static str>> {
+        if self.running != Self::identity(chunk) {
+            return Poll::Ready(Err("VM is not running this chunk"));
+        }
+        if self.profile.is_some() {
+            self.run::<true>(chunk, budget)
+        } else {
+            self.run::<false>(chunk, budget)
+        }
+    }
+
+    /// The interpreter loop, counting instructions and cycles if `PROFILE`
+    #[inline(always)]
+    fn run<const PROFILE: bool>(&mut self, chunk: &Chunk, budget: u64) -> Poll<Result<(), &'static str>> {
+        let code = chunk.code();
+        let constants = self.constants.as_ptr();
+        let locals = self.variables.as_mut_ptr();
+        let stack = self.stack.as_mut_ptr();
+        let mut sp = self.sp; // values on the stack
+        let mut top = self.top;
+        let mut ip = self.ip; // byte offset of the next instruction
+        let mut fuel = budget;
+
+        // Profile counters, and the instruction being timed with when it
+        // started; time before the first instruction is charged to it
+        let (counts, cycles) = match &mut self.profile {
+            Some(profile) if PROFILE => (profile.counts.as_mut_ptr(), profile.cycles.as_mut_ptr()),
+            _ => (core::ptr::null_mut(), core::ptr::null_mut()),
+        };
+        let mut timed = ip;
+        let mut since = if PROFILE { unsafe { core::arch::x86_64::_rdtsc() } } else { 0 };
+
+        // Leave the loop, recording how far execution got
+        macro_rules! suspend {
+            ($result:expr) => {{
+                if PROFILE {
+                    *cycles.add(timed) += core::arch::x86_64::_rdtsc() - since;
                 }
-                OpCode::Multiply => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(a.wrapping_mul(b)))?;
+                self.sp = sp;
+                self.top = top;
+                self.ip = ip;
+                self.executed += budget - fuel;
+                let result = $result;
+                if result.is_ready() {
+                    // A finished run cannot be resumed
+                    self.running = (0, 0);
+                    self.locals.clear();
+                    self.locals.extend(self.variables.iter().map(|&v| Value::from(v)));
                 }
-                OpCode::Divide => {
-                    let b = self.pop()?.as_int()?;
-                    if b == 0 {
-                        return Err("Division by zero");
+                return result;
+            }};
+        }
+
+        // SAFETY: the chunk was verified when it was built, so every opcode
+        // and operand is in range, jumps land on instructions, execution
+        // ends at HALT, and the stack depth at each instruction is fixed,
+        // covers its pops and stays within STACK_SIZE. A suspended run
+        // stops between instructions, so the saved state is one the
+        // verifier accounted for. Profile counters have an entry for every
+        // byte of the code.
+        unsafe {
+            // The `n`th u16 operand of the current instruction
+            macro_rules! arg {
+                ($n:expr) => {
+                    u16::from_le_bytes([
+                        *code.get_unchecked(ip + 1 + 2 * $n),
+                        *code.get_unchecked(ip + 2 + 2 * $n),
+                    ]) as usize
+                };
+            }
+            // The top of the stack lives in `top`, the values beneath it in
+            // `stack[1..sp]`; `stack[0]` is a placeholder so popping the last
+            // value needs no branch
+            macro_rules! pop {
+                () => {{
+                    let value = top;
+                    sp -= 1;
+                    top = *stack.add(sp);
+                    value
+                }};
+            }
+            macro_rules! push {
+                ($value:expr) => {{
+                    let value = $value;
+                    *stack.add(sp) = top;
+                    sp += 1;
+                    top = value;
+                }};
+            }
+            // Replace the top two values with `$a op $b`. With `int` or, in
+            // the `_INT` forms, `int_unchecked`, the operands are integers
+            // and `$a`/`$b` bind their payloads
+            macro_rules! binary {
+                ($check:ident |$a:ident, $b:ident| $result:expr) => {{
+                    let ($a, $b) = (*stack.add(sp - 1), top);
+                    check!($check, $a, $b);
+                    let ($a, $b) = ($a.payload(), $b.payload());
+                    sp -= 1;
+                    top = $result;
+                    ip += 1;
+                }};
+                (|$a:ident, $b:ident| $result:expr) => {{
+                    let ($a, $b) = (*stack.add(sp - 1), top);
+                    sp -= 1;
+                    top = $result;
+                    ip += 1;
+                }};
+            }
+            macro_rules! check {
+                (int, $a:expr, $b:expr) => {
+                    if !Tagged::both_int($a, $b) {
+                        suspend!(Poll::Ready(Err("Expected integer")));
                     }
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(a / b))?;
-                }
-                OpCode::Modulo => {
-                    let b = self.pop()?.as_int()?;
-                    if b == 0 {
-                        return Err("Modulo by zero");
+                };
+                (int_unchecked, $a:expr, $b:expr) => {};
+            }
+
+            // Integer division and remainder, failing on a zero divisor
+            macro_rules! divide {
+                ($a:expr, $b:expr) => {{
+                    if $b == 0 {
+                        suspend!(Poll::Ready(Err("Division by zero")));
                     }
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(a % b))?;
-                }
-                OpCode::Negate => {
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Int(-a))?;
-                }
-                OpCode::Equal => {
-                    let b = self.pop()?;
-                    let a = self.pop()?;
-                    self.push(Value::Bool(a == b))?;
-                }
-                OpCode::NotEqual => {
-                    let b = self.pop()?;
-                    let a = self.pop()?;
-                    self.push(Value::Bool(a != b))?;
-                }
-                OpCode::Less => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Bool(a < b))?;
-                }
-                OpCode::Greater => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Bool(a > b))?;
-                }
-                OpCode::LessEqual => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Bool(a <= b))?;
-                }
-                OpCode::GreaterEqual => {
-                    let b = self.pop()?.as_int()?;
-                    let a = self.pop()?.as_int()?;
-                    self.push(Value::Bool(a >= b))?;
-                }
-                OpCode::Jump(target) => {
-                    self.ip = *target;
-                }
-                OpCode::JumpIfFalse(target) => {
-                    let condition = self.peek()?.is_truthy();
-                    if !condition {
-                        self.ip = *target;
+                    Tagged::int($a.wrapping_div($b))
+                }};
+            }
+            macro_rules! modulo {
+                ($a:expr, $b:expr) => {{
+                    if $b == 0 {
+                        suspend!(Poll::Ready(Err("Modulo by zero")));
                     }
-                    self.pop()?; // Pop the condition value
-                }
-                OpCode::Print => {
-                    let value = self.pop()?;
-                    println!("{}", value);
+                    Tagged::int($a.wrapping_rem($b))
+                }};
+            }
+
+            // Pop two integers and jump unless `a op b`
+            macro_rules! jump_unless {
+                ($check:ident |$a:ident, $b:ident| $test:expr) => {{
+                    let ($a, $b) = (*stack.add(sp - 1), top);
+                    check!($check, $a, $b);
+                    let ($a, $b) = ($a.payload(), $b.payload());
+                    sp -= 2;
+                    top = *stack.add(sp);
+                    ip = if $test { ip + 3 } else { arg!(0) };
+                }};
+            }
+
+            loop {
+                if fuel == 0 {
+                    suspend!(Poll::Pending);
                 }
-                OpCode::Clear => {
-                    // Clear the screen
-                    use crate::vga_buffer::WRITER;
-                    WRITER.lock().clear_screen();
+                fuel -= 1;
+                if PROFILE {
+                    let now = core::arch::x86_64::_rdtsc();
+                    *cycles.add(timed) += now - since;
+                    *counts.add(ip) += 1;
+                    timed = ip;
+                    since = now;
                 }
-                OpCode::Pop => {
-                    self.pop()?;
+                match *code.get_unchecked(ip) {
+                    op::CONSTANT => {
+                        push!(*constants.add(arg!(0)));
+                        ip += 3;
+                    }
+                    op::LOAD_SLOT => {
+                        let value = *locals.add(arg!(0));
+                        if value == Tagged::NIL {
+                            suspend!(Poll::Ready(Err("Undefined variable")));
+                        }
+                        push!(value);
+                        ip += 3;
+                    }
+                    op::STORE_SLOT => {
+                        *locals.add(arg!(0)) = pop!();
+                        ip += 3;
+                    }
+                    op::ADD => binary!(int |a, b| Tagged::int(a.wrapping_add(b))),
+                    op::SUBTRACT => binary!(int |a, b| Tagged::int(a.wrapping_sub(b))),
+                    op::MULTIPLY => binary!(int |a, b| Tagged::int(a.wrapping_mul(b))),
+                    op::DIVIDE => binary!(int |a, b| divide!(a, b)),
+                    op::MODULO => binary!(int |a, b| modulo!(a, b)),
+                    op::ADD_INT => binary!(int_unchecked |a, b| Tagged::int(a.wrapping_add(b))),
+                    op::SUBTRACT_INT => binary!(int_unchecked |a, b| Tagged::int(a.wrapping_sub(b))),
+                    op::MULTIPLY_INT => binary!(int_unchecked |a, b| Tagged::int(a.wrapping_mul(b))),
+                    op::DIVIDE_INT => binary!(int_unchecked |a, b| divide!(a, b)),
+                    op::MODULO_INT => binary!(int_unchecked |a, b| modulo!(a, b)),
+                    op::NEGATE => {
+                        if !top.is_int() {
+                            suspend!(Poll::Ready(Err("Expected integer")));
+                        }
+                        top = Tagged::int(top.payload().wrapping_neg());
+                        ip += 1;
+                    }
+                    op::EQUAL => binary!(|a, b| Tagged::bool(a == b)),
+                    op::NOT_EQUAL => binary!(|a, b| Tagged::bool(a != b)),
+                    op::LESS => binary!(int |a, b| Tagged::bool(a < b)),
+                    op::GREATER => binary!(int |a, b| Tagged::bool(a > b)),
+                    op::LESS_EQUAL => binary!(int |a, b| Tagged::bool(a <= b)),
+                    op::GREATER_EQUAL => binary!(int |a, b| Tagged::bool(a >= b)),
+                    op::LESS_INT => binary!(int_unchecked |a, b| Tagged::bool(a < b)),
+                    op::GREATER_INT => binary!(int_unchecked |a, b| Tagged::bool(a > b)),
+                    op::LESS_EQUAL_INT => binary!(int_unchecked |a, b| Tagged::bool(a <= b)),
+                    op::GREATER_EQUAL_INT => binary!(int_unchecked |a, b| Tagged::bool(a >= b)),
+                    op::JUMP => {
+                        ip = arg!(0);
+                    }
+                    op::JUMP_IF_FALSE => {
+                        if pop!().is_truthy() {
+                            ip += 3;
+                        } else {
+                            ip = arg!(0);
+                        }
+                    }
+                    op::PRINT => {
+                        let value = pop!();
+                        if !self.quiet {
+                            println!("{}", Value::from(value));
+                        }
+                        ip += 1;
+                    }
+                    op::CLEAR => {
+                        if !self.quiet {
+                            use crate::vga_buffer::WRITER;
+                            WRITER.lock().clear_screen();
+                        }
+                        ip += 1;
+                    }
+                    op::POP => {
+                        pop!();
+                        ip += 1;
+                    }
+                    op::INCREMENT_SLOT => {
+                        let slot = locals.add(arg!(0));
+                        let n = *constants.add(arg!(1));
+                        if !Tagged::both_int(*slot, n) {
+                            let e = if *slot == Tagged::NIL { "Undefined variable" } else { "Expected integer" };
+                            suspend!(Poll::Ready(Err(e)));
+                        }
+                        *slot = Tagged::int((*slot).payload().wrapping_add(n.payload()));
+                        ip += 5;
+                    }
+                    op::JUMP_UNLESS_EQUAL => {
+                        let equal = top == *stack.add(sp - 1);
+                        sp -= 2;
+                        top = *stack.add(sp);
+                        ip = if equal { ip + 3 } else { arg!(0) };
+                    }
+                    op::JUMP_UNLESS_NOT_EQUAL => {
+                        let equal = top == *stack.add(sp - 1);
+                        sp -= 2;
+                        top = *stack.add(sp);
+                        ip = if equal { arg!(0) } else { ip + 3 };
+                    }
+                    op::JUMP_UNLESS_LESS => jump_unless!(int |a, b| a < b),
+                    op::JUMP_UNLESS_GREATER => jump_unless!(int |a, b| a > b),
+                    op::JUMP_UNLESS_LESS_EQUAL => jump_unless!(int |a, b| a <= b),
+                    op::JUMP_UNLESS_GREATER_EQUAL => jump_unless!(int |a, b| a >= b),
+                    op::JUMP_UNLESS_LESS_INT => jump_unless!(int_unchecked |a, b| a < b),
+                    op::JUMP_UNLESS_GREATER_INT => jump_unless!(int_unchecked |a, b| a > b),
+                    op::JUMP_UNLESS_LESS_EQUAL_INT => jump_unless!(int_unchecked |a, b| a <= b),
+                    op::JUMP_UNLESS_GREATER_EQUAL_INT => jump_unless!(int_unchecked |a, b| a >= b),
+                    op::HALT => suspend!(Poll::Ready(Ok(()))),
+                    _ => core::hint::unreachable_unchecked(),
                 }
             }
         }
-        
-        Ok(())
     }
 }
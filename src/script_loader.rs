@@ -1,37 +1,46 @@
-// Script loader - embeds scripts at compile time and loads them into filesystem
+// Script loader - mounts the initrd archive of scripts into the filesystem
 
 use crate::fs;
+use crate::fs::initrd;
+use crate::fs::FileSystem;
+use crate::rustrial_script::image;
 
-/// Embedded script files
-pub const SCRIPTS: &[(&str, &[u8])] = &[
-    ("fibonacci.rscript", include_bytes!("rustrial_script/examples/fibonacci.rscript")),
-    ("factorial.rscript", include_bytes!("rustrial_script/examples/factorial.rscript")),
-    ("collatz.rscript", include_bytes!("rustrial_script/examples/collatz.rscript")),
-    ("gcd.rscript", include_bytes!("rustrial_script/examples/gcd.rscript")),
-    ("prime_checker.rscript", include_bytes!("rustrial_script/examples/prime_checker.rscript")),
-    ("sum_of_squares.rscript", include_bytes!("rustrial_script/examples/sum_of_squares.rscript")),
-    // ("triangle.rscript", include_bytes!("rustrial_script/examples/triangle.rscript")),
-    ("countdown.rscript", include_bytes!("rustrial_script/examples/countdown.rscript")),
-    // ("pyramid.rscript", include_bytes!("rustrial_script/examples/pyramid.rscript")),
-];
+/// cpio (newc) archive of the scripts listed in
+/// `rustrial_script/examples/initrd.list`, packed by build.rs
+pub static INITRD: &[u8] = include_bytes!(concat!(env!("OUT_DIR"), "/initrd.cpio"));
 
-/// Load all embedded scripts into the filesystem
+/// Mount the initrd at /scripts
 pub fn load_scripts() -> Result<(), fs::VfsError> {
-    crate::println!("[LOADER] Loading embedded scripts...");
-    fs::mount_scripts(SCRIPTS)?;
-    crate::println!("[LOADER] Loaded {} scripts", SCRIPTS.len());
+    crate::println!("[LOADER] Mounting initrd...");
+    fs::mount_initrd("/scripts", INITRD)?;
+    crate::println!("[LOADER] Loaded {} scripts", list_scripts().len());
     Ok(())
 }
 
 /// Get list of available script names
 pub fn list_scripts() -> alloc::vec::Vec<alloc::string::String> {
     use alloc::string::ToString;
-    SCRIPTS.iter().map(|(name, _)| (*name).to_string()).collect()
+    initrd::entries(INITRD)
+        .filter_map(|e| e.ok())
+        .filter(|e| e.is_file() && !image::is_image(e.name))
+        .map(|e| e.name.to_string())
+        .collect()
+}
+
+/// Paths of the scripts under /scripts, leaving out their compiled images
+pub fn script_paths() -> alloc::vec::Vec<alloc::string::String> {
+    fs::root_fs()
+        .and_then(|fs| fs.lock().list_dir("/scripts").ok())
+        .unwrap_or_default()
+        .into_iter()
+        .filter(|path| !image::is_image(path))
+        .collect()
 }
 
 /// Get script content by name
 pub fn get_script_content(name: &str) -> Option<&'static [u8]> {
-    SCRIPTS.iter()
-        .find(|(n, _)| *n == name)
-        .map(|(_, content)| *content)
+    initrd::entries(INITRD)
+        .filter_map(|e| e.ok())
+        .find(|e| e.is_file() && e.name == name)
+        .map(|e| e.data)
 }
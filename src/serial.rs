@@ -1,26 +1,201 @@
+/// COM1 output, drained by the UART's transmit interrupt
+///
+/// Printing only copies bytes into a queue, with interrupts off for as
+/// long as that takes. Once `enable_interrupts` has run, the
+/// transmit-empty interrupt (IRQ 4) refills the 16-byte FIFO from the
+/// queue while the kernel gets on with other work. Before that, and
+/// whenever the queue is full and interrupts are off, output is written
+/// out by polling as it always was.
+
+use core::sync::atomic::{AtomicBool, Ordering};
 use lazy_static::lazy_static;
 use spin::Mutex;
 use uart_16550::SerialPort;
+use x86_64::instructions::interrupts;
+use x86_64::instructions::port::Port;
+
+const COM1: u16 = 0x3F8;
+const DATA: u16 = COM1;
+const INTERRUPT_ENABLE: u16 = COM1 + 1;
+const INTERRUPT_ID: u16 = COM1 + 2;
+const LINE_STATUS: u16 = COM1 + 5;
+const MODEM_STATUS: u16 = COM1 + 6;
+
+/// Interrupt enable bit for "transmitter holding register empty"
+const TX_EMPTY_INTERRUPT: u8 = 0x02;
+/// Line status: the transmit FIFO is empty
+const LSR_TX_EMPTY: u8 = 0x20;
+/// Line status: the FIFO and the shift register are both empty
+const LSR_IDLE: u8 = 0x40;
+
+/// Bytes the transmit FIFO takes at once when empty
+const FIFO_SIZE: usize = 16;
+
+/// Bytes of output that can wait for the UART
+const QUEUE_SIZE: usize = 16 * 1024;
 
 lazy_static! {
     pub static ref SERIAL1: Mutex<SerialPort> = {
-        let mut serial_port = unsafe { SerialPort::new(0x3F8) };
+        let mut serial_port = unsafe { SerialPort::new(COM1) };
         serial_port.init();
         Mutex::new(serial_port)
     };
 }
 
+struct TxQueue {
+    bytes: [u8; QUEUE_SIZE],
+    /// Index of the oldest byte
+    head: usize,
+    len: usize,
+    /// Whether the transmit-empty interrupt is enabled and will come
+    armed: bool,
+}
+
+static TX: Mutex<TxQueue> = Mutex::new(TxQueue {
+    bytes: [0; QUEUE_SIZE],
+    head: 0,
+    len: 0,
+    armed: false,
+});
+
+/// Set once IRQ 4 reaches `handle_interrupt`
+static IRQ_READY: AtomicBool = AtomicBool::new(false);
+
+fn read(port: u16) -> u8 {
+    unsafe { Port::<u8>::new(port).read() }
+}
+
+fn write(port: u16, value: u8) {
+    unsafe { Port::<u8>::new(port).write(value) }
+}
+
+impl TxQueue {
+    /// Queue as much of `bytes` as fits; returns how much did
+    fn push(&mut self, bytes: &[u8]) -> usize {
+        let n = bytes.len().min(QUEUE_SIZE - self.len);
+        let tail = (self.head + self.len) % QUEUE_SIZE;
+        let first = n.min(QUEUE_SIZE - tail);
+        self.bytes[tail..tail + first].copy_from_slice(&bytes[..first]);
+        self.bytes[..n - first].copy_from_slice(&bytes[first..n]);
+        self.len += n;
+        n
+    }
+
+    /// Move up to a FIFO's worth of bytes to the UART if its FIFO is empty
+    fn fill_fifo(&mut self) {
+        if read(LINE_STATUS) & LSR_TX_EMPTY == 0 {
+            return;
+        }
+        for _ in 0..self.len.min(FIFO_SIZE) {
+            write(DATA, self.bytes[self.head]);
+            self.head = (self.head + 1) % QUEUE_SIZE;
+            self.len -= 1;
+        }
+    }
+
+    /// Keep the interrupt enabled exactly while there is something to send
+    fn rearm(&mut self) {
+        let armed = self.len > 0 && IRQ_READY.load(Ordering::Relaxed);
+        if armed != self.armed {
+            let enable = read(INTERRUPT_ENABLE);
+            let enable = if armed { enable | TX_EMPTY_INTERRUPT } else { enable & !TX_EMPTY_INTERRUPT };
+            write(INTERRUPT_ENABLE, enable);
+            self.armed = armed;
+        }
+    }
+
+    /// Send queued bytes, waiting on the UART, until at most `keep` are left
+    fn drain_to(&mut self, keep: usize) {
+        while self.len > keep {
+            self.fill_fifo();
+        }
+        self.rearm();
+    }
+}
+
+/// Start draining output from IRQ 4; call once its handler is installed
+/// and the line is unmasked
+pub fn enable_interrupts() {
+    lazy_static::initialize(&SERIAL1);
+    interrupts::without_interrupts(|| {
+        // Only transmit interrupts; nothing reads COM1
+        write(INTERRUPT_ENABLE, 0);
+        IRQ_READY.store(true, Ordering::Relaxed);
+        let mut tx = TX.lock();
+        tx.armed = false;
+        tx.fill_fifo();
+        tx.rearm();
+    });
+}
+
+/// COM1's interrupt: refill the FIFO, and stop the interrupt once the
+/// queue is empty
+pub fn handle_interrupt() {
+    loop {
+        // Reading the ID acknowledges a transmit-empty interrupt
+        let id = read(INTERRUPT_ID);
+        if id & 0x01 != 0 {
+            break;
+        }
+        match id & 0x0e {
+            0x02 => {
+                let mut tx = TX.lock();
+                tx.fill_fifo();
+                tx.rearm();
+            }
+            0x04 | 0x0c => {
+                read(DATA);
+            }
+            0x06 => {
+                read(LINE_STATUS);
+            }
+            _ => {
+                read(MODEM_STATUS);
+            }
+        }
+    }
+}
+
+/// Queue `bytes` for COM1, waiting only when the queue is full
+fn commit(mut bytes: &[u8]) {
+    lazy_static::initialize(&SERIAL1);
+    while !bytes.is_empty() {
+        let waiting = interrupts::are_enabled() && IRQ_READY.load(Ordering::Relaxed);
+        interrupts::without_interrupts(|| {
+            let mut tx = TX.lock();
+            let n = tx.push(bytes);
+            bytes = &bytes[n..];
+            if !IRQ_READY.load(Ordering::Relaxed) {
+                tx.drain_to(0);
+            } else if !bytes.is_empty() && !waiting {
+                // Full, and IRQ 4 can't run to empty it: make room by polling
+                tx.drain_to(QUEUE_SIZE - bytes.len().min(QUEUE_SIZE));
+            } else {
+                tx.fill_fifo();
+                tx.rearm();
+            }
+        });
+        if !bytes.is_empty() && waiting {
+            // Let IRQ 4 make room
+            x86_64::instructions::hlt();
+        }
+    }
+}
+
+/// Wait until everything printed so far has left the UART, e.g. before
+/// exiting QEMU
+pub fn flush() {
+    interrupts::without_interrupts(|| {
+        TX.lock().drain_to(0);
+        while read(LINE_STATUS) & LSR_IDLE == 0 {
+            core::hint::spin_loop();
+        }
+    });
+}
+
 #[doc(hidden)]
 pub fn _print(args: ::core::fmt::Arguments) {
-    use core::fmt::Write;
-    use x86_64::instructions::interrupts;        
-
-    interrupts::without_interrupts(|| {         
-        SERIAL1
-            .lock()
-            .write_fmt(args)
-            .expect("Printing to serial failed");
-    });
+    crate::line_buffer::format_buffered(args, commit);
 }
 
 
@@ -38,4 +213,4 @@ macro_rules! serial_println {
     ($fmt:expr) => ($crate::serial_print!(concat!($fmt, "\n")));
     ($fmt:expr, $($arg:tt)*) => ($crate::serial_print!(
         concat!($fmt, "\n"), $($arg)*));
-}
\ No newline at end of file
+}
@@ -1,16 +1,16 @@
 use crate::{print, println};
 use crate::task::keyboard;
-use crate::vga_buffer::{Color, WRITER};
-use crate::fs::FileSystem;
+use crate::vga_buffer::{self, Color, BUFFER_HEIGHT, WRITER};
+use crate::fs::{FileSystem, VfsError};
 use crate::rustrial_script;
 use alloc::{string::String, vec::Vec, format};
+use alloc::borrow::Cow;
 use alloc::string::ToString;
 use pc_keyboard::{layouts, DecodedKey, HandleControl, Keyboard, ScancodeSet1, KeyCode};
 use futures_util::stream::StreamExt;
 
 const PROMPT: &str = "rustrial> ";
 const MAX_HISTORY: usize = 50;
-const MAX_SCROLLBACK_LINES: usize = 1000;
 
 pub struct Shell {
     input_buffer: String,
@@ -19,9 +19,8 @@ pub struct Shell {
     current_dir: String,
     foreground_color: Color,
     background_color: Color,
-    scrollback_buffer: Vec<String>,
-    scroll_offset: usize,
-    in_scroll_mode: bool,
+    /// Root filesystem state saved by `snapshot`
+    snapshot: Option<crate::fs::RamFs>,
 }
 
 impl Shell {
@@ -33,9 +32,7 @@ impl Shell {
             current_dir: String::from("/"),
             foreground_color: Color::LightGreen,
             background_color: Color::Black,
-            scrollback_buffer: Vec::new(),
-            scroll_offset: 0,
-            in_scroll_mode: false,
+            snapshot: None,
         }
     }
 
@@ -73,13 +70,6 @@ impl Shell {
     }
 
     fn print_welcome(&mut self) {
-        self.add_to_scrollback("\n+--------------------------------------------------------------------+");
-        self.add_to_scrollback("|              Welcome to RustrialOS Shell v0.1                      |");
-        self.add_to_scrollback("+--------------------------------------------------------------------+");
-        self.add_to_scrollback("|  Type 'help' for available commands                                |");
-        self.add_to_scrollback("|  Type 'exit' to return to desktop                                  |");
-        self.add_to_scrollback("|  Use PageUp/PageDown to scroll through output                      |");
-        self.add_to_scrollback("+--------------------------------------------------------------------+\n");
         println!("\n+--------------------------------------------------------------------+");
         println!("|              Welcome to RustrialOS Shell v0.1                      |");
         println!("+--------------------------------------------------------------------+");
@@ -107,30 +97,16 @@ impl Shell {
             if let Some(scancode) = scancodes.next().await {
                 if let Ok(Some(key_event)) = kb.add_byte(scancode) {
                     if let Some(key) = kb.process_keyevent(key_event) {
+                        // Any other key brings back the newest output
+                        if !matches!(key, DecodedKey::RawKey(KeyCode::PageUp | KeyCode::PageDown)) {
+                            vga_buffer::scroll_to_bottom();
+                        }
                         match key {
                             DecodedKey::Unicode(character) => {
-                                // Exit scroll mode when user starts typing
-                                if self.in_scroll_mode {
-                                    if character != '\n' {
-                                        self.exit_scroll_mode();
-                                        // Redraw prompt with any existing input
-                                        self.print_prompt();
-                                        if !self.input_buffer.is_empty() {
-                                            print!("{}", self.input_buffer);
-                                        }
-                                    }
-                                }
-                                
                                 match character {
                                     '\n' => {
                                         println!();
-                                        let result = self.input_buffer.clone();
-                                        // Add the command line to scrollback only if not empty
-                                        if !result.is_empty() {
-                                            self.add_to_scrollback(&format!("{}{} {}", 
-                                                self.current_dir, PROMPT, result));
-                                        }
-                                        return Some(result);
+                                        return Some(self.input_buffer.clone());
                                     }
                                     '\u{0008}' => {
                                         // Backspace
@@ -151,14 +127,6 @@ impl Shell {
                             DecodedKey::RawKey(code) => {
                                 match code {
                                     KeyCode::Backspace => {
-                                        // Exit scroll mode
-                                        if self.in_scroll_mode {
-                                            self.exit_scroll_mode();
-                                            self.print_prompt();
-                                            if !self.input_buffer.is_empty() {
-                                                print!("{}", self.input_buffer);
-                                            }
-                                        }
                                         // Handle backspace as RawKey
                                         if !self.input_buffer.is_empty() {
                                             self.input_buffer.pop();
@@ -167,32 +135,22 @@ impl Shell {
                                         }
                                     }
                                     KeyCode::ArrowUp => {
-                                        // Exit scroll mode first
-                                        if self.in_scroll_mode {
-                                            self.exit_scroll_mode();
-                                            self.print_prompt();
-                                        }
                                         if self.history_index > 0 {
                                             self.history_index -= 1;
                                             self.load_history_entry();
                                         }
                                     }
                                     KeyCode::ArrowDown => {
-                                        // Exit scroll mode first
-                                        if self.in_scroll_mode {
-                                            self.exit_scroll_mode();
-                                            self.print_prompt();
-                                        }
                                         if self.history_index < self.history.len() {
                                             self.history_index += 1;
                                             self.load_history_entry();
                                         }
                                     }
                                     KeyCode::PageUp => {
-                                        self.scroll_up();
+                                        vga_buffer::scroll_up(BUFFER_HEIGHT - 1);
                                     }
                                     KeyCode::PageDown => {
-                                        self.scroll_down();
+                                        vga_buffer::scroll_down(BUFFER_HEIGHT - 1);
                                     }
                                     _ => {}
                                 }
@@ -235,16 +193,16 @@ impl Shell {
             "clear" | "cls" => {
                 self.cmd_clear();
                 // Clear scrollback when clearing screen
-                self.scrollback_buffer.clear();
-                self.scroll_offset = 0;
-                self.in_scroll_mode = false;
+                vga_buffer::clear_scrollback();
             },
             "echo" => self.cmd_echo(args),
             "ls" | "dir" => self.cmd_ls(args),
             "cat" => self.cmd_cat(args),
             "mkdir" => self.cmd_mkdir(args),
             "touch" => self.cmd_touch(args),
+            "mv" => self.cmd_mv(args),
             "run" => self.cmd_run(args).await,
+            "scripts" => self.cmd_scripts(),
             "cd" => self.cmd_cd(args),
             "pwd" => self.cmd_pwd(),
             "color" => self.cmd_color(args),
@@ -259,6 +217,19 @@ impl Shell {
             "http-get" => self.cmd_http_get(args).await,
             "tcptest" => self.cmd_tcptest(),
             "dmastat" => self.cmd_dmastat(),
+            "cachestat" => self.cmd_cachestat(),
+            "vgastat" => self.cmd_vgastat(),
+            "fbdemo" => self.cmd_fbdemo(args),
+            "vgabench" => self.cmd_vgabench(args),
+            "fbtext" => self.cmd_fbtext(args),
+            "snapshot" => self.cmd_snapshot(),
+            "rollback" => self.cmd_rollback(),
+            "mkfs" => self.cmd_mkfs(),
+            "sync" => self.cmd_sync(),
+            "lfsstat" => self.cmd_lfsstat(),
+            "lfsbench" => self.cmd_lfsbench(args),
+            "scriptbench" => self.cmd_scriptbench(args),
+            "jit" => self.cmd_jit(args),
             "exit" | "quit" => return true,
             _ => {
                 let msg = format!("Unknown command: '{}'. Type 'help' for available commands.", command);
@@ -269,15 +240,13 @@ impl Shell {
         false
     }
 
-    /// Shell println - prints to screen and adds to scrollback
+    /// Shell println - prints to screen; the console keeps it for scrollback
     fn sprintln(&mut self, s: &str) {
-        self.add_to_scrollback(s);
         println!("{}", s);
     }
 
-    /// Shell print - prints to screen and adds to scrollback (no newline)
+    /// Shell print - prints to screen (no newline)
     fn sprint(&mut self, s: &str) {
-        self.add_to_scrollback(s);
         print!("{}", s);
     }
 
@@ -290,7 +259,10 @@ impl Shell {
         self.sprintln("  cat <file>        - Display file contents");
         self.sprintln("  mkdir <dir>       - Create a directory");
         self.sprintln("  touch <file>      - Create an empty file");
-        self.sprintln("  run <script>      - Execute a RustrialScript file");
+        self.sprintln("  mv <from> <to>    - Move or rename a file or directory");
+        self.sprintln("  run <script> [&]  - Execute a RustrialScript file ('&' runs it in the background)");
+        self.sprintln("  run --profile <script> - Run a script and report its hottest lines");
+        self.sprintln("  scripts           - List running and recent scripts with instruction counts");
         self.sprintln("  cd <dir>          - Change current directory");
         self.sprintln("  pwd               - Print working directory");
         self.sprintln("  color <fg> <bg>   - Change text color (0-15)");
@@ -305,6 +277,19 @@ impl Shell {
         self.sprintln("  http-get <url>    - Fetch HTTP resource (RFC 7230)");
         self.sprintln("  tcptest           - Test TCP stack implementation");
         self.sprintln("  dmastat           - Display DMA memory statistics");
+        self.sprintln("  cachestat         - Display page cache statistics");
+        self.sprintln("  vgastat           - Display text compositor flush statistics");
+        self.sprintln("  fbdemo [WxH]      - Animate the 32-bpp framebuffer and report fps");
+        self.sprintln("  vgabench [ms]     - Measure mode 13h fill rate, per pixel and with spans");
+        self.sprintln("  fbtext [font.psf] - Redraw a screen of text per frame and report fps");
+        self.sprintln("  snapshot          - Save the root filesystem state (copy-on-write)");
+        self.sprintln("  rollback          - Restore the state saved by 'snapshot'");
+        self.sprintln("  mkfs              - Format the data disk and mount it at /data");
+        self.sprintln("  sync              - Flush filesystem writes to disk");
+        self.sprintln("  lfsstat           - Display /data filesystem statistics");
+        self.sprintln("  lfsbench [KB]     - Measure /data write and read throughput");
+        self.sprintln("  scriptbench [ms]  - Time the interpreter and JIT on each script in /scripts");
+        self.sprintln("  jit [on|off]      - Show or set whether 'run' JIT-compiles scripts");
         self.sprintln("  exit, quit        - Return to desktop");
         self.sprintln("\nColors: 0=Black, 1=Blue, 2=Green, 3=Cyan, 4=Red, 5=Magenta, 6=Brown,");
         self.sprintln("        7=LightGray, 8=DarkGray, 9=LightBlue, 10=LightGreen, 11=LightCyan,");
@@ -320,12 +305,7 @@ impl Shell {
     }
 
     fn cmd_ls(&mut self, args: &[&str]) {
-        let path = if args.is_empty() {
-            self.current_dir.as_str()
-        } else {
-            args[0]
-        };
-
+        let path = args.first().copied().unwrap_or(".");
         let full_path = self.resolve_path(path);
 
         if let Some(fs) = crate::fs::root_fs() {
@@ -346,7 +326,7 @@ impl Shell {
                             let name = entry_path.rsplit('/').next().unwrap_or(&entry_path);
                             
                             let size_str = if !is_dir {
-                                if let Ok(content) = fs.read_file(&entry_path) {
+                                if let Ok(content) = fs.read_file_bytes(&entry_path) {
                                     format!(" ({} bytes)", content.len())
                                 } else {
                                     String::new()
@@ -378,7 +358,7 @@ impl Shell {
 
         if let Some(fs) = crate::fs::root_fs() {
             let fs = fs.lock();
-            match fs.read_file(&path) {
+            match fs.read_file_bytes(&path) {
                 Ok(content) => {
                     self.sprintln("\n─────────────────────────────────────");
                     self.sprintln(&format!("File: {}", path));
@@ -452,9 +432,42 @@ impl Shell {
         }
     }
 
+    fn cmd_mv(&mut self, args: &[&str]) {
+        if args.len() < 2 {
+            self.sprintln("Usage: mv <from> <to>");
+            return;
+        }
+
+        let from = self.resolve_path(args[0]);
+        let to = self.resolve_path(args[1]);
+
+        if let Some(fs) = crate::fs::root_fs() {
+            let mut fs = fs.lock();
+            match fs.rename(&from, &to) {
+                Ok(_) => self.sprintln(&format!("Moved: {} -> {}", from, to)),
+                Err(e) => self.sprintln(&format!("Error moving file: {}", e)),
+            }
+        } else {
+            self.sprintln("Error: Filesystem not initialized");
+        }
+    }
+
     async fn cmd_run(&mut self, args: &[&str]) {
+        // A trailing '&' starts the script as a background task
+        let (args, background) = match args.split_last() {
+            Some((&"&", rest)) => (rest, true),
+            _ => (args, false),
+        };
+        let (args, profile) = match args.split_first() {
+            Some((&"--profile", rest)) => (rest, true),
+            _ => (args, false),
+        };
+        if profile && background {
+            self.sprintln("Error: a profiled script runs in the foreground");
+            return;
+        }
         if args.is_empty() {
-            self.sprintln("Usage: run <script>");
+            self.sprintln("Usage: run [--profile] <script> [&]");
             self.sprintln("Available scripts:");
             self.list_scripts();
             return;
@@ -462,47 +475,153 @@ impl Shell {
 
         let script_name = args[0];
         let path = if script_name.starts_with('/') {
-            script_name.to_string()
+            Cow::Borrowed(script_name)
         } else if script_name.contains('/') {
             self.resolve_path(script_name)
         } else {
             // Try to find in /scripts directory
-            format!("/scripts/{}", script_name)
+            Cow::Owned(format!("/scripts/{}", script_name))
         };
 
-        // Try to read from filesystem
-        if let Some(fs) = crate::fs::root_fs() {
-            let fs = fs.lock();
-            match fs.read_file(&path) {
-                Ok(content) => {
-                    match core::str::from_utf8(&content) {
-                        Ok(source) => {
-                            self.sprintln("\n─────────────────────────────────────");
-                            self.sprintln(&format!("Executing: {}", path));
-                            self.sprintln("─────────────────────────────────────");
-                            
-                            match rustrial_script::run(source) {
-                                Ok(_) => {
-                                    self.sprintln("\n─────────────────────────────────────");
-                                    self.sprintln("Script completed successfully");
-                                    self.sprintln("─────────────────────────────────────\n");
-                                }
-                                Err(e) => {
-                                    self.sprintln(&format!("\nScript error: {}", e));
-                                }
-                            }
-                        }
-                        Err(_) => self.sprintln("Error: File is not valid UTF-8 text"),
-                    }
-                }
-                Err(e) => {
-                    self.sprintln(&format!("Error: Could not read file '{}': {:?}", path, e));
-                    self.sprintln("\nAvailable scripts:");
-                    self.list_scripts();
+        let Some(fs) = crate::fs::root_fs() else {
+            self.sprintln("Error: Filesystem not initialized");
+            return;
+        };
+        if profile {
+            self.run_profiled(&path).await;
+            return;
+        }
+        // Compile, or load the cached image, then run with the filesystem unlocked
+        let loaded = {
+            let mut fs = fs.lock();
+            fs.is_file(&path).then(|| rustrial_script::image::load(&mut *fs, &path))
+        };
+        let Some(loaded) = loaded else {
+            self.sprintln(&format!("Error: Could not read file '{}'", path));
+            self.sprintln("\nAvailable scripts:");
+            self.list_scripts();
+            return;
+        };
+
+        if background {
+            match loaded {
+                Ok(chunk) => {
+                    let id = rustrial_script::task::spawn(path.to_string(), chunk);
+                    self.sprintln(&format!("Started script #{}: {} (see 'scripts')", id, path));
                 }
+                Err(e) => self.sprintln(&format!("Script error: {}", e)),
+            }
+            return;
+        }
+
+        self.sprintln("\n─────────────────────────────────────");
+        self.sprintln(&format!("Executing: {}", path));
+        self.sprintln("─────────────────────────────────────");
+
+        // Runs as slices of this task, so background work keeps going
+        let result = match loaded {
+            Ok(chunk) => rustrial_script::task::run(path.to_string(), chunk).await,
+            Err(e) => Err(e),
+        };
+        match result {
+            Ok(_) => {
+                self.sprintln("\n─────────────────────────────────────");
+                self.sprintln("Script completed successfully");
+                self.sprintln("─────────────────────────────────────\n");
+            }
+            Err(e) => {
+                self.sprintln(&format!("\nScript error: {}", e));
             }
+        }
+    }
+
+    /// Run a script in the profiling interpreter, print its hottest lines
+    /// and export the profile for the Inspector
+    async fn run_profiled(&mut self, path: &str) {
+        use rustrial_script::profile;
+        const HOT_LINES: usize = 10;
+        const TOP_OPCODES: usize = 5;
+
+        let Some(fs) = crate::fs::root_fs() else { return };
+        // Images carry no line table, so always compile from source
+        let source = match fs.lock().read_file_bytes(path) {
+            Ok(bytes) => String::from_utf8_lossy(&bytes).into_owned(),
+            Err(_) => {
+                self.sprintln(&format!("Error: Could not read file '{}'", path));
+                return;
+            }
+        };
+        let chunk = match rustrial_script::compile(&source) {
+            Ok(chunk) => chunk,
+            Err(e) => {
+                self.sprintln(&format!("Script error: {}", e));
+                return;
+            }
+        };
+
+        self.sprintln("\n─────────────────────────────────────");
+        self.sprintln(&format!("Profiling: {}", path));
+        self.sprintln("─────────────────────────────────────");
+        let (result, report) = rustrial_script::task::run_profiled(path.to_string(), chunk).await;
+        self.sprintln("─────────────────────────────────────");
+        if let Err(e) = result {
+            self.sprintln(&format!("Script error: {}", e));
+        }
+
+        self.sprintln(&format!("{} instructions, {} cycles", report.instructions, report.cycles));
+        self.sprintln(&format!("{:>6} {:>12} {:>14} {:>6}  {}", "LINE", "COUNT", "CYCLES", "%", "SOURCE"));
+        let lines: Vec<&str> = source.lines().collect();
+        for stats in report.lines.iter().take(HOT_LINES) {
+            let text = lines.get(stats.line as usize - 1).map_or("", |line| line.trim());
+            let permille = report.permille(stats.cycles);
+            self.sprintln(&format!("{:>6} {:>12} {:>14} {:>4}.{}  {}",
+                stats.line, stats.count, stats.cycles, permille / 10, permille % 10, text));
+        }
+        self.sprintln("Top opcodes:");
+        for stats in report.opcodes.iter().take(TOP_OPCODES) {
+            self.sprintln(&format!("  {:<30} {:>12}", rustrial_script::bytecode::name(stats.opcode), stats.count));
+        }
+
+        // Next to the script if its mount is writable, else in the root
+        let export = report.export(path, &source);
+        let mut out = profile::profile_path(path);
+        let written = {
+            let mut fs = fs.lock();
+            fs.write_file(&out, export.as_bytes()).is_ok() || {
+                out = format!("/{}", out.rsplit('/').next().unwrap_or(&out));
+                fs.write_file(&out, export.as_bytes()).is_ok()
+            }
+        };
+        if written {
+            self.sprintln(&format!("Profile written to {} (open it in the Inspector)", out));
         } else {
-            self.sprintln("Error: Filesystem not initialized");
+            self.sprintln("Error: could not write the profile");
+        }
+        // Also on the serial port, for capture from the host
+        crate::serial_println!("--- begin {} ---", out);
+        crate::serial_print!("{}", export);
+        crate::serial_println!("--- end {} ---", out);
+    }
+
+    fn cmd_scripts(&mut self) {
+        use rustrial_script::task::{self, Status};
+        let scripts = task::scripts();
+        if scripts.is_empty() {
+            self.sprintln("No scripts have run yet");
+            return;
+        }
+        self.sprintln(&format!("{:>4} {:<24} {:<7} {:>14} {:>8}  {}",
+            "ID", "SCRIPT", "ENGINE", "INSTRUCTIONS", "SLICES", "STATUS"));
+        for script in scripts {
+            let status = match script.status() {
+                Status::Running => String::from("running"),
+                Status::Done => String::from("done"),
+                Status::Failed(e) => format!("error: {}", e),
+            };
+            let name = script.name.rsplit('/').next().unwrap_or(&script.name);
+            self.sprintln(&format!("{:>4} {:<24} {:<7} {:>14} {:>8}  {}",
+                script.id, name, if script.native { "jit" } else { "interp" },
+                script.executed(), script.slices(), status));
         }
     }
 
@@ -511,7 +630,7 @@ impl Shell {
             let fs = fs.lock();
             if let Ok(entries) = fs.list_dir("/scripts") {
                 for entry_path in entries {
-                    if fs.is_file(&entry_path) {
+                    if fs.is_file(&entry_path) && !rustrial_script::image::is_image(&entry_path) {
                         let name = entry_path.rsplit('/').next().unwrap_or(&entry_path);
                         self.sprintln(&format!("  - {}", name));
                     }
@@ -532,7 +651,7 @@ impl Shell {
         if let Some(fs) = crate::fs::root_fs() {
             let fs = fs.lock();
             if fs.is_dir(&new_path) {
-                self.current_dir = new_path;
+                self.current_dir = new_path.into_owned();
             } else {
                 self.sprintln(&format!("Error: Directory not found: {}", new_path));
             }
@@ -616,13 +735,7 @@ impl Shell {
         let pci_devices = native_ffi::enumerate_pci_devices();
         
         // Count scripts
-        let script_count = if let Some(fs) = crate::fs::root_fs() {
-            fs.lock().list_dir("/scripts")
-                .map(|scripts| scripts.len())
-                .unwrap_or(0)
-        } else {
-            0
-        };
+        let script_count = crate::script_loader::script_paths().len();
         
         self.sprintln("");
         
@@ -817,139 +930,13 @@ impl Shell {
     }
 
     /// Resolve a path relative to current directory
-    fn resolve_path(&self, path: &str) -> String {
-        if path.starts_with('/') {
-            // Absolute path
-            path.to_string()
-        } else if path == "." {
-            self.current_dir.clone()
-        } else if path == ".." {
-            // Go up one directory
-            if self.current_dir == "/" {
-                String::from("/")
-            } else {
-                let mut parts: Vec<&str> = self.current_dir.split('/').collect();
-                parts.pop();
-                if parts.is_empty() || (parts.len() == 1 && parts[0].is_empty()) {
-                    String::from("/")
-                } else {
-                    parts.join("/")
-                }
-            }
-        } else {
-            // Relative path
-            if self.current_dir == "/" {
-                format!("/{}", path)
-            } else {
-                format!("{}/{}", self.current_dir, path)
-            }
-        }
-    }
-
-    /// Add a line to the scrollback buffer
-    fn add_to_scrollback(&mut self, line: &str) {
-        // Split by newlines and add each line separately
-        for l in line.split('\n') {
-            if self.scrollback_buffer.len() >= MAX_SCROLLBACK_LINES {
-                self.scrollback_buffer.remove(0);
-            }
-            self.scrollback_buffer.push(l.to_string());
-        }
-    }
-
-    /// Scroll up in the scrollback buffer
-    fn scroll_up(&mut self) {
-        use crate::vga_buffer::BUFFER_HEIGHT;
-
-        if self.scrollback_buffer.is_empty() {
-            return;
-        }
-
-        if !self.in_scroll_mode {
-            self.in_scroll_mode = true;
-            self.scroll_offset = 0;
-        }
-
-        let display_lines = BUFFER_HEIGHT - 1;
-        let max_offset = self.scrollback_buffer.len().saturating_sub(display_lines);
-
-        if self.scroll_offset < max_offset {
-            self.scroll_offset = (self.scroll_offset + display_lines).min(max_offset);
-            self.redraw_screen();
-        }
-    }
-
-    fn scroll_down(&mut self) {
-        use crate::vga_buffer::BUFFER_HEIGHT;
-
-        if !self.in_scroll_mode {
-            return;
-        }
-
-        let display_lines = BUFFER_HEIGHT - 1;
-
-        if self.scroll_offset <= display_lines {
-            self.exit_scroll_mode();
-        } else {
-            self.scroll_offset -= display_lines;
-            self.redraw_screen();
-        }
-    }
-
-    /// Redraw the screen from the scrollback buffer
-    fn redraw_screen(&self) {
-        use crate::vga_buffer::{BUFFER_HEIGHT, WRITER};
-        
-        // Clear screen
-        WRITER.lock().clear_screen();
-        
-        // Calculate which lines to display
-        let total_lines = self.scrollback_buffer.len();
-        let display_lines = BUFFER_HEIGHT - 1; // Reserve last line for prompt/status
-        
-        if total_lines <= display_lines {
-            // All lines fit on screen
-            for line in &self.scrollback_buffer {
-                println!("{}", line);
-            }
-        } else {
-            // Display from offset
-            let start_idx = total_lines.saturating_sub(display_lines + self.scroll_offset);
-            let end_idx = (start_idx + display_lines).min(total_lines);
-            
-            for i in start_idx..end_idx {
-                println!("{}", self.scrollback_buffer[i]);
-            }
-        }
-        
-        // Show scroll indicator if in scroll mode
-        if self.in_scroll_mode {
-            let scroll_pct = if total_lines > display_lines {
-                100 - (self.scroll_offset * 100 / (total_lines - display_lines))
-            } else {
-                100
-            };
-            print!("[SCROLL MODE: {}% - PgUp/PgDn to scroll, any key to exit]", scroll_pct);
-        }
-    }
-
-    /// Exit scroll mode and return to normal operation
-    fn exit_scroll_mode(&mut self) {
-        if self.in_scroll_mode {
-            self.in_scroll_mode = false;
-            self.scroll_offset = 0;
-            // Clear screen and show recent history
-            use crate::vga_buffer::WRITER;
-            WRITER.lock().clear_screen();
-            
-            // Show the last screen's worth of scrollback
-            use crate::vga_buffer::BUFFER_HEIGHT;
-            let display_lines = BUFFER_HEIGHT.saturating_sub(2); // Leave room for prompt
-            let start = self.scrollback_buffer.len().saturating_sub(display_lines);
-            
-            for i in start..self.scrollback_buffer.len() {
-                println!("{}", self.scrollback_buffer[i]);
-            }
+    ///
+    /// Absolute, normal paths come back borrowed; anything that needed the
+    /// current directory is copied so the result doesn't borrow the shell.
+    fn resolve_path<'a>(&self, path: &'a str) -> Cow<'a, str> {
+        match crate::fs::path::resolve(&self.current_dir, path) {
+            Cow::Borrowed(resolved) if core::ptr::eq(resolved, path) => Cow::Borrowed(path),
+            resolved => Cow::Owned(resolved.into_owned()),
         }
     }
 
@@ -1156,6 +1143,302 @@ impl Shell {
         self.sprintln("  • Long-lived buffers (RX/TX rings) are not pooled");
     }
 
+    fn cmd_cachestat(&mut self) {
+        self.sprintln("\n╔════════════════════════════════════════════════════════════════════╗");
+        self.sprintln("║                    Page Cache Statistics                           ║");
+        self.sprintln("╠════════════════════════════════════════════════════════════════════╣");
+
+        let stats = crate::fs::page_cache::stats();
+
+        self.sprintln(&format!("║  Resident Pages:        {:>8} / {:<8}                         ║",
+            stats.resident, stats.capacity));
+        self.sprintln(&format!("║  Dirty Pages:           {:>8}                                    ║", stats.dirty));
+        self.sprintln(&format!("║  Hits:                  {:>8}                                    ║", stats.hits));
+        self.sprintln(&format!("║  Misses:                {:>8}                                    ║", stats.misses));
+
+        if stats.hits + stats.misses > 0 {
+            let hit_rate = (stats.hits as f64) / ((stats.hits + stats.misses) as f64) * 100.0;
+            self.sprintln(&format!("║  Hit Rate:              {:>7.1}%                                  ║", hit_rate));
+        } else {
+            self.sprintln("║  Hit Rate:                   N/A                                  ║");
+        }
+
+        self.sprintln("╠════════════════════════════════════════════════════════════════════╣");
+        self.sprintln(&format!("║  Readahead Pages:       {:>8}                                    ║", stats.readahead_pages));
+        self.sprintln(&format!("║  Readahead Hits:        {:>8}                                    ║", stats.readahead_hits));
+        self.sprintln(&format!("║  Written Back:          {:>8} pages in {:>6} batches           ║",
+            stats.writeback_pages, stats.writeback_batches));
+        self.sprintln(&format!("║  Evictions:             {:>8}                                    ║", stats.evictions));
+        self.sprintln("╚════════════════════════════════════════════════════════════════════╝");
+
+        if let Some(fs) = crate::fs::root_fs() {
+            let counters = fs.lock().counters();
+            self.sprintln("\nRoot filesystem:");
+            for (label, value) in counters {
+                self.sprintln(&format!("  {:<22} {}", format!("{}:", label), value));
+            }
+        }
+
+        if !crate::drivers::block::has_block_device() {
+            self.sprintln("\nNote: no block device registered, cache is idle");
+        }
+    }
+
+    fn cmd_vgastat(&mut self) {
+        let stats = crate::graphics::compositor::stats();
+        self.sprintln(&format!("Flushes:       {}", stats.flushes));
+        self.sprintln(&format!("Cells drawn:   {}", stats.drawn));
+        self.sprintln(&format!("Cells written: {}", stats.written));
+        if stats.drawn > 0 {
+            self.sprintln(&format!("Skipped:       {}% unchanged", 100 - stats.written * 100 / stats.drawn));
+        }
+        if let Some(last) = crate::graphics::compositor::last_interaction() {
+            self.sprintln(&format!("Last drag:     {} cells drawn, {} written in {} flushes",
+                last.drawn, last.written, last.flushes));
+        }
+        let presents = crate::graphics::vsync::stats();
+        self.sprintln(&format!("Presents:      {} on retrace, {} late", presents.on_retrace, presents.late));
+    }
+
+    fn cmd_fbdemo(&mut self, args: &[&str]) {
+        const DURATION_MS: u64 = 3000;
+        let (width, height) = match args.first() {
+            None => (1024, 768),
+            Some(mode) => match mode.split_once('x').and_then(|(w, h)| Some((w.parse().ok()?, h.parse().ok()?))) {
+                Some(mode) => mode,
+                None => {
+                    self.sprintln("Usage: fbdemo [WIDTHxHEIGHT]");
+                    return;
+                }
+            },
+        };
+        // The demo holds the screen in graphics mode until it returns
+        match crate::graphics::demo::run_framebuffer_demo(width, height, DURATION_MS) {
+            Ok(stats) => {
+                self.sprintln(&format!("{}x{}x32: {} frames in {} ms ({} fps)",
+                    width, height, stats.frames, stats.ms, stats.frames * 1000 / stats.ms.max(1)));
+                let raster = stats.raster;
+                self.sprintln(&format!("Last frame: {} shapes in {} bin entries, {} empty tiles, {} entries occluded",
+                    raster.shapes, raster.binned, raster.empty_tiles, raster.occluded));
+            }
+            Err(e) => self.sprintln(&format!("fbdemo: {}", e)),
+        }
+    }
+
+    fn cmd_fbtext(&mut self, args: &[&str]) {
+        const DURATION_MS: u64 = 3000;
+        let font = match args.first() {
+            None => crate::graphics::font::system_font(),
+            Some(path) => {
+                let path = self.resolve_path(path);
+                match crate::graphics::font::Font::load(&path) {
+                    Ok(font) => Some(alloc::sync::Arc::new(font)),
+                    Err(e) => {
+                        self.sprintln(&format!("fbtext: {}: {}", path, e));
+                        return;
+                    }
+                }
+            }
+        };
+        let Some(font) = font else {
+            self.sprintln("fbtext: no font loaded");
+            return;
+        };
+        let (cols, rows) = (1024 / font.width(), 768 / font.height());
+        match crate::graphics::demo::run_text_demo(1024, 768, font, DURATION_MS) {
+            Ok((frames, ms, stats)) => {
+                self.sprintln(&format!("{}x{} text: {} frames in {} ms ({} fps, {} glyphs/s)",
+                    cols, rows, frames, ms, frames * 1000 / ms.max(1), stats.glyphs * 1000 / ms.max(1)));
+                self.sprintln(&format!("Color pairs: {} hits, {} expanded", stats.hits, stats.misses));
+            }
+            Err(e) => self.sprintln(&format!("fbtext: {}", e)),
+        }
+    }
+
+    fn cmd_vgabench(&mut self, args: &[&str]) {
+        let duration_ms = args.first().and_then(|a| a.parse::<u64>().ok()).unwrap_or(1000);
+        let rate = crate::graphics::vga_graphics::measure_fill_rate(duration_ms);
+        self.sprintln(&format!("Per pixel: {:>10} pixels/s", rate.per_pixel));
+        self.sprintln(&format!("Spans:     {:>10} pixels/s", rate.spans));
+        if rate.per_pixel > 0 {
+            self.sprintln(&format!("Speedup:   {}x", rate.spans / rate.per_pixel));
+        }
+    }
+
+    fn cmd_snapshot(&mut self) {
+        match crate::fs::snapshot() {
+            Ok(snapshot) => {
+                self.snapshot = Some(snapshot);
+                self.sprintln("Snapshot saved (mounted filesystems are not included)");
+            }
+            Err(e) => self.sprintln(&format!("snapshot: {}", e)),
+        }
+    }
+
+    fn cmd_rollback(&mut self) {
+        let Some(snapshot) = self.snapshot.as_ref() else {
+            self.sprintln("rollback: no snapshot saved (run 'snapshot' first)");
+            return;
+        };
+        match crate::fs::rollback(snapshot) {
+            Ok(()) => self.sprintln("Filesystem rolled back to the snapshot"),
+            Err(e) => self.sprintln(&format!("rollback: {}", e)),
+        }
+    }
+
+    fn cmd_mkfs(&mut self) {
+        self.sprintln("Formatting data disk...");
+        match crate::fs::format_disk("/data") {
+            Ok(()) => self.sprintln("Data disk formatted and mounted at /data"),
+            Err(VfsError::NotFound) => self.sprintln("mkfs: no unmounted data disk (attach one with ./run.sh --disk)"),
+            Err(VfsError::AlreadyExists) => self.sprintln("mkfs: /data is already mounted"),
+            Err(e) => self.sprintln(&format!("mkfs: {}", e)),
+        }
+    }
+
+    fn cmd_sync(&mut self) {
+        match crate::fs::sync() {
+            Ok(()) => self.sprintln("Filesystems synced"),
+            Err(e) => self.sprintln(&format!("sync: {}", e)),
+        }
+    }
+
+    fn cmd_lfsstat(&mut self) {
+        let counters = crate::fs::root_fs().and_then(|fs| fs.lock().counters_at("/data"));
+        let Some(counters) = counters else {
+            self.sprintln("No filesystem mounted at /data (see 'mkfs')");
+            return;
+        };
+
+        self.sprintln("\n╔════════════════════════════════════════════════════════════════════╗");
+        self.sprintln("║                 Log-Structured FS Statistics (/data)               ║");
+        self.sprintln("╠════════════════════════════════════════════════════════════════════╣");
+        for (label, value) in counters {
+            self.sprintln(&format!("║  {:<22} {:>8}                                    ║",
+                format!("{}:", label), value));
+        }
+        self.sprintln("╚════════════════════════════════════════════════════════════════════╝");
+    }
+
+    fn cmd_lfsbench(&mut self, args: &[&str]) {
+        const CHUNK: usize = 4096;
+        const PATH: &str = "/data/lfsbench.bin";
+
+        let kb = args.first().and_then(|a| a.parse::<usize>().ok()).unwrap_or(256);
+        let Some(fs) = crate::fs::root_fs() else {
+            self.sprintln("Filesystem not initialized");
+            return;
+        };
+        if !fs.lock().is_mount_point("/data") {
+            self.sprintln("No filesystem mounted at /data (see 'mkfs')");
+            return;
+        }
+
+        let chunk: Vec<u8> = (0..CHUNK).map(|i| i as u8).collect();
+        let chunks = (kb * 1024).div_ceil(CHUNK);
+        let mut fs = fs.lock();
+        let _ = fs.delete(PATH);
+
+        let start = crate::interrupts::uptime_ms();
+        for _ in 0..chunks {
+            if let Err(e) = fs.append_file(PATH, &chunk) {
+                self.sprintln(&format!("lfsbench: write failed: {}", e));
+                return;
+            }
+        }
+        if let Err(e) = fs.sync() {
+            self.sprintln(&format!("lfsbench: sync failed: {}", e));
+            return;
+        }
+        let write_ms = crate::interrupts::uptime_ms() - start;
+
+        let start = crate::interrupts::uptime_ms();
+        let read = fs.read_file(PATH).map(|data| data.len()).unwrap_or(0);
+        let read_ms = crate::interrupts::uptime_ms() - start;
+        let _ = fs.delete(PATH);
+        let _ = fs.sync();
+        drop(fs);
+
+        // Timer resolution is one PIT tick (~55 ms)
+        let rate = |bytes: usize, ms: u64| bytes as u64 * 1000 / 1024 / ms.max(1);
+        self.sprintln(&format!("Wrote {} KB in {} x {} B appends + sync: {} ms ({} KB/s)",
+            chunks * CHUNK / 1024, chunks, CHUNK, write_ms, rate(chunks * CHUNK, write_ms)));
+        self.sprintln(&format!("Read {} KB: {} ms ({} KB/s)", read / 1024, read_ms, rate(read, read_ms)));
+    }
+
+    fn cmd_scriptbench(&mut self, args: &[&str]) {
+        use rustrial_script::{jit, VirtualMachine};
+
+        let budget_ms = args.first().and_then(|a| a.parse::<u64>().ok()).unwrap_or(500);
+
+        // Copy the sources out so the filesystem isn't locked while timing
+        let mut scripts = Vec::new();
+        if let Some(fs) = crate::fs::root_fs() {
+            let fs = fs.lock();
+            for path in fs.list_dir("/scripts").unwrap_or_default() {
+                if path.ends_with(".rscript") {
+                    if let Ok(source) = fs.read_file_to_string(&path) {
+                        scripts.push((path, source));
+                    }
+                }
+            }
+        }
+        if scripts.is_empty() {
+            self.sprintln("scriptbench: no scripts found in /scripts");
+            return;
+        }
+
+        self.sprintln(&format!("{:<24} {:>12} {:>12} {:>8}", "Script", "interp us", "jit us", "speedup"));
+        let (mut total_interp, mut total_jit) = (0, 0);
+        for (path, source) in scripts {
+            let name = path.rsplit('/').next().unwrap_or(&path);
+            let chunk = match rustrial_script::compile(&source) {
+                Ok(chunk) => chunk,
+                Err(e) => {
+                    self.sprintln(&format!("{:<24} compile error: {}", name, e));
+                    continue;
+                }
+            };
+
+            let mut vm = VirtualMachine::quiet();
+            let interp = match time_runs(budget_ms, || vm.execute(&chunk)) {
+                Ok(us) => us,
+                Err(e) => {
+                    self.sprintln(&format!("{:<24} script error: {}", name, e));
+                    continue;
+                }
+            };
+            total_interp += interp;
+            match jit::compile(&chunk).map(|native| time_runs(budget_ms, || native.run(&mut vm))) {
+                Some(Ok(native)) => {
+                    total_jit += native;
+                    self.sprintln(&format!("{:<24} {:>12} {:>12} {:>7}x",
+                        name, interp, native, interp / native.max(1)));
+                }
+                _ => {
+                    total_jit += interp;
+                    self.sprintln(&format!("{:<24} {:>12} {:>12} {:>8}", name, interp, "-", "-"));
+                }
+            }
+        }
+        self.sprintln(&format!("{:<24} {:>12} {:>12} {:>7}x",
+            "total", total_interp, total_jit, total_interp / total_jit.max(1)));
+    }
+
+    fn cmd_jit(&mut self, args: &[&str]) {
+        use rustrial_script::jit;
+        match args.first().copied() {
+            Some("on") => jit::set_enabled(true),
+            Some("off") => jit::set_enabled(false),
+            Some(_) => {
+                self.sprintln("Usage: jit [on|off]");
+                return;
+            }
+            None => {}
+        }
+        self.sprintln(&format!("Script JIT: {}", if jit::enabled() { "on" } else { "off" }));
+    }
+
     fn cmd_tcptest(&mut self) {
         use core::net::Ipv4Addr;
         use crate::net::tcp::{TcpConnection, TcpSocketId, TcpState};
@@ -1406,3 +1689,26 @@ fn truncate_str_shell(s: &str, max_len: usize) -> String {
         format!("{}...", &s[..max_len.saturating_sub(3)])
     }
 }
+
+/// Call `run` repeatedly for whole timer ticks covering `budget_ms` and
+/// return the average time per call in microseconds
+fn time_runs(
+    budget_ms: u64,
+    mut run: impl FnMut() -> Result<(), &'static str>,
+) -> Result<u64, &'static str> {
+    use crate::interrupts::{ticks, TICK_US};
+
+    let budget_ticks = (budget_ms * 1000).div_ceil(TICK_US).max(1);
+    // Start on a tick edge
+    let edge = ticks();
+    while ticks() == edge {
+        core::hint::spin_loop();
+    }
+    let start = ticks();
+    let mut runs = 0u64;
+    while ticks() - start < budget_ticks {
+        run()?;
+        runs += 1;
+    }
+    Ok((ticks() - start) * TICK_US / runs.max(1))
+}
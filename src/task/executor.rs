@@ -88,7 +88,11 @@ impl Executor {
             waker_cache,
         } = self;
 
-        while let Some(task_id) = task_queue.pop() {
+        // Poll only the tasks ready when the pass began: a task that wakes
+        // itself, like a script yielding between slices, then can't keep
+        // newly spawned tasks and the idle check waiting
+        for _ in 0..task_queue.len() {
+            let Some(task_id) = task_queue.pop() else { break };
             let task = match tasks.get_mut(&task_id) {
                 Some(task) => task,
                 None => continue, // task no longer exists
@@ -9,6 +9,7 @@ pub mod simple_executor;
 pub mod keyboard;
 pub mod executor;
 pub mod mouse;
+pub mod timer;
 
 /// Global task storage for spawning background tasks
 static GLOBAL_TASKS: Mutex<Vec<Task>> = Mutex::new(Vec::new());
@@ -0,0 +1,101 @@
+/// Sleeping until a timer tick
+///
+/// A task that awaits `sleep_until` is parked in one of a few slots and
+/// woken by the timer interrupt once its deadline tick has passed, so a
+/// periodic background task costs nothing between its deadlines and the
+/// executor can halt the CPU.
+use core::future::Future;
+use core::pin::Pin;
+use core::sync::atomic::{AtomicU64, Ordering};
+use core::task::{Context, Poll};
+use futures_util::task::AtomicWaker;
+
+use crate::interrupts::{ticks, TICK_US};
+
+/// Tasks that can sleep at once; further sleepers fall back to polling
+const SLOTS: usize = 8;
+
+/// Deadline of a free slot
+const FREE: u64 = 0;
+
+struct Sleeper {
+    /// Tick to wake at, or FREE
+    deadline: AtomicU64,
+    waker: AtomicWaker,
+}
+
+static SLEEPERS: [Sleeper; SLOTS] = [const {
+    Sleeper { deadline: AtomicU64::new(FREE), waker: AtomicWaker::new() }
+}; SLOTS];
+
+/// Wake the sleepers whose deadline has passed; called from the timer
+/// interrupt with the new tick count
+pub(crate) fn wake_expired(now: u64) {
+    for sleeper in &SLEEPERS {
+        let deadline = sleeper.deadline.load(Ordering::Acquire);
+        if deadline != FREE && deadline <= now {
+            // Takes the waker, so later ticks don't wake the task again
+            sleeper.waker.wake();
+        }
+    }
+}
+
+struct Sleep {
+    deadline: u64,
+    slot: Option<usize>,
+}
+
+impl Sleep {
+    fn claim(&mut self) -> Option<usize> {
+        if self.slot.is_none() {
+            self.slot = SLEEPERS.iter().position(|s| {
+                s.deadline
+                    .compare_exchange(FREE, self.deadline, Ordering::AcqRel, Ordering::Relaxed)
+                    .is_ok()
+            });
+        }
+        self.slot
+    }
+}
+
+impl Future for Sleep {
+    type Output = ();
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<()> {
+        if ticks() >= self.deadline {
+            return Poll::Ready(());
+        }
+        match self.claim() {
+            Some(slot) => {
+                SLEEPERS[slot].waker.register(cx.waker());
+                // The tick may have come between the check and registering
+                if ticks() >= self.deadline {
+                    return Poll::Ready(());
+                }
+            }
+            None => cx.waker().wake_by_ref(),
+        }
+        Poll::Pending
+    }
+}
+
+impl Drop for Sleep {
+    fn drop(&mut self) {
+        if let Some(slot) = self.slot {
+            SLEEPERS[slot].waker.take();
+            SLEEPERS[slot].deadline.store(FREE, Ordering::Release);
+        }
+    }
+}
+
+/// Sleep until the tick counter reaches `deadline`
+pub async fn sleep_until(deadline: u64) {
+    // FREE marks an empty slot; tick 0 has passed by the time anyone sleeps
+    Sleep { deadline: deadline.max(1), slot: None }.await
+}
+
+/// Sleep for at least `ms` milliseconds
+pub async fn sleep_ms(ms: u64) {
+    let wait = (ms * 1000).div_ceil(TICK_US);
+    sleep_until(ticks() + wait).await
+}
@@ -5,10 +5,8 @@ use volatile::Volatile;
 
 lazy_static! {
     
-    pub static ref WRITER: Mutex<Writer> = Mutex::new(Writer {
-        column_position: 0,
-        color_code: ColorCode::new(Color::Yellow, Color::Black),
-        buffer: unsafe { &mut *(0xb8000 as *mut Buffer) },
+    pub static ref WRITER: Mutex<Writer> = Mutex::new(unsafe {
+        Writer::new(&mut *(0xb8000 as *mut Buffer), &mut *(&raw mut LINES))
     });
 }
 
@@ -59,20 +57,138 @@ struct ScreenChar {
 pub const BUFFER_HEIGHT: usize = 25;
 pub const BUFFER_WIDTH: usize = 80;
 
+/// Lines the console keeps, on screen and scrolled off; a power of two
+pub const SCROLLBACK_LINES: usize = 4096;
+
+const BLANK: ScreenChar = ScreenChar {
+    ascii_character: b' ',
+    color_code: ColorCode(0x0e),
+};
+
+/// Console lines, written only through `WRITER`
+static mut LINES: [[ScreenChar; BUFFER_WIDTH]; SCROLLBACK_LINES] =
+    [[BLANK; BUFFER_WIDTH]; SCROLLBACK_LINES];
+
 #[repr(transparent)]
 struct Buffer {
     chars: [[Volatile<ScreenChar>; BUFFER_WIDTH]; BUFFER_HEIGHT],
 }
 
+/// The text console
+///
+/// Text goes into a ring of `SCROLLBACK_LINES` lines, and the screen is a
+/// window onto it. The cursor is always on the bottom row, the newest
+/// line, so a newline only advances the ring's head and blanks that one
+/// line. Writes that scrolled redraw the window once they are done, a bulk
+/// copy per row, however many lines they printed. Scrolling back moves the
+/// window and marks the bottom row with how far back it is; the next write
+/// returns it to the newest lines.
+///
+/// Cells drawn through the compositor are not in the ring, so they stay
+/// on screen only until the console next scrolls.
 pub struct Writer {
     column_position: usize,
     color_code: ColorCode,
     buffer: &'static mut Buffer,
+    lines: &'static mut [[ScreenChar; BUFFER_WIDTH]; SCROLLBACK_LINES],
+    /// Number of the newest line, the one the cursor is on
+    head: usize,
+    /// Oldest line still kept
+    first: usize,
+    /// First line since the screen was cleared; older ones show only when
+    /// scrolled back to
+    cleared: usize,
+    /// Lines the window is scrolled back from the newest
+    view: usize,
+    /// Whether the screen no longer shows the window
+    stale: bool,
+}
+
+/// One screen row written through `fmt::Write`, cut off at the right edge
+struct RowWriter<'a> {
+    cells: &'a mut [Volatile<ScreenChar>; BUFFER_WIDTH],
+    col: usize,
+    color_code: ColorCode,
+}
+
+impl fmt::Write for RowWriter<'_> {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        for byte in s.bytes() {
+            if self.col < BUFFER_WIDTH {
+                self.cells[self.col].write(ScreenChar { ascii_character: byte, color_code: self.color_code });
+                self.col += 1;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Copy `source` to the screen cells at the start of `cells`, one volatile
+/// write per cell
+fn write_cells(cells: &mut [Volatile<ScreenChar>], source: &[ScreenChar]) {
+    for (cell, &character) in cells.iter_mut().zip(source) {
+        cell.write(character);
+    }
 }
 
 impl Writer {
+    fn new(buffer: &'static mut Buffer,
+           lines: &'static mut [[ScreenChar; BUFFER_WIDTH]; SCROLLBACK_LINES]) -> Writer {
+        // Keep what the bootloader left on screen, so it can be scrolled back to
+        for row in 0..BUFFER_HEIGHT {
+            for col in 0..BUFFER_WIDTH {
+                lines[row][col] = buffer.chars[row][col].read();
+            }
+        }
+        Writer {
+            column_position: 0,
+            color_code: ColorCode::new(Color::Yellow, Color::Black),
+            buffer,
+            lines,
+            head: BUFFER_HEIGHT - 1,
+            first: 0,
+            cleared: 0,
+            view: 0,
+            stale: false,
+        }
+    }
+
+    fn line(&mut self, number: usize) -> &mut [ScreenChar; BUFFER_WIDTH] {
+        &mut self.lines[number % SCROLLBACK_LINES]
+    }
+
+    fn blank(&self) -> ScreenChar {
+        ScreenChar {
+            ascii_character: b' ',
+            color_code: self.color_code,
+        }
+    }
+
+    /// Set column `col` of the cursor's line, and of the screen unless it
+    /// is about to be redrawn anyway
+    fn put(&mut self, col: usize, character: ScreenChar) {
+        self.line(self.head)[col] = character;
+        if !self.stale {
+            self.buffer.chars[BUFFER_HEIGHT - 1][col].write(character);
+        }
+    }
+
+    /// Return the window to the newest lines
+    fn follow(&mut self) {
+        if self.view != 0 {
+            self.view = 0;
+            self.stale = true;
+        }
+    }
 
     pub fn write_byte(&mut self, byte: u8) {
+        self.put_byte(byte);
+        self.present();
+    }
+
+    fn put_byte(&mut self, byte: u8) {
+        crate::graphics::compositor::invalidate();
+        self.follow();
         match byte {
             b'\n' => self.new_line(),
             byte => {
@@ -80,11 +196,9 @@ impl Writer {
                     self.new_line();
                 }
 
-                let row = BUFFER_HEIGHT - 1;
                 let col = self.column_position;
-
                 let color_code = self.color_code;
-                self.buffer.chars[row][col].write(ScreenChar {
+                self.put(col, ScreenChar {
                     ascii_character: byte,
                     color_code,
                 });
@@ -94,57 +208,151 @@ impl Writer {
     }
 
     fn write_string(&mut self, s: &str) {
-        for byte in s.bytes() {
-            match byte {
-                // printable ASCII byte or newline
-                0x20..=0x7e | b'\n' => self.write_byte(byte),
-                // not part of printable ASCII range
-                _ => self.write_byte(0xfe),
+        self.write_bytes(s.as_bytes());
+    }
+
+    /// Write text a run at a time: each stretch of a line is filled in the
+    /// ring, then copied to the screen in one go unless a redraw is due
+    fn write_bytes(&mut self, mut bytes: &[u8]) {
+        crate::graphics::compositor::invalidate();
+        self.follow();
+        while let Some(&first) = bytes.first() {
+            if first == b'\n' {
+                self.new_line();
+                bytes = &bytes[1..];
+                continue;
             }
+            if self.column_position >= BUFFER_WIDTH {
+                self.new_line();
+            }
+            let col = self.column_position;
+            let run = bytes.iter()
+                .take(BUFFER_WIDTH - col)
+                .take_while(|&&b| b != b'\n')
+                .count();
+            let color_code = self.color_code;
+            let line = &mut self.lines[self.head % SCROLLBACK_LINES];
+            for (cell, &byte) in line[col..col + run].iter_mut().zip(bytes) {
+                *cell = ScreenChar {
+                    ascii_character: match byte {
+                        // printable ASCII byte
+                        0x20..=0x7e => byte,
+                        // not part of printable ASCII range
+                        _ => 0xfe,
+                    },
+                    color_code,
+                };
+            }
+            if !self.stale {
+                write_cells(&mut self.buffer.chars[BUFFER_HEIGHT - 1][col..], &line[col..col + run]);
+            }
+            self.column_position += run;
+            bytes = &bytes[run..];
         }
+        self.present();
     }
 
-    
+    /// Start a new line; the ring drops its oldest line once full
     fn new_line(&mut self) {
-        for row in 1..BUFFER_HEIGHT {
-            for col in 0..BUFFER_WIDTH {
-                let character = self.buffer.chars[row][col].read();
-                self.buffer.chars[row - 1][col].write(character);
-            }
-        }
-        self.clear_row(BUFFER_HEIGHT - 1);
+        self.head += 1;
+        let blank = self.blank();
+        self.line(self.head).fill(blank);
+        self.first = self.first.max((self.head + 1).saturating_sub(SCROLLBACK_LINES));
         self.column_position = 0;
+        self.stale = true;
     }
 
-    
-    fn clear_row(&mut self, row: usize) {
-        let blank = ScreenChar {
-            ascii_character: b' ',
-            color_code: self.color_code,
-        };
-        for col in 0..BUFFER_WIDTH {
-            self.buffer.chars[row][col].write(blank);
+    /// Copy the window to the screen if it moved since the last copy
+    fn present(&mut self) {
+        if !self.stale {
+            return;
         }
+        crate::graphics::compositor::invalidate();
+        let blank = [self.blank(); BUFFER_WIDTH];
+        let bottom = self.head - self.view;
+        for row in 0..BUFFER_HEIGHT {
+            let shown = (bottom + row + 1).checked_sub(BUFFER_HEIGHT)
+                .filter(|&n| n >= self.first && (self.view > 0 || n >= self.cleared));
+            let source = match shown {
+                Some(n) => &self.lines[n % SCROLLBACK_LINES],
+                None => &blank,
+            };
+            write_cells(&mut self.buffer.chars[row], source);
+        }
+        if self.view > 0 {
+            use core::fmt::Write;
+            let (view, limit) = (self.view, self.scroll_limit());
+            let mut status = RowWriter {
+                cells: &mut self.buffer.chars[BUFFER_HEIGHT - 1],
+                col: 0,
+                color_code: ColorCode::new(Color::Black, Color::LightGray),
+            };
+            let _ = write!(status, " Scrollback: {} of {} lines up - PgUp/PgDn to scroll, any key to return",
+                           view, limit);
+            while status.col < BUFFER_WIDTH {
+                let _ = status.write_str(" ");
+            }
+        }
+        self.stale = false;
     }
 
     pub fn clear_screen(&mut self) {
-        for row in 0..BUFFER_HEIGHT {
-            self.clear_row(row);
+        if self.column_position > 0 {
+            self.new_line();
+        } else {
+            // Blank it in the current color, which may have changed
+            let blank = self.blank();
+            self.line(self.head).fill(blank);
+        }
+        self.cleared = self.head;
+        self.view = 0;
+        self.stale = true;
+        self.present();
+    }
+
+    /// Forget every line that is not on screen
+    pub fn clear_scrollback(&mut self) {
+        self.first = self.first.max(self.cleared).max(self.head + 1 - BUFFER_HEIGHT);
+        self.follow();
+        self.present();
+    }
+
+    /// Lines the window can be scrolled back
+    fn scroll_limit(&self) -> usize {
+        (self.head - self.first + 1).saturating_sub(BUFFER_HEIGHT)
+    }
+
+    /// Move the window `lines` further back, at most to the oldest line kept
+    pub fn scroll_up(&mut self, lines: usize) {
+        self.scroll_to((self.view + lines).min(self.scroll_limit()));
+    }
+
+    /// Move the window `lines` back toward the newest line
+    pub fn scroll_down(&mut self, lines: usize) {
+        self.scroll_to(self.view.saturating_sub(lines));
+    }
+
+    /// Return the window to the newest lines
+    pub fn scroll_to_bottom(&mut self) {
+        self.scroll_to(0);
+    }
+
+    fn scroll_to(&mut self, view: usize) {
+        if view != self.view {
+            self.view = view;
+            self.stale = true;
+            self.present();
         }
-        self.column_position = 0;
     }
 
     pub fn backspace(&mut self) {
         if self.column_position > 0 {
+            crate::graphics::compositor::invalidate();
+            self.follow();
             self.column_position -= 1;
-            let row = BUFFER_HEIGHT - 1;
-            let col = self.column_position;
-            
-            let blank = ScreenChar {
-                ascii_character: b' ',
-                color_code: self.color_code,
-            };
-            self.buffer.chars[row][col].write(blank);
+            let blank = self.blank();
+            self.put(self.column_position, blank);
+            self.present();
         }
     }
 
@@ -175,11 +383,12 @@ macro_rules! println {
 
 #[doc(hidden)]
 pub fn _print(args: fmt::Arguments) {
-    use core::fmt::Write;
     use x86_64::instructions::interrupts;   
 
-    interrupts::without_interrupts(|| {     
-        WRITER.lock().write_fmt(args).unwrap();
+    crate::line_buffer::format_buffered(args, |bytes| {
+        interrupts::without_interrupts(|| {     
+            WRITER.lock().write_bytes(bytes);
+        });
     });
 }
 
@@ -199,21 +408,45 @@ pub fn backspace() {
     });
 }
 
+/// Scroll the console window `lines` back into its scrollback
+pub fn scroll_up(lines: usize) {
+    use x86_64::instructions::interrupts;
+
+    interrupts::without_interrupts(|| {
+        WRITER.lock().scroll_up(lines);
+    });
+}
+
+/// Scroll the console window `lines` toward the newest output
+pub fn scroll_down(lines: usize) {
+    use x86_64::instructions::interrupts;
+
+    interrupts::without_interrupts(|| {
+        WRITER.lock().scroll_down(lines);
+    });
+}
+
+/// Show the newest console output again after scrolling back
+pub fn scroll_to_bottom() {
+    use x86_64::instructions::interrupts;
+
+    interrupts::without_interrupts(|| {
+        WRITER.lock().scroll_to_bottom();
+    });
+}
+
+/// Drop the console's scrollback, keeping what is on screen
+pub fn clear_scrollback() {
+    use x86_64::instructions::interrupts;
+
+    interrupts::without_interrupts(|| {
+        WRITER.lock().clear_scrollback();
+    });
+}
+
 /// Write a character at a specific position with given colors
 pub fn write_char_at(x: usize, y: usize, ch: u8, fg: Color, bg: Color) {
-    use x86_64::instructions::interrupts;
-    
-    if x < BUFFER_WIDTH && y < BUFFER_HEIGHT {
-        interrupts::without_interrupts(|| {
-            let mut writer = WRITER.lock();
-            let color_code = ColorCode::new(fg, bg);
-            let screen_char = ScreenChar {
-                ascii_character: ch,
-                color_code,
-            };
-            writer.buffer.chars[y][x].write(screen_char);
-        });
-    }
+    crate::graphics::text_graphics::put_char(x, y, ch, fg, bg);
 }
 
 
@@ -2,6 +2,8 @@ use alloc::{vec::Vec, string::String};
 use alloc::string::ToString;
 use pc_keyboard::{DecodedKey, KeyCode};
 use crate::vga_buffer::Color;
+use crate::graphics::compositor::{self, Frame};
+use crate::graphics::region::{Rect, Region};
 use crate::graphics::text_graphics::{draw_filled_box, draw_double_box, write_at};
 
 const SCREEN_W: usize = 80;
@@ -11,6 +13,12 @@ const WIN_MIN_H: usize = 5;
 const WIN_Y_MIN: usize = 1;
 const WIN_Y_MAX_OFFSET: usize = 1;
 
+/// Lines of output a shell window keeps; older ones are dropped
+const SHELL_OUTPUT_LINES: usize = 512;
+
+/// Lines a shell window's PageUp/PageDown move by
+const SHELL_PAGE_LINES: usize = 5;
+
 #[derive(Clone)]
 pub struct FsEntry {
     pub full_path: String,
@@ -18,6 +26,128 @@ pub struct FsEntry {
     pub is_dir: bool,
 }
 
+#[derive(Clone)]
+struct OutputLine {
+    text: String,
+    /// Byte offsets where the second and later rows start
+    breaks: Vec<usize>,
+}
+
+impl OutputLine {
+    fn wrap(&mut self, width: usize) {
+        self.breaks.clear();
+        if width == 0 {
+            return;
+        }
+        for (n, (at, _)) in self.text.char_indices().enumerate() {
+            if n > 0 && n % width == 0 {
+                self.breaks.push(at);
+            }
+        }
+    }
+
+    fn rows(&self) -> usize {
+        self.breaks.len() + 1
+    }
+
+    fn row(&self, row: usize) -> &str {
+        let start = if row == 0 { 0 } else { self.breaks[row - 1] };
+        let end = self.breaks.get(row).copied().unwrap_or(self.text.len());
+        &self.text[start..end]
+    }
+}
+
+/// A shell window's output: a ring of its last `SHELL_OUTPUT_LINES` lines
+///
+/// Lines wrap at the window's width. Where each one breaks is worked out
+/// when it is added or the window is resized, so drawing touches only the
+/// lines on screen. Once the ring is full a new line takes the oldest
+/// one's place and, through `push_str`, its buffer.
+#[derive(Clone)]
+pub struct ShellOutput {
+    lines: Vec<OutputLine>,
+    /// Index in `lines` of the oldest line
+    first: usize,
+    width: usize,
+    /// Rows of all lines at `width`
+    rows: usize,
+}
+
+impl ShellOutput {
+    pub fn new(width: usize) -> Self {
+        ShellOutput { lines: Vec::new(), first: 0, width, rows: 0 }
+    }
+
+    /// Screen rows the lines take, wrapped
+    pub fn rows(&self) -> usize {
+        self.rows
+    }
+
+    pub fn clear(&mut self) {
+        self.lines.clear();
+        self.first = 0;
+        self.rows = 0;
+    }
+
+    /// Wrap lines at `width` columns
+    pub fn set_width(&mut self, width: usize) {
+        if width == self.width {
+            return;
+        }
+        self.width = width;
+        self.rows = 0;
+        for line in &mut self.lines {
+            line.wrap(width);
+            self.rows += line.rows();
+        }
+    }
+
+    pub fn push(&mut self, text: String) {
+        self.push_line(|line| line.text = text);
+    }
+
+    /// Add a copy of `text`, reusing the buffer of the line it replaces
+    pub fn push_str(&mut self, text: &str) {
+        self.push_line(|line| {
+            line.text.clear();
+            line.text.push_str(text);
+        });
+    }
+
+    fn push_line(&mut self, fill: impl FnOnce(&mut OutputLine)) {
+        let slot = if self.lines.len() < SHELL_OUTPUT_LINES {
+            self.lines.push(OutputLine { text: String::new(), breaks: Vec::new() });
+            self.lines.len() - 1
+        } else {
+            let slot = self.first;
+            self.rows -= self.lines[slot].rows();
+            self.first = (slot + 1) % SHELL_OUTPUT_LINES;
+            slot
+        };
+        let line = &mut self.lines[slot];
+        fill(line);
+        line.wrap(self.width);
+        self.rows += line.rows();
+    }
+
+    /// Call `f` with the number and text of each row in `start..end`,
+    /// newest first
+    pub fn rows_in(&self, start: usize, end: usize, mut f: impl FnMut(usize, &str)) {
+        let mut line_end = self.rows;
+        for i in (0..self.lines.len()).rev() {
+            if line_end <= start {
+                break;
+            }
+            let line = &self.lines[(self.first + i) % self.lines.len()];
+            let line_start = line_end - line.rows();
+            for row in (line_start.max(start)..line_end.min(end)).rev() {
+                f(row, line.row(row - line_start));
+            }
+            line_end = line_start;
+        }
+    }
+}
+
 #[derive(Clone)]
 pub enum WindowContent {
     Empty,
@@ -30,7 +160,7 @@ pub enum WindowContent {
     Settings,
     Shell {
         input: String,
-        output: Vec<String>,
+        output: ShellOutput,
         cwd: String,
         history: Vec<String>,
         history_idx: usize,
@@ -88,6 +218,24 @@ pub struct Window {
     pub content: WindowContent,
 }
 
+impl Window {
+    pub fn rect(&self) -> Rect {
+        Rect::new(self.x, self.y, self.w, self.h)
+    }
+
+    /// Cells inside the border
+    fn content_rect(&self) -> Rect {
+        Rect::new(self.x + 1, self.y + 1, self.w.saturating_sub(2), self.h.saturating_sub(2))
+    }
+
+    /// Fit the content to a new window size
+    fn resized(&mut self) {
+        if let WindowContent::Shell { output, .. } = &mut self.content {
+            output.set_width(self.w.saturating_sub(2));
+        }
+    }
+}
+
 pub struct WindowManager {
     windows: Vec<Window>,
     focus_id: Option<u8>,
@@ -100,6 +248,8 @@ pub struct WindowManager {
     resize_start_w: usize,
     resize_start_h: usize,
     next_id: u8,
+    /// Cells changed since the last `take_damage`
+    damage: Region,
 }
 
 impl WindowManager {
@@ -116,6 +266,7 @@ impl WindowManager {
             resize_start_w: 0,
             resize_start_h: 0,
             next_id: 0,
+            damage: Region::new(),
         }
     }
 
@@ -139,7 +290,7 @@ impl WindowManager {
     }
 
     pub fn add_shell_window(&mut self) -> u8 {
-        let mut output = Vec::new();
+        let mut output = ShellOutput::new(0);
         output.push(String::from("RustrialOS Shell  type 'help' for commands"));
         let content = WindowContent::Shell {
             input: String::new(),
@@ -160,7 +311,7 @@ impl WindowManager {
         let h = h.max(WIN_MIN_H).min(SCREEN_H.saturating_sub(WIN_Y_MIN + WIN_Y_MAX_OFFSET));
         let x = x.min(SCREEN_W.saturating_sub(w));
         let y = y.clamp(WIN_Y_MIN, SCREEN_H.saturating_sub(h + WIN_Y_MAX_OFFSET));
-        self.windows.push(Window {
+        let mut win = Window {
             id,
             x,
             y,
@@ -169,15 +320,21 @@ impl WindowManager {
             title: String::from(title),
             z_order: max_z.wrapping_add(1),
             content,
-        });
-        self.focus_id = Some(id);
+        };
+        win.resized();
+        self.windows.push(win);
+        self.damage.add(Rect::new(x, y, w, h));
+        self.set_focus(Some(id));
         id
     }
 
     pub fn close_window(&mut self, id: u8) {
+        self.damage_window(id);
+        self.damage_taskbar();
         self.windows.retain(|w| w.id != id);
         if self.focus_id == Some(id) {
-            self.focus_id = self.windows.iter().max_by_key(|w| w.z_order).map(|w| w.id);
+            let next = self.windows.iter().max_by_key(|w| w.z_order).map(|w| w.id);
+            self.set_focus(next);
         }
         if self.drag_id == Some(id) {
             self.drag_id = None;
@@ -191,15 +348,74 @@ impl WindowManager {
         self.windows.len()
     }
 
+    /// Mark `rect` for repainting, e.g. after something drawn over it went away
+    pub fn damage(&mut self, rect: Rect) {
+        self.damage.add(rect);
+    }
+
+    /// Cells changed since the last call: windows moved, resized, opened,
+    /// closed, refocused or with new content, and anything passed to `damage`
+    pub fn take_damage(&mut self) -> Region {
+        core::mem::take(&mut self.damage)
+    }
+
+    fn damage_window(&mut self, id: u8) {
+        if let Some(win) = self.windows.iter().find(|w| w.id == id) {
+            self.damage.add(win.rect());
+        }
+    }
+
+    /// The taskbar lists windows and marks the focused one
+    fn damage_taskbar(&mut self) {
+        self.damage.add(Rect::new(0, SCREEN_H - 1, SCREEN_W, 1));
+    }
+
+    /// Focus a window; both title bars and the taskbar change
+    fn set_focus(&mut self, id: Option<u8>) {
+        if self.focus_id == id {
+            return;
+        }
+        if let Some(old) = self.focus_id {
+            self.damage_window(old);
+        }
+        if let Some(new) = id {
+            self.damage_window(new);
+        }
+        self.damage_taskbar();
+        self.focus_id = id;
+    }
+
     pub fn render_all(&self) {
+        self.render_damage(&Region::from_rect(Rect::screen()));
+    }
+
+    /// Repaint the windows inside `damage`, each only where no window above
+    /// it covers it; windows hidden there entirely are skipped
+    pub fn render_damage(&self, damage: &Region) {
+        // Overlapping windows overdraw each other; only the result is flushed
+        let _frame = Frame::begin();
         let mut order: Vec<usize> = (0..self.windows.len()).collect();
         order.sort_by_key(|&i| self.windows[i].z_order);
-        for i in order {
-            self.render_window(&self.windows[i]);
+        for (k, &i) in order.iter().enumerate() {
+            let win = &self.windows[i];
+            let mut visible = damage.intersect(&win.rect());
+            for &above in &order[k + 1..] {
+                if visible.is_empty() {
+                    break;
+                }
+                visible.subtract(&self.windows[above].rect());
+            }
+            if visible.is_empty() {
+                continue;
+            }
+            compositor::set_clip(Some(&visible));
+            self.render_window(win, &visible);
         }
+        compositor::set_clip(None);
     }
 
-    fn render_window(&self, win: &Window) {
+    /// Draw `win`; `visible` is the part that needs it
+    fn render_window(&self, win: &Window, visible: &Region) {
         let focused = self.focus_id == Some(win.id);
         let title_bg = if focused { Color::Blue } else { Color::DarkGray };
 
@@ -235,11 +451,11 @@ impl WindowManager {
             let cy = win.y + 1;
             let cw = win.w - 2;
             let ch = win.h - 2;
-            self.render_content(win, cx, cy, cw, ch, focused);
+            self.render_content(win, visible, cx, cy, cw, ch, focused);
         }
     }
 
-    fn render_content(&self, win: &Window, cx: usize, cy: usize, cw: usize, ch: usize, focused: bool) {
+    fn render_content(&self, win: &Window, visible: &Region, cx: usize, cy: usize, cw: usize, ch: usize, focused: bool) {
         match &win.content {
             WindowContent::Empty => {}
             WindowContent::Settings => {
@@ -292,39 +508,49 @@ impl WindowManager {
                 }
             }
             WindowContent::Shell { .. } => {
-                self.render_shell_content(win, cx, cy, cw, ch);
+                self.render_shell_content(win, visible, cx, cy, cw, ch);
             }
         }
     }
 
-    fn render_shell_content(&self, win: &Window, cx: usize, cy: usize, cw: usize, ch: usize) {
+    /// Draw the rows of a shell window that lie in `visible`: usually just
+    /// the prompt, or the lines a command added
+    fn render_shell_content(&self, win: &Window, visible: &Region, cx: usize, cy: usize, cw: usize, ch: usize) {
         let (input, output, cwd, scroll) = match &win.content {
             WindowContent::Shell { input, output, cwd, scroll, .. } => (input, output, cwd, *scroll),
             _ => return,
         };
         if ch == 0 { return; }
+        let shown = |row: usize| visible.overlaps(&Rect::new(cx, row, cw, 1));
 
         let output_h = ch.saturating_sub(1);
-        let total = output.len();
-        let end_idx = total.saturating_sub(scroll);
-        let start_idx = end_idx.saturating_sub(output_h);
+        let end = output.rows().saturating_sub(scroll);
+        let start = end.saturating_sub(output_h);
 
         for i in 0..output_h {
-            let row = cy + i;
-            draw_filled_box(cx, row, cw, 1, Color::LightGreen, Color::Black);
-            let line_idx = start_idx + i;
-            if line_idx < end_idx && line_idx < total {
-                let line = &output[line_idx];
-                let disp = if line.len() > cw { &line[..cw] } else { line.as_str() };
-                write_at(cx, row, disp, Color::LightGreen, Color::Black);
+            if shown(cy + i) {
+                draw_filled_box(cx, cy + i, cw, 1, Color::LightGreen, Color::Black);
             }
         }
+        output.rows_in(start, end, |row, text| {
+            if shown(cy + row - start) {
+                write_at(cx, cy + row - start, text, Color::LightGreen, Color::Black);
+            }
+        });
 
         let prompt_row = cy + ch - 1;
-        let full_line = alloc::format!("{}> {}", cwd, input);
-        draw_filled_box(cx, prompt_row, cw, 1, Color::Black, Color::Black);
-        let disp = if full_line.len() > cw { &full_line[full_line.len() - cw..] } else { full_line.as_str() };
-        write_at(cx, prompt_row, disp, Color::Yellow, Color::Black);
+        if shown(prompt_row) {
+            draw_filled_box(cx, prompt_row, cw, 1, Color::Black, Color::Black);
+            // The end of "<cwd>> <input>" that fits, a piece at a time
+            let mut skip = (cwd.len() + 2 + input.len()).saturating_sub(cw);
+            let mut x = cx;
+            for piece in [cwd.as_str(), "> ", input.as_str()] {
+                let part = piece.get(skip.min(piece.len())..).unwrap_or("");
+                skip -= skip.min(piece.len());
+                write_at(x, prompt_row, part, Color::Yellow, Color::Black);
+                x += part.len();
+            }
+        }
     }
 
     fn render_settings_content(&self, cx: usize, cy: usize, cw: usize, _ch: usize, _focused: bool) {
@@ -404,6 +630,8 @@ impl WindowManager {
                 let w = &self.windows[idx];
                 (w.id, w.x, w.y, w.w, w.h)
             };
+            // Raising, focusing and content clicks all repaint the window
+            self.damage_window(id);
 
             // Close button
             if my_u == win_y && mx_u >= win_x + win_w.saturating_sub(4) {
@@ -417,7 +645,7 @@ impl WindowManager {
                 self.drag_offset_x = mx - win_x as i16;
                 self.drag_offset_y = my - win_y as i16;
                 self.bring_to_front(id);
-                self.focus_id = Some(id);
+                self.set_focus(Some(id));
                 return true;
             }
 
@@ -429,7 +657,7 @@ impl WindowManager {
                 self.resize_start_w = win_w;
                 self.resize_start_h = win_h;
                 self.bring_to_front(id);
-                self.focus_id = Some(id);
+                self.set_focus(Some(id));
                 return true;
             }
 
@@ -438,13 +666,13 @@ impl WindowManager {
                 let inner_x = mx_u - win_x - 1;
                 let inner_y = my_u - win_y - 1;
                 self.bring_to_front(id);
-                self.focus_id = Some(id);
+                self.set_focus(Some(id));
                 self.handle_content_click(id, inner_x, inner_y);
                 return true;
             }
 
             self.bring_to_front(id);
-            self.focus_id = Some(id);
+            self.set_focus(Some(id));
             true
         } else {
             false
@@ -495,7 +723,7 @@ impl WindowManager {
         }
     }
 
-    fn handle_settings_click(&self, inner_x: usize, inner_y: usize) {
+    fn handle_settings_click(&mut self, inner_x: usize, inner_y: usize) {
         match inner_y {
             1 => {
                 // Mouse speed row: [<] at cols 2-4, [>] at cols 9-11
@@ -506,6 +734,17 @@ impl WindowManager {
                     crate::task::mouse::set_sensitivity(sens.saturating_add(2));
                 }
             }
+            4 | 5 => {
+                // A theme recolors the desktop as well as every window
+                self.damage.add(Rect::screen());
+                self.handle_theme_click(inner_x, inner_y);
+            }
+            _ => {}
+        }
+    }
+
+    fn handle_theme_click(&self, inner_x: usize, inner_y: usize) {
+        match inner_y {
             4 => {
                 // Theme row 1: [Cyan ] at 1-7, [Dark ] at 9-15, [Night] at 17-23
                 if inner_x >= 1 && inner_x <= 7 {
@@ -539,8 +778,11 @@ impl WindowManager {
                 let new_w = new_w.min(SCREEN_W.saturating_sub(win.x));
                 let new_h = new_h.min(SCREEN_H.saturating_sub(win.y + WIN_Y_MAX_OFFSET));
                 if new_w != win.w || new_h != win.h {
+                    self.damage.add(win.rect());
                     win.w = new_w;
                     win.h = new_h;
+                    win.resized();
+                    self.damage.add(win.rect());
                     return true;
                 }
                 return false;
@@ -554,8 +796,10 @@ impl WindowManager {
                 let new_x = new_x.min(SCREEN_W.saturating_sub(win.w));
                 let new_y = new_y.clamp(WIN_Y_MIN, SCREEN_H.saturating_sub(win.h + WIN_Y_MAX_OFFSET));
                 if new_x != win.x || new_y != win.y {
+                    self.damage.add(win.rect());
                     win.x = new_x;
                     win.y = new_y;
+                    self.damage.add(win.rect());
                     return true;
                 }
                 return false;
@@ -578,11 +822,18 @@ impl WindowManager {
     pub fn handle_shell_key(&mut self, key: DecodedKey) -> bool {
         let id = match self.focus_id { Some(id) => id, None => return false };
         let idx = match self.windows.iter().position(|w| w.id == id) { Some(i) => i, None => return false };
+        // Only the rows that change are damaged, not the whole window
+        let content = self.windows[idx].content_rect();
+        let output_h = content.h.saturating_sub(1);
+        let prompt = Rect::new(content.x, content.y + output_h, content.w, 1);
+        let output_area = Rect::new(content.x, content.y, content.w, output_h);
 
-        match &mut self.windows[idx].content {
+        let changed = match &mut self.windows[idx].content {
             WindowContent::Shell { input, output, cwd, history, history_idx, scroll } => {
                 match key {
                     DecodedKey::Unicode('\n') | DecodedKey::Unicode('\r') => {
+                        let rows_before = output.rows();
+                        let scrolled = *scroll != 0;
                         let cmd = input.clone();
                         output.push(alloc::format!("{}> {}", cwd, cmd));
                         if !cmd.is_empty() {
@@ -593,22 +844,27 @@ impl WindowManager {
                         }
                         input.clear();
                         *scroll = 0;
-                        true
+                        if !scrolled && rows_before <= output.rows() && output.rows() <= output_h {
+                            // New lines went below the old ones, which stay put
+                            Some(Rect::new(content.x, content.y + rows_before, content.w, content.h - rows_before))
+                        } else {
+                            Some(content)
+                        }
                     }
                     DecodedKey::Unicode('\u{0008}') | DecodedKey::RawKey(KeyCode::Backspace) => {
                         input.pop();
-                        true
+                        Some(prompt)
                     }
                     DecodedKey::Unicode(c) if !c.is_control() => {
                         input.push(c);
-                        true
+                        Some(prompt)
                     }
                     DecodedKey::RawKey(KeyCode::ArrowUp) => {
                         if *history_idx > 0 {
                             *history_idx -= 1;
                             *input = history[*history_idx].clone();
                         }
-                        true
+                        Some(prompt)
                     }
                     DecodedKey::RawKey(KeyCode::ArrowDown) => {
                         if *history_idx < history.len() {
@@ -619,21 +875,28 @@ impl WindowManager {
                                 input.clear();
                             }
                         }
-                        true
+                        Some(prompt)
                     }
                     DecodedKey::RawKey(KeyCode::PageUp) => {
-                        *scroll = scroll.saturating_add(5);
-                        true
+                        let limit = output.rows().saturating_sub(output_h);
+                        let before = *scroll;
+                        *scroll = (*scroll + SHELL_PAGE_LINES).min(limit.max(*scroll));
+                        (*scroll != before).then_some(output_area)
                     }
                     DecodedKey::RawKey(KeyCode::PageDown) => {
-                        *scroll = scroll.saturating_sub(5);
-                        true
+                        let before = *scroll;
+                        *scroll = scroll.saturating_sub(SHELL_PAGE_LINES);
+                        (*scroll != before).then_some(output_area)
                     }
-                    _ => false,
+                    _ => None,
                 }
             }
-            _ => false,
+            _ => None,
+        };
+        if let Some(rect) = changed {
+            self.damage.add(rect);
         }
+        changed.is_some()
     }
 
     /// Bounds of the currently dragged/resized window, used for targeted erase.
@@ -658,7 +921,7 @@ impl WindowManager {
 
     pub fn focus_and_raise(&mut self, id: u8) {
         self.bring_to_front(id);
-        self.focus_id = Some(id);
+        self.set_focus(Some(id));
     }
 
     pub fn topmost_window_at(&self, mx: i16, my: i16) -> Option<u8> {
@@ -674,16 +937,7 @@ impl WindowManager {
     }
 
     pub fn render_windows_overlapping(&self, x: usize, y: usize, w: usize, h: usize) {
-        let x_end = x + w;
-        let y_end = y + h;
-        let mut order: Vec<usize> = (0..self.windows.len()).collect();
-        order.sort_by_key(|&i| self.windows[i].z_order);
-        for i in order {
-            let win = &self.windows[i];
-            if win.x < x_end && win.x + win.w > x && win.y < y_end && win.y + win.h > y {
-                self.render_window(win);
-            }
-        }
+        self.render_damage(&Region::from_rect(Rect::new(x, y, w, h)));
     }
 
     pub fn is_point_over_window(&self, mx: i16, my: i16) -> bool {
@@ -702,18 +956,20 @@ impl WindowManager {
         if let Some(win) = self.windows.iter_mut().find(|w| w.id == id) {
             win.z_order = max_z.wrapping_add(1);
         }
+        self.damage_window(id);
     }
 }
 
-fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
+fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut ShellOutput) {
     use crate::fs::FileSystem;
     let parts: Vec<&str> = cmd.trim().split_whitespace().collect();
     if parts.is_empty() { return; }
     match parts[0] {
         "help" => {
             output.push(String::from("Commands:"));
-            output.push(String::from("  help  echo  ls  cat  cd  pwd  mkdir  touch  clear"));
-            output.push(String::from("  run  fetch  netinfo  pciinfo  arp  ifconfig  dmastat  tcptest"));
+            output.push(String::from("  help  echo  ls  cat  cd  pwd  mkdir  touch  mv  clear"));
+            output.push(String::from("  run  scripts  fetch  netinfo  pciinfo  arp  ifconfig  dmastat  cachestat  tcptest"));
+            output.push(String::from("  mkfs  sync  lfsstat  jit  (lfsbench/scriptbench: use desktop Shell)"));
             output.push(String::from("  (ping/dhcp-acquire/ntp-sync/http-get: use desktop Shell)"));
         }
         "echo" => { output.push(parts[1..].join(" ")); }
@@ -721,7 +977,7 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
         "pwd" => { output.push(cwd.clone()); }
         "cd" => {
             let target = if parts.len() < 2 { "/" } else { parts[1] };
-            let new_path = shell_resolve_path(cwd, target);
+            let new_path = shell_resolve_path(cwd, target).into_owned();
             if new_path == "/" {
                 *cwd = new_path;
                 return;
@@ -736,7 +992,7 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
             }
         }
         "ls" => {
-            let path = if parts.len() > 1 { shell_resolve_path(cwd, parts[1]) } else { cwd.clone() };
+            let path = shell_resolve_path(cwd, parts.get(1).copied().unwrap_or("."));
             if let Some(fs) = crate::fs::root_fs() {
                 let fs = fs.lock();
                 match fs.list_dir(&path) {
@@ -744,7 +1000,7 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
                         if entries.is_empty() { output.push(String::from("(empty)")); }
                         for entry in entries {
                             let is_dir = fs.is_dir(&entry);
-                            let name = entry.rsplit('/').next().unwrap_or(&entry).to_string();
+                            let name = entry.rsplit('/').next().unwrap_or(&entry);
                             output.push(alloc::format!("{} {}", if is_dir { "[D]" } else { "[F]" }, name));
                         }
                     }
@@ -757,9 +1013,9 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
             let path = shell_resolve_path(cwd, parts[1]);
             if let Some(fs) = crate::fs::root_fs() {
                 let fs = fs.lock();
-                match fs.read_file(&path) {
+                match fs.read_file_bytes(&path) {
                     Ok(content) => match core::str::from_utf8(&content) {
-                        Ok(text) => { for line in text.lines() { output.push(line.to_string()); } }
+                        Ok(text) => { for line in text.lines() { output.push_str(line); } }
                         Err(_) => output.push(alloc::format!("(binary, {} bytes)", content.len())),
                     },
                     Err(_) => output.push(alloc::format!("cat: {}: no such file", parts[1])),
@@ -788,6 +1044,17 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
                 }
             }
         }
+        "mv" => {
+            if parts.len() < 3 { output.push(String::from("Usage: mv <from> <to>")); return; }
+            let from = shell_resolve_path(cwd, parts[1]);
+            let to = shell_resolve_path(cwd, parts[2]);
+            if let Some(fs) = crate::fs::root_fs() {
+                let mut fs = fs.lock();
+                if let Err(e) = fs.rename(&from, &to) {
+                    output.push(alloc::format!("mv: {}", e));
+                }
+            }
+        }
         "run" => {
             if parts.len() < 2 { output.push(String::from("Usage: run <script>")); return; }
             let path = if parts[1].starts_with('/') {
@@ -796,30 +1063,43 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
                 alloc::format!("/scripts/{}", parts[1])
             };
             if let Some(fs) = crate::fs::root_fs() {
-                let fs = fs.lock();
-                match fs.read_file(&path) {
-                    Ok(content) => match core::str::from_utf8(&content) {
-                        Ok(text) => {
-                            output.push(alloc::format!("Running: {}", path));
-                            match crate::rustrial_script::run(text) {
-                                Ok(_) => output.push(String::from("Script completed")),
-                                Err(e) => output.push(alloc::format!("Script error: {}", e)),
-                            }
-                        }
-                        Err(_) => output.push(String::from("Error: file is not valid UTF-8")),
-                    },
-                    Err(_) => output.push(alloc::format!("Error: cannot read '{}'", path)),
+                let loaded = {
+                    let mut fs = fs.lock();
+                    fs.is_file(&path).then(|| crate::rustrial_script::image::load(&mut *fs, &path))
+                };
+                // Scripts run as tasks of their own so the desktop stays live
+                match loaded {
+                    Some(Ok(chunk)) => {
+                        let id = crate::rustrial_script::task::spawn(path.clone(), chunk);
+                        output.push(alloc::format!("Started script #{}: {} (see 'scripts')", id, path));
+                    }
+                    Some(Err(e)) => output.push(alloc::format!("Script error: {}", e)),
+                    None => output.push(alloc::format!("Error: cannot read '{}'", path)),
                 }
             }
         }
+        "scripts" => {
+            use crate::rustrial_script::task::{self, Status};
+            let scripts = task::scripts();
+            if scripts.is_empty() { output.push(String::from("No scripts have run yet")); }
+            for script in scripts {
+                let status = match script.status() {
+                    Status::Running => String::from("running"),
+                    Status::Done => String::from("done"),
+                    Status::Failed(e) => alloc::format!("error: {}", e),
+                };
+                let name = script.name.rsplit('/').next().unwrap_or(&script.name);
+                output.push(alloc::format!("#{} {} [{}] {} instr, {}",
+                    script.id, name, if script.native { "jit" } else { "interp" },
+                    script.executed(), status));
+            }
+        }
         "rustrialfetch" | "fetch" => {
             use crate::native_ffi;
             let cpu = native_ffi::CpuInfo::get();
             let dt = native_ffi::DateTime::read();
             let pci = native_ffi::enumerate_pci_devices();
-            let scripts = if let Some(fs) = crate::fs::root_fs() {
-                fs.lock().list_dir("/scripts").map(|e| e.len()).unwrap_or(0)
-            } else { 0 };
+            let scripts = crate::script_loader::script_paths().len();
             output.push(String::from("OS:          RustrialOS v0.1"));
             output.push(String::from("Kernel:      Rust bare-metal"));
             output.push(alloc::format!("CPU:         {}", cpu.brand_str()));
@@ -904,6 +1184,44 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
             output.push(alloc::format!("Peak:      {} KB", s.peak_usage / 1024));
             output.push(alloc::format!("Pool hits: {}  misses: {}", s.pool_hits, s.pool_misses));
         }
+        "cachestat" => {
+            let s = crate::fs::page_cache::stats();
+            output.push(alloc::format!("Resident:  {} / {} pages ({} dirty)", s.resident, s.capacity, s.dirty));
+            output.push(alloc::format!("Hits: {}  misses: {}", s.hits, s.misses));
+            output.push(alloc::format!("Readahead: {} pages, {} hits", s.readahead_pages, s.readahead_hits));
+            output.push(alloc::format!("Writeback: {} pages in {} batches", s.writeback_pages, s.writeback_batches));
+        }
+        "jit" => {
+            use crate::rustrial_script::jit;
+            match parts.get(1).copied() {
+                Some("on") => jit::set_enabled(true),
+                Some("off") => jit::set_enabled(false),
+                _ => {}
+            }
+            output.push(alloc::format!("Script JIT: {}", if jit::enabled() { "on" } else { "off" }));
+        }
+        "mkfs" => {
+            output.push(match crate::fs::format_disk("/data") {
+                Ok(()) => String::from("Data disk formatted and mounted at /data"),
+                Err(e) => alloc::format!("mkfs: {}", e),
+            });
+        }
+        "sync" => {
+            output.push(match crate::fs::sync() {
+                Ok(()) => String::from("Filesystems synced"),
+                Err(e) => alloc::format!("sync: {}", e),
+            });
+        }
+        "lfsstat" => {
+            match crate::fs::root_fs().and_then(|fs| fs.lock().counters_at("/data")) {
+                Some(counters) => {
+                    for (label, value) in counters {
+                        output.push(alloc::format!("{:<18} {}", alloc::format!("{}:", label), value));
+                    }
+                }
+                None => output.push(String::from("No filesystem mounted at /data")),
+            }
+        }
         "tcptest" => {
             use core::net::Ipv4Addr;
             use crate::net::tcp::{TcpConnection, TcpSocketId, TcpState};
@@ -939,20 +1257,6 @@ fn shell_exec_to_buf(cmd: &str, cwd: &mut String, output: &mut Vec<String>) {
     }
 }
 
-fn shell_resolve_path(cwd: &str, path: &str) -> String {
-    if path.starts_with('/') {
-        path.to_string()
-    } else if path == ".." {
-        if cwd == "/" { return String::from("/"); }
-        match cwd.rsplit_once('/') {
-            Some((parent, _)) => if parent.is_empty() { String::from("/") } else { parent.to_string() },
-            None => String::from("/"),
-        }
-    } else if path == "." {
-        cwd.to_string()
-    } else if cwd == "/" {
-        alloc::format!("/{}", path)
-    } else {
-        alloc::format!("{}/{}", cwd, path)
-    }
+fn shell_resolve_path<'a>(cwd: &'a str, path: &'a str) -> alloc::borrow::Cow<'a, str> {
+    crate::fs::path::resolve(cwd, path)
 }
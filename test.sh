@@ -23,6 +23,8 @@ TESTS=(
     "ipv4_test"
     "icmp_test"
     "udp_test"
+    "page_cache_test"
+    "lfs_test"
 )
 
 # If argument provided, run specific test
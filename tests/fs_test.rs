@@ -9,7 +9,8 @@ extern crate alloc;
 use bootloader::{entry_point, BootInfo};
 use core::panic::PanicInfo;
 use rustrial_os::{allocator, memory, serial_print, serial_println};
-use rustrial_os::fs::{RamFs, FileSystem, VfsError};
+use rustrial_os::fs::{RamFs, FileSystem, VfsError, InitrdFs, MountFs};
+use rustrial_os::script_loader::INITRD;
 use x86_64::VirtAddr;
 
 entry_point!(main);
@@ -117,3 +118,165 @@ fn test_read_dir_on_file_fails() {
     assert!(dir_result.is_err());
     serial_println!("[ok]");
 }
+
+#[test_case]
+fn test_initrd_serves_in_place() {
+    serial_print!("fs::initrd_serves_in_place... ");
+    let fs = InitrdFs::new(INITRD).unwrap();
+    let data = fs.read_file_bytes("/fibonacci.rscript").unwrap();
+    assert!(!data.is_empty());
+    // The returned slice points into the archive image, not a heap copy
+    let image = INITRD.as_ptr_range();
+    assert!(image.contains(&data.as_ptr()));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_initrd_is_read_only() {
+    serial_print!("fs::initrd_is_read_only... ");
+    let mut fs = InitrdFs::new(INITRD).unwrap();
+    assert!(matches!(fs.create_file("/new.txt", b"x"), Err(VfsError::ReadOnly)));
+    assert!(matches!(fs.delete("/fibonacci.rscript"), Err(VfsError::ReadOnly)));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_mount_routes_paths() {
+    serial_print!("fs::mount_routes_paths... ");
+    let mut fs = MountFs::new(RamFs::new());
+    fs.create_file("/notes.txt", b"root").unwrap();
+    fs.mount("/scripts", alloc::boxed::Box::new(InitrdFs::new(INITRD).unwrap())).unwrap();
+    assert!(fs.is_dir("/scripts"));
+    assert!(fs.is_file("/scripts/fibonacci.rscript"));
+    let listing = fs.list_dir("/scripts").unwrap();
+    assert!(listing.iter().any(|p| p == "/scripts/fibonacci.rscript"));
+    assert!(fs.list_dir("/").unwrap().iter().any(|p| p == "/scripts"));
+    assert_eq!(&*fs.read_file_bytes("/notes.txt").unwrap(), b"root");
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_nested_directories() {
+    serial_print!("fs::nested_directories... ");
+    let mut fs = RamFs::new();
+    fs.create_dir("/home").unwrap();
+    fs.create_dir("/home/user").unwrap();
+    fs.create_file("/home/user/notes.txt", b"hi").unwrap();
+    assert!(matches!(fs.create_file("/missing/a.txt", b""), Err(VfsError::NotFound)));
+    assert_eq!(fs.list_dir("/").unwrap(), ["/home"]);
+    assert_eq!(fs.list_dir("/home/user/").unwrap(), ["/home/user/notes.txt"]);
+    fs.delete("/home").unwrap();
+    assert!(!fs.exists("/home/user/notes.txt"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_snapshot_is_isolated() {
+    serial_print!("fs::snapshot_is_isolated... ");
+    let mut fs = RamFs::new();
+    fs.create_dir("/etc").unwrap();
+    fs.create_file("/etc/motd", b"before").unwrap();
+    let snap = fs.snapshot();
+
+    fs.write_file("/etc/motd", b"after").unwrap();
+    fs.create_file("/etc/new", b"x").unwrap();
+    fs.delete("/etc").unwrap();
+
+    // The snapshot still reads the tree as it was
+    assert_eq!(&*snap.read_file_bytes("/etc/motd").unwrap(), b"before");
+    assert!(!snap.exists("/etc/new"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_snapshot_restore() {
+    serial_print!("fs::snapshot_restore... ");
+    let mut fs = RamFs::new();
+    let big = [b'x'; 3 * 4096 + 10];
+    fs.create_file("/log", &big).unwrap();
+    let snap = fs.snapshot();
+
+    fs.append_file("/log", b"more").unwrap();
+    fs.create_file("/junk", b"untrusted").unwrap();
+    assert_eq!(fs.read_file("/log").unwrap().len(), big.len() + 4);
+
+    fs.restore(&snap);
+    assert_eq!(fs.read_file("/log").unwrap(), big);
+    assert!(!fs.exists("/junk"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_rename_moves_subtree() {
+    serial_print!("fs::rename_moves_subtree... ");
+    let mut fs = RamFs::new();
+    fs.create_dir("/src").unwrap();
+    fs.create_file("/src/main.rs", b"fn main() {}").unwrap();
+    fs.create_dir("/dst").unwrap();
+    assert!(fs.is_file("/src/main.rs"));
+
+    fs.rename("/src", "/dst/app").unwrap();
+    assert!(!fs.exists("/src/main.rs"));
+    assert!(!fs.exists("/src"));
+    assert_eq!(fs.read_file("/dst/app/main.rs").unwrap(), b"fn main() {}");
+    assert!(matches!(fs.rename("/dst", "/dst/app/inner"), Err(VfsError::InvalidPath)));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_lookup_cache_invalidation() {
+    serial_print!("fs::lookup_cache_invalidation... ");
+    let mut fs = RamFs::new();
+    // Cache a negative lookup, then make it stale
+    assert!(!fs.exists("/tmp"));
+    fs.create_dir("/tmp").unwrap();
+    assert!(fs.is_dir("/tmp"));
+    // Cache a positive lookup, then make it stale
+    fs.delete("/tmp").unwrap();
+    assert!(!fs.exists("/tmp"));
+    fs.create_file("/tmp", b"now a file").unwrap();
+    assert!(fs.is_file("/tmp") && !fs.is_dir("/tmp"));
+    // Repeated walks are served from the cache
+    for _ in 0..4 {
+        assert!(fs.is_file("/tmp"));
+    }
+    let hits = fs.counters().iter().find(|(k, _)| k.contains("hits")).unwrap().1;
+    assert!(hits >= 4);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_path_resolve() {
+    serial_print!("fs::path_resolve... ");
+    use rustrial_os::fs::path::resolve;
+    assert_eq!(resolve("/home/user", "docs"), "/home/user/docs");
+    assert_eq!(resolve("/home/user", "../other/./x"), "/home/other/x");
+    assert_eq!(resolve("/home", "../.."), "/");
+    assert_eq!(resolve("/", "/etc//motd/"), "/etc/motd");
+    // Already-normal paths come back borrowed
+    assert!(matches!(resolve("/home", "/etc/motd"), alloc::borrow::Cow::Borrowed(_)));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_unused_names_are_released() {
+    serial_print!("fs::unused_names_are_released... ");
+    use rustrial_os::fs::path::{interned, sweep};
+    let mut fs = RamFs::new();
+    // Drop whatever earlier tests' trees left behind
+    sweep();
+    let before = interned();
+    fs.create_dir("/released-dir").unwrap();
+    for i in 0..20 {
+        let path = alloc::format!("/released-dir/file-{}", i);
+        fs.create_file(&path, b"x").unwrap();
+    }
+    fs.create_file("/released-file", b"x").unwrap();
+    fs.rename("/released-file", "/released-moved").unwrap();
+    assert_eq!(interned(), before + 22);
+
+    fs.delete("/released-moved").unwrap();
+    fs.delete("/released-dir").unwrap();
+    assert_eq!(interned(), before);
+    serial_println!("[ok]");
+}
@@ -0,0 +1,319 @@
+#![no_std]
+#![no_main]
+#![feature(custom_test_frameworks)]
+#![test_runner(rustrial_os::test_runner)]
+#![reexport_test_harness_main = "test_main"]
+
+extern crate alloc;
+
+use alloc::vec::Vec;
+use bootloader::{entry_point, BootInfo};
+use core::panic::PanicInfo;
+use rustrial_os::{allocator, memory, serial_print, serial_println};
+use rustrial_os::drivers::block::{ramdisk::RamDisk, BlockDevice, BlockError};
+use rustrial_os::fs::lfs::{Lfs, BLOCK_SIZE};
+use rustrial_os::fs::{FileSystem, VfsError};
+use x86_64::VirtAddr;
+
+entry_point!(main);
+
+fn main(boot_info: &'static BootInfo) -> ! {
+    rustrial_os::init();
+    let phys_mem_offset = VirtAddr::new(boot_info.physical_memory_offset);
+    let mut mapper = unsafe { memory::init(phys_mem_offset) };
+    let mut frame_allocator = unsafe {
+        memory::BootInfoFrameAllocator::init(&boot_info.memory_map)
+    };
+    allocator::init_heap(&mut mapper, &mut frame_allocator)
+        .expect("heap initialization failed");
+    test_main();
+    rustrial_os::hlt_loop();
+}
+
+#[panic_handler]
+fn panic(info: &PanicInfo) -> ! {
+    rustrial_os::test_panic_handler(info)
+}
+
+/// 1 MiB disk: 15 segments after the metadata blocks
+fn disk() -> RamDisk {
+    RamDisk::new(512, 2048)
+}
+
+/// RAM disk that loses power after a number of device writes
+///
+/// The write that crosses the limit is torn: only its first half lands.
+struct CrashDisk {
+    inner: RamDisk,
+    writes_left: usize,
+}
+
+impl BlockDevice for CrashDisk {
+    fn block_size(&self) -> usize {
+        self.inner.block_size()
+    }
+
+    fn block_count(&self) -> u64 {
+        self.inner.block_count()
+    }
+
+    fn read_blocks(&mut self, start: u64, buf: &mut [u8]) -> Result<(), BlockError> {
+        self.inner.read_blocks(start, buf)
+    }
+
+    fn write_blocks(&mut self, start: u64, buf: &[u8]) -> Result<(), BlockError> {
+        match self.writes_left {
+            0 => Ok(()),
+            1 => {
+                self.writes_left = 0;
+                let sectors = buf.len() / 512;
+                let keep = (sectors / 2).max(1) * 512;
+                self.inner.write_blocks(start, &buf[..keep.min(buf.len())])
+            }
+            _ => {
+                self.writes_left -= 1;
+                self.inner.write_blocks(start, buf)
+            }
+        }
+    }
+
+    fn flush(&mut self) -> Result<(), BlockError> {
+        Ok(())
+    }
+
+    fn device_name(&self) -> &str {
+        "crash0"
+    }
+}
+
+fn record(i: usize) -> [u8; 100] {
+    let mut r = [b'.'; 100];
+    r[..8].copy_from_slice(&(i as u64).to_le_bytes());
+    r[99] = b'\n';
+    r
+}
+
+#[test_case]
+fn test_roundtrip() {
+    serial_print!("lfs::roundtrip... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_dir("/logs").unwrap();
+    fs.create_file("/logs/a.txt", b"hello").unwrap();
+    fs.append_file("/logs/a.txt", b" world").unwrap();
+    assert_eq!(fs.read_file("/logs/a.txt").unwrap(), b"hello world");
+    assert!(fs.is_dir("/logs"));
+    assert_eq!(fs.list_dir("/logs").unwrap(), ["/logs/a.txt"]);
+    fs.delete("/logs/a.txt").unwrap();
+    assert!(!fs.exists("/logs/a.txt"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_survives_remount() {
+    serial_print!("lfs::survives_remount... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    let data: Vec<u8> = (0..3 * BLOCK_SIZE + 17).map(|i| i as u8).collect();
+    fs.create_file("/capture.bin", &data).unwrap();
+    fs.sync().unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/capture.bin").unwrap(), data);
+    // Synced but never checkpointed: recovered by roll-forward
+    assert!(fs.stats().rolled_forward > 0);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_unsynced_writes_are_dropped() {
+    serial_print!("lfs::unsynced_writes_are_dropped... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_file("/kept", b"synced").unwrap();
+    fs.sync().unwrap();
+    fs.create_file("/lost", b"never synced").unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/kept").unwrap(), b"synced");
+    assert!(!fs.exists("/lost"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_crash_at_every_write() {
+    serial_print!("lfs::crash_at_every_write... ");
+    const ROUNDS: usize = 12;
+    const PER_ROUND: usize = 50;
+
+    let mut cut = 1;
+    loop {
+        let fs = Lfs::format(disk()).unwrap();
+        let dev = CrashDisk { inner: fs.into_device(), writes_left: cut };
+        let mut fs = Lfs::mount(dev).unwrap();
+
+        // Append records, syncing after each round
+        let mut durable = 0;
+        let mut expected = Vec::new();
+        for round in 0..ROUNDS {
+            for i in 0..PER_ROUND {
+                expected.extend_from_slice(&record(round * PER_ROUND + i));
+            }
+            let start = expected.len() - PER_ROUND * 100;
+            fs.append_file("/log", &expected[start..]).unwrap();
+            fs.sync().unwrap();
+            if fs.with_device(|d| d.writes_left) > 0 {
+                durable = expected.len();
+            }
+        }
+        let survived = fs.with_device(|d| d.writes_left) > 0;
+
+        let fs = Lfs::mount(fs.into_device().inner).unwrap();
+        let log = fs.read_file("/log").unwrap_or_default();
+        // Everything synced before the power cut is there, intact
+        assert!(log.len() >= durable);
+        assert_eq!(&log[..], &expected[..log.len()]);
+
+        if survived {
+            break;
+        }
+        cut += 1;
+    }
+    serial_println!("[ok] ({} crash points)", cut);
+}
+
+#[test_case]
+fn test_cleaner_reclaims_segments() {
+    serial_print!("lfs::cleaner_reclaims_segments... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    // Rewrite far more data than the disk holds, leaving a few live
+    // blocks behind in most segments so they never die on their own
+    let mut content = [0u8; 8 * BLOCK_SIZE];
+    for round in 0..100u8 {
+        content.fill(round);
+        fs.write_file("/churn", &content).unwrap();
+        if round % 3 == 0 {
+            let path = alloc::format!("/keep{}", round);
+            fs.create_file(&path, &[round; BLOCK_SIZE]).unwrap();
+        }
+        fs.sync().unwrap();
+    }
+    assert!(fs.stats().segments_cleaned > 0);
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/churn").unwrap(), [99u8; 8 * BLOCK_SIZE]);
+    for round in (0..100u8).step_by(3) {
+        let path = alloc::format!("/keep{}", round);
+        assert_eq!(fs.read_file(&path).unwrap(), [round; BLOCK_SIZE]);
+    }
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_unformatted_disk_is_rejected() {
+    serial_print!("lfs::unformatted_disk_is_rejected... ");
+    assert!(matches!(Lfs::mount(disk()), Err(VfsError::Corrupted)));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_small_appends_share_a_block() {
+    serial_print!("lfs::small_appends_share_a_block... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_file("/log", b"").unwrap();
+    fs.sync().unwrap();
+    let before = fs.stats().blocks_written;
+    for i in 0..40 {
+        fs.append_file("/log", &record(i)).unwrap();
+    }
+    fs.sync().unwrap();
+    // One data block, the inode and a summary, not a block per append
+    assert!(fs.stats().blocks_written - before <= 4);
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    let log = fs.read_file("/log").unwrap();
+    assert_eq!(log.len(), 40 * 100);
+    assert_eq!(&log[39 * 100..], &record(39)[..]);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_rereads_come_from_cache() {
+    serial_print!("lfs::rereads_come_from_cache... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    let data: Vec<u8> = (0..8 * BLOCK_SIZE).map(|i| (i / 7) as u8).collect();
+    fs.create_file("/data.bin", &data).unwrap();
+    fs.sync().unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/data.bin").unwrap(), data);
+    let reads = fs.with_device(|d| d.reads);
+    assert_eq!(fs.read_file("/data.bin").unwrap(), data);
+    assert_eq!(fs.with_device(|d| d.reads), reads);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_entries_need_a_parent_directory() {
+    serial_print!("lfs::entries_need_a_parent_directory... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_file("/file", b"x").unwrap();
+    assert!(matches!(fs.create_file("/missing/a", b""), Err(VfsError::NotFound)));
+    assert!(matches!(fs.create_dir("/file/sub"), Err(VfsError::NotADirectory)));
+    assert!(matches!(fs.write_file("/missing/b", b""), Err(VfsError::NotFound)));
+    assert!(matches!(fs.rename("/file", "/missing/file"), Err(VfsError::NotFound)));
+    assert!(matches!(fs.rename("/file", "/file/inside"), Err(VfsError::InvalidPath)));
+    fs.create_dir("/dir").unwrap();
+    fs.rename("/file", "/dir/file").unwrap();
+    assert_eq!(fs.read_file("/dir/file").unwrap(), b"x");
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_deleting_a_directory_deletes_its_contents() {
+    serial_print!("lfs::deleting_a_directory_deletes_its_contents... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_dir("/d").unwrap();
+    fs.create_dir("/d/e").unwrap();
+    fs.create_file("/d/e/f", &[7; BLOCK_SIZE]).unwrap();
+    fs.create_file("/d2", b"sibling").unwrap();
+    fs.delete("/d").unwrap();
+    assert!(!fs.exists("/d/e") && !fs.exists("/d/e/f"));
+    // A new directory of the same name starts empty
+    fs.create_dir("/d").unwrap();
+    assert!(fs.list_dir("/d").unwrap().is_empty());
+    fs.sync().unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert!(!fs.exists("/d/e/f"));
+    assert_eq!(fs.read_file("/d2").unwrap(), b"sibling");
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_write_back_logs_dirty_pages() {
+    serial_print!("lfs::write_back_logs_dirty_pages... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    fs.create_file("/a", &[3; 2 * BLOCK_SIZE]).unwrap();
+    let before = fs.stats().blocks_written;
+    assert_eq!(fs.write_back(usize::MAX).unwrap(), 2);
+    assert_eq!(fs.stats().blocks_written - before, 3);
+    assert_eq!(fs.write_back(usize::MAX).unwrap(), 0);
+    fs.sync().unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/a").unwrap(), [3; 2 * BLOCK_SIZE]);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_files_larger_than_the_cache() {
+    serial_print!("lfs::files_larger_than_the_cache... ");
+    let mut fs = Lfs::format(disk()).unwrap();
+    let data: Vec<u8> = (0..80 * BLOCK_SIZE).map(|i| (i / BLOCK_SIZE) as u8).collect();
+    fs.create_file("/big", &data).unwrap();
+    assert!(rustrial_os::fs::page_cache::stats().resident <= rustrial_os::fs::page_cache::DEFAULT_CAPACITY);
+    assert_eq!(fs.read_file("/big").unwrap(), data);
+    fs.sync().unwrap();
+
+    let fs = Lfs::mount(fs.into_device()).unwrap();
+    assert_eq!(fs.read_file("/big").unwrap(), data);
+    serial_println!("[ok]");
+}
@@ -0,0 +1,187 @@
+#![no_std]
+#![no_main]
+#![feature(custom_test_frameworks)]
+#![test_runner(rustrial_os::test_runner)]
+#![reexport_test_harness_main = "test_main"]
+
+extern crate alloc;
+
+use bootloader::{entry_point, BootInfo};
+use core::panic::PanicInfo;
+use rustrial_os::{allocator, memory, serial_print, serial_println};
+use rustrial_os::drivers::block::{ramdisk::RamDisk, BlockDevice, BlockError};
+use rustrial_os::fs::page_cache::{InodeId, PageCache, PageMap, PAGE_SIZE};
+use x86_64::VirtAddr;
+
+entry_point!(main);
+
+fn main(boot_info: &'static BootInfo) -> ! {
+    rustrial_os::init();
+    let phys_mem_offset = VirtAddr::new(boot_info.physical_memory_offset);
+    let mut mapper = unsafe { memory::init(phys_mem_offset) };
+    let mut frame_allocator = unsafe {
+        memory::BootInfoFrameAllocator::init(&boot_info.memory_map)
+    };
+    allocator::init_heap(&mut mapper, &mut frame_allocator)
+        .expect("heap initialization failed");
+    test_main();
+    rustrial_os::hlt_loop();
+}
+
+#[panic_handler]
+fn panic(info: &PanicInfo) -> ! {
+    rustrial_os::test_panic_handler(info)
+}
+
+/// One file laid out contiguously from block 0, 8 sectors per page
+struct Linear;
+
+impl PageMap for Linear {
+    fn page_block(&self, _inode: InodeId, index: u64) -> Option<u64> {
+        if index < 32 { Some(index * 8) } else { None }
+    }
+}
+
+fn disk() -> RamDisk {
+    RamDisk::new(512, 32 * 8)
+}
+
+#[test_case]
+fn test_write_then_read() {
+    serial_print!("page_cache::write_then_read... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(8);
+    cache.write(&mut dev, &Linear, 1, 0, 10, b"hello").unwrap();
+    let page = cache.read(&mut dev, &Linear, 1, 0).unwrap();
+    assert_eq!(&page[10..15], b"hello");
+    assert_eq!(cache.dirty_pages(), 1);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_sync_reaches_device() {
+    serial_print!("page_cache::sync_reaches_device... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(8);
+    cache.write(&mut dev, &Linear, 1, 2, 0, b"abc").unwrap();
+    assert_eq!(&dev.contents()[2 * PAGE_SIZE..2 * PAGE_SIZE + 3], &[0, 0, 0]);
+    cache.sync(&mut dev, 1..=1).unwrap();
+    assert_eq!(&dev.contents()[2 * PAGE_SIZE..2 * PAGE_SIZE + 3], b"abc");
+    assert_eq!(cache.dirty_pages(), 0);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_writeback_coalesces() {
+    serial_print!("page_cache::writeback_coalesces... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(16);
+    for index in 0..8u64 {
+        let buf = [index as u8; PAGE_SIZE];
+        cache.write(&mut dev, &Linear, 1, index, 0, &buf).unwrap();
+    }
+    // Full-page writes never read, and 8 adjacent pages go out as one command
+    assert_eq!(dev.reads, 0);
+    assert_eq!(cache.writeback(&mut dev, 1..=1, 32).unwrap(), 8);
+    assert_eq!(dev.writes, 1);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_sequential_readahead() {
+    serial_print!("page_cache::sequential_readahead... ");
+    let mut dev = disk();
+    for index in 0..20u64 {
+        let buf = [index as u8; PAGE_SIZE];
+        dev.write_blocks(index * 8, &buf).unwrap();
+    }
+    let mut cache = PageCache::new(8);
+    for index in 0..20u64 {
+        let page = cache.read(&mut dev, &Linear, 1, index).unwrap();
+        assert_eq!(page[0], index as u8);
+    }
+    let stats = cache.stats();
+    assert!(stats.readahead_hits > 0);
+    assert!(stats.resident <= 8);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_eviction_keeps_dirty_pages() {
+    serial_print!("page_cache::eviction_keeps_dirty_pages... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(4);
+    cache.write(&mut dev, &Linear, 1, 0, 0, b"dirty").unwrap();
+    for index in 1..4u64 {
+        cache.read(&mut dev, &Linear, 1, index).unwrap();
+    }
+    cache.evict(4);
+    assert_eq!(cache.dirty_pages(), 1);
+    let page = cache.read(&mut dev, &Linear, 1, 0).unwrap();
+    assert_eq!(&page[..5], b"dirty");
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_hole_reads_zero() {
+    serial_print!("page_cache::hole_reads_zero... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(4);
+    let page = cache.read(&mut dev, &Linear, 1, 40).unwrap();
+    assert!(page.iter().all(|&b| b == 0));
+    assert!(cache.write(&mut dev, &Linear, 1, 40, 0, b"x").is_err());
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_unplaced_pages_wait_for_their_filesystem() {
+    serial_print!("page_cache::unplaced_pages_wait_for_their_filesystem... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(8);
+    assert!(cache.write_unplaced(&mut dev, &Linear, 1, 3, 0, b"log").unwrap());
+    assert!(!cache.write_unplaced(&mut dev, &Linear, 1, 3, 3, b"ged").unwrap());
+    // In-place write-back leaves it alone
+    cache.sync(&mut dev, 1..=1).unwrap();
+    assert_eq!(&dev.contents()[3 * PAGE_SIZE..3 * PAGE_SIZE + 6], &[0; 6]);
+    assert_eq!(cache.dirty_in(1..=1), [(1, 3)]);
+    assert_eq!(&cache.page(1, 3).unwrap()[..6], b"logged");
+
+    cache.mark_clean(1, 3, 200);
+    assert_eq!(cache.dirty_pages(), 0);
+    assert!(cache.dirty_in(0..=u64::MAX).is_empty());
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_writeback_stays_on_its_volume() {
+    serial_print!("page_cache::writeback_stays_on_its_volume... ");
+    let mut dev = disk();
+    let mut cache = PageCache::new(8);
+    cache.write(&mut dev, &Linear, 1, 0, 0, b"mine").unwrap();
+    cache.write(&mut dev, &Linear, 1 << 32 | 1, 1, 0, b"other").unwrap();
+    assert_eq!(cache.writeback(&mut dev, 0..=u32::MAX as u64, 32).unwrap(), 1);
+    assert_eq!(&dev.contents()[..4], b"mine");
+    assert_eq!(&dev.contents()[PAGE_SIZE..PAGE_SIZE + 5], &[0; 5]);
+    assert_eq!(cache.dirty_pages(), 1);
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_full_of_unplaced_pages() {
+    serial_print!("page_cache::full_of_unplaced_pages... ");
+    let mut dev = disk();
+    dev.write_blocks(5 * 8, &[7; PAGE_SIZE]).unwrap();
+    let mut cache = PageCache::new(4);
+    for index in 0..4u64 {
+        cache.write_unplaced(&mut dev, &Linear, 1, index, 0, b"log").unwrap();
+    }
+    // No page can be written back or evicted, so the cache takes no more
+    assert_eq!(cache.write_unplaced(&mut dev, &Linear, 1, 4, 0, b"log"), Err(BlockError::CacheFull));
+    assert_eq!(cache.read(&mut dev, &Linear, 1, 5).unwrap()[0], 7);
+    assert_eq!(cache.resident(), 4);
+
+    cache.mark_clean(1, 0, 100);
+    assert!(cache.write_unplaced(&mut dev, &Linear, 1, 4, 0, b"log").unwrap());
+    assert_eq!(cache.resident(), 4);
+    serial_println!("[ok]");
+}
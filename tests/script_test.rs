@@ -0,0 +1,198 @@
+#![no_std]
+#![no_main]
+#![feature(custom_test_frameworks)]
+#![test_runner(rustrial_os::test_runner)]
+#![reexport_test_harness_main = "test_main"]
+
+extern crate alloc;
+
+use alloc::string::String;
+use alloc::vec::Vec;
+use bootloader::{entry_point, BootInfo};
+use core::panic::PanicInfo;
+use core::task::Poll;
+use rustrial_os::{allocator, memory, serial_print, serial_println};
+use rustrial_os::rustrial_script::{compile, jit, parser, Chunk, VirtualMachine};
+use rustrial_os::script_loader::{get_script_content, list_scripts};
+use x86_64::VirtAddr;
+
+entry_point!(main);
+
+fn main(boot_info: &'static BootInfo) -> ! {
+    rustrial_os::init();
+    let phys_mem_offset = VirtAddr::new(boot_info.physical_memory_offset);
+    let mut mapper = unsafe { memory::init(phys_mem_offset) };
+    let mut frame_allocator = unsafe {
+        memory::BootInfoFrameAllocator::init(&boot_info.memory_map)
+    };
+    allocator::init_heap(&mut mapper, &mut frame_allocator)
+        .expect("heap initialization failed");
+    test_main();
+    rustrial_os::hlt_loop();
+}
+
+#[panic_handler]
+fn panic(info: &PanicInfo) -> ! {
+    rustrial_os::test_panic_handler(info)
+}
+
+/// The example scripts bundled in the initrd
+fn examples() -> Vec<(String, &'static str)> {
+    list_scripts()
+        .into_iter()
+        .filter(|name| name.ends_with(".rscript"))
+        .map(|name| {
+            let source = core::str::from_utf8(get_script_content(&name).unwrap()).unwrap();
+            (name, source)
+        })
+        .collect()
+}
+
+/// Run `source` in the interpreter, unoptimized and optimized, and in
+/// native code when the JIT takes it; every run must end the same way.
+/// Returns whether the JIT compiled it.
+fn check_same(source: &str) -> bool {
+    let chunk = compile(source).unwrap();
+    let mut vm = VirtualMachine::quiet();
+    let expected = vm.execute(&chunk);
+
+    // Without the optimizer's rewrites and superinstructions
+    let plain = Chunk::assemble(&parser::parse(source).unwrap()).unwrap();
+    let mut plain_vm = VirtualMachine::quiet();
+    assert_eq!(plain_vm.execute(&plain), expected, "{}", source);
+    assert_eq!(plain_vm.locals(), vm.locals(), "{}", source);
+
+    // Without the `_INT` forms `specialize` chose
+    let generic = Chunk::new(chunk.generic_code(), chunk.constants().to_vec(), chunk.slots().to_vec()).unwrap();
+    assert_eq!(generic.code(), chunk.code(), "{}", source);
+
+    let Some(native) = jit::compile(&chunk) else {
+        return false;
+    };
+    let mut native_vm = VirtualMachine::quiet();
+    assert_eq!(native.run(&mut native_vm), expected, "{}", source);
+    assert_eq!(native_vm.locals(), vm.locals(), "{}", source);
+    // Native code charges a failing block in full, so only completed
+    // runs count the same
+    if expected.is_ok() {
+        assert_eq!(native_vm.executed(), vm.executed(), "{}", source);
+    }
+    true
+}
+
+/// Run `source` in slices of `budget` instructions in both engines
+fn check_resumed(source: &str, budget: u64) {
+    let chunk = compile(source).unwrap();
+    let mut full = VirtualMachine::quiet();
+    let expected = full.execute(&chunk);
+
+    let mut vm = VirtualMachine::quiet();
+    vm.start(&chunk);
+    let result = loop {
+        if let Poll::Ready(result) = vm.resume(&chunk, budget) {
+            break result;
+        }
+    };
+    assert_eq!(result, expected, "{} / {}", source, budget);
+    assert_eq!(vm.locals(), full.locals());
+    assert_eq!(vm.executed(), full.executed());
+
+    if let Some(native) = jit::compile(&chunk) {
+        let mut vm = VirtualMachine::quiet();
+        native.start(&mut vm);
+        let mut slices = 0u64;
+        let result = loop {
+            slices += 1;
+            if let Poll::Ready(result) = native.resume(&mut vm, budget) {
+                break result;
+            }
+        };
+        assert_eq!(result, expected, "{} / {}", source, budget);
+        assert_eq!(vm.locals(), full.locals());
+        if expected.is_ok() {
+            assert_eq!(vm.executed(), full.executed());
+        }
+        // Budgets are checked at loop heads, so long loops must yield
+        if full.executed() > 4 * budget.max(64) {
+            assert!(slices > 1, "{} / {}", source, budget);
+        }
+    }
+}
+
+#[test_case]
+fn test_examples_match_in_every_engine() {
+    serial_print!("script::examples_match_in_every_engine... ");
+    let examples = examples();
+    assert!(!examples.is_empty());
+    for (name, source) in &examples {
+        assert!(check_same(source), "{} not compiled", name);
+    }
+    serial_println!("[ok] ({} examples)", examples.len());
+}
+
+#[test_case]
+fn test_division_edge_cases() {
+    serial_print!("script::division_edge_cases... ");
+    // idiv faults on i32::MIN / -1; both engines wrap instead
+    let min = "let a = -2147483647 - 1; let b = -1; let q = a / b; let r = a % b; let n = -a;";
+    check_same(min);
+    let mut vm = VirtualMachine::quiet();
+    vm.execute(&compile(min).unwrap()).unwrap();
+    assert_eq!(vm.locals()[2], rustrial_os::rustrial_script::Value::Int(i32::MIN));
+
+    for source in [
+        "let a = 7; let b = -3; let q = a / b; let r = a % b;",
+        "let a = 1; let b = 0; let q = a / b;",
+        "let a = 1; let b = 0; let r = a % b;",
+        "let a = 5 % 0;",
+    ] {
+        check_same(source);
+    }
+    let mut vm = VirtualMachine::quiet();
+    assert_eq!(vm.execute(&compile("let a = 1; let b = 0; let r = a % b;").unwrap()), Err("Modulo by zero"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_undefined_variables() {
+    serial_print!("script::undefined_variables... ");
+    for source in [
+        "let x = y;",
+        "let i = 0; if (i > 0) { let k = 1; } let z = k;",
+        "let i = 0; if (i == 0) { let k = 1; } let z = k + 1;",
+        "let i = 0; while (i < 3) { if (i == 2) { j = j + 1; } let j = i; i = i + 1; }",
+    ] {
+        check_same(source);
+    }
+    let mut vm = VirtualMachine::quiet();
+    assert_eq!(vm.execute(&compile("let x = y;").unwrap()), Err("Undefined variable"));
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_mixed_int_bool_equality() {
+    serial_print!("script::mixed_int_bool_equality... ");
+    for source in [
+        "let h = (1 == (1 == 1)); let g = ((2 < 1) != 0);",
+        "let t = (1 == 1); let f = (2 < 1); let e = (t == f); let g = (t != (3 > 2));",
+        "let b = (1 == 1); let c = b + 1;",
+        "let a = 1; if (a < (1 == 1)) { a = 2; }",
+    ] {
+        check_same(source);
+    }
+    serial_println!("[ok]");
+}
+
+#[test_case]
+fn test_resuming_with_small_budgets() {
+    serial_print!("script::resuming_with_small_budgets... ");
+    let mut sources: Vec<&str> = examples().into_iter().map(|(_, source)| source).collect();
+    sources.push("let i = 0; while (i < 1000) { i = i + 3; if (i % 7 == 0) { i = i - 1; } }");
+    sources.push("let i = 0; while (i < 50) { i = i + 1; } let z = i / 0;");
+    for source in sources {
+        for budget in [1, 2, 7, 64] {
+            check_resumed(source, budget);
+        }
+    }
+    serial_println!("[ok]");
+}
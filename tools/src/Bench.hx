@@ -0,0 +1,159 @@
+package tools.src;
+
+import haxe.io.Path;
+import sys.FileSystem;
+import sys.io.File;
+import StringTools;
+
+// Host-side benchmark of the example scripts: compiles each one with and
+// without the optimizer, runs both on the reference interpreter and reports
+// code size and instructions executed. The two runs must agree on output,
+// variables and errors. With --check the optimized counts are compared to
+// the committed baseline, so an optimizer change that makes any example run
+// more instructions fails without booting the kernel.
+class Bench {
+    // Instructions after which a script counts as stuck
+    static inline var LIMIT = 100000000;
+    static inline var BASELINE = "bench_baseline.txt";
+
+    public static function main():Void {
+        var args = Sys.args().filter(function(arg) return arg != "--");
+        var check = false;
+        var update = false;
+        var only = new Array<String>();
+        for (arg in args) {
+            switch (arg) {
+                case "--check": check = true;
+                case "--update": update = true;
+                default:
+                    if (StringTools.startsWith(arg, "--")) {
+                        Sys.println("Bench: unknown argument '" + arg + "'");
+                        Sys.exit(1);
+                    }
+                    only.push(StringTools.endsWith(arg, ".rscript") ? arg : arg + ".rscript");
+            }
+        }
+
+        var examplesDir = findDir(["src", "rustrial_script", "examples"]);
+        var toolsDir = findDir(["tools"]);
+        if (examplesDir == null || toolsDir == null) {
+            Sys.println("Bench: run from the repository root");
+            Sys.exit(1);
+        }
+        var files = FileSystem.readDirectory(examplesDir)
+            .filter(function(name) return StringTools.endsWith(name, ".rscript"))
+            .filter(function(name) return only.length == 0 || only.indexOf(name) >= 0);
+        files.sort(Reflect.compare);
+
+        var baselinePath = Path.join([toolsDir, BASELINE]);
+        var baseline = check ? readBaseline(baselinePath) : new Map<String, Int>();
+        var counts = new Array<String>();
+        var failures = 0;
+
+        Sys.println(pad("SCRIPT", -20) + pad("BYTES", 7) + pad("OPT", 7)
+            + pad("INSTRUCTIONS", 14) + pad("OPT", 12) + pad("SAVED", 8));
+        for (file in files) {
+            var source = File.getContent(Path.join([examplesDir, file]));
+            var plain:Interpreter.RunResult = null;
+            var optimized:Interpreter.RunResult = null;
+            var plainSize = 0;
+            var optimizedSize = 0;
+            try {
+                var plainChunk = Compiler.compile(source, false);
+                var optimizedChunk = Compiler.compile(source, true);
+                plainSize = plainChunk.code.length;
+                optimizedSize = optimizedChunk.code.length;
+                plain = Interpreter.run(plainChunk, LIMIT);
+                optimized = Interpreter.run(optimizedChunk, LIMIT);
+            } catch (e) {
+                Sys.println(file + ": " + Std.string(e));
+                failures++;
+                continue;
+            }
+
+            var saved = plain.executed == 0 ? 0.0 : 100 * (1 - optimized.executed / plain.executed);
+            Sys.println(pad(file, -20) + pad(plainSize, 7) + pad(optimizedSize, 7)
+                + pad(plain.executed, 14) + pad(optimized.executed, 12)
+                + pad(Std.string(Math.round(saved * 10) / 10) + "%", 8));
+            counts.push(file + " " + optimized.executed);
+
+            var mismatch = sameRun(plain, optimized);
+            if (mismatch != null) {
+                Sys.println("  " + file + ": optimized code " + mismatch);
+                failures++;
+            }
+            if (optimized.error == "Instruction limit reached") {
+                Sys.println("  " + file + ": did not finish in " + LIMIT + " instructions");
+                failures++;
+            }
+            if (check) {
+                var expected = baseline.get(file);
+                if (expected == null) {
+                    Sys.println("  " + file + ": not in " + BASELINE);
+                } else if (optimized.executed > expected) {
+                    Sys.println("  " + file + ": regressed from " + expected + " to " + optimized.executed + " instructions");
+                    failures++;
+                } else if (optimized.executed < expected) {
+                    Sys.println("  " + file + ": improved from " + expected + " instructions; run with --update");
+                }
+            }
+        }
+
+        if (update && failures == 0) {
+            File.saveContent(baselinePath, "# Instructions each example executes once optimized; see tools/bench.hxml\n"
+                + counts.join("\n") + "\n");
+            Sys.println("Bench: wrote " + baselinePath);
+        }
+        if (failures > 0) {
+            Sys.exit(1);
+        }
+    }
+
+    // How two runs of the same script differ, or null if they don't
+    static function sameRun(a:Interpreter.RunResult, b:Interpreter.RunResult):String {
+        if (a.error != b.error) {
+            return "fails with '" + b.error + "' instead of '" + a.error + "'";
+        }
+        if (a.output.join("\n") != b.output.join("\n")) {
+            return "prints different output";
+        }
+        if (a.locals.join(",") != b.locals.join(",")) {
+            return "leaves different variables";
+        }
+        return null;
+    }
+
+    static function readBaseline(path:String):Map<String, Int> {
+        var baseline = new Map<String, Int>();
+        if (!FileSystem.exists(path)) {
+            Sys.println("Bench: " + path + " not found; create it with --update");
+            Sys.exit(1);
+        }
+        for (line in File.getContent(path).split("\n")) {
+            var trimmed = StringTools.trim(line);
+            if (trimmed.length == 0 || StringTools.startsWith(trimmed, "#")) {
+                continue;
+            }
+            var fields = trimmed.split(" ");
+            baseline.set(fields[0], Std.parseInt(fields[1]));
+        }
+        return baseline;
+    }
+
+    // Right-align `value` in `width` columns, or left-align for a negative width
+    static function pad(value:Dynamic, width:Int):String {
+        var text = Std.string(value);
+        return width < 0 ? StringTools.rpad(text, " ", -width) : StringTools.lpad(text, " ", width);
+    }
+
+    static function findDir(parts:Array<String>):String {
+        var cwd = Sys.getCwd();
+        for (base in [cwd, Path.join([cwd, ".."])]) {
+            var path = Path.normalize(Path.join([base].concat(parts)));
+            if (FileSystem.exists(path) && FileSystem.isDirectory(path)) {
+                return path;
+            }
+        }
+        return null;
+    }
+}
@@ -0,0 +1,450 @@
+package tools.src;
+
+import haxe.Int32;
+import haxe.Int64;
+import haxe.io.Bytes;
+import haxe.io.BytesBuffer;
+import tools.src.Parser.OpCode;
+
+// An assembled program, as `Chunk` holds it in bytecode.rs
+typedef CompiledChunk = {
+    var code: Bytes;
+    var constants: Array<Int>;
+    var slots: Array<String>;
+}
+
+// Instructions after peephole optimization (mirrors Rust's extra OpCodes)
+enum Instr {
+    IOp(op:OpCode);
+    IIncrementSlot(slot:Int, n:Int);
+    IJumpUnless(comparison:OpCode, target:Int);
+}
+
+// Compiles scripts to `.rsc` images, mirroring the Rust optimizer.rs,
+// bytecode.rs assembler and image.rs encoder byte for byte. The kernel
+// verifies every image it loads, so this needs no verifier of its own.
+class Compiler {
+    public static inline var FORMAT_VERSION = 1;
+    static inline var WINDOW = 4;
+    static inline var TAG_INT = 0;
+
+    // Opcode bytes, as in bytecode.rs
+    public static inline var CONSTANT = 0;
+    public static inline var LOAD_SLOT = 1;
+    public static inline var STORE_SLOT = 2;
+    public static inline var ADD = 3;
+    public static inline var SUBTRACT = 4;
+    public static inline var MULTIPLY = 5;
+    public static inline var DIVIDE = 6;
+    public static inline var MODULO = 7;
+    public static inline var NEGATE = 8;
+    public static inline var EQUAL = 9;
+    public static inline var NOT_EQUAL = 10;
+    public static inline var LESS = 11;
+    public static inline var GREATER = 12;
+    public static inline var LESS_EQUAL = 13;
+    public static inline var GREATER_EQUAL = 14;
+    public static inline var JUMP = 15;
+    public static inline var JUMP_IF_FALSE = 16;
+    public static inline var PRINT = 17;
+    public static inline var CLEAR = 18;
+    public static inline var POP = 19;
+    public static inline var HALT = 20;
+    public static inline var INCREMENT_SLOT = 21;
+    public static inline var JUMP_UNLESS_EQUAL = 22;
+    public static inline var JUMP_UNLESS_NOT_EQUAL = 23;
+    public static inline var JUMP_UNLESS_LESS = 24;
+    public static inline var JUMP_UNLESS_GREATER = 25;
+    public static inline var JUMP_UNLESS_LESS_EQUAL = 26;
+    public static inline var JUMP_UNLESS_GREATER_EQUAL = 27;
+
+    // Compile a script's source (read as bytes, for the header hash) to an image
+    public static function compileImage(source:Bytes):Bytes {
+        var chunk = compile(source.toString(), true);
+        return encode(chunk.code, chunk.constants, chunk.slots, source);
+    }
+
+    // Compile a script's source to a chunk, as the kernel's `compile` does;
+    // without `optimized` the parser's code is assembled as is
+    public static function compile(source:String, optimized:Bool):CompiledChunk {
+        var parsed = Parser.parseWithSlots(Lexer.tokenize(source));
+        var code = optimized ? optimize(parsed.code) : [for (op in parsed.code) IOp(op)];
+        var asm = assemble(code);
+        return { code: asm.code, constants: asm.constants, slots: parsed.slots };
+    }
+
+    // Image file name for a script file name
+    public static function imageName(script:String):String {
+        var stem = StringTools.endsWith(script, ".rscript")
+            ? script.substr(0, script.length - ".rscript".length)
+            : script;
+        return stem + ".rsc";
+    }
+
+    // FNV-1a over the source bytes
+    public static function sourceHash(source:Bytes):Int64 {
+        var hash = Int64.make(0xcbf29ce4, 0x84222325);
+        var prime = Int64.make(0x00000100, 0x000001b3);
+        for (i in 0...source.length) {
+            hash = Int64.xor(hash, Int64.ofInt(source.get(i)));
+            hash = hash * prime;
+        }
+        return hash;
+    }
+
+    // --- optimizer.rs ---------------------------------------------------
+
+    public static function optimize(ops:Array<OpCode>):Array<Instr> {
+        var code = [for (op in ops) IOp(op)];
+        while (true) {
+            var result = pass(code);
+            code = result.code;
+            if (!result.changed) {
+                return code;
+            }
+        }
+    }
+
+    static function fold(op:OpCode, a:Int, b:Int):Null<Int> {
+        var x:Int32 = a;
+        var y:Int32 = b;
+        return switch (op) {
+            case OAdd: (x + y : Int);
+            case OSubtract: (x - y : Int);
+            case OMultiply: (x * y : Int);
+            case ODivide if (b != 0): wrappingDiv(a, b);
+            case OModulo if (b != 0): b == -1 ? 0 : a % b;
+            default: null;
+        };
+    }
+
+    public static function wrappingDiv(a:Int, b:Int):Int {
+        if (a == 0x80000000 && b == -1) {
+            return a;
+        }
+        return Std.int(a / b);
+    }
+
+    public static function negate(a:Int):Int {
+        var x:Int32 = a;
+        return -x;
+    }
+
+    static function isComparison(op:OpCode):Bool {
+        return switch (op) {
+            case OEqual | ONotEqual | OLess | OGreater | OLessEqual | OGreaterEqual: true;
+            default: false;
+        };
+    }
+
+    static function compare(op:OpCode, a:Int, b:Int):Bool {
+        return switch (op) {
+            case OEqual: a == b;
+            case ONotEqual: a != b;
+            case OLess: a < b;
+            case OGreater: a > b;
+            case OLessEqual: a <= b;
+            case OGreaterEqual: a >= b;
+            default: false;
+        };
+    }
+
+    static function constantAt(window:Array<Instr>, i:Int):Null<Int> {
+        if (i >= window.length) {
+            return null;
+        }
+        return switch (window[i]) {
+            case IOp(OConstant(n)): n;
+            default: null;
+        };
+    }
+
+    static function opAt(window:Array<Instr>, i:Int):OpCode {
+        if (i >= window.length) {
+            return null;
+        }
+        return switch (window[i]) {
+            case IOp(op): op;
+            default: null;
+        };
+    }
+
+    static function slotAt(window:Array<Instr>, i:Int, store:Bool):Null<Int> {
+        var op = opAt(window, i);
+        if (op == null) {
+            return null;
+        }
+        return switch (op) {
+            case OLoadSlot(s) if (!store): s;
+            case OStoreSlot(s) if (store): s;
+            default: null;
+        };
+    }
+
+    static function jumpIfFalseAt(window:Array<Instr>, i:Int):Null<Int> {
+        var op = opAt(window, i);
+        if (op == null) {
+            return null;
+        }
+        return switch (op) {
+            case OJumpIfFalse(t): t;
+            default: null;
+        };
+    }
+
+    // Rewrite at the start of `window` as (instructions replaced, replacement),
+    // or null to keep it; rules are tried in the same order as in Rust
+    static function rewrite(window:Array<Instr>, next:Int):{ n:Int, ops:Array<Instr> } {
+        var c0 = constantAt(window, 0);
+        var c1 = constantAt(window, 1);
+        var op1 = opAt(window, 1);
+        var op2 = opAt(window, 2);
+
+        if (c0 != null && c1 != null && op2 != null && fold(op2, c0, c1) != null) {
+            return { n: 3, ops: [IOp(OConstant(fold(op2, c0, c1)))] };
+        }
+        if (c0 != null && op1 != null && op1.match(ONegate)) {
+            return { n: 2, ops: [IOp(OConstant(negate(c0)))] };
+        }
+        var t3 = jumpIfFalseAt(window, 3);
+        if (c0 != null && c1 != null && op2 != null && isComparison(op2) && t3 != null) {
+            var taken = !compare(op2, c0, c1);
+            return { n: 4, ops: taken ? [IOp(OJump(t3))] : [] };
+        }
+        var t1 = jumpIfFalseAt(window, 1);
+        if (c0 != null && t1 != null) {
+            return { n: 2, ops: c0 == 0 ? [IOp(OJump(t1))] : [] };
+        }
+        if (c0 != null && op1 != null && op1.match(OPop)) {
+            return { n: 2, ops: [] };
+        }
+        var store = slotAt(window, 3, true);
+        if (store != null && op2 != null) {
+            var load = slotAt(window, 0, false);
+            if (load == store && c1 != null && op2.match(OAdd)) {
+                return { n: 4, ops: [IIncrementSlot(store, c1)] };
+            }
+            if (c0 != null && slotAt(window, 1, false) == store && op2.match(OAdd)) {
+                return { n: 4, ops: [IIncrementSlot(store, c0)] };
+            }
+            if (load == store && c1 != null && op2.match(OSubtract)) {
+                return { n: 4, ops: [IIncrementSlot(store, negate(c1))] };
+            }
+        }
+        var op0 = opAt(window, 0);
+        if (op0 != null && isComparison(op0) && t1 != null) {
+            return { n: 2, ops: [IJumpUnless(op0, t1)] };
+        }
+        if (op0 != null) {
+            switch (op0) {
+                case OJump(t) if (t == next): return { n: 1, ops: [] };
+                default:
+            }
+        }
+        return null;
+    }
+
+    static function target(instr:Instr):Null<Int> {
+        return switch (instr) {
+            case IOp(OJump(t)) | IOp(OJumpIfFalse(t)) | IJumpUnless(_, t): t;
+            default: null;
+        };
+    }
+
+    static function retarget(instr:Instr, map:Array<Int>):Instr {
+        return switch (instr) {
+            case IOp(OJump(t)): IOp(OJump(map[t]));
+            case IOp(OJumpIfFalse(t)): IOp(OJumpIfFalse(map[t]));
+            case IJumpUnless(cmp, t): IJumpUnless(cmp, map[t]);
+            default: instr;
+        };
+    }
+
+    static function pass(code:Array<Instr>):{ code:Array<Instr>, changed:Bool } {
+        var len = code.length;
+        var isTarget = [for (_ in 0...len + 1) false];
+        for (instr in code) {
+            var t = target(instr);
+            if (t != null) {
+                isTarget[t] = true;
+            }
+        }
+
+        // New index of each old instruction; removed ones map to whatever follows
+        var map = [for (_ in 0...len + 1) 0];
+        var out = new Array<Instr>();
+        var changed = false;
+        var i = 0;
+        while (i < len) {
+            var free = 1;
+            var limit = len < i + WINDOW ? len : i + WINDOW;
+            var j = i + 1;
+            while (j < limit && !isTarget[j]) {
+                free++;
+                j++;
+            }
+            var result = rewrite(code.slice(i, i + free), i + 1);
+            if (result != null) {
+                for (k in i...i + result.n) {
+                    map[k] = out.length;
+                }
+                for (op in result.ops) {
+                    out.push(op);
+                }
+                i += result.n;
+                changed = true;
+            } else {
+                map[i] = out.length;
+                out.push(code[i]);
+                i++;
+                // Code after an unconditional jump is dead until the next target
+                if (code[i - 1].match(IOp(OJump(_)))) {
+                    while (i < len && !isTarget[i]) {
+                        map[i] = out.length;
+                        i++;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        map[len] = out.length;
+
+        return { code: [for (instr in out) retarget(instr, map)], changed: changed };
+    }
+
+    // --- bytecode.rs assembler ------------------------------------------
+
+    static function encodedLen(instr:Instr):Int {
+        return switch (instr) {
+            case IIncrementSlot(_, _): 5;
+            case IJumpUnless(_, _): 3;
+            case IOp(OConstant(_) | OLoadSlot(_) | OStoreSlot(_) | OJump(_) | OJumpIfFalse(_)): 3;
+            case IOp(_): 1;
+        };
+    }
+
+    static function simpleOpcode(op:OpCode):Int {
+        return switch (op) {
+            case OAdd: ADD;
+            case OSubtract: SUBTRACT;
+            case OMultiply: MULTIPLY;
+            case ODivide: DIVIDE;
+            case OModulo: MODULO;
+            case ONegate: NEGATE;
+            case OEqual: EQUAL;
+            case ONotEqual: NOT_EQUAL;
+            case OLess: LESS;
+            case OGreater: GREATER;
+            case OLessEqual: LESS_EQUAL;
+            case OGreaterEqual: GREATER_EQUAL;
+            case OPrint: PRINT;
+            case OClear: CLEAR;
+            case OPop: POP;
+            default: throw "Operand-carrying opcode " + Std.string(op);
+        };
+    }
+
+    static function jumpUnless(comparison:OpCode):Int {
+        return JUMP_UNLESS_EQUAL + switch (comparison) {
+            case OEqual: 0;
+            case ONotEqual: 1;
+            case OLess: 2;
+            case OGreater: 3;
+            case OLessEqual: 4;
+            case OGreaterEqual: 5;
+            default: throw "Not a comparison";
+        };
+    }
+
+    public static function assemble(code:Array<Instr>):{ code:Bytes, constants:Array<Int> } {
+        var offsets = new Array<Int>();
+        var len = 0;
+        for (instr in code) {
+            offsets.push(len);
+            len += encodedLen(instr);
+        }
+        offsets.push(len);
+        if (len >= 0xFFFF) {
+            throw "Program too large";
+        }
+
+        var out = new BytesBuffer();
+        var constants = new Array<Int>();
+        function u16(value:Int):Void {
+            out.addByte(value & 0xFF);
+            out.addByte((value >> 8) & 0xFF);
+        }
+        function constant(n:Int):Int {
+            var index = constants.indexOf(n);
+            if (index < 0) {
+                constants.push(n);
+                index = constants.length - 1;
+            }
+            if (index > 0xFFFF) {
+                throw "Too many constants";
+            }
+            return index;
+        }
+        function emit(opcode:Int, arg:Int):Void {
+            out.addByte(opcode);
+            u16(arg);
+        }
+        function jumpTarget(t:Int):Int {
+            if (t < 0 || t >= offsets.length) {
+                throw "Jump out of range";
+            }
+            return offsets[t];
+        }
+
+        for (instr in code) {
+            switch (instr) {
+                case IOp(OConstant(n)): emit(CONSTANT, constant(n));
+                case IIncrementSlot(slot, n):
+                    var index = constant(n);
+                    emit(INCREMENT_SLOT, slot);
+                    u16(index);
+                case IOp(OLoadSlot(slot)): emit(LOAD_SLOT, slot);
+                case IOp(OStoreSlot(slot)): emit(STORE_SLOT, slot);
+                case IOp(OJump(t)): emit(JUMP, jumpTarget(t));
+                case IOp(OJumpIfFalse(t)): emit(JUMP_IF_FALSE, jumpTarget(t));
+                case IJumpUnless(cmp, t): emit(jumpUnless(cmp), jumpTarget(t));
+                case IOp(op): out.addByte(simpleOpcode(op));
+            }
+        }
+        out.addByte(HALT);
+        return { code: out.getBytes(), constants: constants };
+    }
+
+    // --- image.rs encoder -----------------------------------------------
+
+    public static function encode(code:Bytes, constants:Array<Int>, slots:Array<String>, source:Bytes):Bytes {
+        var out = new BytesBuffer();
+        function u16(value:Int):Void {
+            out.addByte(value & 0xFF);
+            out.addByte((value >> 8) & 0xFF);
+        }
+
+        out.addString("RSC");
+        out.addByte(0);
+        u16(FORMAT_VERSION);
+        out.addInt32(source.length);
+        out.addInt64(sourceHash(source));
+
+        out.addInt32(code.length);
+        out.addBytes(code, 0, code.length);
+
+        u16(constants.length);
+        for (n in constants) {
+            out.addByte(TAG_INT);
+            out.addInt32(n);
+        }
+
+        u16(slots.length);
+        for (name in slots) {
+            var bytes = Bytes.ofString(name);
+            u16(bytes.length);
+            out.addBytes(bytes, 0, bytes.length);
+        }
+        return out.getBytes();
+    }
+}
@@ -1,6 +1,7 @@
 package tools.src;
 
 import haxe.ui.HaxeUIApp;
+import haxe.ui.components.Button;
 import haxe.ui.components.Label;
 import haxe.ui.components.TextArea;
 import haxe.ui.containers.HBox;
@@ -10,8 +11,21 @@ import haxe.ui.events.KeyboardEvent;
 import haxe.ui.events.UIEvent;
 import haxe.ui.events.MouseEvent;
 import js.Browser;
+import js.html.FileReader;
 import tools.src.Parser.OpCode;
 
+typedef LineProfile = { line:Int, count:Float, cycles:Float };
+
+/** A profile exported by the shell's `run --profile` */
+typedef ScriptProfile = {
+    script:String,
+    instructions:Float,
+    cycles:Float,
+    lines:Array<LineProfile>,
+    ops:Array<{name:String, count:Float, cycles:Float}>,
+    source:String
+};
+
 class Inspector {
     static var sourceArea:TextArea;
     static var status:Label;
@@ -25,6 +39,9 @@ class Inspector {
     static var overlayInitAttempts:Int = 0;
     static var currentOps:Array<{op:OpCode, line:Int}> = [];
     static var arrowDiv:Dynamic = null;
+    static var profile:ScriptProfile = null;
+    static var profileBox:VBox;
+    static var profileInput:js.html.InputElement = null;
 
     public static function main():Void {
         if (Browser.document == null || Browser.document.body == null) {
@@ -59,9 +76,21 @@ class Inspector {
             right.percentWidth = 40;
             right.percentHeight = 100;
 
+            var leftHeader = new HBox();
+            leftHeader.percentWidth = 100;
+
             var leftTitle = new Label();
             leftTitle.text = "Source";
 
+            var loadProfileButton = new Button();
+            loadProfileButton.text = "Load profile";
+            loadProfileButton.onClick = function(_e:MouseEvent) {
+                chooseProfile();
+            };
+
+            leftHeader.addComponent(leftTitle);
+            leftHeader.addComponent(loadProfileButton);
+
             sourceArea = new TextArea();
             sourceArea.text = defaultSource();
             sourceArea.percentWidth = 100;
@@ -79,14 +108,18 @@ class Inspector {
             opcodeBox.percentWidth = 100;
             opcodeScroll.addComponent(opcodeBox);
 
+            profileBox = new VBox();
+            profileBox.percentWidth = 100;
+
             status = new Label();
             status.text = "Ready";
 
-            left.addComponent(leftTitle);
+            left.addComponent(leftHeader);
             left.addComponent(sourceArea);
 
             right.addComponent(rightTitle);
             right.addComponent(opcodeScroll);
+            right.addComponent(profileBox);
             right.addComponent(status);
 
             root.addComponent(left);
@@ -131,6 +164,11 @@ class Inspector {
         opcodeLines = [];
         selectedIndex = -1;
         var source = sourceArea.text;
+        // Editing the source invalidates the profile's line numbers
+        if (profile != null && source != profile.source) {
+            profile = null;
+            profileBox.removeAllComponents();
+        }
         updateSyntaxOverlay(source);
         try {
             var tokens = Lexer.tokenize(source);
@@ -166,6 +204,10 @@ class Inspector {
             }
             Browser.window.setTimeout(function() { updateJumpArrows(); }, 20);
             status.text = "OK (" + ops.length + " ops)";
+            if (profile != null) {
+                status.text += " - profile of " + profile.script + ": " + profile.instructions +
+                    " instructions, " + profile.cycles + " cycles";
+            }
         } catch (e) {
             currentOps = [];
             clearArrowDiv();
@@ -173,6 +215,121 @@ class Inspector {
         }
     }
 
+    static function chooseProfile():Void {
+        if (profileInput == null) {
+            profileInput = Browser.document.createInputElement();
+            profileInput.type = "file";
+            profileInput.accept = ".prof,.txt";
+            profileInput.style.display = "none";
+            profileInput.addEventListener("change", function(_e) {
+                if (profileInput.files.length == 0) {
+                    return;
+                }
+                var reader = new FileReader();
+                reader.onload = function(_e) {
+                    loadProfile(Std.string(reader.result));
+                };
+                reader.readAsText(profileInput.files.item(0));
+                profileInput.value = "";
+            });
+            Browser.document.body.appendChild(profileInput);
+        }
+        profileInput.click();
+    }
+
+    /** Parse the text format written by `Report::export` in profile.rs */
+    public static function parseProfile(text:String):ScriptProfile {
+        var lines = text.split("\n");
+        if (lines.length == 0 || StringTools.trim(lines[0]) != "rustrial-profile 1") {
+            throw "Not a RustrialScript profile";
+        }
+        var result:ScriptProfile = {
+            script: "", instructions: 0, cycles: 0, lines: [], ops: [], source: ""
+        };
+        for (i in 1...lines.length) {
+            var line = StringTools.trim(lines[i]);
+            if (line == "source") {
+                result.source = lines.slice(i + 1).join("\n");
+                return result;
+            }
+            var fields = line.split(" ");
+            switch (fields[0]) {
+                case "script": result.script = line.substr(7);
+                case "instructions": result.instructions = Std.parseFloat(fields[1]);
+                case "cycles": result.cycles = Std.parseFloat(fields[1]);
+                case "line":
+                    result.lines.push({ line: Std.parseInt(fields[1]),
+                        count: Std.parseFloat(fields[2]), cycles: Std.parseFloat(fields[3]) });
+                case "op":
+                    result.ops.push({ name: fields[1],
+                        count: Std.parseFloat(fields[2]), cycles: Std.parseFloat(fields[3]) });
+                default:
+            }
+        }
+        throw "Profile has no source";
+    }
+
+    static function loadProfile(text:String):Void {
+        var loaded:ScriptProfile = null;
+        try {
+            loaded = parseProfile(text);
+        } catch (e) {
+            status.text = Std.string(e);
+            return;
+        }
+        loaded.lines.sort(function(a, b) return Reflect.compare(b.cycles, a.cycles));
+        profile = loaded;
+        sourceArea.text = loaded.source;
+        compile();
+        showHotSpots();
+    }
+
+    static function percent(cycles:Float):String {
+        if (profile.cycles <= 0) {
+            return "0.0%";
+        }
+        return (Math.round(cycles * 1000 / profile.cycles) / 10) + "%";
+    }
+
+    /** Hottest lines, each selecting its source line when clicked */
+    static function showHotSpots():Void {
+        profileBox.removeAllComponents();
+        var title = new Label();
+        title.text = "Hot spots";
+        profileBox.addComponent(title);
+        var sourceLines = profile.source.split("\n");
+        for (i in 0...Std.int(Math.min(10, profile.lines.length))) {
+            var hot = profile.lines[i];
+            var text = hot.line <= sourceLines.length ? StringTools.trim(sourceLines[hot.line - 1]) : "";
+            var label = new Label();
+            label.text = "line " + hot.line + "  " + percent(hot.cycles) + "  " + hot.count + " instr  " + text;
+            label.percentWidth = 100;
+            Reflect.setProperty(label, "styleString", "color: " + heatColor(hot.cycles, 0.4, 1) + ";");
+            label.onClick = function(_e:MouseEvent) {
+                selectLine(hot.line);
+                var idx = findFirstOpcodeLine(hot.line);
+                if (idx >= 0) {
+                    highlightOpcodeIndex(idx);
+                    scrollOpcodeIntoView(idx);
+                }
+            };
+            profileBox.addComponent(label);
+        }
+        var ops = new Label();
+        var names = [for (i in 0...Std.int(Math.min(5, profile.ops.length))) profile.ops[i].name + " " + profile.ops[i].count];
+        ops.text = "Top opcodes: " + names.join(", ");
+        ops.percentWidth = 100;
+        profileBox.addComponent(ops);
+    }
+
+    /** Orange-red, more opaque the larger the share of cycles; a line
+        with 40% or more of them gets `max` */
+    static function heatColor(cycles:Float, min:Float, max:Float):String {
+        var share = profile.cycles > 0 ? cycles / profile.cycles : 0;
+        var alpha = min + (max - min) * Math.min(1, share * 2.5);
+        return "rgba(255, 90, 40, " + (Math.round(alpha * 100) / 100) + ")";
+    }
+
     static function opcodeLabel(index:Int, op:OpCode, line:Int):String {
         var text = "[" + index + "] " + opcodeToString(op) + " (line " + line + ")";
         return switch (op) {
@@ -185,8 +342,8 @@ class Inspector {
     static function opcodeToString(op:OpCode):String {
         return switch (op) {
             case OConstant(value): "Constant(" + value + ")";
-            case OLoadVar(name): "LoadVar(" + name + ")";
-            case OStoreVar(name): "StoreVar(" + name + ")";
+            case OLoadSlot(slot): "LoadSlot(" + slot + ")";
+            case OStoreSlot(slot): "StoreSlot(" + slot + ")";
             case OAdd: "Add";
             case OSubtract: "Subtract";
             case OMultiply: "Multiply";
@@ -436,7 +593,7 @@ class Inspector {
         if (syntaxContent == null) {
             return;
         }
-        var html = buildHighlightHtml(source);
+        var html = profile != null ? buildHeatHtml(source) : buildHighlightHtml(source);
         Reflect.setProperty(syntaxContent, "innerHTML", html);
         syncSyntaxScroll();
     }
@@ -457,6 +614,28 @@ class Inspector {
         Reflect.setProperty(style, "transform", "translate(" + (-x) + "px, " + (-y) + "px)");
     }
 
+    /** Highlighted source with each profiled line shaded by its cycles */
+    static function buildHeatHtml(source:String):String {
+        var cycles = new Map<Int, Float>();
+        for (hot in profile.lines) {
+            cycles.set(hot.line, hot.cycles);
+        }
+        var lines = source.split("\n");
+        var buf = new StringBuf();
+        for (i in 0...lines.length) {
+            if (i > 0) {
+                buf.add("\n");
+            }
+            var html = buildHighlightHtml(lines[i]);
+            if (cycles.exists(i + 1) && lines[i].length > 0) {
+                buf.add("<span style=\"background-color: " + heatColor(cycles.get(i + 1), 0.05, 0.6) + "\">" + html + "</span>");
+            } else {
+                buf.add(html);
+            }
+        }
+        return buf.toString();
+    }
+
     static function buildHighlightHtml(source:String):String {
         var buf = new StringBuf();
         var i = 0;
@@ -0,0 +1,193 @@
+package tools.src;
+
+import haxe.Int32;
+import haxe.io.Bytes;
+import tools.src.Compiler.CompiledChunk;
+
+// Outcome of running a chunk: what it printed, how many instructions ran,
+// the variables it left and the runtime error it stopped on, if any
+typedef RunResult = {
+    var output: Array<String>;
+    var executed: Int;
+    var locals: Array<String>;
+    var error: Null<String>;
+}
+
+// Reference interpreter for encoded chunks, mirroring vm.rs: the same
+// generic opcodes, wrapping 32-bit arithmetic, error messages and checks
+// in the same order, and the same instruction count (HALT included). It
+// trusts the chunk the way the VM trusts a verified one. Values are an
+// Int payload plus a tag, compared together like `Tagged`.
+class Interpreter {
+    static inline var TAG_INT = 0;
+    static inline var TAG_BOOL = 1;
+    static inline var TAG_NIL = 2;
+
+    // Run `chunk` for at most `limit` instructions
+    public static function run(chunk:CompiledChunk, limit:Int):RunResult {
+        var code = chunk.code;
+        var constants = chunk.constants;
+        var values = [for (_ in chunk.slots) 0];
+        var tags = [for (_ in chunk.slots) TAG_NIL];
+        var stack = new Array<Int>();
+        var stackTags = new Array<Int>();
+        var output = new Array<String>();
+        var executed = 0;
+        var ip = 0;
+        var error:String = null;
+
+        inline function arg(n:Int):Int {
+            return code.getUInt16(ip + 1 + 2 * n);
+        }
+        inline function push(value:Int, tag:Int):Void {
+            stack.push(value);
+            stackTags.push(tag);
+        }
+        inline function isInt(depth:Int):Bool {
+            return stackTags[stackTags.length - 1 - depth] == TAG_INT;
+        }
+        inline function bothInt():Bool {
+            return isInt(0) && isInt(1);
+        }
+        // The top two values compared tag and payload together
+        inline function equal():Bool {
+            var n = stack.length;
+            return stack[n - 1] == stack[n - 2] && stackTags[n - 1] == stackTags[n - 2];
+        }
+        // Pop two integers `a`, `b` for a binary op
+        function pop2():{ a:Int, b:Int } {
+            stackTags.pop();
+            stackTags.pop();
+            var b = stack.pop();
+            var a = stack.pop();
+            return { a: a, b: b };
+        }
+        function compare(opcode:Int, a:Int, b:Int):Bool {
+            return switch (opcode) {
+                case Compiler.LESS | Compiler.JUMP_UNLESS_LESS: a < b;
+                case Compiler.GREATER | Compiler.JUMP_UNLESS_GREATER: a > b;
+                case Compiler.LESS_EQUAL | Compiler.JUMP_UNLESS_LESS_EQUAL: a <= b;
+                default: a >= b;
+            };
+        }
+
+        while (error == null) {
+            if (executed >= limit) {
+                error = "Instruction limit reached";
+                break;
+            }
+            executed++;
+            var opcode = code.get(ip);
+            switch (opcode) {
+                case Compiler.CONSTANT:
+                    push(constants[arg(0)], TAG_INT);
+                    ip += 3;
+                case Compiler.LOAD_SLOT:
+                    var slot = arg(0);
+                    if (tags[slot] == TAG_NIL) {
+                        error = "Undefined variable";
+                    } else {
+                        push(values[slot], tags[slot]);
+                        ip += 3;
+                    }
+                case Compiler.STORE_SLOT:
+                    var slot = arg(0);
+                    values[slot] = stack.pop();
+                    tags[slot] = stackTags.pop();
+                    ip += 3;
+                case Compiler.ADD | Compiler.SUBTRACT | Compiler.MULTIPLY | Compiler.DIVIDE | Compiler.MODULO:
+                    if (!bothInt()) {
+                        error = "Expected integer";
+                    } else {
+                        var v = pop2();
+                        var x:Int32 = v.a;
+                        var y:Int32 = v.b;
+                        switch (opcode) {
+                            case Compiler.ADD: push((x + y : Int), TAG_INT);
+                            case Compiler.SUBTRACT: push((x - y : Int), TAG_INT);
+                            case Compiler.MULTIPLY: push((x * y : Int), TAG_INT);
+                            case Compiler.DIVIDE if (v.b == 0): error = "Division by zero";
+                            case Compiler.DIVIDE: push(Compiler.wrappingDiv(v.a, v.b), TAG_INT);
+                            case _ if (v.b == 0): error = "Modulo by zero";
+                            default: push(v.b == -1 ? 0 : v.a % v.b, TAG_INT);
+                        }
+                        ip += 1;
+                    }
+                case Compiler.NEGATE:
+                    if (!isInt(0)) {
+                        error = "Expected integer";
+                    } else {
+                        stack.push(Compiler.negate(stack.pop()));
+                        ip += 1;
+                    }
+                case Compiler.EQUAL | Compiler.NOT_EQUAL:
+                    var same = equal();
+                    pop2();
+                    push((same == (opcode == Compiler.EQUAL)) ? 1 : 0, TAG_BOOL);
+                    ip += 1;
+                case Compiler.LESS | Compiler.GREATER | Compiler.LESS_EQUAL | Compiler.GREATER_EQUAL:
+                    if (!bothInt()) {
+                        error = "Expected integer";
+                    } else {
+                        var v = pop2();
+                        push(compare(opcode, v.a, v.b) ? 1 : 0, TAG_BOOL);
+                        ip += 1;
+                    }
+                case Compiler.JUMP:
+                    ip = arg(0);
+                case Compiler.JUMP_IF_FALSE:
+                    stackTags.pop();
+                    ip = stack.pop() != 0 ? ip + 3 : arg(0);
+                case Compiler.PRINT:
+                    var tag = stackTags.pop();
+                    var value = stack.pop();
+                    output.push(show(value, tag));
+                    ip += 1;
+                case Compiler.CLEAR:
+                    ip += 1;
+                case Compiler.POP:
+                    stack.pop();
+                    stackTags.pop();
+                    ip += 1;
+                case Compiler.INCREMENT_SLOT:
+                    var slot = arg(0);
+                    if (tags[slot] != TAG_INT) {
+                        error = tags[slot] == TAG_NIL ? "Undefined variable" : "Expected integer";
+                    } else {
+                        var x:Int32 = values[slot];
+                        var y:Int32 = constants[arg(1)];
+                        values[slot] = (x + y : Int);
+                        ip += 5;
+                    }
+                case Compiler.JUMP_UNLESS_EQUAL | Compiler.JUMP_UNLESS_NOT_EQUAL:
+                    var same = equal();
+                    pop2();
+                    ip = (same == (opcode == Compiler.JUMP_UNLESS_EQUAL)) ? ip + 3 : arg(0);
+                case Compiler.JUMP_UNLESS_LESS | Compiler.JUMP_UNLESS_GREATER
+                    | Compiler.JUMP_UNLESS_LESS_EQUAL | Compiler.JUMP_UNLESS_GREATER_EQUAL:
+                    if (!bothInt()) {
+                        error = "Expected integer";
+                    } else {
+                        var v = pop2();
+                        ip = compare(opcode, v.a, v.b) ? ip + 3 : arg(0);
+                    }
+                case Compiler.HALT:
+                    break;
+                default:
+                    error = "Invalid opcode " + opcode;
+            }
+        }
+
+        var locals = [for (i in 0...values.length) show(values[i], tags[i])];
+        return { output: output, executed: executed, locals: locals, error: error };
+    }
+
+    // A value as `print` shows it
+    static function show(value:Int, tag:Int):String {
+        return switch (tag) {
+            case TAG_INT: Std.string(value);
+            case TAG_BOOL: value != 0 ? "true" : "false";
+            default: "nil";
+        };
+    }
+}
@@ -6,8 +6,8 @@ import Type;
 
 enum OpCode {
     OConstant(value:Int);
-    OLoadVar(name:String);
-    OStoreVar(name:String);
+    OLoadSlot(slot:Int);
+    OStoreSlot(slot:Int);
 
     OAdd;
     OSubtract;
@@ -37,12 +37,20 @@ typedef OpCodeInfo = {
     var line: Int;
 }
 
+// Bytecode plus the variable name of each slot, like Rust's `Program`
+typedef ParsedProgram = {
+    var code: Array<OpCode>;
+    var slots: Array<String>;
+}
+
 class Parser {
     var tokens:Array<TokenInfo>;
     var current:Int;
     var bytecode:Array<OpCode>;
     var lineMap:Array<Int>;
     var lastLine:Int;
+    var slots:Map<String, Int>;
+    var names:Array<String>;
 
     function new(tokens:Array<TokenInfo>) {
         this.tokens = tokens;
@@ -50,6 +58,8 @@ class Parser {
         this.bytecode = [];
         this.lineMap = [];
         this.lastLine = tokens.length > 0 ? tokens[0].line : 1;
+        this.slots = new Map();
+        this.names = [];
     }
 
     public static function parse(tokens:Array<TokenInfo>):Array<OpCode> {
@@ -58,6 +68,12 @@ class Parser {
         return parser.bytecode;
     }
 
+    public static function parseWithSlots(tokens:Array<TokenInfo>):ParsedProgram {
+        var parser = new Parser(tokens);
+        parser.parseProgram();
+        return { code: parser.bytecode, slots: parser.names };
+    }
+
     public static function parseWithLines(tokens:Array<TokenInfo>):Array<OpCodeInfo> {
         var parser = new Parser(tokens);
         parser.parseProgram();
@@ -116,6 +132,20 @@ class Parser {
         lineMap.push(lastLine);
     }
 
+    // Slot for a variable, allocating one on first mention (mirrors Rust)
+    function resolveSlot(name:String):Int {
+        if (slots.exists(name)) {
+            return slots.get(name);
+        }
+        if (names.length > 0xFFFF) {
+            fail(lastLine, "Too many variables");
+        }
+        var slot = names.length;
+        slots.set(name, slot);
+        names.push(name);
+        return slot;
+    }
+
     function buildOpInfo():Array<OpCodeInfo> {
         var result = new Array<OpCodeInfo>();
         for (i in 0...bytecode.length) {
@@ -162,7 +192,7 @@ class Parser {
         parseExpression();
         consume(TSemicolon, "Expected ';'");
 
-        emit(OStoreVar(name));
+        emit(OStoreSlot(resolveSlot(name)));
     }
 
     function parseAssignmentOrExpr():Void {
@@ -178,7 +208,7 @@ class Parser {
             advance();
             parseExpression();
             consume(TSemicolon, "Expected ';'");
-            emit(OStoreVar(name));
+            emit(OStoreSlot(resolveSlot(name)));
         } else {
             current -= 1;
             parseExpression();
@@ -342,7 +372,7 @@ class Parser {
             case TNumber(n):
                 emit(OConstant(n));
             case TIdentifier(name):
-                emit(OLoadVar(name));
+                emit(OLoadSlot(resolveSlot(name)));
             case TLeftParen:
                 parseExpression();
                 consume(TRightParen, "Expected ')' after expression");
@@ -10,6 +10,7 @@ class Pipeline {
         var args = Sys.args();
         var filtered = args.filter(function(arg) return arg != "--");
         var includeAll = false;
+        var precompile = false;
         var excludes = new Map<String, Bool>();
         var newScriptName:String = null;
 
@@ -30,6 +31,11 @@ class Pipeline {
                 i++;
                 continue;
             }
+            if (arg == "--precompile") {
+                precompile = true;
+                i++;
+                continue;
+            }
             if (StringTools.startsWith(arg, "--exclude=")) {
                 addExclude(excludes, arg.substr("--exclude=".length));
                 i++;
@@ -87,13 +93,17 @@ class Pipeline {
             Sys.exit(1);
         }
 
-        var loaderPath = findScriptLoader();
-        if (loaderPath == null) {
-            Sys.println("Pipeline: src/script_loader.rs not found");
+        if (precompile) {
+            precompileImages(examplesDir, files);
+        }
+
+        var manifestPath = Path.join([examplesDir, "initrd.list"]);
+        if (!FileSystem.exists(manifestPath)) {
+            Sys.println("Pipeline: " + manifestPath + " not found");
             Sys.exit(1);
         }
 
-        var oldContent = File.getContent(loaderPath);
+        var oldContent = File.getContent(manifestPath);
         var oldLines = oldContent.split("\n");
 
         var existingOrder = new Array<String>();
@@ -101,9 +111,9 @@ class Pipeline {
         var seen = new Map<String, Bool>();
         for (line in oldLines) {
             var trimmed = StringTools.trim(line);
-            var isComment = StringTools.startsWith(trimmed, "//");
+            var isComment = StringTools.startsWith(trimmed, "#");
             if (isComment) {
-                trimmed = StringTools.trim(trimmed.substr(2));
+                trimmed = StringTools.trim(trimmed.substr(1));
             }
 
             var name = parseScriptName(trimmed);
@@ -138,26 +148,18 @@ class Pipeline {
 
         var entries = new Array<String>();
         for (name in finalOrder) {
-            var entry = "(\"" + name + "\", include_bytes!(\"rustrial_script/examples/" + name + "\")),";
             var isExcluded = excludes.exists(name);
             var wasCommented = commented.exists(name) && commented.get(name);
             var commentOut = isExcluded || (!includeAll && wasCommented);
             if (commentOut) {
-                entries.push("    // " + entry);
+                entries.push("# " + name);
             } else {
-                entries.push("    " + entry);
+                entries.push(name);
             }
         }
 
-        var range = findScriptsRange(oldLines);
-        if (range == null) {
-            Sys.println("Pipeline: could not locate SCRIPTS array in script_loader.rs");
-            Sys.exit(1);
-        }
-
-        var before = oldLines.slice(0, range.start + 1);
-        var after = oldLines.slice(range.end, oldLines.length);
-        var newLines = before.concat(entries).concat(after);
+        var header = manifestHeader(oldLines);
+        var newLines = header.concat(entries).concat([""]);
         var newContent = newLines.join("\n");
 
         if (oldContent == newContent) {
@@ -166,8 +168,28 @@ class Pipeline {
         }
 
         printDiff(oldLines, newLines);
-        File.saveContent(loaderPath, newContent);
-        Sys.println("Pipeline: wrote " + Path.withoutDirectory(loaderPath));
+        File.saveContent(manifestPath, newContent);
+        Sys.println("Pipeline: wrote " + Path.withoutDirectory(manifestPath));
+    }
+
+    // Write a .rsc image next to each script so boot skips lexing and parsing;
+    // build.rs packs current images into the initrd
+    static function precompileImages(examplesDir:String, files:Array<String>):Void {
+        var failures = 0;
+        for (file in files) {
+            var path = Path.join([examplesDir, file]);
+            try {
+                var image = Compiler.compileImage(File.getBytes(path));
+                File.saveBytes(Path.join([examplesDir, Compiler.imageName(file)]), image);
+            } catch (e) {
+                printError(file, -1, Std.string(e));
+                failures++;
+            }
+        }
+        if (failures > 0) {
+            Sys.exit(1);
+        }
+        Sys.println("Pipeline: precompiled " + files.length + " image(s)");
     }
 
     static function addExclude(excludes:Map<String, Bool>, name:String):Void {
@@ -182,44 +204,26 @@ class Pipeline {
     }
 
     static function parseScriptName(line:String):String {
-        if (line.indexOf("include_bytes!(\"rustrial_script/examples/") == -1) {
-            return null;
-        }
-
-        var start = line.indexOf("(\"");
-        var end = line.indexOf("\", include_bytes!");
-        if (start == -1 || end == -1 || end <= start + 2) {
+        if (!StringTools.endsWith(line, ".rscript") || line.indexOf(" ") != -1) {
             return null;
         }
-
-        return line.substr(start + 2, end - (start + 2));
+        return line;
     }
 
-    static function findScriptsRange(lines:Array<String>):{ start:Int, end:Int } {
-        var start = -1;
-        var end = -1;
-        for (i in 0...lines.length) {
-            if (lines[i].indexOf("pub const SCRIPTS") != -1) {
-                start = i;
+    // Leading comment lines of initrd.list, kept as-is on rewrite
+    static function manifestHeader(lines:Array<String>):Array<String> {
+        var header = new Array<String>();
+        for (line in lines) {
+            var trimmed = StringTools.trim(line);
+            if (!StringTools.startsWith(trimmed, "#")) {
                 break;
             }
-        }
-        if (start == -1) {
-            return null;
-        }
-
-        for (i in start + 1...lines.length) {
-            if (StringTools.trim(lines[i]) == "];" || StringTools.trim(lines[i]) == "];\r") {
-                end = i;
+            if (parseScriptName(StringTools.trim(trimmed.substr(1))) != null) {
                 break;
             }
+            header.push(line);
         }
-
-        if (end == -1) {
-            return null;
-        }
-
-        return { start: start, end: end };
+        return header;
     }
 
     static function printDiff(oldLines:Array<String>, newLines:Array<String>):Void {
@@ -279,20 +283,4 @@ class Pipeline {
 
         return null;
     }
-
-    static function findScriptLoader():String {
-        var cwd = Sys.getCwd();
-        var candidates = [
-            Path.normalize(Path.join([cwd, "src", "script_loader.rs"])),
-            Path.normalize(Path.join([cwd, "..", "src", "script_loader.rs"]))
-        ];
-
-        for (path in candidates) {
-            if (FileSystem.exists(path) && !FileSystem.isDirectory(path)) {
-                return path;
-            }
-        }
-
-        return null;
-    }
 }